@@ -0,0 +1,226 @@
+/* bench_ring : fan-out benchmark of the shared memory history ring
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * bench_ring is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * bench_ring is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bench_ring. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * One writer process puts records in a ring (mlx_ring_put), while 1, 4
+ * and 16 consumer processes each read all of them with their own
+ * cursor (mlx_ring_get). No bus is needed.
+ *
+ * For each fan-out is displayed : the write rate, the records received
+ * and lost per consumer, the time per record read and the total rate
+ * of records delivered to all consumers.
+ *
+ * Each record carries its number (in time_ns), so a consumer checks
+ * that it gets the records in order. Records received and lost by a
+ * consumer must add up to the records written.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sched.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "libmlx90615.h"
+
+#define BENCH_RING		"/mlx90615.bench"
+
+/* max consumers */
+#define MAX_READERS		16
+
+/* records per mlx_ring_get() */
+#define BATCH			256
+
+/* shared between the processes (anonymous mapping) */
+typedef struct shared {
+	_Atomic int	ready;				// consumers started
+	_Atomic int	done;				// writer finished
+	struct {
+		uint64_t	received;
+		uint64_t	lost;
+		uint64_t	errors;			// out of order / not counted
+		uint64_t	get_ns;			// time in mlx_ring_get with records
+	} res[MAX_READERS];
+} shared;
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/* consumer process */
+static void consumer(shared *sh, int id)
+{
+	mlx_sample	s[BATCH];
+	mlx_cursor	cur;
+	mlx_ring	*ring;
+	uint64_t	prev = 0, t;
+	int			n, i, done, have = 0;
+
+	if ((ring = mlx_ring_open(BENCH_RING)) == NULL) exit(1);
+
+	mlx_ring_cursor(ring, &cur, 0);
+	atomic_fetch_add(&sh->ready, 1);
+
+	for (;;)
+	{
+		// read until empty after the writer is done
+		done = atomic_load(&sh->done);
+
+		t = now_ns();
+
+		if ((n = mlx_ring_get(ring, &cur, s, BATCH)) == 0)
+		{
+			if (done) break;
+			sched_yield();
+			continue;
+		}
+
+		sh->res[id].get_ns += now_ns() - t;
+		sh->res[id].received += n;
+
+		// check order
+		for (i = 0; i < n; i++)
+		{
+			if (have && s[i].time_ns <= prev) sh->res[id].errors++;
+			prev = s[i].time_ns;
+			have = 1;
+		}
+	}
+
+	sh->res[id].lost = cur.lost;
+
+	mlx_ring_close(ring);
+	exit(0);
+}
+
+/* run the benchmark for a number of consumers */
+static int run(int readers, long records, int size, shared *sh)
+{
+	mlx_sample	s;
+	mlx_ring	*ring;
+	uint64_t	start, wr_ns, got = 0, lost = 0, err = 0, get_ns = 0;
+	long		i;
+	int			r;
+
+	memset(sh, 0, sizeof(shared));
+
+	if ((ring = mlx_ring_create(BENCH_RING, size, 0600)) == NULL)
+	{
+		perror("bench_ring");
+		return(-1);
+	}
+
+	fflush(stdout);
+
+	for (r = 0; r < readers; r++)
+		if (fork() == 0) consumer(sh, r);
+
+	while (atomic_load(&sh->ready) < readers) sched_yield();
+
+	memset(&s, 0, sizeof(s));
+	s.raw_ta = 0x3980;
+	s.raw_to = 0x39aa;
+	s.addr = 0x5b;
+
+	start = now_ns();
+
+	for (i = 0; i < records; i++)
+	{
+		s.time_ns = i;
+		mlx_ring_put(ring, &s);
+	}
+
+	wr_ns = now_ns() - start;
+	atomic_store(&sh->done, 1);
+
+	for (r = 0; r < readers; r++) wait(NULL);
+
+	for (r = 0; r < readers; r++)
+	{
+		// every record not received must be counted as lost
+		if (sh->res[r].received + sh->res[r].lost != (uint64_t) records) sh->res[r].errors++;
+
+		got += sh->res[r].received;
+		lost += sh->res[r].lost;
+		err += sh->res[r].errors;
+		get_ns += sh->res[r].get_ns;
+	}
+
+	printf("%7d %12.2f %14.0f %14.0f %10.1f %16.2f %7lu\n", readers,
+		records * 1e3 / wr_ns,
+		(double) got / readers, (double) lost / readers,
+		got ? (double) get_ns / got : 0.0,
+		got * 1e3 / (now_ns() - start), (unsigned long) err);
+
+	mlx_ring_close(ring);
+	mlx_ring_unlink(BENCH_RING);
+
+	return(err ? -1 : 0);
+}
+
+int main(int argc, char *argv[])
+{
+	static const int fan[] = {1, 4, 16};
+	shared	*sh;
+	long	records = 2000000;
+	int		size = 65536, c, i, ret = 0;
+
+	while ((c = getopt(argc, argv, "n:s:H")) != -1)
+	{
+		switch(c)
+		{
+			case 'n':	// records to write
+				records = strtol(optarg, NULL, 10);
+				break;
+
+			case 's':	// ring size
+				size = (int) strtol(optarg, NULL, 10);
+				break;
+
+			default:
+				printf("%s [-n records] [-s ring size]\n", argv[0]);
+				exit(c == 'H' ? 0 : 1);
+		}
+	}
+
+	sh = mmap(NULL, sizeof(shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (sh == MAP_FAILED)
+	{
+		perror("bench_ring");
+		exit(1);
+	}
+
+	printf("%ld records, ring of %d\n\n", records, size);
+	printf("%7s %12s %14s %14s %10s %16s %7s\n", "readers", "write M/s",
+		"received/rdr", "lost/rdr", "ns/record", "delivered M/s", "errors");
+
+	for (i = 0; i < 3; i++)
+		if (run(fan[i], records, size, sh) < 0) ret = 1;
+
+	munmap(sh, sizeof(shared));
+
+	exit(ret);
+}
@@ -0,0 +1,961 @@
+/* libmlx90615 : core communication with an MLX90615
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * libmlx90615 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * libmlx90615 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libmlx90615. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * There are no globals in this file: all state is in the bus and the
+ * device. Each transaction on a bus is done under the bus lock.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "libmlx90615.h"
+
+/* MLX commands */
+#define MLX_EEPROM 	0x10	// EEPROM access
+#define MLX_RAM		0x20	// RAM access
+#define MLX_READ    0x1		// read instruction
+#define MLX_WRITE   0x0		// write instruction
+#define MLX_SLEEP 	0xc6	// sleep command
+
+/* Apperently the EEPROM needs a delay after write to handle/settle.
+ * This is undocumented, but needed !!
+ * imperial research proved 50ms is needed at least for stable working,
+ * for safety 100ms has bee choosen !! */
+#define MLX_EEPROM_DELAY	100000
+
+/* low pulse on SCL for wake-up / SMBus request (ms) */
+#define MLX_WAKE_PULSE		50
+
+struct mlx_bus {
+	const mlx_bus_ops *ops;
+	void	*ctx;
+
+	pthread_mutex_t lock;		// one transaction at a time
+
+	/* asynchronous operations */
+	pthread_mutex_t qlock;
+	pthread_cond_t	qcond;
+	pthread_t		worker;
+	int				worker_run;
+	int				stop;
+	mlx_op			*sq_head, *sq_tail;	// submitted
+	mlx_op			*cq_head, *cq_tail;	// completed
+	int				efd;
+
+	long			write_delay;		// after EEPROM write (us)
+};
+
+struct mlx_dev {
+	mlx_bus	*bus;
+	uint8_t	addr;
+	int		flags;
+};
+
+/* CRC8 check to compare PEC (Packet Error Checking)
+ * @param poly : x8+x2+x1+1
+ * @param data : array to check
+ * @param size : #bytes
+ *
+ * return CRC value */
+uint8_t mlx_crc8(uint8_t poly, const uint8_t *data, int size)
+{
+	uint8_t crc = 0x00;
+	int bit;
+
+	while (size--)
+	{
+		crc ^= *data++;
+
+		for (bit = 0;  bit < 8; bit++)
+		{
+			if (crc & 0x80)  crc = crc << 1 ^ poly;
+			else crc <<= 1;
+		}
+	}
+	return(crc);
+}
+
+/* RAM To / Ta value to celsius */
+double mlx_raw_to_celsius(uint16_t raw)
+{
+	return(((raw & 0x7fff) * 0.02) - 273.15);
+}
+
+/* PWM duty cycle to celsius
+ * the first 0.125 are always high and need to be subtracted
+ * page 17 and 18 of the datasheet explain */
+double mlx_pwm_celsius(double duty, long t_min, long t_range)
+{
+	return(2 * (duty - 0.125) * t_range / 50 + (t_min - (50 * 273.15)) / 50);
+}
+
+void mlx_pwm_dec_init(mlx_pwm_dec *d)
+{
+	memset(d, 0, sizeof(mlx_pwm_dec));
+}
+
+/* The capture starts in the middle of a period : first wait for a
+ * high level and the end of it. Then the next high is the start of a
+ * period, followed by the low (stop high) and the high of the next
+ * period (cycle time). */
+int mlx_pwm_dec_step(mlx_pwm_dec *d, int level, double now)
+{
+	switch(d->state)
+	{
+		case 0:		// wait for high
+			if (level) d->state = 1;
+			break;
+
+		case 1:		// wait for end of high : in sync
+			if (level) break;
+			d->state = 2;
+			return(MLX_PWM_SYNC);
+
+		case 2:		// start of period
+			if (! level) break;
+			d->start_high = now;
+			d->state = 3;
+			break;
+
+		case 3:		// end of high
+			if (level) break;
+			d->stop_high = now;
+			d->state = 4;
+			break;
+
+		case 4:		// start of next period
+			if (! level) break;
+			d->cycle_time = now - d->start_high;
+			d->state = 5;
+			return(MLX_PWM_DONE);
+
+		default:
+			return(MLX_PWM_DONE);
+	}
+
+	return(MLX_PWM_BUSY);
+}
+
+const char *mlx_strerror(int err)
+{
+	switch(err)
+	{
+		case MLX_OK:			return("OK");
+		case MLX_ERR_NACK:		return("NACK error");
+		case MLX_ERR_CLKT:		return("Clock stretch error");
+		case MLX_ERR_DATA:		return("not all data has been sent / read");
+		case MLX_ERR_PEC:		return("PEC error");
+		case MLX_ERR_PARAM:		return("invalid parameter");
+		case MLX_ERR_BUS:		return("can not setup bus");
+		case MLX_ERR_NOMEM:		return("out of memory");
+		case MLX_ERR_CANCEL:	return("cancelled");
+		case MLX_ERR_TIMEOUT:	return("time-out");
+		case MLX_ERR_CLOSED:	return("bus closed");
+		case MLX_ERR_NODATA:	return("no data published");
+		case MLX_ERR_NOHOLD:	return("bus not held");
+	}
+	return("unknown error");
+}
+
+/*********************************************************************
+ * transactions (caller holds the bus lock)
+ *********************************************************************/
+
+/* start time of a transaction when tracing, else 0 */
+#define trace_start()	(mlx_trace_active() ? mlx_clock_ns() : 0)
+
+/* read a location (opcode included) */
+static int do_read(mlx_dev *dev, uint8_t loc, uint16_t *val)
+{
+	uint8_t rbuf[6];
+	uint64_t t0 = trace_start();
+	int		ret;
+
+	/* needed to calculate PEC later */
+	rbuf[0] = dev->addr << 1 | MLX_WRITE;
+	rbuf[1] = loc;
+	rbuf[2] = dev->addr << 1 | MLX_READ;
+
+	dev->bus->ops->set_addr(dev->bus->ctx, dev->addr);
+
+	// perform read with restart
+	ret = dev->bus->ops->read_rs(dev->bus->ctx, loc, &rbuf[3], 3);
+
+	// unless requested a PEC check is done on read
+	if (ret == MLX_OK && ! (dev->flags & MLX_F_NOPEC))
+		if (mlx_crc8(0x7, rbuf, 5) != rbuf[5]) ret = MLX_ERR_PEC;
+
+	if (ret == MLX_OK) *val = rbuf[4] << 8 | rbuf[3];
+
+	if (t0) mlx_trace_event(MLX_TR_READ, dev->addr, loc, ret, ret == MLX_OK ? *val : 0, t0);
+
+	return(ret);
+}
+
+/* write a location (opcode included) and wait for the EEPROM */
+static int do_write(mlx_dev *dev, uint8_t loc, uint16_t val)
+{
+	uint8_t wbuf[5];
+	uint64_t t0 = trace_start();
+	int		ret;
+
+	/* needed to calculate PEC */
+	wbuf[0] = dev->addr << 1 | MLX_WRITE;
+	wbuf[1] = loc;
+	wbuf[2] = val & 0xff;						// LSB
+	wbuf[3] = (val >> 8) & 0xff;				// MSB
+	wbuf[4] = mlx_crc8(0x7, wbuf, 4);			// add PEC
+
+	/* While the slave_address is needed for the correct PEC calculation
+	 * it should NOT be sent, as the transport will do that (hence wbuf+1) */
+	dev->bus->ops->set_addr(dev->bus->ctx, dev->addr);
+
+	ret = dev->bus->ops->write(dev->bus->ctx, wbuf + 1, 4);
+
+	if (ret == MLX_OK && dev->bus->write_delay > 0)
+		mlx_clock_sleep((uint64_t) dev->bus->write_delay * 1000);
+
+	if (t0) mlx_trace_event(MLX_TR_WRITE, dev->addr, loc, ret, val, t0);
+
+	return(ret);
+}
+
+/* merge user definable bits in config */
+static int do_config_merge(mlx_dev *dev, uint16_t val, uint16_t *out)
+{
+	uint16_t result;
+	int		 ret;
+
+	if ((ret = do_read(dev, MLX_REG_CONFIG | MLX_EEPROM, &result)) != MLX_OK)
+		return(ret);
+
+	// Bit 0 : PWM or SMB, Bit 1 : PWM frequency, Bit 2 : PWM output
+	*out = (result & ~0x7) | (val & 0x7);
+
+	return(MLX_OK);
+}
+
+static int do_write_seq(mlx_dev *dev, int reg, uint16_t val)
+{
+	int ret;
+
+	// allow only for user definable bits in config
+	if (reg == MLX_REG_CONFIG)
+		if ((ret = do_config_merge(dev, val, &val)) != MLX_OK) return(ret);
+
+	/* Before write operation to EEPROM, this needs to be erased
+	 * by writing 0x0000 (pag 14 of MLX90615 document) */
+	if ((ret = do_write(dev, reg | MLX_EEPROM, 0x0000)) != MLX_OK) return(ret);
+
+	/* if updating the SMBUS slave address, it is now set for 0x0.
+	 * In case the write of the new value fails, the MLX can still
+	 * be accessed on address 0x0. */
+	if (reg == MLX_REG_PWMSA)
+	{
+		dev->addr = 0x0;
+
+		if ((ret = do_write(dev, reg | MLX_EEPROM, val)) != MLX_OK) return(ret);
+
+		dev->addr = val & 0x7f;
+		return(MLX_OK);
+	}
+
+	return(do_write(dev, reg | MLX_EEPROM, val));
+}
+
+static int do_write_reg(mlx_dev *dev, int reg, uint16_t val)
+{
+	mlx_bus *bus = dev->bus;
+	int		ret;
+
+	// check on allowable registers to write
+	if (reg < 0 || reg > 0x03) return(MLX_ERR_PARAM);
+
+	/* on a shared bus no other user may come in between the erase and
+	 * the write : the register (or slave address) is 0x0 meanwhile */
+	if (bus->ops->hold &&
+		(ret = bus->ops->hold(bus->ctx, (int) (2 * bus->write_delay / 1000) + 100)) != MLX_OK)
+		return(ret);
+
+	ret = do_write_seq(dev, reg, val);
+
+	if (bus->ops->hold) bus->ops->hold(bus->ctx, 0);
+
+	return(ret);
+}
+
+static int do_sleep(mlx_dev *dev)
+{
+	uint8_t wbuf[3];
+	uint64_t t0 = trace_start();
+	int		ret;
+
+	/* needed to calculate PEC */
+	wbuf[0] = dev->addr << 1 | MLX_WRITE;
+	wbuf[1] = MLX_SLEEP;
+	wbuf[2] = mlx_crc8(0x7, wbuf, 2);			// add PEC
+
+	dev->bus->ops->set_addr(dev->bus->ctx, dev->addr);
+
+	ret = dev->bus->ops->write(dev->bus->ctx, wbuf + 1, 2);
+
+	if (t0) mlx_trace_event(MLX_TR_SLEEP, dev->addr, MLX_SLEEP, ret, 0, t0);
+
+	return(ret);
+}
+
+static int do_wake(mlx_dev *dev)
+{
+	uint64_t t0 = trace_start();
+	int		ret;
+
+	ret = dev->bus->ops->wake(dev->bus->ctx, MLX_WAKE_PULSE);
+
+	if (t0) mlx_trace_event(MLX_TR_WAKE, dev->addr, 0, ret, MLX_WAKE_PULSE, t0);
+
+	return(ret);
+}
+
+/* execute an operation */
+static int do_op(mlx_op *op)
+{
+	mlx_dev *dev = op->dev;
+
+	switch(op->op)
+	{
+		case MLX_OP_READ_REG:
+			if (op->loc < 0 || op->loc > 0xf) return(MLX_ERR_PARAM);
+			return(do_read(dev, op->loc | MLX_EEPROM, &op->val));
+
+		case MLX_OP_READ_RAM:
+			if (op->loc < 0 || op->loc > 0xf) return(MLX_ERR_PARAM);
+			return(do_read(dev, op->loc | MLX_RAM, &op->val));
+
+		case MLX_OP_WRITE_REG:
+			return(do_write_reg(dev, op->loc, op->val));
+
+		case MLX_OP_SLEEP:
+			return(do_sleep(dev));
+
+		case MLX_OP_WAKE:
+			return(do_wake(dev));
+	}
+
+	return(MLX_ERR_PARAM);
+}
+
+/* execute an operation under the bus lock */
+static int run_op(mlx_dev *dev, mlx_op *op)
+{
+	int ret;
+
+	if (dev == NULL) return(MLX_ERR_PARAM);
+
+	op->dev = dev;
+
+	pthread_mutex_lock(&dev->bus->lock);
+	ret = op->result = do_op(op);
+	pthread_mutex_unlock(&dev->bus->lock);
+
+	return(ret);
+}
+
+/*********************************************************************
+ * bus
+ *********************************************************************/
+
+mlx_bus *mlx_bus_new(const mlx_bus_ops *ops, void *ctx)
+{
+	mlx_bus *bus;
+
+	if (ops == NULL) return(NULL);
+
+	if ((bus = calloc(1, sizeof(mlx_bus))) == NULL) return(NULL);
+
+	bus->ops = ops;
+	bus->ctx = ctx;
+	bus->efd = -1;
+	bus->write_delay = MLX_EEPROM_DELAY;
+
+	pthread_mutex_init(&bus->lock, NULL);
+	pthread_mutex_init(&bus->qlock, NULL);
+	pthread_cond_init(&bus->qcond, NULL);
+
+	if (ops->begin(ctx) != MLX_OK)
+	{
+		pthread_mutex_destroy(&bus->lock);
+		pthread_mutex_destroy(&bus->qlock);
+		pthread_cond_destroy(&bus->qcond);
+		free(bus);
+		return(NULL);
+	}
+
+	return(bus);
+}
+
+void mlx_bus_shutdown(mlx_bus *bus)
+{
+	mlx_op		*op;
+	uint64_t	one = 1;
+
+	if (bus == NULL) return;
+
+	// stop the worker (an operation in progress is finished)
+	pthread_mutex_lock(&bus->qlock);
+	bus->stop = 1;
+	pthread_cond_broadcast(&bus->qcond);
+	pthread_mutex_unlock(&bus->qlock);
+
+	if (bus->worker_run)
+	{
+		pthread_join(bus->worker, NULL);
+		bus->worker_run = 0;
+	}
+
+	// what is still pending is completed : waiters see MLX_ERR_CLOSED
+	pthread_mutex_lock(&bus->qlock);
+
+	while ((op = bus->sq_head) != NULL)
+	{
+		bus->sq_head = op->next;
+
+		op->result = MLX_ERR_CLOSED;
+		op->next = NULL;
+		if (bus->cq_tail) bus->cq_tail->next = op;
+		else bus->cq_head = op;
+		bus->cq_tail = op;
+
+		if (bus->efd >= 0 && write(bus->efd, &one, sizeof(one)) < 0) { /* still readable */ }
+	}
+
+	bus->sq_tail = NULL;
+
+	pthread_mutex_unlock(&bus->qlock);
+}
+
+void mlx_bus_close(mlx_bus *bus)
+{
+	if (bus == NULL) return;
+
+	mlx_bus_shutdown(bus);
+
+	if (bus->efd >= 0) close(bus->efd);
+
+	bus->ops->end(bus->ctx);
+	if (bus->ops->close) bus->ops->close(bus->ctx);
+
+	pthread_mutex_destroy(&bus->lock);
+	pthread_mutex_destroy(&bus->qlock);
+	pthread_cond_destroy(&bus->qcond);
+
+	free(bus);
+}
+
+int mlx_bus_scan(mlx_bus *bus, uint8_t *found, int max, int flags)
+{
+	mlx_dev		dev = {bus, 0, flags};
+	uint16_t	val;
+	int			i, count = 0;
+
+	pthread_mutex_lock(&bus->lock);
+
+	for (i = 1; i < 0x7f; i++)
+	{
+		dev.addr = (uint8_t) i;
+
+		if (do_read(&dev, MLX_REG_PWMSA | MLX_EEPROM, &val) == MLX_OK && val > 0)
+		{
+			if (count < max) found[count] = (uint8_t) i;
+			count++;
+		}
+	}
+
+	pthread_mutex_unlock(&bus->lock);
+
+	return(count);
+}
+
+void mlx_bus_power(mlx_bus *bus, int on)
+{
+	pthread_mutex_lock(&bus->lock);
+	if (bus->ops->power) bus->ops->power(bus->ctx, on);
+	pthread_mutex_unlock(&bus->lock);
+}
+
+int mlx_bus_hold(mlx_bus *bus, int ms)
+{
+	int ret = MLX_OK;
+
+	if (ms < 0) return(MLX_ERR_PARAM);
+
+	pthread_mutex_lock(&bus->lock);
+	if (bus->ops->hold) ret = bus->ops->hold(bus->ctx, ms);
+	pthread_mutex_unlock(&bus->lock);
+
+	return(ret);
+}
+
+int mlx_bus_begin(mlx_bus *bus)
+{
+	int ret;
+
+	pthread_mutex_lock(&bus->lock);
+	ret = bus->ops->begin(bus->ctx);
+	pthread_mutex_unlock(&bus->lock);
+
+	return(ret);
+}
+
+void mlx_bus_end(mlx_bus *bus)
+{
+	pthread_mutex_lock(&bus->lock);
+	bus->ops->end(bus->ctx);
+	pthread_mutex_unlock(&bus->lock);
+}
+
+void mlx_bus_set_write_delay(mlx_bus *bus, long us)
+{
+	pthread_mutex_lock(&bus->lock);
+	bus->write_delay = us;
+	pthread_mutex_unlock(&bus->lock);
+}
+
+int mlx_bus_write(mlx_bus *bus, uint8_t addr, const uint8_t *buf, int len)
+{
+	uint64_t t0;
+	int ret;
+
+	if (buf == NULL || len < 1) return(MLX_ERR_PARAM);
+
+	pthread_mutex_lock(&bus->lock);
+	t0 = trace_start();
+	bus->ops->set_addr(bus->ctx, addr);
+	ret = bus->ops->write(bus->ctx, buf, len);
+
+	if (t0) mlx_trace_event(buf[0] == MLX_SLEEP ? MLX_TR_SLEEP : MLX_TR_WRITE, addr, buf[0],
+		ret, len > 2 ? buf[2] << 8 | buf[1] : 0, t0);
+
+	pthread_mutex_unlock(&bus->lock);
+
+	return(ret);
+}
+
+int mlx_bus_read_rs(mlx_bus *bus, uint8_t addr, uint8_t cmd, uint8_t *buf, int len)
+{
+	uint64_t t0;
+	int ret;
+
+	if (buf == NULL || len < 1) return(MLX_ERR_PARAM);
+
+	pthread_mutex_lock(&bus->lock);
+	t0 = trace_start();
+	bus->ops->set_addr(bus->ctx, addr);
+	ret = bus->ops->read_rs(bus->ctx, cmd, buf, len);
+
+	if (t0) mlx_trace_event(MLX_TR_READ, addr, cmd, ret,
+		ret == MLX_OK && len > 1 ? buf[1] << 8 | buf[0] : 0, t0);
+
+	pthread_mutex_unlock(&bus->lock);
+
+	return(ret);
+}
+
+int mlx_bus_wake(mlx_bus *bus, int ms)
+{
+	uint64_t t0;
+	int ret;
+
+	pthread_mutex_lock(&bus->lock);
+	t0 = trace_start();
+	ret = bus->ops->wake(bus->ctx, ms);
+
+	if (t0) mlx_trace_event(MLX_TR_WAKE, 0, 0, ret, (uint16_t) ms, t0);
+
+	pthread_mutex_unlock(&bus->lock);
+
+	return(ret);
+}
+
+/*********************************************************************
+ * GPIO
+ *********************************************************************/
+
+struct mlx_gpio {
+	const mlx_gpio_ops *ops;
+	void		*ctx;
+};
+
+mlx_gpio *mlx_gpio_new(const mlx_gpio_ops *ops, void *ctx)
+{
+	mlx_gpio *gpio;
+
+	if (ops == NULL) return(NULL);
+
+	if ((gpio = calloc(1, sizeof(mlx_gpio))) == NULL) return(NULL);
+
+	gpio->ops = ops;
+	gpio->ctx = ctx;
+
+	return(gpio);
+}
+
+void mlx_gpio_close(mlx_gpio *gpio)
+{
+	if (gpio == NULL) return;
+
+	if (gpio->ops->close) gpio->ops->close(gpio->ctx);
+
+	free(gpio);
+}
+
+void mlx_gpio_fsel(mlx_gpio *gpio, uint8_t pin, int mode)
+{
+	gpio->ops->fsel(gpio->ctx, pin, mode);
+}
+
+void mlx_gpio_write(mlx_gpio *gpio, uint8_t pin, int level)
+{
+	gpio->ops->write(gpio->ctx, pin, level);
+}
+
+int mlx_gpio_lev(mlx_gpio *gpio, uint8_t pin)
+{
+	return(gpio->ops->lev(gpio->ctx, pin));
+}
+
+/*********************************************************************
+ * device
+ *********************************************************************/
+
+mlx_dev *mlx_open(mlx_bus *bus, uint8_t addr, int flags)
+{
+	mlx_dev *dev;
+
+	if (bus == NULL || addr > 0x7f) return(NULL);
+
+	if ((dev = calloc(1, sizeof(mlx_dev))) == NULL) return(NULL);
+
+	dev->bus = bus;
+	dev->addr = addr;
+	dev->flags = flags;
+
+	return(dev);
+}
+
+void mlx_close(mlx_dev *dev)
+{
+	free(dev);
+}
+
+uint8_t mlx_get_addr(mlx_dev *dev)
+{
+	return(dev->addr);
+}
+
+void mlx_set_addr(mlx_dev *dev, uint8_t addr)
+{
+	dev->addr = addr & 0x7f;
+}
+
+int mlx_get_flags(mlx_dev *dev)
+{
+	return(dev->flags);
+}
+
+void mlx_set_flags(mlx_dev *dev, int flags)
+{
+	dev->flags = flags;
+}
+
+mlx_bus *mlx_get_bus(mlx_dev *dev)
+{
+	return(dev->bus);
+}
+
+int mlx_read_reg(mlx_dev *dev, int reg, uint16_t *val)
+{
+	mlx_op	op = {MLX_OP_READ_REG, reg};
+	int		ret;
+
+	if ((ret = run_op(dev, &op)) == MLX_OK) *val = op.val;
+	return(ret);
+}
+
+int mlx_read_ram(mlx_dev *dev, int loc, uint16_t *val)
+{
+	mlx_op	op = {MLX_OP_READ_RAM, loc};
+	int		ret;
+
+	if ((ret = run_op(dev, &op)) == MLX_OK) *val = op.val;
+	return(ret);
+}
+
+int mlx_write_reg(mlx_dev *dev, int reg, uint16_t val)
+{
+	mlx_op	op = {MLX_OP_WRITE_REG, reg, val};
+
+	return(run_op(dev, &op));
+}
+
+int mlx_write_raw(mlx_dev *dev, int cmd, uint16_t val)
+{
+	int ret;
+
+	pthread_mutex_lock(&dev->bus->lock);
+	ret = do_write(dev, (uint8_t) cmd, val);
+	pthread_mutex_unlock(&dev->bus->lock);
+
+	return(ret);
+}
+
+int mlx_config_merge(mlx_dev *dev, uint16_t val, uint16_t *out)
+{
+	int ret;
+
+	pthread_mutex_lock(&dev->bus->lock);
+	ret = do_config_merge(dev, val, out);
+	pthread_mutex_unlock(&dev->bus->lock);
+
+	return(ret);
+}
+
+int mlx_sleep(mlx_dev *dev)
+{
+	mlx_op	op = {MLX_OP_SLEEP};
+
+	return(run_op(dev, &op));
+}
+
+int mlx_wake(mlx_dev *dev)
+{
+	mlx_op	op = {MLX_OP_WAKE};
+
+	return(run_op(dev, &op));
+}
+
+int mlx_por(mlx_dev *dev, int off_ms)
+{
+	mlx_bus *bus = dev->bus;
+	uint64_t t0;
+
+	if (bus->ops->power == NULL) return(MLX_ERR_PARAM);
+
+	pthread_mutex_lock(&bus->lock);
+
+	t0 = trace_start();
+
+	// turn the power to MLX off, wait and on
+	bus->ops->power(bus->ctx, 0);
+	mlx_clock_sleep((uint64_t) off_ms * 1000000);
+	bus->ops->power(bus->ctx, 1);
+
+	if (t0) mlx_trace_event(MLX_TR_POR, dev->addr, 0, MLX_OK, (uint16_t) off_ms, t0);
+
+	pthread_mutex_unlock(&bus->lock);
+
+	return(MLX_OK);
+}
+
+int mlx_unit_id(mlx_dev *dev, uint32_t *id)
+{
+	uint16_t id_low, id_high;
+	int		 ret;
+
+	if ((ret = mlx_read_reg(dev, MLX_REG_ID1, &id_low)) != MLX_OK) return(ret);
+	if ((ret = mlx_read_reg(dev, MLX_REG_ID2, &id_high)) != MLX_OK) return(ret);
+
+	*id = (uint32_t) id_high << 16 | id_low;
+	return(MLX_OK);
+}
+
+int mlx_read_temp(mlx_dev *dev, int loc, double *celsius)
+{
+	uint16_t raw;
+	int		 ret;
+
+	if (loc != MLX_RAM_TO && loc != MLX_RAM_TA) return(MLX_ERR_PARAM);
+
+	if ((ret = mlx_read_ram(dev, loc, &raw)) != MLX_OK) return(ret);
+
+	*celsius = mlx_raw_to_celsius(raw);
+	return(MLX_OK);
+}
+
+/*********************************************************************
+ * asynchronous
+ *********************************************************************/
+
+/* worker : execute submitted operations in order */
+static void *mlx_worker(void *arg)
+{
+	mlx_bus		*bus = arg;
+	mlx_op		*op;
+	uint64_t	one = 1;
+
+	pthread_mutex_lock(&bus->qlock);
+
+	while (! bus->stop)
+	{
+		if ((op = bus->sq_head) == NULL)
+		{
+			pthread_cond_wait(&bus->qcond, &bus->qlock);
+			continue;
+		}
+
+		bus->sq_head = op->next;
+		if (bus->sq_head == NULL) bus->sq_tail = NULL;
+
+		pthread_mutex_unlock(&bus->qlock);
+
+		run_op(op->dev, op);
+
+		pthread_mutex_lock(&bus->qlock);
+
+		// add to completion queue and signal
+		op->next = NULL;
+		if (bus->cq_tail) bus->cq_tail->next = op;
+		else bus->cq_head = op;
+		bus->cq_tail = op;
+
+		if (write(bus->efd, &one, sizeof(one)) < 0) { /* counter full : still readable */ }
+	}
+
+	pthread_mutex_unlock(&bus->qlock);
+
+	return(NULL);
+}
+
+/* create the event fd and worker on first use (caller holds qlock) */
+static int start_worker(mlx_bus *bus)
+{
+	if (bus->worker_run) return(MLX_OK);
+
+	if (bus->efd < 0)
+		if ((bus->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) return(MLX_ERR_NOMEM);
+
+	if (pthread_create(&bus->worker, NULL, mlx_worker, bus) != 0) return(MLX_ERR_NOMEM);
+
+	bus->worker_run = 1;
+	return(MLX_OK);
+}
+
+int mlx_submit(mlx_dev *dev, mlx_op *op)
+{
+	mlx_bus	*bus;
+	int		ret;
+
+	if (dev == NULL || op == NULL) return(MLX_ERR_PARAM);
+
+	bus = dev->bus;
+	op->dev = dev;
+	op->next = NULL;
+	op->result = MLX_OK;
+
+	pthread_mutex_lock(&bus->qlock);
+
+	if (bus->stop)
+		ret = MLX_ERR_CLOSED;
+
+	else if ((ret = start_worker(bus)) == MLX_OK)
+	{
+		if (bus->sq_tail) bus->sq_tail->next = op;
+		else bus->sq_head = op;
+		bus->sq_tail = op;
+
+		pthread_cond_signal(&bus->qcond);
+	}
+
+	pthread_mutex_unlock(&bus->qlock);
+
+	return(ret);
+}
+
+int mlx_event_fd(mlx_bus *bus)
+{
+	pthread_mutex_lock(&bus->qlock);
+
+	if (bus->efd < 0)
+		bus->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	pthread_mutex_unlock(&bus->qlock);
+
+	return(bus->efd);
+}
+
+int mlx_complete(mlx_bus *bus, mlx_op **ops, int max)
+{
+	uint64_t	cnt;
+	mlx_op		*op;
+	int			num = 0;
+
+	pthread_mutex_lock(&bus->qlock);
+
+	while (num < max && (op = bus->cq_head) != NULL)
+	{
+		bus->cq_head = op->next;
+		ops[num++] = op;
+	}
+
+	if (bus->cq_head == NULL)
+	{
+		bus->cq_tail = NULL;
+
+		// reset the event counter
+		if (bus->efd >= 0 && read(bus->efd, &cnt, sizeof(cnt)) < 0) { /* was 0 already */ }
+	}
+
+	pthread_mutex_unlock(&bus->qlock);
+
+	return(num);
+}
+
+int mlx_cancel(mlx_bus *bus, mlx_op *op)
+{
+	mlx_op		**p, *prev = NULL;
+	uint64_t	one = 1;
+	int			ret = MLX_ERR_PARAM;
+
+	pthread_mutex_lock(&bus->qlock);
+
+	for (p = &bus->sq_head; *p != NULL; prev = *p, p = &(*p)->next)
+	{
+		if (*p != op) continue;
+
+		// remove from submit queue
+		*p = op->next;
+		if (bus->sq_tail == op) bus->sq_tail = prev;
+
+		// add to completion queue
+		op->result = MLX_ERR_CANCEL;
+		op->next = NULL;
+		if (bus->cq_tail) bus->cq_tail->next = op;
+		else bus->cq_head = op;
+		bus->cq_tail = op;
+
+		if (write(bus->efd, &one, sizeof(one)) < 0) { /* still readable */ }
+
+		ret = MLX_OK;
+		break;
+	}
+
+	pthread_mutex_unlock(&bus->qlock);
+
+	return(ret);
+}
@@ -0,0 +1,1140 @@
+/* header file for libmlx90615
+ *
+ * ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ *
+ * The core of the MLX90615 communication, without globals and without
+ * printing, so it can be embedded in other (multithreaded) programs.
+ *
+ * A bus (mlx_bus) is the transport to one or more MLX90615. It is
+ * created on top of a set of transport routines (mlx_bus_ops), e.g.
+ * the BCM2835 I2C (mlx_bus_open_bcm2835()).
+ * A device (mlx_dev) is one MLX90615 on a bus, selected by its slave
+ * address. All calls on the same bus are serialised per transaction,
+ * so different threads can use devices on the same bus.
+ *
+ * Next to the blocking calls, operations can be submitted (mlx_submit).
+ * They are executed in order by a worker thread of the bus. When done,
+ * the file descriptor from mlx_event_fd() becomes readable and the
+ * finished operations are collected with mlx_complete(). This can be
+ * driven from an epoll / poll loop.
+ *
+ * All routines return MLX_OK (0) or a negative error code.
+ */
+
+#ifndef LIBMLX90615_H
+#define LIBMLX90615_H
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* error codes */
+#define MLX_OK			0
+#define MLX_ERR_NACK	-1		// no acknowledge from device
+#define MLX_ERR_CLKT	-2		// clock stretch time-out
+#define MLX_ERR_DATA	-3		// not all data sent / received
+#define MLX_ERR_PEC		-4		// PEC (CRC) error on read
+#define MLX_ERR_PARAM	-5		// invalid parameter / register
+#define MLX_ERR_BUS		-6		// can not init the bus
+#define MLX_ERR_NOMEM	-7		// out of memory
+#define MLX_ERR_CANCEL	-8		// operation was cancelled
+#define MLX_ERR_TIMEOUT	-9		// operation timed out
+#define MLX_ERR_CLOSED	-10		// bus is closing
+#define MLX_ERR_NODATA	-11		// nothing published (yet)
+#define MLX_ERR_NOHOLD	-12		// bus not held (broker)
+
+/* EEPROM registers */
+#define MLX_REG_PWMSA	0x0		// PWM T min / SMBus Slave address (SA)
+#define MLX_REG_PWMTR	0x1		// PWM T range
+#define MLX_REG_CONFIG	0x2		// config
+#define MLX_REG_EMMIS	0x3		// Emissivity
+#define MLX_REG_ID1		0xE		// ID number
+#define MLX_REG_ID2		0xF		// ID number
+
+/* default socket of the bus broker (mlxd) */
+#define MLXD_SOCKET		"/run/mlxd.sock"
+
+/* RAM locations */
+#define MLX_RAM_RAWIR	0x5		// RAW IR data
+#define MLX_RAM_TA		0x6		// Ambient Temperature
+#define MLX_RAM_TO		0x7		// Object Temperature
+
+/* device flags */
+#define MLX_F_NOPEC		0x1		// no PEC check on read
+
+/* operations for mlx_submit() */
+#define MLX_OP_READ_REG		1
+#define MLX_OP_READ_RAM		2
+#define MLX_OP_WRITE_REG	3
+#define MLX_OP_SLEEP		4
+#define MLX_OP_WAKE			5
+
+typedef struct mlx_bus mlx_bus;
+typedef struct mlx_dev mlx_dev;
+typedef struct mlx_clock mlx_clock;
+typedef struct mlx_gpio mlx_gpio;
+
+/* transport routines for a bus. All return MLX_OK or an error code */
+typedef struct mlx_bus_ops {
+
+	/* start I2C communication */
+	int		(*begin)(void *ctx);
+
+	/* stop I2C communication (pins released) */
+	void	(*end)(void *ctx);
+
+	/* set the slave address for the next transfers */
+	void	(*set_addr)(void *ctx, uint8_t addr);
+
+	/* write len bytes (slave address is added by the transport) */
+	int		(*write)(void *ctx, const uint8_t *buf, int len);
+
+	/* write command byte, repeated start and read len bytes */
+	int		(*read_rs)(void *ctx, uint8_t cmd, uint8_t *buf, int len);
+
+	/* SCL low for ms milliseconds (wake-up / SMBus request), then begin */
+	int		(*wake)(void *ctx, int ms);
+
+	/* power on (1) or off (0) the MLX */
+	void	(*power)(void *ctx, int on);
+
+	/* release the transport */
+	void	(*close)(void *ctx);
+
+	/* keep the bus for this user only for at most ms milliseconds,
+	 * release it with ms = 0. NULL if the bus has only one user */
+	int		(*hold)(void *ctx, int ms);
+
+} mlx_bus_ops;
+
+/* an operation for mlx_submit(). The memory is owned by the caller
+ * and must stay valid until it is returned by mlx_complete() */
+typedef struct mlx_op {
+	int			op;			// MLX_OP_xxx
+	int			loc;		// register or RAM location
+	uint16_t	val;		// value to write, or value read
+	int			result;		// MLX_OK or error code when completed
+	void		*user;		// free for the caller
+
+	/* internal, do not touch */
+	mlx_dev		*dev;
+	struct mlx_op *next;
+} mlx_op;
+
+/** bus */
+
+/* create a bus on top of transport routines
+ * @param ops : transport routines
+ * @param ctx : passed to the transport routines
+ * return bus or NULL in case of error */
+mlx_bus *mlx_bus_new(const mlx_bus_ops *ops, void *ctx);
+
+/* create a bus on the BCM2835 I2C (takes the BCM2835 library)
+ * return bus or NULL in case of error */
+mlx_bus *mlx_bus_open_bcm2835(void);
+
+/* stop the worker. Operations not started yet are completed with
+ * MLX_ERR_CLOSED (collect them with mlx_complete()), a new submit
+ * fails. The bus stays valid until mlx_bus_close() */
+void mlx_bus_shutdown(mlx_bus *bus);
+
+/* mlx_bus_shutdown() if not done yet, then release the bus and
+ * transport. Operations not collected keep their result */
+void mlx_bus_close(mlx_bus *bus);
+
+/* find MLX90615 on the bus
+ * @param found : to store the slave addresses found
+ * @param max : size of found
+ * @param flags : MLX_F_xxx for the probe (e.g. MLX_F_NOPEC)
+ * return number of devices found (can be more than max) */
+int mlx_bus_scan(mlx_bus *bus, uint8_t *found, int max, int flags);
+
+/* power on (1) or off (0) the MLX on the bus */
+void mlx_bus_power(mlx_bus *bus, int on);
+
+/* keep a shared bus (broker) for a sequence of transactions : no
+ * other user gets the bus until it is released (ms = 0) or after
+ * ms milliseconds. Nothing is done on a bus with one user.
+ * return MLX_OK or error */
+int mlx_bus_hold(mlx_bus *bus, int ms);
+
+/* (re)start I2C communication on the bus */
+int mlx_bus_begin(mlx_bus *bus);
+
+/* stop I2C communication on the bus (e.g. to use the pins for PWM) */
+void mlx_bus_end(mlx_bus *bus);
+
+/* set the delay after an EEPROM write (default 100ms)
+ * @param us : delay in micro seconds */
+void mlx_bus_set_write_delay(mlx_bus *bus, long us);
+
+/* create a bus on a bus broker (mlxd) that owns the real bus
+ * @param path : Unix socket of the broker (NULL = MLXD_SOCKET)
+ * return bus or NULL in case of error */
+mlx_bus *mlx_bus_open_broker(const char *path);
+
+/** GPIO */
+
+/* The pins used next to the bus : SDA is read to capture the PWM
+ * signal, SCL is held high to keep the MLX in PWM mode. */
+
+#define MLX_GPIO_IN		0
+#define MLX_GPIO_OUT	1
+
+/* GPIO routines (pin numbers as used by the BCM2835 library) */
+typedef struct mlx_gpio_ops {
+
+	/* set a pin for input or output (MLX_GPIO_IN / MLX_GPIO_OUT) */
+	void	(*fsel)(void *ctx, uint8_t pin, int mode);
+
+	/* set an output pin low (0) or high (1) */
+	void	(*write)(void *ctx, uint8_t pin, int level);
+
+	/* read the level of a pin : 0 = low, 1 = high */
+	int		(*lev)(void *ctx, uint8_t pin);
+
+	/* release (can be NULL) */
+	void	(*close)(void *ctx);
+
+} mlx_gpio_ops;
+
+/* create GPIO on top of routines
+ * return gpio or NULL in case of error */
+mlx_gpio *mlx_gpio_new(const mlx_gpio_ops *ops, void *ctx);
+
+/* create GPIO on the BCM2835. Use after mlx_bus_open_bcm2835(), which
+ * takes the BCM2835 library
+ * return gpio or NULL in case of error */
+mlx_gpio *mlx_gpio_open_bcm2835(void);
+
+/* release the GPIO */
+void mlx_gpio_close(mlx_gpio *gpio);
+
+void mlx_gpio_fsel(mlx_gpio *gpio, uint8_t pin, int mode);
+void mlx_gpio_write(mlx_gpio *gpio, uint8_t pin, int level);
+int mlx_gpio_lev(mlx_gpio *gpio, uint8_t pin);
+
+/** simulated bus */
+
+/* A simulated bus with simulated MLX90615 (no hardware needed), e.g.
+ * for benchmarks and tests. The devices answer with PEC, follow the
+ * EEPROM erase / write, the slave address, sleep / wake-up and
+ * SMBus / PWM mode after power on reset. */
+
+typedef struct mlx_sim mlx_sim;
+
+/* max devices on a simulated bus */
+#define MLX_SIM_MAX		8
+
+/* create / release a simulation (release after mlx_bus_close) */
+mlx_sim *mlx_sim_new(void);
+void mlx_sim_free(mlx_sim *sim);
+
+/* add an MLX90615 with the factory EEPROM
+ * @param addr : slave address
+ * @param unit_id : ID2 << 16 | ID1
+ * return MLX_OK or MLX_ERR_PARAM (address in use or full) */
+int mlx_sim_add(mlx_sim *sim, uint8_t addr, uint32_t unit_id);
+
+/* set the temperatures measured by a device (celsius) */
+int mlx_sim_set_temp(mlx_sim *sim, uint8_t addr, double ta, double to);
+
+/* return the number of bus transactions done */
+unsigned long mlx_sim_transfers(mlx_sim *sim);
+
+/* Timing model. The simulation does not wait, but keeps a virtual
+ * clock that advances with the time each transaction would take on the
+ * real bus. Benchmarks report the bus throughput from this clock. */
+
+typedef struct mlx_sim_timing {
+	long		core_hz;		// I2C core clock (Hz)
+	int			divider;		// clock divider (as set in bcm_begin)
+	double		start_bits;		// START condition (bit times)
+	double		restart_bits;	// repeated START (bit times)
+	double		stop_bits;		// STOP condition (bit times)
+	long		stretch_ns;		// clock stretching by the MLX on a read
+	long		clkt_bits;		// stretch time-out of the master (bit times)
+	long		eeprom_ns;		// EEPROM write busy time
+	long		sleep_ns;		// sleep command until in sleep
+	long		wake_ns;		// wake-up pulse until first data
+	long		por_ns;			// power on until first data
+} mlx_sim_timing;
+
+/* get the timing of the BCM2835 at 100Khz and the MLX90615 datasheet */
+void mlx_sim_timing_default(mlx_sim_timing *t);
+
+/* set the timing model (default is mlx_sim_timing_default) */
+void mlx_sim_set_timing(mlx_sim *sim, const mlx_sim_timing *t);
+
+/* return the virtual time of the bus (ns) */
+uint64_t mlx_sim_time_ns(mlx_sim *sim);
+
+/* advance the virtual time (e.g. time the host is not using the bus) */
+void mlx_sim_advance(mlx_sim *sim, uint64_t ns);
+
+/* Fault injection. A fault hits a transaction with a rate, optionally
+ * only within a window of virtual time that can repeat. */
+
+#define MLX_FAULT_NACK	0		// not acknowledged
+#define MLX_FAULT_CLKT	1		// clock stretch time-out
+#define MLX_FAULT_SHORT	2		// transfer aborted (not all data)
+#define MLX_FAULT_PEC	3		// bit flip : PEC error (a write is ignored)
+#define MLX_FAULT_STUCK	4		// SDA stuck low : no transaction on the bus
+#define MLX_FAULT_DROP	5		// device off the bus until a power on reset
+#define MLX_FAULT_NUM	6
+
+/* max faults on a simulation */
+#define MLX_SIM_FAULTS	8
+
+typedef struct mlx_sim_fault {
+	int			type;		// MLX_FAULT_xxx
+	uint8_t		addr;		// slave address (0 = all devices)
+	double		rate;		// chance per transaction (1 = always)
+	uint64_t	start_ns;	// window start (virtual time)
+	uint64_t	len_ns;		// window length (0 = no window)
+	uint64_t	every_ns;	// window repeat (0 = once)
+} mlx_sim_fault;
+
+/* add a fault
+ * return MLX_OK or MLX_ERR_PARAM (invalid type or full) */
+int mlx_sim_add_fault(mlx_sim *sim, const mlx_sim_fault *f);
+
+/* remove all faults and reset the counts */
+void mlx_sim_clear_faults(mlx_sim *sim);
+
+/* seed the random generator of the faults and PWM signal (0 = default) */
+void mlx_sim_seed(mlx_sim *sim, uint64_t seed);
+
+/* return the number of times a fault type hit a transaction */
+unsigned long mlx_sim_faults(mlx_sim *sim, int type);
+
+/* let the simulation follow a clock (e.g. a virtual clock) : the bus
+ * time is at least the time of the clock. NULL = own time only */
+void mlx_sim_set_clock(mlx_sim *sim, mlx_clock *c);
+
+/* create a bus on a simulation. There is no delay after an EEPROM
+ * write (mlx_bus_set_write_delay()) : a transaction to a device that
+ * is busy starts (in virtual time) when the device is ready
+ * return bus or NULL in case of error */
+mlx_bus *mlx_bus_open_sim(mlx_sim *sim);
+
+/* create GPIO on a simulation. A device in PWM mode drives the SDA pin
+ * with the PWM signal (mlx_pwm_gen) of its config, T min, T range and
+ * temperature, starting at the end of the power on reset.
+ * @param sda : pin number of SDA
+ * @param sample_ns : virtual time a read of a pin takes. If the
+ * simulation follows a clock (mlx_sim_set_clock) this is slept on the
+ * process clock, with 0 the level at the time of the clock is read.
+ * return gpio or NULL in case of error */
+mlx_gpio *mlx_gpio_open_sim(mlx_sim *sim, uint8_t sda, uint64_t sample_ns);
+
+/* set the jitter and noise of the simulated PWM signal (see mlx_pwm_gen) */
+void mlx_sim_set_pwm_noise(mlx_sim *sim, double jitter_ns, double noise);
+
+/* raw transactions, e.g. for a bus broker. These are done under the
+ * bus lock, so they do not interleave with other calls on the bus */
+
+/* write len bytes to slave address addr */
+int mlx_bus_write(mlx_bus *bus, uint8_t addr, const uint8_t *buf, int len);
+
+/* write command byte to slave address addr, repeated start and read len bytes */
+int mlx_bus_read_rs(mlx_bus *bus, uint8_t addr, uint8_t cmd, uint8_t *buf, int len);
+
+/* SCL low for ms milliseconds (wake-up / SMBus request) */
+int mlx_bus_wake(mlx_bus *bus, int ms);
+
+/** device */
+
+/* open an MLX90615 on a bus
+ * @param addr : slave address (0x0 = any device)
+ * @param flags : MLX_F_xxx
+ * return device or NULL in case of error */
+mlx_dev *mlx_open(mlx_bus *bus, uint8_t addr, int flags);
+
+/* release a device */
+void mlx_close(mlx_dev *dev);
+
+/* get / set the slave address and flags of a device */
+uint8_t mlx_get_addr(mlx_dev *dev);
+void mlx_set_addr(mlx_dev *dev, uint8_t addr);
+int mlx_get_flags(mlx_dev *dev);
+void mlx_set_flags(mlx_dev *dev, int flags);
+
+/* return the bus of a device */
+mlx_bus *mlx_get_bus(mlx_dev *dev);
+
+/* read an EEPROM register (0x0 - 0xf) */
+int mlx_read_reg(mlx_dev *dev, int reg, uint16_t *val);
+
+/* read a RAM location (0x0 - 0xf) */
+int mlx_read_ram(mlx_dev *dev, int loc, uint16_t *val);
+
+/* write a user register (0x0 - 0x3): erase + write.
+ * For the config register only the user definable bits are taken.
+ * Writing the slave address (0x0) changes the address of the device */
+int mlx_write_reg(mlx_dev *dev, int reg, uint16_t val);
+
+/* write a location with command (opcode included), no checks.
+ * Only for recovery, this can damage the MLX */
+int mlx_write_raw(mlx_dev *dev, int cmd, uint16_t val);
+
+/* merge the user definable bits (0 - 2) of val in the current config
+ * @param val : requested config
+ * @param out : config to write */
+int mlx_config_merge(mlx_dev *dev, uint16_t val, uint16_t *out);
+
+/* send the sleep command */
+int mlx_sleep(mlx_dev *dev);
+
+/* wake-up from sleep / SMBus request from PWM (SCL low pulse) */
+int mlx_wake(mlx_dev *dev);
+
+/* power on reset
+ * @param off_ms : time the power is off */
+int mlx_por(mlx_dev *dev, int off_ms);
+
+/* read the 32 bit unit ID (ID2 << 16 | ID1) */
+int mlx_unit_id(mlx_dev *dev, uint32_t *id);
+
+/* read To or Ta in celsius
+ * @param loc : MLX_RAM_TO or MLX_RAM_TA */
+int mlx_read_temp(mlx_dev *dev, int loc, double *celsius);
+
+/** asynchronous */
+
+/* submit an operation (non-blocking)
+ * return MLX_OK or error code */
+int mlx_submit(mlx_dev *dev, mlx_op *op);
+
+/* return a file descriptor that becomes readable when there
+ * are completed operations on the bus */
+int mlx_event_fd(mlx_bus *bus);
+
+/* collect completed operations (non-blocking)
+ * @param ops : to store completed operations
+ * @param max : size of ops
+ * return number of operations collected */
+int mlx_complete(mlx_bus *bus, mlx_op **ops, int max);
+
+/* cancel a submitted operation that has not started yet.
+ * It is completed with MLX_ERR_CANCEL.
+ * return MLX_OK or MLX_ERR_PARAM if not pending anymore */
+int mlx_cancel(mlx_bus *bus, mlx_op *op);
+
+/** shared memory snapshot */
+
+/* The acquisition loop (e.g. mlxd -p) publishes the latest reading of
+ * each sensor in a POSIX shared memory segment. Each slot is guarded by
+ * a seqlock : readers never block the writer and do no system call.
+ * A read is only retried if it overlapped with a publish. */
+
+/* default name of the segment */
+#define MLX_SHM_NAME	"/mlx90615"
+
+/* max sensors in the segment */
+#define MLX_SHM_MAX		16
+
+/* statistics of a window of readings (mlx_stats_get()) */
+typedef struct mlx_summary {
+	uint32_t	n;			// readings in the window, 0 = none
+	float		mean;
+	float		sd;			// standard deviation
+	float		min;
+	float		max;
+	float		p50;		// quantiles (estimate)
+	float		p95;
+	float		p99;
+} mlx_summary;
+
+typedef struct mlx_snapshot {
+	uint64_t	time_ns;	// CLOCK_MONOTONIC of the reading
+	uint64_t	count;		// readings published in this slot
+	uint32_t	unit_id;	// ID2 << 16 | ID1
+	int32_t		status;		// MLX_OK or error of the last reading
+	uint16_t	raw_ta;		// RAM Ta
+	uint16_t	raw_to;		// RAM To
+	uint8_t		addr;		// slave address
+	uint8_t		pad[3];
+	double		ta;			// celsius
+	double		to;			// celsius
+	mlx_summary	ta_stat;	// of the last readings (mlxd -W), n = 0 if none
+	mlx_summary	to_stat;
+} mlx_snapshot;
+
+typedef struct mlx_shm mlx_shm;
+
+/* create (or take over) a segment for publishing
+ * @param name : name of the segment (NULL = MLX_SHM_NAME)
+ * @param mode : access mode (e.g. 0644)
+ * return segment or NULL in case of error */
+mlx_shm *mlx_shm_create(const char *name, int mode);
+
+/* open a segment read-only
+ * return segment or NULL in case of error */
+mlx_shm *mlx_shm_open(const char *name);
+
+/* unmap the segment */
+void mlx_shm_close(mlx_shm *shm);
+
+/* remove the segment name (after close of the publisher) */
+void mlx_shm_unlink(const char *name);
+
+/* set the number of slots in use (publisher) */
+void mlx_shm_set_count(mlx_shm *shm, int count);
+
+/* return the number of slots in use */
+int mlx_shm_count(mlx_shm *shm);
+
+/* publish the snapshot of slot idx (only one publisher) */
+int mlx_shm_publish(mlx_shm *shm, int idx, const mlx_snapshot *snap);
+
+/* read the latest snapshot of slot idx
+ * return MLX_OK, MLX_ERR_PARAM or MLX_ERR_NODATA */
+int mlx_shm_read(mlx_shm *shm, int idx, mlx_snapshot *snap);
+
+/** shared memory history ring */
+
+/* The acquisition loop (e.g. mlxd -R) writes every reading in a ring
+ * of records in shared memory. Each consumer has its own cursor and
+ * reads at its own pace. The writer never waits for a consumer : if a
+ * consumer falls more than the ring size behind, the oldest records are
+ * lost for that consumer, which is detected with the sequence numbers
+ * and counted in the cursor. */
+
+/* default name of the ring */
+#define MLX_RING_NAME	"/mlx90615.ring"
+
+typedef struct mlx_sample {
+	uint64_t	time_ns;	// CLOCK_MONOTONIC of the reading
+	uint32_t	unit_id;	// ID2 << 16 | ID1
+	int32_t		status;		// MLX_OK or error of the reading
+	uint16_t	raw_ta;		// RAM Ta
+	uint16_t	raw_to;		// RAM To
+	uint8_t		addr;		// slave address
+	uint8_t		pad[3];
+} mlx_sample;
+
+typedef struct mlx_ring mlx_ring;
+
+/* read position of a consumer */
+typedef struct mlx_cursor {
+	uint32_t	pos;		// sequence number of next record
+	uint64_t	lost;		// records overwritten before read
+} mlx_cursor;
+
+/* create a ring for writing
+ * @param name : name of the ring (NULL = MLX_RING_NAME)
+ * @param size : number of records (rounded up to a power of 2)
+ * @param mode : access mode (e.g. 0644)
+ * return ring or NULL in case of error */
+mlx_ring *mlx_ring_create(const char *name, int size, int mode);
+
+/* open a ring read-only
+ * return ring or NULL in case of error */
+mlx_ring *mlx_ring_open(const char *name);
+
+/* unmap the ring */
+void mlx_ring_close(mlx_ring *ring);
+
+/* remove the ring name (after close of the writer) */
+void mlx_ring_unlink(const char *name);
+
+/* return number of records in the ring */
+int mlx_ring_size(mlx_ring *ring);
+
+/* add a record (only one writer) */
+int mlx_ring_put(mlx_ring *ring, const mlx_sample *s);
+
+/* set a cursor to the next record to be written, or (oldest = 1)
+ * to the oldest record still in the ring */
+void mlx_ring_cursor(mlx_ring *ring, mlx_cursor *cur, int oldest);
+
+/* set a cursor to the oldest record still in the ring at or after
+ * time_ns (CLOCK_MONOTONIC), or the next to be written if none */
+void mlx_ring_cursor_time(mlx_ring *ring, mlx_cursor *cur, uint64_t time_ns);
+
+/* read the records from the cursor on (non-blocking)
+ * @param s : to store the records
+ * @param max : size of s
+ * return number of records read (0 = none available) */
+int mlx_ring_get(mlx_ring *ring, mlx_cursor *cur, mlx_sample *s, int max);
+
+/** fleet registry */
+
+/* What is known of each sensor, keyed on the unit ID : where it is
+ * (bus and slave address), its emissivity profile, calibration and a
+ * copy of its EEPROM. The registry is a hash table in a file that is
+ * mapped in memory, so it is available at start-up without reading
+ * the ID registers of all sensors. Changes are written to the file by
+ * the kernel (mlx_fleet_sync() to force).
+ *
+ * One process can open the registry for writing. A pointer to a unit
+ * is valid until the next mlx_fleet_add() or mlx_fleet_del(), and for a
+ * read-only open until the next lookup (the writer may grow the table). */
+
+/* default registry file */
+#define MLX_FLEET_FILE		"/var/lib/mlx90615.fleet"
+
+/* open flags */
+#define MLX_FLEET_CREATE	0x1		// create the file if it does not exist
+#define MLX_FLEET_RDONLY	0x2		// read-only (no lock)
+
+/* no emissivity profile */
+#define MLX_UNIT_NOEMISS	0xffff
+
+typedef struct mlx_unit {
+	uint32_t	id;			// ID2 << 16 | ID1 (0 = free slot)
+	uint8_t		bus;		// bus number (defined by the application)
+	uint8_t		addr;		// slave address (0 = not placed)
+	uint16_t	emiss;		// emissivity profile (MLX_UNIT_NOEMISS = none)
+	float		gain;		// calibration : celsius = gain * To + offset
+	float		offset;
+	uint32_t	seen;		// last time found on the bus (epoch seconds)
+	uint16_t	cached;		// bit per EEPROM register in eeprom[]
+	uint16_t	pad;
+	uint16_t	eeprom[16];	// copy of EEPROM 0x0 - 0xF
+	uint32_t	spare[2];
+} mlx_unit;
+
+typedef struct mlx_fleet mlx_fleet;
+
+/* open a registry
+ * @param path : registry file (NULL = MLX_FLEET_FILE)
+ * @param flags : MLX_FLEET_CREATE and / or MLX_FLEET_RDONLY
+ * return registry or NULL in case of error (errno set) */
+mlx_fleet *mlx_fleet_open(const char *path, int flags);
+
+/* write the changes and unmap */
+void mlx_fleet_close(mlx_fleet *fleet);
+
+/* write the changes to the file now */
+int mlx_fleet_sync(mlx_fleet *fleet);
+
+/* return the unit, or NULL if not known */
+mlx_unit *mlx_fleet_find(mlx_fleet *fleet, uint32_t id);
+
+/* return the unit, added (gain 1, not placed) if not known yet
+ * return NULL in case of error */
+mlx_unit *mlx_fleet_add(mlx_fleet *fleet, uint32_t id);
+
+/* remove a unit
+ * return MLX_OK or MLX_ERR_PARAM if not known */
+int mlx_fleet_del(mlx_fleet *fleet, uint32_t id);
+
+/* set the location of a unit. A unit that was at the same location
+ * before is no longer placed. */
+void mlx_fleet_place(mlx_fleet *fleet, mlx_unit *u, uint8_t bus, uint8_t addr);
+
+/* return the unit at a location, or NULL (looks at all units) */
+mlx_unit *mlx_fleet_at(mlx_fleet *fleet, uint8_t bus, uint8_t addr);
+
+/* return the number of units */
+int mlx_fleet_count(mlx_fleet *fleet);
+
+/* walk all units, start with *pos = 0
+ * return next unit or NULL at the end */
+mlx_unit *mlx_fleet_next(mlx_fleet *fleet, int *pos);
+
+/** presence monitor */
+
+/* Finds sensors that are added to, removed from or readdressed on a bus
+ * that is in use, without a full scan : each mlx_watch_tick() probes a
+ * few addresses within a budget of bus time. The handles are kept per
+ * unit ID, so a sensor that comes back (at any address) gets the handle
+ * it had before.
+ *
+ * A sensor in sleep or PWM mode does not answer and is seen as removed.
+ * Call the functions of one monitor from one thread. */
+
+/* events */
+#define MLX_WATCH_ADDED		1		// new sensor, or known sensor back
+#define MLX_WATCH_REMOVED	2		// sensor does not answer anymore
+#define MLX_WATCH_MOVED		3		// sensor found on another address
+
+/* failed reads in a row before a sensor is removed */
+#define MLX_WATCH_MISSES	2
+
+typedef struct mlx_watch_ev {
+	int			type;		// MLX_WATCH_xxx
+	uint32_t	unit_id;
+	uint8_t		addr;		// current address (0 = removed)
+	uint8_t		old_addr;	// previous address (0 = none)
+	mlx_dev		*dev;		// handle of the unit (owned by the monitor)
+} mlx_watch_ev;
+
+typedef void (*mlx_watch_cb)(const mlx_watch_ev *ev, void *user);
+
+typedef struct mlx_watch mlx_watch;
+
+/* create a monitor
+ * @param cb : called for each event (from mlx_watch_tick)
+ * return monitor or NULL in case of error */
+mlx_watch *mlx_watch_new(mlx_bus *bus, mlx_watch_cb cb, void *user);
+
+/* release a monitor and close the handles it owns */
+void mlx_watch_free(mlx_watch *w);
+
+/* hand over a sensor that is known already (e.g. from mlx_bus_scan) :
+ * no event is raised for it. The monitor owns the handle from now on.
+ * return MLX_OK or MLX_ERR_PARAM (address or ID taken) / MLX_ERR_NOMEM */
+int mlx_watch_attach(mlx_watch *w, mlx_dev *dev, uint32_t id);
+
+/* probe addresses within a budget of bus time
+ * @param budget_ns : bus time for this tick
+ * return number of events raised */
+int mlx_watch_tick(mlx_watch *w, uint64_t budget_ns);
+
+/* return the handle of a unit, or NULL if never seen */
+mlx_dev *mlx_watch_dev(mlx_watch *w, uint32_t id);
+
+/* return the number of probes done */
+unsigned long mlx_watch_probes(mlx_watch *w);
+
+/* set the time the budget is measured in (default mlx_clock_ns), e.g.
+ * the virtual time of a simulated bus (mlx_sim_time_ns) */
+void mlx_watch_set_time(mlx_watch *w, uint64_t (*fn)(void *ctx), void *ctx);
+
+/** clock */
+
+/* All sleeps and time reads go through the process clock. By default
+ * this is the real clock. A virtual clock (e.g. with the simulated bus)
+ * only moves when all actors are sleeping : it jumps to the earliest
+ * wake-up. Days of simulated time then take seconds and a run with one
+ * actor does exactly the same every time. */
+
+/* return the real clock */
+mlx_clock *mlx_clock_real(void);
+
+/* create a virtual clock with one actor (the caller)
+ * @param epoch : wall time (mlx_clock_time) at start
+ * return clock or NULL in case of error */
+mlx_clock *mlx_vclock_new(time_t epoch);
+
+/* release a virtual clock (the process clock returns to real) */
+void mlx_vclock_free(mlx_clock *c);
+
+/* add / remove an actor : a thread that sleeps on the clock.
+ * The clock only moves when all actors sleep */
+void mlx_vclock_join(mlx_clock *c);
+void mlx_vclock_leave(mlx_clock *c);
+
+/* set the process clock (NULL = real clock) */
+void mlx_clock_set(mlx_clock *c);
+mlx_clock *mlx_clock_get(void);
+
+/* return the monotonic time of a clock (ns) */
+uint64_t mlx_clock_read(mlx_clock *c);
+
+/* return the monotonic time of the process clock (ns) */
+uint64_t mlx_clock_ns(void);
+
+/* return the wall time of the process clock (seconds, as time()) */
+time_t mlx_clock_time(void);
+
+/* sleep on the process clock */
+void mlx_clock_sleep(uint64_t ns);
+
+/** tracer */
+
+/* Each bus transaction can be recorded as a fixed size binary event in a
+ * buffer of the calling thread. A flusher thread writes them to a file,
+ * which mlx_trace2json converts to a Chrome / Perfetto trace. Without
+ * tracing the cost is one check per transaction. */
+
+#define MLX_TRACE_MAGIC		0x54584c4d	// "MLXT"
+#define MLX_TRACE_VERSION	1
+
+/* traced operations */
+#define MLX_TR_READ		1		// read location (loc = opcode | location)
+#define MLX_TR_WRITE	2		// write location, including EEPROM delay
+#define MLX_TR_SLEEP	3		// sleep command
+#define MLX_TR_WAKE		4		// wake-up pulse
+#define MLX_TR_POR		5		// power on reset
+
+/* start of trace file */
+typedef struct mlx_trace_hdr {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	ev_size;		// sizeof(mlx_trace_ev)
+	uint32_t	pad;
+	uint64_t	start_ns;		// process clock at start
+} mlx_trace_hdr;
+
+/* one transaction (32 bytes) */
+typedef struct mlx_trace_ev {
+	uint64_t	start_ns;		// process clock
+	uint64_t	end_ns;
+	uint32_t	tid;			// thread id
+	uint8_t		op;				// MLX_TR_
+	uint8_t		addr;			// device address
+	uint8_t		loc;
+	int8_t		result;			// MLX_OK or MLX_ERR_
+	uint16_t	val;			// value read or written
+	uint16_t	pad[3];
+} mlx_trace_ev;
+
+/* start tracing to a file
+ * return MLX_OK or error */
+int mlx_trace_start(const char *path);
+
+/* flush all events and close the file */
+void mlx_trace_stop(void);
+
+/* return 1 if tracing */
+int mlx_trace_active(void);
+
+/* return events dropped as a thread buffer was full */
+unsigned long mlx_trace_dropped(void);
+
+/* add an event (end is now), if tracing */
+void mlx_trace_event(int op, uint8_t addr, uint8_t loc, int result, uint16_t val, uint64_t start_ns);
+
+/** helpers */
+
+/* CRC8 as used for PEC
+ * @param poly : x8+x2+x1+1 = 0x7 */
+uint8_t mlx_crc8(uint8_t poly, const uint8_t *data, int size);
+
+/* RAM To / Ta value to celsius */
+double mlx_raw_to_celsius(uint16_t raw);
+
+/* PWM duty cycle to celsius
+ * The first 0.125 of the period is always high (datasheet pag 17/18) */
+double mlx_pwm_celsius(double duty, long t_min, long t_range);
+
+/* PWM capture : decode the high time and cycle time of one period
+ * from level samples (see detect_pwm in mlx_pwm.c) */
+typedef struct mlx_pwm_dec {
+	int		state;
+	double	start_high;		// time of start of high
+	double	stop_high;		// time of end of high
+	double	cycle_time;		// time between start of two periods
+} mlx_pwm_dec;
+
+#define MLX_PWM_BUSY	0		// need more samples
+#define MLX_PWM_SYNC	1		// end of first (partial) high seen
+#define MLX_PWM_DONE	2		// start_high, stop_high and cycle_time set
+
+/* reset the decoder */
+void mlx_pwm_dec_init(mlx_pwm_dec *d);
+
+/* add a level sample
+ * @param level : 0 = low, else high
+ * @param now : time of the sample (any unit)
+ * return MLX_PWM_BUSY, MLX_PWM_SYNC or MLX_PWM_DONE */
+int mlx_pwm_dec_step(mlx_pwm_dec *d, int level, double now);
+
+/* PWM signal generator : the level of the MLX90615 PWM output at any
+ * time, to test and benchmark PWM capture without a sensor. Each edge
+ * can be moved by a random jitter and each read can return the wrong
+ * level (noise). With the same seed the signal is the same. */
+typedef struct mlx_pwm_gen {
+	double		freq;		// 1000 (1Khz) or 10 (10hz)
+	double		duty;		// duty cycle, including the 0.125 lead-in
+	double		jitter_ns;	// standard deviation of the time of an edge
+	double		noise;		// chance a read returns the wrong level
+	uint64_t	seed;		// jitter of the edges
+	uint64_t	rnd;		// noise
+} mlx_pwm_gen;
+
+/* celsius to PWM duty cycle (the inverse of mlx_pwm_celsius). The
+ * temperature is limited to T min ... T min + T range */
+double mlx_pwm_duty(double temp, long t_min, long t_range);
+
+/* set up a generator without jitter and noise
+ * @param freq : frequency (Hz)
+ * @param duty : duty cycle (mlx_pwm_duty) */
+void mlx_pwm_gen_init(mlx_pwm_gen *g, double freq, double duty);
+
+/* return the level (0 / 1) at time t (ns from the start of the signal) */
+int mlx_pwm_gen_level(mlx_pwm_gen *g, uint64_t t);
+
+/* PWM bitstream : SDA sampled at a fixed rate, one bit per sample and
+ * 64 samples per word (sample i is bit i % 64 of word i / 64). The duty
+ * cycle is the number of high samples over all whole periods. */
+typedef struct mlx_pwm_bits {
+	long		periods;	// whole periods in the capture
+	double		period;		// samples per period
+	double		duty;		// duty cycle over the whole periods
+	long		first;		// sample of the first rising edge
+} mlx_pwm_bits;
+
+/* decode a bitstream
+ * @param valid : NULL, or a bit per sample : 1 = sample taken in time
+ *   (a sample that is not valid must be 0 in w)
+ * @param nbits : number of samples
+ * return MLX_OK or MLX_ERR_NODATA (less than one whole period) */
+int mlx_pwm_bits_decode(const uint64_t *w, const uint64_t *valid, long nbits, mlx_pwm_bits *r);
+
+/* number of bits set in n words : vector (NEON / AVX2) where available */
+uint64_t mlx_popcount(const uint64_t *w, long n);
+
+/* same, one word at a time (to compare) */
+uint64_t mlx_popcount_scalar(const uint64_t *w, long n);
+
+/** radiometric compensation */
+
+/* To of the sensor is for the emissivity in its EEPROM, with the
+ * radiation that is reflected by the object (and a window) at the
+ * temperature of the sensor (Ta). The compensation computes To for the
+ * emissivity of the object, the reflected temperature and an optional
+ * window (see mlx_comp.c). */
+
+/* reflected or window temperature is Ta */
+#define MLX_COMP_TA		-1000.0
+
+typedef struct mlx_comp {
+	double		emissivity;	// of the object (0 - 1]
+	double		chip_emiss;	// in the EEPROM (MLX_REG_EMMIS / 0x4000)
+	double		t_refl;		// reflected temperature (celsius) or MLX_COMP_TA
+	double		tau;		// transmissivity of the window (0 - 1], 1 = none
+	double		t_win;		// temperature of the window (celsius) or MLX_COMP_TA
+	double		ko, ka, k0;	// set by mlx_comp_prepare()
+} mlx_comp;
+
+/* set no compensation : emissivity 1, no window, reflected is Ta */
+void mlx_comp_init(mlx_comp *c);
+
+/* compute the coefficients after a change of the settings
+ * return MLX_OK or MLX_ERR_PARAM */
+int mlx_comp_prepare(mlx_comp *c);
+
+/* set from emissivity[:reflected[:transmissivity[:window]]], a
+ * temperature in celsius or "ta" (default), e.g. "0.3:25:0.9" (the
+ * emissivity of the sensor is kept)
+ * return MLX_OK or MLX_ERR_PARAM */
+int mlx_comp_parse(mlx_comp *c, const char *spec);
+
+/* compensated To of one sample (celsius)
+ * return To or NAN (more reflected than measured) */
+double mlx_comp_to(const mlx_comp *c, double to, double ta);
+
+/* compensate n samples of RAM values : vector (NEON / AVX2) where
+ * available. A value with the error flag gives NAN. */
+int mlx_comp_raw(const mlx_comp *c, const uint16_t *raw_to, const uint16_t *raw_ta, float *out, long n);
+
+/* same, one sample at a time (to compare) */
+int mlx_comp_raw_scalar(const mlx_comp *c, const uint16_t *raw_to, const uint16_t *raw_ta, float *out, long n);
+
+/* compensate n records of the history ring (status not MLX_OK gives NAN) */
+int mlx_comp_samples(const mlx_comp *c, const mlx_sample *s, float *out, long n);
+
+/** streaming statistics */
+
+/* Mean, standard deviation, min, max and quantiles of the last 'window'
+ * readings of a stream, e.g. To of a sensor. An update takes O(1)
+ * (amortised) and the memory is fixed when created (about 14 bytes a
+ * reading of the window and 12 Kbyte). Mean, standard deviation, min
+ * and max are exact, the quantiles are an estimate (t-digest, the rank
+ * within 2% at p50 and 1% at p95 / p99). */
+
+typedef struct mlx_stats mlx_stats;
+
+/* create for a window of readings (at least 5)
+ * return statistics or NULL (out of memory / too small) */
+mlx_stats *mlx_stats_new(int window);
+
+void mlx_stats_free(mlx_stats *s);
+
+/* forget all readings */
+void mlx_stats_reset(mlx_stats *s);
+
+/* add a reading (NAN is skipped) */
+void mlx_stats_add(mlx_stats *s, double val);
+
+/* the summary of the window (p50, p95 and p99)
+ * return MLX_OK or MLX_ERR_NODATA (no readings) */
+int mlx_stats_get(mlx_stats *s, mlx_summary *r);
+
+/* quantiles q[] (0 - 1) of the window in val[]
+ * return MLX_OK or MLX_ERR_NODATA */
+int mlx_stats_quantiles(mlx_stats *s, const double *q, double *val, int num);
+
+/** alarms */
+
+/* Rules on the readings of a number of channels (e.g. the sensors of
+ * mlxd), evaluated on every sample in O(1) per rule :
+ * - threshold : To or Ta above / below a level
+ * - rate : To or Ta rises / falls faster than a level (celsius per
+ *   second, over about MLX_ALARM_TAU seconds)
+ * An alarm is raised when the level is crossed and cleared when the
+ * value is back past the hysteresis (level - hyst for above / rise,
+ * level + hyst for below / fall). The time of the crossing is
+ * interpolated between the samples, to measure the reaction time. */
+
+/* max rules */
+#define MLX_ALARM_MAX	32
+
+/* time constant of the rate (s) */
+#define MLX_ALARM_TAU	1.0
+
+/* kind of rule */
+#define MLX_ALARM_ABOVE	0
+#define MLX_ALARM_BELOW	1
+#define MLX_ALARM_RISE	2
+#define MLX_ALARM_FALL	3
+
+/* value of a rule */
+#define MLX_ALARM_TO	0
+#define MLX_ALARM_TA	1
+
+typedef struct mlx_alarm_rule {
+	int			kind;		// MLX_ALARM_ABOVE ..
+	int			what;		// MLX_ALARM_TO or MLX_ALARM_TA
+	double		level;		// celsius or celsius per second (rise / fall, > 0)
+	double		hyst;		// hysteresis (>= 0)
+	char		name[32];	// as parsed
+} mlx_alarm_rule;
+
+typedef struct mlx_alarm_ev {
+	int			rule;
+	int			chan;
+	int			raised;		// 1 = raised, 0 = cleared
+	double		value;		// value or rate that crossed
+	uint64_t	cross_ns;	// time of the crossing (interpolated)
+	uint64_t	time_ns;	// time of the sample
+} mlx_alarm_ev;
+
+typedef struct mlx_alarm mlx_alarm;
+
+/* create for a number of channels
+ * return engine or NULL (out of memory) */
+mlx_alarm *mlx_alarm_new(int chans);
+
+void mlx_alarm_free(mlx_alarm *a);
+
+/* set a rule from [to|ta]<op>level[:hyst], op > (above), < (below),
+ * + (rises faster than level / s) or - (falls faster), e.g. "to>40:2"
+ * or "ta+0.5" (To if not given)
+ * return MLX_OK or MLX_ERR_PARAM */
+int mlx_alarm_parse(mlx_alarm_rule *r, const char *spec);
+
+/* add a rule
+ * return index of the rule or MLX_ERR_PARAM (invalid or full) */
+int mlx_alarm_add(mlx_alarm *a, const mlx_alarm_rule *r);
+
+/* return rule i or NULL */
+const mlx_alarm_rule *mlx_alarm_get(mlx_alarm *a, int i);
+
+/* forget the readings of a channel and clear its alarms (no events) */
+void mlx_alarm_reset(mlx_alarm *a, int chan);
+
+/* evaluate the rules on a sample of a channel
+ * @param ev : to store the events (MLX_ALARM_MAX is enough)
+ * return number of events */
+int mlx_alarm_update(mlx_alarm *a, int chan, uint64_t time_ns, double ta, double to, mlx_alarm_ev *ev, int max);
+
+/* return the rules that are raised on a channel (bit per rule) */
+uint32_t mlx_alarm_active(mlx_alarm *a, int chan);
+
+/** PWM capture engine */
+
+/* In PWM mode each MLX90615 needs one wire and no address. The capture
+ * engine decodes the PWM of many lines at once in one epoll loop over
+ * edge event file descriptors (Linux GPIO character device). An event
+ * has the time of the edge from the kernel, so the reading does not
+ * depend on when the program gets to run. */
+
+typedef struct mlx_pwm_cap mlx_pwm_cap;
+
+/* settings of a line (as written in the EEPROM of the MLX on it) */
+typedef struct mlx_pwm_line {
+	uint8_t		pin;		// GPIO line offset
+	long		t_min;		// PWM T min
+	long		t_range;	// PWM T range
+	int			temp;		// MLX_RAM_TA or MLX_RAM_TO (config bit 2)
+} mlx_pwm_line;
+
+/* a decoded period */
+typedef struct mlx_pwm_reading {
+	int			line;		// index returned by mlx_pwm_cap_add_xxx
+	uint8_t		pin;
+	int			temp;		// MLX_RAM_TA or MLX_RAM_TO
+	double		celsius;
+	double		duty;
+	double		freq;		// Hz
+	uint64_t	time_ns;	// end of the period (event time)
+} mlx_pwm_reading;
+
+/* called for each decoded period */
+typedef void (*mlx_pwm_cb)(const mlx_pwm_reading *r, void *user);
+
+/* statistics of the capture */
+typedef struct mlx_pwm_stat {
+	unsigned long events;	// edges
+	unsigned long readings;	// periods decoded
+	unsigned long rejected;	// periods out of range (glitch, lost edge)
+} mlx_pwm_stat;
+
+/* edge event as read from an event file descriptor
+ * (struct gpioevent_data of the GPIO character device) */
+typedef struct mlx_pwm_event {
+	uint64_t	timestamp;	// ns
+	uint32_t	id;			// MLX_PWM_RISING or MLX_PWM_FALLING
+	uint32_t	pad;
+} mlx_pwm_event;
+
+#define MLX_PWM_RISING	0x1
+#define MLX_PWM_FALLING	0x2
+
+/* create / release an engine
+ * @param cb : called for each reading (can be NULL, see mlx_pwm_cap_get)
+ * return engine or NULL in case of error */
+mlx_pwm_cap *mlx_pwm_cap_new(mlx_pwm_cb cb, void *user);
+void mlx_pwm_cap_free(mlx_pwm_cap *cap);
+
+/* add a GPIO line for both edges
+ * @param chip : GPIO character device (NULL = /dev/gpiochip0)
+ * return line index or error */
+int mlx_pwm_cap_add_gpio(mlx_pwm_cap *cap, const char *chip, const mlx_pwm_line *cfg);
+
+/* add a file descriptor that provides mlx_pwm_event (e.g. a pipe for a
+ * simulation). The engine closes it on release
+ * return line index or error */
+int mlx_pwm_cap_add_fd(mlx_pwm_cap *cap, int fd, const mlx_pwm_line *cfg);
+
+/* wait for edges and decode them
+ * @param timeout_ms : -1 = wait for at least one event
+ * return number of readings or error */
+int mlx_pwm_cap_poll(mlx_pwm_cap *cap, int timeout_ms);
+
+/* return the epoll file descriptor (readable when edges are waiting) */
+int mlx_pwm_cap_fd(mlx_pwm_cap *cap);
+
+/* get the last reading of a line
+ * return MLX_OK or MLX_ERR_NODATA */
+int mlx_pwm_cap_get(mlx_pwm_cap *cap, int line, mlx_pwm_reading *r);
+
+/* get the statistics of all lines */
+void mlx_pwm_cap_stat(mlx_pwm_cap *cap, mlx_pwm_stat *st);
+
+/* return a description of an error code */
+const char *mlx_strerror(int err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBMLX90615_H */
@@ -0,0 +1,842 @@
+/* libmlx90615 : C++20 coroutine front-end
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * libmlx90615 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * libmlx90615 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libmlx90615. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Collectors can be written as coroutines :
+ *
+ *	mlx::task<void> collect(mlx::device &dev)
+ *	{
+ *		for (;;)
+ *		{
+ *			auto ta = co_await dev.read_ambient().timeout(500);
+ *			if (ta) printf("Ta %.2f\n", *ta);
+ *			co_await dev.exec().sleep_for(1000);
+ *		}
+ *	}
+ *
+ *	mlx::executor ex;
+ *	mlx::device dev(ex, mlx_dev);
+ *	ex.spawn(collect(dev));
+ *	ex.run();
+ *
+ * The operations are submitted with mlx_submit() and executed by the
+ * worker thread of each bus. One executor (one thread) waits with epoll
+ * on the event fd of all buses and the timers, and resumes the coroutine
+ * that is waiting on a completed operation. There is no thread per
+ * sensor.
+ *
+ * The mlx_op of an await lives in the coroutine frame, and the coroutine
+ * frames are taken from a pool. After the pool has grown to the number
+ * of coroutines alive, an await does not allocate.
+ *
+ * Timers and timeouts are on the process clock (mlx_clock_ns). With a
+ * virtual clock the executor sleeps on that clock when no operation is
+ * on a bus, so the time jumps to the next timer.
+ *
+ * A timeout or cancel can only stop an operation that has not started
+ * on the bus yet. An I2C transaction in progress is always finished (to
+ * not leave the MLX halfway) and then returns its own result.
+ *
+ * All members of the executor and devices must be called from the
+ * executor thread. Needs -std=c++20.
+ */
+
+#ifndef LIBMLX90615_HPP
+#define LIBMLX90615_HPP
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "libmlx90615.h"
+
+namespace mlx {
+
+/* current monotonic time in ms of the process clock (mlx_clock_ns) */
+inline uint64_t now_ms()
+{
+	return(mlx_clock_ns() / 1000000);
+}
+
+/** frame pool */
+
+/* Coroutine frames are taken from blocks in size classes of FRAME_MIN,
+ * 2 * FRAME_MIN ... FRAME_MAX bytes : a frame gets the smallest block
+ * it fits in, so a small collector does not take a large block and a
+ * large one still comes from the pool. Blocks are never returned to
+ * the system, only to the free list of their class in the thread. A
+ * frame larger than FRAME_MAX is allocated normally (counted in
+ * oversize). Define MLX_FRAME_CLASSES to have more (larger) classes. */
+
+#ifndef MLX_FRAME_CLASSES
+#define MLX_FRAME_CLASSES	5
+#endif
+
+class frame_pool
+{
+public:
+	static constexpr size_t FRAME_MIN = 128;			// bytes of the smallest class
+	static constexpr int FRAME_CLASSES = MLX_FRAME_CLASSES;
+	static constexpr size_t FRAME_MAX = FRAME_MIN << (FRAME_CLASSES - 1);
+	static constexpr size_t FRAME_SLAB = 32;			// blocks per allocation
+
+	static_assert(FRAME_CLASSES > 0 && FRAME_CLASSES <= 16, "frame classes");
+
+	struct stats {
+		size_t	blocks;		// blocks allocated from the system
+		size_t	bytes;		// of those blocks
+		size_t	in_use;		// blocks in use
+		size_t	oversize;	// frames too large for a block
+	};
+
+	/* class of a frame size, FRAME_CLASSES if too large */
+	static constexpr int size_class(size_t size)
+	{
+		int c = 0;
+
+		while (c < FRAME_CLASSES && (FRAME_MIN << c) < size) c++;
+
+		return(c);
+	}
+
+	static void *alloc(size_t size)
+	{
+		pool &p = get();
+		int c = size_class(size);
+
+		if (c == FRAME_CLASSES)
+		{
+			p.st.oversize++;
+			return(::operator new(size));
+		}
+
+		if (p.free[c] == nullptr) grow(p, c);
+
+		block *b = p.free[c];
+		p.free[c] = b->next;
+		p.st.in_use++;
+
+		return(b);
+	}
+
+	static void release(void *ptr, size_t size)
+	{
+		pool &p = get();
+		int c = size_class(size);
+
+		if (c == FRAME_CLASSES)
+		{
+			::operator delete(ptr);
+			return;
+		}
+
+		block *b = static_cast<block *>(ptr);
+		b->next = p.free[c];
+		p.free[c] = b;
+		p.st.in_use--;
+	}
+
+	/* statistics of the pool of the calling thread */
+	static stats get_stats() { return(get().st); }
+
+private:
+	/* a free block : the size of the class, at least max_align_t */
+	struct block {
+		block *next;
+	};
+
+	static_assert(FRAME_MIN % alignof(std::max_align_t) == 0, "frame alignment");
+
+	struct pool {
+		block				*free[FRAME_CLASSES] = {};
+		std::vector<void *>	slabs;
+		stats				st = {0, 0, 0, 0};
+
+		~pool()
+		{
+			for (void *s : slabs) ::operator delete(s);
+		}
+	};
+
+	static pool &get()
+	{
+		static thread_local pool p;
+		return(p);
+	}
+
+	/* FRAME_SLAB blocks of class c (aligned for max_align_t by new) */
+	static void grow(pool &p, int c)
+	{
+		size_t	size = FRAME_MIN << c;
+		unsigned char *s = static_cast<unsigned char *>(::operator new(size * FRAME_SLAB));
+
+		p.slabs.push_back(s);
+
+		for (size_t i = 0; i < FRAME_SLAB; i++)
+		{
+			block *b = reinterpret_cast<block *>(s + i * size);
+			b->next = p.free[c];
+			p.free[c] = b;
+		}
+
+		p.st.blocks += FRAME_SLAB;
+		p.st.bytes += size * FRAME_SLAB;
+	}
+};
+
+/* promise base : frames from the pool */
+struct pooled_promise
+{
+	static void *operator new(size_t size) { return(frame_pool::alloc(size)); }
+	static void operator delete(void *ptr, size_t size) { frame_pool::release(ptr, size); }
+};
+
+/** task */
+
+template <typename T> class task;
+
+namespace detail {
+
+/* resume the awaiting coroutine when a task is done */
+struct final_awaiter
+{
+	bool await_ready() noexcept { return(false); }
+
+	template <typename P>
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+	{
+		if (h.promise().cont) return(h.promise().cont);
+		return(std::noop_coroutine());
+	}
+
+	void await_resume() noexcept {}
+};
+
+struct task_promise_base : pooled_promise
+{
+	std::coroutine_handle<> cont;
+
+	std::suspend_always initial_suspend() noexcept { return {}; }
+	final_awaiter final_suspend() noexcept { return {}; }
+
+	// no exceptions are used in this library
+	void unhandled_exception() noexcept { std::terminate(); }
+};
+
+template <typename T>
+struct task_promise : task_promise_base
+{
+	T	value{};
+
+	task<T> get_return_object() noexcept;
+	void return_value(T v) noexcept { value = std::move(v); }
+};
+
+template <>
+struct task_promise<void> : task_promise_base
+{
+	task<void> get_return_object() noexcept;
+	void return_void() noexcept {}
+};
+
+} // namespace detail
+
+/* a lazy coroutine : starts when awaited (or spawned on an executor) */
+template <typename T = void>
+class task
+{
+public:
+	using promise_type = detail::task_promise<T>;
+	using handle = std::coroutine_handle<promise_type>;
+
+	explicit task(handle h) noexcept : h_(h) {}
+	task(task &&o) noexcept : h_(std::exchange(o.h_, {})) {}
+	task(const task &) = delete;
+	task &operator=(const task &) = delete;
+	~task() { if (h_) h_.destroy(); }
+
+	bool await_ready() const noexcept { return(! h_ || h_.done()); }
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> c) noexcept
+	{
+		h_.promise().cont = c;
+		return(h_);
+	}
+
+	T await_resume() noexcept
+	{
+		if constexpr (! std::is_void_v<T>) return(std::move(h_.promise().value));
+	}
+
+	/* take over the coroutine (executor::spawn) */
+	handle release() noexcept { return(std::exchange(h_, {})); }
+
+private:
+	handle	h_;
+};
+
+namespace detail {
+
+template <typename T>
+inline task<T> task_promise<T>::get_return_object() noexcept
+{
+	return(task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this)));
+}
+
+inline task<void> task_promise<void>::get_return_object() noexcept
+{
+	return(task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this)));
+}
+
+} // namespace detail
+
+/** result of an operation */
+
+template <typename T>
+struct result
+{
+	int	err = MLX_OK;		// MLX_OK or MLX_ERR_xxx
+	T	val{};
+
+	explicit operator bool() const { return(err == MLX_OK); }
+	const T &operator*() const { return(val); }
+};
+
+/** timers */
+
+/* a timer is part of an awaiter (no allocation). The executor keeps
+ * the pending timers in a binary heap on the due time. */
+struct timer_node
+{
+	uint64_t	due = 0;
+	size_t		idx = (size_t) -1;		// position in heap, -1 = not queued
+	void		(*fire)(void *arg) = nullptr;
+	void		*arg = nullptr;
+};
+
+class timer_heap
+{
+public:
+	bool empty() const { return(h_.empty()); }
+	uint64_t next_due() const { return(h_[0]->due); }
+
+	void add(timer_node *t)
+	{
+		t->idx = h_.size();
+		h_.push_back(t);
+		up(t->idx);
+	}
+
+	void remove(timer_node *t)
+	{
+		size_t i = t->idx;
+
+		if (i == (size_t) -1) return;
+
+		t->idx = (size_t) -1;
+
+		if (i == h_.size() - 1)
+		{
+			h_.pop_back();
+			return;
+		}
+
+		h_[i] = h_.back();
+		h_[i]->idx = i;
+		h_.pop_back();
+
+		down(i);
+		up(i);
+	}
+
+	/* remove and return the first timer that is due, else nullptr */
+	timer_node *pop_due(uint64_t now)
+	{
+		if (h_.empty() || h_[0]->due > now) return(nullptr);
+
+		timer_node *t = h_[0];
+		remove(t);
+		return(t);
+	}
+
+private:
+	std::vector<timer_node *> h_;
+
+	void swap(size_t a, size_t b)
+	{
+		std::swap(h_[a], h_[b]);
+		h_[a]->idx = a;
+		h_[b]->idx = b;
+	}
+
+	void up(size_t i)
+	{
+		while (i > 0 && h_[(i - 1) / 2]->due > h_[i]->due)
+		{
+			swap(i, (i - 1) / 2);
+			i = (i - 1) / 2;
+		}
+	}
+
+	void down(size_t i)
+	{
+		for (;;)
+		{
+			size_t l = 2 * i + 1, r = l + 1, m = i;
+
+			if (l < h_.size() && h_[l]->due < h_[m]->due) m = l;
+			if (r < h_.size() && h_[r]->due < h_[m]->due) m = r;
+			if (m == i) return;
+
+			swap(i, m);
+			i = m;
+		}
+	}
+};
+
+class op_awaiter;
+
+/** cancellation */
+
+/* cancel all pending operations that were awaited with this source.
+ * Operations that are started on the bus are finished. */
+class cancel_source
+{
+public:
+	cancel_source() = default;
+	cancel_source(const cancel_source &) = delete;
+	cancel_source &operator=(const cancel_source &) = delete;
+
+	inline void cancel();
+	bool cancelled() const { return(cancelled_); }
+
+	/* allow to use again */
+	void reset() { cancelled_ = false; }
+
+private:
+	friend class op_awaiter;
+
+	op_awaiter	*head_ = nullptr;		// pending operations
+	bool		cancelled_ = false;
+};
+
+/** executor */
+
+class executor
+{
+public:
+	/* max completed operations taken per mlx_complete() */
+	static constexpr int BATCH = 64;
+
+	executor()
+	{
+		epfd_ = epoll_create1(EPOLL_CLOEXEC);
+	}
+
+	~executor()
+	{
+		if (epfd_ >= 0) close(epfd_);
+	}
+
+	executor(const executor &) = delete;
+	executor &operator=(const executor &) = delete;
+
+	/* is the executor usable */
+	bool ok() const { return(epfd_ >= 0); }
+
+	/* wait for the completions of a bus (done by device as well)
+	 * return MLX_OK or error */
+	int watch(mlx_bus *bus)
+	{
+		struct epoll_event ev;
+		int fd;
+
+		for (mlx_bus *b : buses_) if (b == bus) return(MLX_OK);
+
+		if ((fd = mlx_event_fd(bus)) < 0) return(fd);
+
+		ev.events = EPOLLIN;
+		ev.data.ptr = bus;
+
+		if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0) return(MLX_ERR_BUS);
+
+		buses_.push_back(bus);
+		return(MLX_OK);
+	}
+
+	/* start a task. It is destroyed when finished */
+	void spawn(task<void> &&t)
+	{
+		live_++;
+		start(detach(std::move(t)));
+	}
+
+	/* number of spawned tasks not finished */
+	size_t live() const { return(live_); }
+
+	/* run until all spawned tasks are finished or stop() */
+	void run()
+	{
+		stop_ = false;
+
+		while (live_ > 0 && ! stop_) run_once(-1);
+	}
+
+	/* wait at most max_ms (-1 = until an event) and handle the events.
+	 * return number of coroutines resumed */
+	int run_once(int max_ms)
+	{
+		struct epoll_event evs[16];
+		mlx_op	*done[BATCH];
+		int		n, i, k, num = 0, wait = max_ms;
+
+		// wait until the first timer is due
+		if (! timers_.empty())
+		{
+			uint64_t now = now_ms(), due = timers_.next_due();
+			int	t = due > now ? (int) (due - now) : 0;
+
+			if (wait < 0 || t < wait) wait = t;
+		}
+
+		/* a virtual clock only moves while the actors sleep on it : with no
+		 * operation on a bus only a timer can be next */
+		if (wait > 0 && inflight_ == 0 && mlx_clock_get() != mlx_clock_real())
+		{
+			mlx_clock_sleep((uint64_t) wait * 1000000);
+			n = 0;
+		}
+		else
+			n = epoll_wait(epfd_, evs, 16, wait);
+
+		for (i = 0; i < n; i++)
+		{
+			mlx_bus *bus = static_cast<mlx_bus *>(evs[i].data.ptr);
+
+			while ((k = mlx_complete(bus, done, BATCH)) > 0)
+			{
+				for (int j = 0; j < k; j++) num += complete(done[j]);
+			}
+		}
+
+		uint64_t now = now_ms();
+		timer_node *t;
+
+		while ((t = timers_.pop_due(now)) != nullptr)
+		{
+			t->fire(t->arg);
+			num++;
+		}
+
+		return(num);
+	}
+
+	/* let run() return */
+	void stop() { stop_ = true; }
+
+	/* awaitable delay */
+	struct sleep_awaiter
+	{
+		executor		*ex;
+		uint64_t		ms;
+		timer_node		tn;
+		std::coroutine_handle<> h;
+
+		bool await_ready() const noexcept { return(ms == 0); }
+
+		void await_suspend(std::coroutine_handle<> c) noexcept
+		{
+			h = c;
+			tn.due = now_ms() + ms;
+			tn.arg = h.address();
+			tn.fire = [](void *arg)
+			{
+				std::coroutine_handle<>::from_address(arg).resume();
+			};
+			ex->timers_.add(&tn);
+		}
+
+		void await_resume() noexcept {}
+	};
+
+	sleep_awaiter sleep_for(uint64_t ms) { return sleep_awaiter{this, ms, {}, {}}; }
+
+	timer_heap &timers() { return(timers_); }
+
+private:
+	friend class op_awaiter;
+
+	int						epfd_ = -1;
+	std::vector<mlx_bus *>	buses_;
+	timer_heap				timers_;
+	size_t					live_ = 0;
+	size_t					inflight_ = 0;		// operations submitted, not completed
+	bool					stop_ = false;
+
+	/* wrapper of a spawned task : destroys itself when done */
+	struct detached
+	{
+		struct promise_type : pooled_promise
+		{
+			detached get_return_object() noexcept
+			{
+				return detached{std::coroutine_handle<promise_type>::from_promise(*this)};
+			}
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() noexcept {}
+			void unhandled_exception() noexcept { std::terminate(); }
+		};
+
+		std::coroutine_handle<promise_type> h;
+	};
+
+	detached detach(task<void> t)
+	{
+		co_await t;
+		live_--;
+	}
+
+	static void start(detached d) { d.h.resume(); }
+
+	static inline int complete(mlx_op *op);
+};
+
+/** operation awaiter */
+
+/* the mlx_op is part of the awaiter, which is in the coroutine frame */
+class op_awaiter
+{
+public:
+	op_awaiter(executor &ex, mlx_dev *dev, int op, int loc, uint16_t val) noexcept
+		: ex_(&ex), dev_(dev)
+	{
+		op_.op = op;
+		op_.loc = loc;
+		op_.val = val;
+		op_.user = this;
+	}
+
+	/* the compiler may copy an awaiter into the frame before it is
+	 * suspended. Only then : the copy takes the settings, not the state */
+	op_awaiter(const op_awaiter &o) noexcept
+		: ex_(o.ex_), dev_(o.dev_), op_(o.op_), timeout_(o.timeout_), cs_(o.cs_)
+	{
+		op_.user = this;
+	}
+	op_awaiter &operator=(const op_awaiter &) = delete;
+
+	/* give up if not started within ms (result MLX_ERR_TIMEOUT) */
+	op_awaiter &timeout(uint64_t ms) && noexcept
+	{
+		timeout_ = ms;
+		return(*this);
+	}
+
+	/* cancel with a cancel_source (result MLX_ERR_CANCEL) */
+	op_awaiter &cancel_with(cancel_source &cs) && noexcept
+	{
+		cs_ = &cs;
+		return(*this);
+	}
+
+	bool await_ready() noexcept
+	{
+		if (cs_ && cs_->cancelled())
+		{
+			op_.result = MLX_ERR_CANCEL;
+			return(true);
+		}
+		return(false);
+	}
+
+	bool await_suspend(std::coroutine_handle<> h) noexcept
+	{
+		int ret;
+
+		h_ = h;
+
+		if ((ret = mlx_submit(dev_, &op_)) != MLX_OK)
+		{
+			op_.result = ret;
+			return(false);		// resume directly
+		}
+
+		ex_->inflight_++;
+
+		if (timeout_)
+		{
+			tn_.due = now_ms() + timeout_;
+			tn_.fire = on_timeout;
+			tn_.arg = this;
+			ex_->timers().add(&tn_);
+		}
+
+		if (cs_) link();
+
+		return(true);
+	}
+
+	/* return MLX_OK or error, value in op().val */
+	int await_resume() noexcept { return(op_.result); }
+
+	const mlx_op &op() const { return(op_); }
+
+protected:
+	executor	*ex_;
+	mlx_dev		*dev_;
+	mlx_op		op_ = {};
+	uint64_t	timeout_ = 0;
+	cancel_source *cs_ = nullptr;
+
+private:
+	friend class executor;
+	friend class cancel_source;
+
+	std::coroutine_handle<> h_;
+	timer_node	tn_;
+	bool		timed_out_ = false;
+	op_awaiter	*prev_ = nullptr, *next_ = nullptr;		// in cancel_source
+
+	void link()
+	{
+		next_ = cs_->head_;
+		if (next_) next_->prev_ = this;
+		cs_->head_ = this;
+	}
+
+	void unlink()
+	{
+		if (prev_) prev_->next_ = next_;
+		else cs_->head_ = next_;
+		if (next_) next_->prev_ = prev_;
+		prev_ = next_ = nullptr;
+	}
+
+	/* try to take the operation back from the bus queue */
+	void try_cancel()
+	{
+		mlx_cancel(mlx_get_bus(dev_), &op_);
+	}
+
+	static void on_timeout(void *arg)
+	{
+		op_awaiter *a = static_cast<op_awaiter *>(arg);
+
+		a->timed_out_ = true;
+		a->try_cancel();
+	}
+
+	/* called by the executor : operation is completed */
+	void done()
+	{
+		ex_->timers().remove(&tn_);
+		if (cs_) unlink();
+
+		if (op_.result == MLX_ERR_CANCEL && timed_out_) op_.result = MLX_ERR_TIMEOUT;
+
+		h_.resume();
+	}
+};
+
+inline int executor::complete(mlx_op *op)
+{
+	static_cast<op_awaiter *>(op->user)->ex_->inflight_--;
+	static_cast<op_awaiter *>(op->user)->done();
+	return(1);
+}
+
+inline void cancel_source::cancel()
+{
+	cancelled_ = true;
+
+	// mlx_cancel() only queues the completion, the list stays intact
+	for (op_awaiter *a = head_; a != nullptr; a = a->next_) a->try_cancel();
+}
+
+/* awaiter that converts the result */
+template <typename T, T (*CONV)(uint16_t)>
+class conv_awaiter : public op_awaiter
+{
+public:
+	using op_awaiter::op_awaiter;
+
+	conv_awaiter &timeout(uint64_t ms) && noexcept
+	{
+		timeout_ = ms;
+		return(*this);
+	}
+
+	conv_awaiter &cancel_with(cancel_source &cs) && noexcept
+	{
+		cs_ = &cs;
+		return(*this);
+	}
+
+	result<T> await_resume() noexcept
+	{
+		result<T> r;
+
+		if ((r.err = op_.result) == MLX_OK) r.val = CONV(op_.val);
+		return(r);
+	}
+};
+
+inline uint16_t conv_raw(uint16_t v) { return(v); }
+
+/** device */
+
+/* an MLX90615 used from an executor */
+class device
+{
+public:
+	using raw_awaiter = conv_awaiter<uint16_t, conv_raw>;
+	using celsius_awaiter = conv_awaiter<double, mlx_raw_to_celsius>;
+
+	device(executor &ex, mlx_dev *dev) : ex_(ex), dev_(dev)
+	{
+		ex.watch(mlx_get_bus(dev));
+	}
+
+	raw_awaiter read_reg(int reg) { return raw_awaiter(ex_, dev_, MLX_OP_READ_REG, reg, 0); }
+	raw_awaiter read_ram(int loc) { return raw_awaiter(ex_, dev_, MLX_OP_READ_RAM, loc, 0); }
+
+	celsius_awaiter read_ambient() { return celsius_awaiter(ex_, dev_, MLX_OP_READ_RAM, MLX_RAM_TA, 0); }
+	celsius_awaiter read_object() { return celsius_awaiter(ex_, dev_, MLX_OP_READ_RAM, MLX_RAM_TO, 0); }
+
+	/* return MLX_OK or error */
+	op_awaiter write_reg(int reg, uint16_t val) { return op_awaiter(ex_, dev_, MLX_OP_WRITE_REG, reg, val); }
+	op_awaiter sleep() { return op_awaiter(ex_, dev_, MLX_OP_SLEEP, 0, 0); }
+	op_awaiter wake() { return op_awaiter(ex_, dev_, MLX_OP_WAKE, 0, 0); }
+
+	executor &exec() { return(ex_); }
+	mlx_dev *get() { return(dev_); }
+
+private:
+	executor	&ex_;
+	mlx_dev		*dev_;
+};
+
+} // namespace mlx
+
+#endif /* LIBMLX90615_HPP */
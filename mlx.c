@@ -36,8 +36,8 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <stdarg.h>
+#include <math.h>
 #include "mlx90615.h"
-#include <bcm2835.h>
 
 /* include details (where possible)*/
 int detailed = 0;
@@ -48,6 +48,22 @@ uint8_t slave_address_base_req = 0x0;
 /* set for PWM menu request */
 int pwm_menu = 0;
 
+/* socket of the bus broker (mlxd) to use instead of the BCM2835 */
+char *broker = NULL;
+
+/* simulated MLX90615 instead of the BCM2835 (-S) */
+int simulate = 0;
+
+/* file to record the bus transactions in (-T) */
+char *trace_file = NULL;
+
+/* run the PWM capture jitter self-test (-J) */
+int jitter_test = 0;
+
+/* compensation of To for the object (-K) */
+mlx_comp comp;
+int comp_on = 0;
+
 
 /* display debug message
  * @param format : debug message to display and optional arguments
@@ -123,25 +139,14 @@ int get_dec_input()
  
 int check_for_mlx() 
 {
-	int i, count=0;
+	int count;
 	uint8_t sla_found=0x5b;
-	uint8_t slave_address_old = slave_address_base;
 	
-	for (i = 1 ; i < 0x7f ; i++)
-	{
-	  	/* set slave address for MLX90615*/
-		bcm2835_i2c_setSlaveAddress((char) i);
-
-		/* set for PEC calculation */
-		slave_address_base = (uint8_t) i;
-		
-	    // perform read 
-	    if (read_reg(0) > 0)
-	    {
-            count++;
-            sla_found = (uint8_t) i;
-	    }
-	}
+	// cached registers might be from a different device
+	cache_reset();
+	
+	// read register 0 on all slave addresses
+	count = find_mlx(&sla_found, 1);
 	
 	if (count == 1)
 	{
@@ -158,13 +163,7 @@ int check_for_mlx()
 		}
 
 		slave_address_base=sla_found;
-		bcm2835_i2c_setSlaveAddress(sla_found);
 	}
-	else
-	{
-		slave_address_base=slave_address_old;
-		bcm2835_i2c_setSlaveAddress(slave_address_old);
-	}	
 	
 	return(count);
 }
@@ -253,10 +252,7 @@ int slv_recover()
 
 	} while (answ != 'y' && answ != 'Y');
 	
-	// set BCM2835 to slave 0x0
-	bcm2835_i2c_setSlaveAddress(0x0);
-	
-	// set for PEC calculation
+	// set for slave 0x0 (and PEC calculation)
 	slave_address_base= 0x0;
 	
 	ret=read_reg(0x0);
@@ -297,7 +293,7 @@ int slv_recover()
 		} while (answ != 'Y' && answ != 'y');
 		
 		// write default slave address
-		if (write_reg(PWMSA, (long) (sla & 0x7f)) == 0 )
+		if (wear_request(PWMSA, (long) (sla & 0x7f)) == 0 && wear_flush() >= 0)
 		{
 	        p_printf(2,"Slave address set to 0x%x\n", sla);
 			return(0);
@@ -372,7 +368,7 @@ int slv_addr_set()
     }
 
 	// write updated slave address
-	if (write_reg(PWMSA, (long) (new_sl_addr & 0x7f)) == 0 )
+	if (wear_request(PWMSA, (long) (new_sl_addr & 0x7f)) == 0 && wear_flush() >= 0)
 	{
         p_printf(2,"slave address set to 0x%x\n", slave_address_base);
 		return(0);
@@ -401,6 +397,9 @@ void set_for_smb()
 		close_out(-1);
 	}
 		
+	// a different MLX might be connected now
+	wear_reset_unit();
+	
 	// find the current slave_address for the connected MLX
 	if ((mlx_count = check_for_mlx()) != 1)
 	{
@@ -418,8 +417,10 @@ void set_for_smb()
 void hw_init() 
 {
     
-    if (!bcm2835_init()) {
-        p_printf(1,"Can't init bcm2835!\n");
+    if (mlx_lib_init(broker) < 0) {
+        if (broker) p_printf(1,"Can't connect to bus broker on %s!\n", broker);
+        else if (simulate) p_printf(1,"Can't create simulation!\n");
+        else p_printf(1,"Can't init bcm2835!\n");
         exit(1);
     }
     
@@ -448,12 +449,13 @@ void close_out(int end)
     
     // reset pins
     if (pwm_mode)
-		bcm2835_gpio_fsel(RPI_V2_GPIO_P1_05, BCM2835_GPIO_FSEL_INPT); 
-    else
-		bcm2835_i2c_end();	
+		gpio_fsel(scl_pin, MLX_GPIO_IN);
 	
-    // release BCM2835 library
-    bcm2835_close();
+    // stop I2C and release BCM2835 library
+    mlx_lib_close();
+
+    // write remaining transactions
+    mlx_trace_stop();
 
     // exit with return code
     exit(end);
@@ -565,7 +567,7 @@ void disp_cont_reg(char reg, long val)
 /*
  * read unit_id
  * @param disp : 1 = display, 0 = return in buf
- * @param buf : NULL or buffer to store ID ( minimal 7 positions)
+ * @param buf : NULL or buffer to store ID ( minimal 10 positions)
  */
 int get_unit_id(int disp, char *buf)
 {
@@ -585,9 +587,9 @@ int get_unit_id(int disp, char *buf)
 	
 	// if display is requested
 	if (disp)
-		p_printf(2,"\nUnit Id:\t%lx%lx\n",id_high, id_low);
+		p_printf(2,"\nUnit Id:\t%04lx%04lx\n",id_high, id_low);
 	else
-		sprintf(buf,"%lx%lx\n", id_high, id_low);
+		sprintf(buf,"%04lx%04lx\n", id_high, id_low);
 	
 	return(0);
 }
@@ -690,6 +692,31 @@ void disp_config()
 			
 }
 
+/* display To compensated for the object (-K)
+ * @param ram : To from the sensor */
+void display_comp(long ram)
+{
+	long	ta, reg;
+	double	to;
+	
+	if ((ta = read_ram(TA)) < 0 || (reg = disp_emis(0)) < 0)
+	{
+		p_printf(1,"can not read Ta / emissivity for the compensation\n");
+		return;
+	}
+	
+	// To of the sensor is for the emissivity it has
+	if (reg > 0) comp.chip_emiss = (double) reg / 16384;
+	mlx_comp_prepare(&comp);
+	
+	to = mlx_comp_to(&comp, mlx_raw_to_celsius(ram), mlx_raw_to_celsius(ta));
+	
+	if (isnan(to))
+		p_printf(1,"Can not compensate : more radiation reflected than measured\n");
+	else
+		p_printf(2,"Compensated object temperature is %2.2fC (emissivity %1.2f)\n", to, comp.emissivity);
+}
+
 /* display temperature information
  * @param temp : TO=object, TA = ambient, RAWIR = raw
  * 
@@ -714,10 +741,14 @@ int display_temp(int temp)
 	}	
 
 	if (temp == TA )
-		p_printf(2,"Ambient temperature is %2.2fC\n", ((ram & 0x7fff) * 0.02) - 273.15);
+		p_printf(2,"Ambient temperature is %2.2fC\n", mlx_raw_to_celsius(ram));
 	
 	else if (temp == TO )
-		p_printf(2,"Object temperature is %2.2fC\n",  ((ram & 0x7fff)* 0.02) - 273.15);
+	{
+		p_printf(2,"Object temperature is %2.2fC\n",  mlx_raw_to_celsius(ram));
+		
+		if (comp_on) display_comp(ram);
+	}
 	
 	else
 		p_printf(2,"Raw IR data sign %c, magnitude: 0x%04lx\n",(ram & 0x08000) ? '+':'-', ram & 0x7fff);
@@ -812,7 +843,7 @@ void set_sleep()
 {
 	int answ;
 	
-	p_printf(3,	"\nDo you want to:\n1) enter sleep mode\n2) exit sleep mode\n(99 = return) ");
+	p_printf(3,	"\nDo you want to:\n1) enter sleep mode\n2) exit sleep mode\n3) duty-cycled sampling\n(99 = return) ");
 	
 	do
 	{
@@ -837,6 +868,8 @@ void set_sleep()
 		}
 		else if (answ == 2) 
 		{
+			double start = get_current();
+			
 			if (wake_up() < 0)
 				p_printf(1,"could not wakeup\n");
 			else
@@ -844,10 +877,19 @@ void set_sleep()
 				p_printf(2,"exit sleep mode\n");
 				// reset still in sleep mode
 				in_sleep_mode = 0;
+				
+				// wait for stable readings
+				ready_wait(start);
+				ready_report();
 			}
 			
 			return;
 		}
+		else if (answ == 3)
+		{
+			duty_menu();
+			return;
+		}
 		
 	} while (1);
 
@@ -1020,14 +1062,27 @@ void usage(char *name)
 		"\nSMB options :\n"
 		"-s,	slave address to use\n"
 		"-n,	no PEC check on read\n"
+		"-V,	variance (C^2)[:readings] for stable readings after wake-up (default 0.01:4)\n"
+		"-O,	power off time in ms for power on reset (default 1000)\n"
+		"-R,	real-time PWM capture with this SCHED_FIFO priority (1 - 99)\n"
+		"-A,	CPU for real-time PWM capture (e.g. an isolated CPU)\n"
+		"-J,	PWM capture jitter self-test and exit\n"
+		"-b,	use the bus broker (mlxd) on this socket (e.g. %s)\n"
+		"-S,	use a simulated MLX90615 (no hardware needed, also PWM)\n"
+		"-w,	file to keep EEPROM write counts (default %s)\n"
+		"-W,	display EEPROM write counts of all units and exit\n"
 		
 		"\nGeneral options\n"
 		"-t,	enable debug tracking\n"
+		"-T,	record the bus transactions in this file (see mlx_trace2json)\n"
 		"-d,	enable detailed display\n"
+		"-E,	compiled emissivity database (default %s if it exists)\n"
+		"-K,	also display To compensated : emissivity[:reflected[:transmissivity[:window]]]\n"
+		"	reflected / window temperature in celsius or ta (default)\n"
 		"-H,	display this help text\n"
 		
 		"\nSpecial options\n"
-		"-C,	recovery of config register. (CAREFULL !!!)\n", name);
+		"-C,	recovery of config register. (CAREFULL !!!)\n", name, MLXD_SOCKET, WEAR_FILE, EMISS_FILE);
 }
 
 /* Toggle detailed */
@@ -1063,14 +1118,16 @@ void toggle_debug()
 int main(int argc, char *argv[])
 {
     int tmp=0, c;
+    uint8_t sla;
     int set_pwm_value = 0;
+    char *end;
 
 	// catch signals
 	set_signals();
 
 	while (1)
 	{
-		c = getopt(argc, argv,"-aolhpm:r:s:ntCPdH");
+		c = getopt(argc, argv,"-aolhpm:r:s:ntT:CPdHw:WV:O:b:R:A:JSE:K:");
 
 		if (c == -1)	break;
 			
@@ -1117,6 +1174,52 @@ int main(int argc, char *argv[])
 				no_pec_check = 1;
 				break;
 		
+			case 'V':	// variance[:window] for stable readings
+				ready_variance = strtod(optarg, &end);
+				
+				if (*end == ':') ready_window = (int) strtol(end + 1, &end, 10);
+				
+				if (ready_variance <= 0 || *end || ready_window < 2 || ready_window > 16)
+				{
+					p_printf(1,"Invalid variance[:readings] provided %s\n", optarg);
+					exit(1);
+				}
+				break;
+			
+			case 'O':	// power off time for POR
+				por_off = (int) strtol(optarg, NULL, 10);
+				
+				if (por_off < 1)
+				{
+					p_printf(1,"Invalid power off time provided %s\n", optarg);
+					exit(1);
+				}
+				break;
+			
+			case 'R':	// real-time PWM capture
+				rt_prio = (int) strtol(optarg, NULL, 10);
+				
+				if (rt_prio < 1 || rt_prio > 99)
+				{
+					p_printf(1,"Invalid real-time priority provided %s\n", optarg);
+					exit(1);
+				}
+				break;
+			
+			case 'A':	// CPU for real-time PWM capture
+				rt_cpu = (int) strtol(optarg, NULL, 10);
+				
+				if (rt_cpu < 0)
+				{
+					p_printf(1,"Invalid CPU provided %s\n", optarg);
+					exit(1);
+				}
+				break;
+			
+			case 'J':	// jitter self-test
+				jitter_test = 1;
+				break;
+			
 			case 's':	// set slave_address
 				slave_address_base_req = (uint8_t) strtol(optarg, NULL,16);
 
@@ -1127,6 +1230,43 @@ int main(int argc, char *argv[])
 				}
 				break;
 
+			case 'b':	// use bus broker
+				broker = optarg;
+				break;
+
+			case 'S':	// simulated MLX90615
+				simulate = 1;
+				break;
+
+			case 'w':	// EEPROM write count file
+				wear_file = optarg;
+				break;
+
+			case 'W':	// display EEPROM write counts
+				wear_report(1);
+				exit(0);
+				break;
+
+			case 'E':	// emissivity database
+				if (emiss_use(optarg) < 0)
+				{
+					p_printf(1,"Can not open emissivity database %s\n", optarg);
+					exit(-1);
+				}
+				break;
+
+			case 'K':	// compensation of To
+				mlx_comp_init(&comp);
+				
+				if (mlx_comp_parse(&comp, optarg) != MLX_OK)
+				{
+					p_printf(1,"Invalid compensation %s\n", optarg);
+					exit(-1);
+				}
+				
+				comp_on = 1;
+				break;
+
 			case 'd':	// enable detailed
 				detailed = 1;
 				break;
@@ -1135,6 +1275,10 @@ int main(int argc, char *argv[])
 				DEBUG = 1;
 				break;								
 
+			case 'T':	// transaction trace
+				trace_file = optarg;
+				break;
+
 			case 'C':	// CONFIG RECOVER
 				config_recover();
 				close_out(0);
@@ -1151,14 +1295,33 @@ int main(int argc, char *argv[])
 		}
 	}
 	
-	if (geteuid() != 0){
+	// PWM is read on the GPIO, which is owned by the broker
+	if (broker && pwm_mode)
+	{
+		p_printf(1,"PWM is not available with the bus broker\n");
+		exit(-1);
+	}
+	
+	if (! broker && ! simulate && geteuid() != 0){
         p_printf(1,"Must be run as root.\n");
         exit(-1);
     }
 	
+    if (trace_file && mlx_trace_start(trace_file) != MLX_OK)
+    {
+        p_printf(1,"Can't create trace file %s\n", trace_file);
+        exit(-1);
+    }
+
     // do hardware init
     hw_init();
     
+    if (jitter_test)
+    {
+        rt_jitter_test(RT_TEST_MS);
+        close_out(0);
+    }
+    
     // if PWM menu was requested on command line
     if (pwm_menu)	set_pwm(set_pwm_value);
     else
@@ -1188,6 +1351,8 @@ int main(int argc, char *argv[])
 	        p_printf(2,"\n13	Toggle debug messages");
 	        if(DEBUG) p_printf(1," (enabled)");
 	        
+	        p_printf(2,"\n14	Display EEPROM write counts");
+	        
 	        p_printf(3, "\n\n99  exit program ");
 			
 	        tmp = get_dec_input();
@@ -1221,9 +1386,15 @@ int main(int argc, char *argv[])
 				get_unit_id(1, NULL);
 				break;
 	        case 9:
+				if (broker)
+				{
+					p_printf(1,"PWM is not available with the bus broker\n");
+					break;
+				}
+	            sla = slave_address_base;
 	            set_SCL_high(1);	// try to enable PWM
 	            set_pwm(0);
-	            set_for_smb();		// back to SMB mode
+	            mode_to_smb(sla);	// back to SMB mode
 	            break;
 	        case 10:
 	            set_sleep();
@@ -1237,6 +1408,9 @@ int main(int argc, char *argv[])
 	        case 13:
 				toggle_debug();
 	            break;
+	        case 14:
+				wear_report(0);
+	            break;
 	        case 99:
 	            break;
 	        default:
@@ -47,6 +47,8 @@
 */
 
 
+#include "libmlx90615.h"
+
 /* EEPROM registers */
 #define PWMSA   0x0		// PWM T min / SMBus Slave address (SA)
 #define PWMTR   0x1		// PWM T range
@@ -64,12 +66,41 @@
 #define default_SLA	0x5b
 #define default_emissivity 0x4000
 #define default_CONF	0x14d9	// at least on MY MLX90615
-#define sda_pin RPI_V2_GPIO_P1_03
-#define scl_pin RPI_V2_GPIO_P1_05
+#define sda_pin 2		// GPIO 2 (P1 pin 3)
+#define scl_pin 3		// GPIO 3 (P1 pin 5)
+
+/* pin levels (mlx_gpio) */
+#define LOW		0
+#define HIGH	1
 
 /*version number */
 #define MLX_VERSION "1.0"
 
+/* EEPROM write count file and expected endurance (erase / write cycles) */
+#define WEAR_FILE	"/var/lib/mlx90615.wear"
+#define WEAR_ENDURANCE	10000
+
+/* compiled emissivity database (mlx_emissc), else the built-in table is used */
+#define EMISS_FILE	"/usr/local/share/mlx90615.emiss"
+
+/* typical supply current active / in sleep (mA) */
+#define MLX_I_ACTIVE	1.5
+#define MLX_I_SLEEP		0.0011
+
+/* mode transitions (mlx_mode.c) */
+#define TR_TO_PWM	0
+#define TR_TO_SMB	1
+#define TR_READ_PWM	2
+#define TR_NUM		3
+
+/* duration of the PWM capture jitter self-test in ms (mlx_rt.c) */
+#define RT_TEST_MS	500
+
+/* PWM bitstream capture : samples per period and periods per capture */
+#define PWM_BITS_SPP		500
+#define PWM_BITS_HIGH		200		// 1Khz : 200ms
+#define PWM_BITS_LOW		20		// 10hz : 2 seconds
+
 /* MLX POWER */
 #define power_pin RPI_V2_GPIO_P1_07	// GPIO4
 #define ON  1
@@ -96,6 +127,12 @@ extern uint8_t slave_address_base;
 /* overwrite default _slave address with -s option*/
 extern uint8_t slave_address_base_req;
 
+/* socket of the bus broker (mlxd), NULL = BCM2835 */
+extern char *broker;
+
+/* simulated MLX90615 instead of the BCM2835 */
+extern int simulate;
+
 
 /** defined  in mlx_lib.c */
 
@@ -111,6 +148,9 @@ extern int in_sleep_mode;
 // set for NO PEC check during read
 extern int no_pec_check;
 
+// power off time for a power on reset (ms)
+extern int por_off;
+
 
 /** defined in mlx_pwm.c */
 /* set to PWM mode */
@@ -129,6 +169,37 @@ extern int cur_temp;
 extern int cur_freq;
 
 
+/** defined in mlx_wear.c */
+
+// file to store the EEPROM write counters
+extern char *wear_file;
+
+// expected EEPROM endurance (erase / write cycles)
+extern unsigned long wear_endurance;
+
+
+/** defined in mlx_duty.c */
+
+// learned wake-to-stable latency (ms)
+extern double duty_latency;
+
+
+/** defined in mlx_ready.c */
+
+// variance limit (C^2) and window to declare readings stable (-V)
+extern double ready_variance;
+extern int ready_window;
+
+
+/** defined in mlx_rt.c */
+
+// SCHED_FIFO priority for PWM capture (0 = off)
+extern int rt_prio;
+
+// CPU for PWM capture (-1 = any)
+extern int rt_cpu;
+
+
 /************************/
 /** routines in mlx */
 /************************/
@@ -168,13 +239,17 @@ int get_dec_input();
 
 /* read unit_id
  * @param disp : 1 = display, 0 = return in buf
- * @param buf : NULL or buffer to store ID ( minimal 7 positions) */
+ * @param buf : NULL or buffer to store ID ( minimal 10 positions) */
 int get_unit_id(int disp, char *buf);
 
 /* display temperature information
  * @param temp : object, ambient, raw */
 int display_temp(int temp);
 
+/* display To compensated for the object (-K)
+ * @param ram : To from the sensor */
+void display_comp(long ram);
+
 /* Display ram location content*/
 int disp_all_ram();
 
@@ -226,6 +301,27 @@ void toggle_debug();
 /** routines in mlx_lib */
 /************************/
 
+/* open the bus (libmlx90615) and MLX90615
+ * @param broker : socket of bus broker, NULL = BCM2835 (or simulation)
+ * return 0 = OK, -1 = error */
+int mlx_lib_init(char *broker);
+
+/* release the MLX90615 and bus */
+void mlx_lib_close();
+
+/* return the MLX90615 in use for direct library calls
+ * (current slave address and PEC setting applied) */
+mlx_dev *mlx_lib_dev();
+
+/* stop I2c communication (to use the pins for PWM) */
+void i2c_end();
+
+/* find the MLX90615 on I2c
+ * @param found : to store the slave addresses found
+ * @param max : size of found
+ * return number of devices found */
+int find_mlx(uint8_t *found, int max);
+
 /* handle power ON or OFF for MLX */
 void mlx_power(int act);
 
@@ -297,6 +393,14 @@ int write_mlx(char reg, long val);
 /* do a power up reset */
 void por();
 
+/* GPIO next to the bus (BCM2835 or simulation, nothing with the broker)
+ * @param mode : MLX_GPIO_IN or MLX_GPIO_OUT */
+void gpio_fsel(uint8_t pin, int mode);
+void gpio_write(uint8_t pin, int level);
+
+/* return level of pin : 0 = low, 1 = high */
+int gpio_lev(uint8_t pin);
+
 /************************/
 /** routines in mlx_emiss.c */
 /************************/
@@ -313,11 +417,11 @@ float find_emis();
  * @param step : 
  * 	1 = select by type, 
  * 	2 = select material within type
- * 	3 = wildcard search
+ * 	3 = fuzzy search (best 20)
  * 
  * @param lookup : 
  * 	lookup value for type in step 2 
- * 	loopup value for wildcard in step 3
+ * 	words to look for in step 3
  *  
  * return: 
  * 	99 = level back 
@@ -326,6 +430,97 @@ float find_emis();
  */
 int	select_emiss(int step, char *lookup);
 
+/*******************************/
+/** routines in mlx_emiss_tab.c */
+/*******************************/
+
+/* entry in the emissivity table */
+typedef struct {
+	char* type;
+	char* material;
+	char* temp;
+	char* emis;
+} lookuptab;
+
+/* the table, ends with an entry with type "0" */
+extern lookuptab emis_table[];
+
+/*****************************/
+/** routines in mlx_emiss_db.c */
+/*****************************/
+
+/* compiled emissivity database, used as it is mapped in memory */
+typedef struct emiss_db emiss_db;
+
+/* max entries in a search result */
+#define EMISS_MAX	400
+
+/* open a compiled database (read-only mapping)
+ * return database or NULL if it can not be opened / is not valid */
+emiss_db *emiss_db_open(const char *path);
+
+/* release a database */
+void emiss_db_close(emiss_db *db);
+
+/* build a database in memory from a table
+ * @param num : entries in tab (-1 = up to the entry with type "0")
+ * return database or NULL in case of error */
+emiss_db *emiss_db_build(const lookuptab *tab, int num);
+
+/* write a database to a file (a new file, renamed in place)
+ * return 0 = OK, -1 = error */
+int emiss_db_save(const emiss_db *db, const char *path);
+
+/* return the number of entries */
+int emiss_db_count(const emiss_db *db);
+
+/* get entry i. The strings are in the database (do not change)
+ * return 0 = OK, -1 = no such entry */
+int emiss_db_get(const emiss_db *db, int i, lookuptab *e);
+
+/* return the emissivity of entry i */
+float emiss_db_value(const emiss_db *db, int i);
+
+/* use a compiled database for the searches
+ * return 0 = OK, -1 = can not be opened (current stays) */
+int emiss_use(const char *path);
+
+/* return the database in use : set by emiss_use(), else EMISS_FILE if
+ * it exists, else the built-in table */
+emiss_db *emiss_current();
+
+/* Find entries in the emissivity database in use (no display)
+ * @param step : 1 = by type, 2 = material within type, 3 = wildcard
+ * @param lookup : type (step 2) or wildcard (step 3)
+ * @param pnt : to store the entries found (entry in database),
+ *              NULL = only count them
+ * @param max : size of pnt
+ * 
+ * return number of entries found (at most max) */
+int emiss_match(int step, char *lookup, int *pnt, int max);
+
+/* same, in a database */
+int emiss_match_db(const emiss_db *db, int step, char *lookup, int *pnt, int max);
+
+/* result of a fuzzy search */
+typedef struct emiss_hit {
+	int		entry;			// in the database
+	float	score;			// higher is better
+} emiss_hit;
+
+/* Fuzzy search on the words of type and material in the database in use,
+ * a part of a word or a typing error is found as well ("stel" finds
+ * "Stainless Steel")
+ * @param query : one or more words
+ * @param hit : to store the best k entries, best first
+ * @param k : size of hit
+ * 
+ * return number of entries found (at most k) */
+int emiss_search(const char *query, emiss_hit *hit, int k);
+
+/* same, in a database */
+int emiss_search_db(const emiss_db *db, const char *query, emiss_hit *hit, int k);
+
 /**************************/
 /** routines in mlx_pwm.c */
 /**************************/
@@ -345,6 +540,10 @@ int set_pwm(int set_pwm_value);
  */ 
 int detect_pwm( double * r_start_high, double * r_stop_high, double * r_cycle_time);
 
+/* same as detect_pwm() with a detection window
+ * @param window : time-out in ms */
+int detect_pwm_win( double * r_start_high, double * r_stop_high, double * r_cycle_time, long window);
+
 /* read the T_min, T-range and temperature type from an MLX in pwm_mode
  * return : 0 = OK, 1 = not OK */
 
@@ -384,6 +583,18 @@ int set_pwm_freq();
  */
 int display_pwm_temp();
 
+/* same as detect_pwm() : sample SDA at a fixed rate into a bitstream
+ * and decode the duty cycle over all whole periods (mlx_pwm_bits)
+ * @param duty : duty cycle
+ * @param cycle_time : time of a period (us)
+ * return values
+ * 1 = PWM signal detected, values are stored
+ * 0 = NO PWM signal detected. */
+int detect_pwm_bits(double *duty, double *cycle_time);
+
+/* same as display_pwm_temp(), with detect_pwm_bits() */
+int display_pwm_temp_bits();
+
 /* will set T_min or T_range for PWM mode */
 void set_range();
 
@@ -405,7 +616,7 @@ int set_SCL_high(int reset);
  */
 int exit_pwm(int ch_to_smb);
 
-/* set config register for PWM mode 
+/* request the config register write for PWM mode (flushed by caller)
  * @param PWM : 1 = set to PWM else to SMB 
  * @param set_value : 1 = overwrite PWM attributes */
 int set_conf_reg (int pwm, int set_value);
@@ -418,3 +629,140 @@ int calc_to_t_range (float val);
 
 /* return current time in useconds */
 double get_current();
+
+/**************************/
+/** routines in mlx_wear.c */
+/**************************/
+
+/* called by write_reg before the EEPROM is touched, to obtain
+ * the unit ID before the slave address can change */
+void wear_prepare();
+
+/* count a skipped write (value was already in the register) */
+void wear_skip(char reg);
+
+/* count a completed write (one erase / write cycle) on a register
+ * a warning is displayed at 80% of the expected endurance */
+void wear_count(char reg);
+
+/* forget the unit ID (e.g. after a new device was discovered) */
+void wear_reset_unit();
+
+/* request a write through the scheduler, written by wear_flush().
+ * A new request for the same register replaces the value.
+ * return 0 = OK, -1 = error */
+int wear_request(char reg, long val);
+
+/* drop all pending requests (e.g. the operation failed) */
+void wear_cancel();
+
+/* write the pending requests (slave address last). When a write
+ * fails the rest is dropped.
+ * return number of registers written or -1 in case of error */
+int wear_flush();
+
+/* return the number of pending scheduled writes */
+int wear_pending();
+
+/* display the lifetime erase / write cycles per register
+ * @param all : 1 = all units in the wear file, 0 = connected MLX */
+void wear_report(int all);
+
+/**************************/
+/** routines in mlx_duty.c */
+/**************************/
+
+/* learn the wake-to-stable latency (exponential moving average)
+ * @param ms : observed latency */
+void duty_learn(double ms);
+
+/* run duty-cycled sampling
+ * @param period : requested sample period in ms
+ * @param count : number of samples to take
+ * return 0 = OK, -1 = error */
+int duty_run(long period, long count);
+
+/* display estimated duty and latency overhead of the last run */
+void duty_report();
+
+/* ask period and count and run duty-cycled sampling */
+void duty_menu();
+
+/***************************/
+/** routines in mlx_ready.c */
+/***************************/
+
+/* wait until the MLX provides stable To and Ta readings
+ * @param start : time the wake-up / POR was started (get_current())
+ * return time to stable readings in ms or -1 in case of time-out */
+double ready_wait(double start);
+
+/* perform a power on reset and wait until the MLX is ready
+ * @param pwm : 1 = wait for the PWM signal, 0 = for stable readings (SMB)
+ * return time to ready in ms or -1 in case of time-out */
+double por_ready(int pwm);
+
+/* display the metrics of the last detection */
+void ready_report();
+
+/**************************/
+/** routines in mlx_mode.c */
+/**************************/
+
+/* store a user register value (0x0 - 0x3) in the cache */
+void cache_set(char reg, long val);
+
+/* get a register value from the cache
+ * return value or -1 if not cached */
+long cache_get(char reg);
+
+/* invalidate the cache (e.g. other device, POR) */
+void cache_reset();
+
+/* copy the cached registers (-1 = not cached) */
+void cache_copy(long *regs);
+
+/* after a POR in PWM mode : take the registers from cache_copy() of
+ * before the POR back if the PWM cycle time (us) matches their config */
+void cache_pwm_check(long *regs, double cycle_time);
+
+/* register the time of a transition
+ * @param tr : transition TR_xxx
+ * @param start : start time of transition (get_current()) */
+void mode_time(int tr, double start);
+
+/* return the PWM detection window (ms) based on the config
+ * @param conf : config register (-1 = unknown) */
+long pwm_window(long conf);
+
+/* after POR wait for the PWM signal to start
+ * return 1 = level change seen, 0 = no signal */
+int pwm_wait_start();
+
+/* can a POR bring the MLX in PWM mode ?
+ * return 0 if the cached config is set for SMBus, else 1 */
+int pwm_possible();
+
+/* switch back to SMBus, try the last known slave address first
+ * @param sla : last known slave address (0 = unknown) */
+void mode_to_smb(uint8_t sla);
+
+/* display the transition times */
+void mode_report();
+
+/**************************/
+/** routines in mlx_rt.c */
+/**************************/
+
+/* switch to real-time for a PWM capture (if rt_prio is set) :
+ * SCHED_FIFO, CPU affinity, memory locked and stack pre-faulted
+ * return 0 = OK, -1 = error (capture continues normal) */
+int rt_enter();
+
+/* restore the scheduling from before rt_enter() */
+void rt_leave();
+
+/* measure the worst-case time between two samples of SDA, normal
+ * and in real-time, and display the result
+ * @param ms : duration of each measurement */
+void rt_jitter_test(long ms);
@@ -0,0 +1,236 @@
+/* libmlx90615 : alarms on the readings (threshold, rate, hysteresis)
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_alarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_alarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_alarm. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Per channel the previous value, rate and time of To and Ta are kept
+ * and a bit per rule that is raised. A sample costs a few operations
+ * per rule, nothing is allocated after create.
+ *
+ * The rate is the distance of the value to its moving average with time
+ * constant MLX_ALARM_TAU, divided by it : for a value that changes at a
+ * constant rate the average is exactly that rate * MLX_ALARM_TAU behind.
+ * Less noisy than the difference of two samples, and with the same
+ * cost. It starts at 0 after a reset.
+ *
+ * The crossing is taken on the line between the previous and this
+ * sample. The first sample after a reset has no previous : the crossing
+ * is the time of that sample.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "libmlx90615.h"
+
+typedef struct alarm_chan {
+	uint64_t	time_ns;		// of the previous sample, 0 = none
+	double		val[2];			// previous To and Ta
+	double		avg[2];			// moving average
+	double		rate[2];		// previous rate
+	uint32_t	active;			// rules that are raised
+} alarm_chan;
+
+struct mlx_alarm {
+	int				num;
+	int				chans;
+	mlx_alarm_rule	rule[MLX_ALARM_MAX];
+	alarm_chan		ch[];
+};
+
+mlx_alarm *mlx_alarm_new(int chans)
+{
+	mlx_alarm *a;
+
+	if (chans < 1) return(NULL);
+
+	if ((a = calloc(1, sizeof(mlx_alarm) + chans * sizeof(alarm_chan))) == NULL) return(NULL);
+
+	a->chans = chans;
+
+	return(a);
+}
+
+void mlx_alarm_free(mlx_alarm *a)
+{
+	free(a);
+}
+
+int mlx_alarm_parse(mlx_alarm_rule *r, const char *spec)
+{
+	const char	*p = spec;
+	char		*end;
+
+	memset(r, 0, sizeof(mlx_alarm_rule));
+
+	if (! strncmp(p, "to", 2)) p += 2;
+	else if (! strncmp(p, "ta", 2))
+	{
+		r->what = MLX_ALARM_TA;
+		p += 2;
+	}
+
+	switch(*p++)
+	{
+		case '>':	r->kind = MLX_ALARM_ABOVE;	break;
+		case '<':	r->kind = MLX_ALARM_BELOW;	break;
+		case '+':	r->kind = MLX_ALARM_RISE;	break;
+		case '-':	r->kind = MLX_ALARM_FALL;	break;
+		default:	return(MLX_ERR_PARAM);
+	}
+
+	r->level = strtod(p, &end);
+	if (end == p) return(MLX_ERR_PARAM);
+
+	if (*end == ':')
+	{
+		p = end + 1;
+		r->hyst = strtod(p, &end);
+		if (end == p || r->hyst < 0) return(MLX_ERR_PARAM);
+	}
+
+	if (*end) return(MLX_ERR_PARAM);
+
+	// a rate is a speed, the direction is in the kind
+	if (r->kind >= MLX_ALARM_RISE && r->level <= 0) return(MLX_ERR_PARAM);
+
+	snprintf(r->name, sizeof(r->name), "%s", spec);
+
+	return(MLX_OK);
+}
+
+int mlx_alarm_add(mlx_alarm *a, const mlx_alarm_rule *r)
+{
+	if (a->num == MLX_ALARM_MAX || r->kind < MLX_ALARM_ABOVE || r->kind > MLX_ALARM_FALL ||
+		(r->what != MLX_ALARM_TO && r->what != MLX_ALARM_TA) || r->hyst < 0) return(MLX_ERR_PARAM);
+
+	a->rule[a->num] = *r;
+
+	return(a->num++);
+}
+
+const mlx_alarm_rule *mlx_alarm_get(mlx_alarm *a, int i)
+{
+	return(i < 0 || i >= a->num ? NULL : &a->rule[i]);
+}
+
+void mlx_alarm_reset(mlx_alarm *a, int chan)
+{
+	if (chan >= 0 && chan < a->chans) memset(&a->ch[chan], 0, sizeof(alarm_chan));
+}
+
+uint32_t mlx_alarm_active(mlx_alarm *a, int chan)
+{
+	return(chan < 0 || chan >= a->chans ? 0 : a->ch[chan].active);
+}
+
+/* time where the line from (t0, v0) to (t1, v1) crosses level */
+static uint64_t cross_time(uint64_t t0, double v0, uint64_t t1, double v1, double level)
+{
+	double f;
+
+	if (t0 == 0 || v1 == v0) return(t1);
+
+	f = (level - v0) / (v1 - v0);
+	if (f < 0) f = 0;
+	if (f > 1) f = 1;
+
+	return(t0 + (uint64_t) (f * (double) (t1 - t0)));
+}
+
+int mlx_alarm_update(mlx_alarm *a, int chan, uint64_t time_ns, double ta, double to, mlx_alarm_ev *ev, int max)
+{
+	mlx_alarm_rule	*r;
+	alarm_chan		*c;
+	double			val[2] = { to, ta }, rate[2], dt, v, prev, level;
+	uint32_t		bit;
+	int				i, k, on, off, num = 0;
+
+	if (chan < 0 || chan >= a->chans || isnan(to) || isnan(ta)) return(0);
+
+	c = &a->ch[chan];
+
+	// moving average and rate of To and Ta
+	for (k = 0; k < 2; k++)
+	{
+		if (c->time_ns == 0)
+		{
+			c->avg[k] = val[k];
+			rate[k] = 0;
+		}
+		else if (time_ns <= c->time_ns)
+			rate[k] = c->rate[k];
+		else
+		{
+			dt = (time_ns - c->time_ns) / 1e9;
+			c->avg[k] += (val[k] - c->avg[k]) * dt / (MLX_ALARM_TAU + dt);
+			rate[k] = (val[k] - c->avg[k]) / MLX_ALARM_TAU;
+		}
+	}
+
+	for (i = 0; i < a->num && num < max; i++)
+	{
+		r = &a->rule[i];
+		bit = 1U << i;
+
+		if (r->kind == MLX_ALARM_ABOVE || r->kind == MLX_ALARM_BELOW)
+		{
+			v = val[r->what];
+			prev = c->val[r->what];
+		}
+		else
+		{
+			v = rate[r->what];
+			prev = c->rate[r->what];
+		}
+
+		// below / fall negated : all are raised going up
+		if (r->kind == MLX_ALARM_BELOW || r->kind == MLX_ALARM_FALL)
+		{
+			v = -v;
+			prev = -prev;
+			level = r->kind == MLX_ALARM_BELOW ? -r->level : r->level;
+		}
+		else
+			level = r->level;
+
+		on = ! (c->active & bit) && v > level;
+		off = (c->active & bit) && v < level - r->hyst;
+
+		if (! on && ! off) continue;
+
+		c->active ^= bit;
+
+		ev[num].rule = i;
+		ev[num].chan = chan;
+		ev[num].raised = on ? 1 : 0;
+		ev[num].value = r->kind == MLX_ALARM_BELOW || r->kind == MLX_ALARM_FALL ? -v : v;
+		ev[num].cross_ns = cross_time(c->time_ns, prev, time_ns, v, on ? level : level - r->hyst);
+		ev[num].time_ns = time_ns;
+		num++;
+	}
+
+	for (k = 0; k < 2; k++)
+	{
+		c->val[k] = val[k];
+		c->rate[k] = rate[k];
+	}
+
+	c->time_ns = time_ns;
+
+	return(num);
+}
@@ -0,0 +1,1444 @@
+/* mlx_bench : benchmark of the MLX90615 code paths on a simulated bus
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_bench is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_bench is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_bench. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * No hardware is needed : the bus is simulated (mlx_bus_sim.c). ns_per_op
+ * is the cost of the code (wall time). For the benchmarks that use the
+ * bus, bus_ns_per_op is the time it would take on the real bus at
+ * 100Khz, from the virtual clock of the simulation.
+ *
+ * Each benchmark is repeated with a doubling number of iterations until
+ * it runs for at least the minimum time (-t). The result is written as
+ * JSON on stdout, so runs can be compared by a script :
+ *
+ * {"benchmarks": [
+ *   {"name": "crc8", "ops": 4194304, "ns_per_op": 21.3},
+ *   ...
+ *   {"name": "sample_sync", "ops": 65536, "ns_per_op": 812.0, "samples_per_s": 1231527,
+ *    "bus_ns_per_op": 1140000.0, "bus_samples_per_s": 877}
+ * ]}
+ *
+ * With -f the samples are read under fault profiles (fault injection of
+ * the simulated bus) instead. A failed read is retried (-r) with a
+ * doubling back-off, a sample that still fails is followed by a power
+ * on reset (a device that dropped off the bus comes back). For each
+ * profile the bus throughput and latency percentiles of a sample
+ * (virtual time, including retries) are given :
+ *
+ * {"faults": [
+ *   {"profile": "pec_1pct", "samples": 100000, "failed": 0, "retries": 2011,
+ *    "injected": 2011, "bus_samples_per_s": 868.1, "p50_us": 1140.0, ...},
+ *   ...
+ * ]}
+ *
+ * With -p PWM captures are decoded from the signal generator of the
+ * library (mlx_pwm_gen) with jitter and noise, over the temperature range
+ * of T min / T range. The decoded temperature is compared with that of
+ * the signal :
+ *
+ * {"pwm": [
+ *   {"profile": "1khz_jitter_1us", "method": "edge", "captures": 1000, "failed": 0,
+ *    "ns_per_capture": ..., "samples_per_capture": 2000, "mean_err_c": 0.0012,
+ *    "mean_abs_err_c": 0.09, ...},
+ *   {"profile": "1khz_jitter_1us", "method": "bits", "captures": 100, ...},
+ *   ...
+ * ]}
+ *
+ * "edge" decodes one period from the time of the edges (mlx_pwm_dec),
+ * "bits" counts the high samples of 100 periods in a bitstream
+ * (mlx_pwm_bits) with 1000 samples per period.
+ *
+ * With -c 1, 2, 4 .. 64 lines of 1Khz PWM are captured by the capture
+ * engine (mlx_pwm_cap.c) in one epoll loop. The edges come from a thread
+ * through pipes in real time. The readings per second and CPU use of
+ * the loop are given for each number of lines.
+ *
+ * With -w all sensors are sampled back to back on a simulated bus while
+ * the presence monitor (mlx_watch.c) gets a budget of bus time after
+ * each round. During the run a sensor is added, one drops off the bus
+ * and one is readdressed. For each budget the bus throughput of the
+ * samples and the time until each change is reported is given :
+ *
+ * {"watch": [
+ *   {"budget_us": 0, "rounds": ..., "bus_samples_per_s": 868.1, ...},
+ *   {"budget_us": 500, ..., "watch_bus_pct": 10.1, "added_ms": 512.3,
+ *    "removed_ms": 20.1, "moved_ms": 480.5},
+ *   ...
+ * ]}
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include "mlx90615.h"
+
+/* devices on the simulated bus */
+#define BENCH_DEVS		4
+
+/* first back-off after a failed read (ns) */
+#define FAULT_BACKOFF	1000000ULL
+
+/* power off time of the power on reset after a failed sample (ms) */
+#define FAULT_POR_OFF	10
+
+/* PWM T min (0C) and T range (50C) of the accuracy profiles */
+#define PWM_T_MIN		0x355a
+#define PWM_T_RANGE		0x9c4
+
+/* bitstream decoding : samples per period and periods per capture */
+#define BITS_SPP		1000
+#define BITS_PERIODS	100
+
+/* units in the fleet registry benchmarks */
+#define FLEET_UNITS		1000
+
+/* entries of the large emissivity database : types * materials */
+#define EMISS_TYPES		200
+#define EMISS_MATS		100
+
+/* words for the popcount benchmarks */
+#define POP_WORDS		4096
+
+/* samples for the compensation benchmarks */
+#define COMP_SAMPLES	4096
+
+/* readings in the window of the statistics (an hour at 1 per second) */
+#define STATS_WINDOW	3600
+
+/* max lines of the capture engine scaling */
+#define CAP_MAX			64
+
+/* presence monitor : run time (virtual) and time of the changes */
+#define WATCH_RUN		12			// seconds
+#define WATCH_ADD		2
+#define WATCH_DROP		5
+#define WATCH_MOVE		8
+
+#define MS				1000000ULL
+#define SEC				1000000000ULL
+
+/* synthetic PWM waveform */
+typedef struct wave {
+	uint8_t		*level;		// level per sample
+	long		num;		// number of samples
+	double		step;		// time between samples (us)
+} wave;
+
+/* benchmark flags */
+#define B_BUS			0x1		// uses the bus
+#define B_SAMPLE		0x2		// one iteration is one sample (Ta + To)
+
+typedef struct bench {
+	const char	*name;
+	void		(*fn)(long n);
+	int			flags;
+} bench;
+
+static mlx_sim	*sim;
+static mlx_bus	*bus;
+static mlx_dev	*dev;
+static wave		pwm_1k, pwm_10;
+static uint64_t	*bits_1k;		// bitstream of BITS_PERIODS of 1Khz
+static uint64_t	pop_buf[POP_WORDS];
+static uint16_t	comp_to[COMP_SAMPLES], comp_ta[COMP_SAMPLES];
+static float	comp_out[COMP_SAMPLES];
+static mlx_comp	comp;
+static mlx_stats *stats;
+static mlx_alarm *alarms;
+static mlx_fleet *fleet;
+static emiss_db	*emiss_big;
+static char		emiss_path[] = "/tmp/mlx_bench.emiss.XXXXXX";
+
+/* keeps the compiler from removing the work */
+static volatile double sink;
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static void fail(const char *what, int ret)
+{
+	fprintf(stderr, "mlx_bench: %s : %s\n", what, mlx_strerror(ret));
+	exit(1);
+}
+
+/** benchmarks */
+
+static void b_crc8(long n)
+{
+	uint8_t	buf[5] = {0xb6, 0x27, 0xb7, 0xaa, 0x39};
+	unsigned sum = 0;
+
+	while (n--)
+	{
+		buf[3] = (uint8_t) n;
+		sum += mlx_crc8(0x7, buf, 5);
+	}
+
+	sink = sum;
+}
+
+static void b_read_reg(long n)
+{
+	uint16_t val;
+	int		ret;
+
+	while (n--)
+		if ((ret = mlx_read_reg(dev, MLX_REG_EMMIS, &val)) != MLX_OK) fail("read", ret);
+
+	sink = val;
+}
+
+/* erase + write + read back (same as write_mlx in mlx_lib.c) */
+static void b_write_reg(long n)
+{
+	uint16_t val;
+	int		ret;
+
+	while (n--)
+	{
+		if ((ret = mlx_write_raw(dev, MLX_REG_EMMIS | 0x10, 0)) != MLX_OK) fail("erase", ret);
+		if ((ret = mlx_write_raw(dev, MLX_REG_EMMIS | 0x10, 0x4000)) != MLX_OK) fail("write", ret);
+		if ((ret = mlx_read_reg(dev, MLX_REG_EMMIS, &val)) != MLX_OK) fail("read", ret);
+	}
+
+	if (val != 0x4000) fail("write", MLX_ERR_DATA);
+}
+
+static void b_scan(long n)
+{
+	uint8_t	found[MLX_SIM_MAX];
+
+	while (n--)
+		if (mlx_bus_scan(bus, found, MLX_SIM_MAX, 0) != BENCH_DEVS) fail("scan", MLX_ERR_NACK);
+}
+
+static void emiss(long n, int step, char *lookup)
+{
+	int		pnt[EMISS_MAX];
+	long	sum = 0;
+
+	while (n--) sum += emiss_match(step, lookup, pnt, EMISS_MAX);
+
+	sink = sum;
+}
+
+/* the same searches in a database of EMISS_TYPES * EMISS_MATS entries */
+static void emiss_db_search(long n, int step, char *lookup)
+{
+	int		pnt[EMISS_MAX];
+	long	sum = 0;
+
+	while (n--) sum += emiss_match_db(emiss_big, step, lookup, pnt, EMISS_MAX);
+
+	sink = sum;
+}
+
+/* fuzzy search, the best EMISS_TOP (db NULL = in use) */
+#define EMISS_TOP	20
+
+static void emiss_fuzzy(long n, emiss_db *db, char *query)
+{
+	emiss_hit	hit[EMISS_TOP];
+	long		sum = 0;
+
+	while (n--) sum += emiss_search_db(db ? db : emiss_current(), query, hit, EMISS_TOP);
+
+	sink = sum;
+}
+
+static void b_emiss_open(long n)
+{
+	emiss_db *db;
+
+	while (n--)
+	{
+		if ((db = emiss_db_open(emiss_path)) == NULL) fail("emissivity database", MLX_ERR_DATA);
+		emiss_db_close(db);
+	}
+}
+
+static void b_emiss_types(long n)	{ emiss(n, 1, NULL); }
+static void b_emiss_type(long n)	{ emiss(n, 2, "Steel Alloys "); }
+static void b_emiss_wild(long n)	{ emiss(n, 3, "iron"); }
+static void b_emiss_big_type(long n)	{ emiss_db_search(n, 2, "Type 123"); }
+static void b_emiss_big_wild(long n)	{ emiss_db_search(n, 3, "material 0042"); }
+static void b_emiss_fuzzy(long n)	{ emiss_fuzzy(n, NULL, "stel"); }
+static void b_emiss_big_fuzzy(long n)	{ emiss_fuzzy(n, emiss_big, "materal 00042"); }
+
+static void b_raw_celsius(long n)
+{
+	double sum = 0;
+
+	while (n--) sum += mlx_raw_to_celsius(0x3980 + (n & 0xff));
+
+	sink = sum;
+}
+
+/* decode one period (same as detect_pwm_win in mlx_pwm.c) */
+static void decode(long n, wave *w)
+{
+	mlx_pwm_dec	d;
+	long		i;
+	double		sum = 0;
+
+	while (n--)
+	{
+		mlx_pwm_dec_init(&d);
+
+		for (i = 0; i < w->num; i++)
+			if (mlx_pwm_dec_step(&d, w->level[i], i * w->step) == MLX_PWM_DONE) break;
+
+		if (i == w->num) fail("pwm decode", MLX_ERR_DATA);
+
+		sum += mlx_pwm_celsius((d.stop_high - d.start_high) / d.cycle_time, 0x5b, 0x9c3);
+	}
+
+	sink = sum;
+}
+
+static void b_pwm_1k(long n)	{ decode(n, &pwm_1k); }
+static void b_pwm_10(long n)	{ decode(n, &pwm_10); }
+
+/* decode BITS_PERIODS periods from a bitstream */
+static void b_pwm_bits(long n)
+{
+	mlx_pwm_bits r;
+	double		sum = 0;
+	int			ret;
+
+	while (n--)
+	{
+		if ((ret = mlx_pwm_bits_decode(bits_1k, NULL, BITS_SPP * (BITS_PERIODS + 1), &r)) != MLX_OK)
+			fail("pwm bits", ret);
+
+		sum += r.duty;
+	}
+
+	sink = sum;
+}
+
+static void b_popcount_scalar(long n)
+{
+	uint64_t sum = 0;
+
+	while (n--) sum += mlx_popcount_scalar(pop_buf, POP_WORDS);
+
+	sink = sum;
+}
+
+static void b_popcount_simd(long n)
+{
+	uint64_t sum = 0;
+
+	while (n--) sum += mlx_popcount(pop_buf, POP_WORDS);
+
+	sink = sum;
+}
+
+/* compensation of To (emissivity 0.3, reflected 35C, window 0.9) */
+static void b_comp_sample(long n)
+{
+	double	sum = 0;
+	int		i;
+
+	while (n--)
+	{
+		i = n & (COMP_SAMPLES - 1);
+		sum += mlx_comp_to(&comp, mlx_raw_to_celsius(comp_to[i]), mlx_raw_to_celsius(comp_ta[i]));
+	}
+
+	sink = sum;
+}
+
+static void b_comp_scalar(long n)
+{
+	while (n--) mlx_comp_raw_scalar(&comp, comp_to, comp_ta, comp_out, COMP_SAMPLES);
+
+	sink = comp_out[0];
+}
+
+static void b_comp_simd(long n)
+{
+	while (n--) mlx_comp_raw(&comp, comp_to, comp_ta, comp_out, COMP_SAMPLES);
+
+	sink = comp_out[0];
+}
+
+/* statistics over STATS_WINDOW readings : an update, and the summary */
+static void b_stats_add(long n)
+{
+	while (n--) mlx_stats_add(stats, mlx_raw_to_celsius(comp_to[n & (COMP_SAMPLES - 1)]));
+}
+
+static void b_stats_get(long n)
+{
+	mlx_summary r;
+
+	while (n--) mlx_stats_get(stats, &r);
+
+	sink = r.p99;
+}
+
+/* 4 alarm rules on a sample of a sensor every 10ms */
+static void b_alarm_update(long n)
+{
+	mlx_alarm_ev ev[MLX_ALARM_MAX];
+	long	events = 0;
+	int		i;
+
+	while (n--)
+	{
+		i = n & (COMP_SAMPLES - 1);
+		events += mlx_alarm_update(alarms, 0, (uint64_t) (n + 1) * 10 * MS, mlx_raw_to_celsius(comp_ta[i]),
+			mlx_raw_to_celsius(comp_to[i]), ev, MLX_ALARM_MAX);
+	}
+
+	sink = events;
+}
+
+/* unit IDs of one batch : only the low bits differ */
+static uint32_t fleet_id(long i)
+{
+	return(0x64c70000 + (uint32_t) (i % FLEET_UNITS) * 3 + 1);
+}
+
+static void b_fleet_find(long n)
+{
+	mlx_unit *u;
+	long	sum = 0;
+
+	while (n--)
+	{
+		if ((u = mlx_fleet_find(fleet, fleet_id(n))) == NULL) fail("fleet find", MLX_ERR_DATA);
+		sum += u->addr;
+	}
+
+	sink = sum;
+}
+
+/* add a unit and remove it again */
+static void b_fleet_add_del(long n)
+{
+	while (n--)
+	{
+		if (mlx_fleet_add(fleet, 0x12340000 + (uint32_t) (n & 0xffff)) == NULL) fail("fleet add", MLX_ERR_NOMEM);
+		mlx_fleet_del(fleet, 0x12340000 + (uint32_t) (n & 0xffff));
+	}
+}
+
+static void b_sample_sync(long n)
+{
+	double	ta, to;
+	int		ret;
+
+	while (n--)
+	{
+		if ((ret = mlx_read_temp(dev, MLX_RAM_TA, &ta)) != MLX_OK) fail("read Ta", ret);
+		if ((ret = mlx_read_temp(dev, MLX_RAM_TO, &to)) != MLX_OK) fail("read To", ret);
+	}
+
+	sink = ta + to;
+}
+
+/* submit Ta + To and wait on the event fd for both */
+static void b_sample_async(long n)
+{
+	struct pollfd pfd;
+	mlx_op	op[2], *done[2];
+	int		got, ret;
+
+	memset(op, 0, sizeof(op));
+	op[0].op = op[1].op = MLX_OP_READ_RAM;
+	op[0].loc = MLX_RAM_TA;
+	op[1].loc = MLX_RAM_TO;
+
+	pfd.fd = mlx_event_fd(bus);
+	pfd.events = POLLIN;
+
+	while (n--)
+	{
+		if ((ret = mlx_submit(dev, &op[0])) != MLX_OK) fail("submit", ret);
+		if ((ret = mlx_submit(dev, &op[1])) != MLX_OK) fail("submit", ret);
+
+		for (got = 0; got < 2; )
+		{
+			poll(&pfd, 1, -1);
+			got += mlx_complete(bus, done + got, 2 - got);
+		}
+
+		if (op[0].result != MLX_OK || op[1].result != MLX_OK) fail("async", op[0].result ? op[0].result : op[1].result);
+	}
+
+	sink = op[0].val + op[1].val;
+}
+
+/* sleep, wake-up and first sample */
+static void b_sleep_wake(long n)
+{
+	double	to;
+	int		ret;
+
+	while (n--)
+	{
+		if ((ret = mlx_sleep(dev)) != MLX_OK) fail("sleep", ret);
+		if ((ret = mlx_wake(dev)) != MLX_OK) fail("wake", ret);
+		if ((ret = mlx_read_temp(dev, MLX_RAM_TO, &to)) != MLX_OK) fail("read To", ret);
+	}
+
+	sink = to;
+}
+
+/* fault profile : window start is relative to the start of the profile */
+typedef struct profile {
+	const char	*name;
+	mlx_sim_fault f;
+} profile;
+
+static const profile profiles[] = {
+	{"none",			{MLX_FAULT_NACK, 0, 0}},
+	{"pec_1pct",		{MLX_FAULT_PEC, 0, 0.01}},
+	{"nack_1pct",		{MLX_FAULT_NACK, 0, 0.01}},
+	{"clkt_1pct",		{MLX_FAULT_CLKT, 0, 0.01}},
+	{"short_1pct",		{MLX_FAULT_SHORT, 0, 0.01}},
+	{"nack_200ms",		{MLX_FAULT_NACK, 0x5b, 1, 1 * SEC, 200 * MS, 10 * SEC}},
+	{"stuck_sda_50ms",	{MLX_FAULT_STUCK, 0, 1, 1 * SEC, 50 * MS, 10 * SEC}},
+	{"drop_2s",			{MLX_FAULT_DROP, 0x5b, 1, 1 * SEC, 2 * SEC, 60 * SEC}},
+	{NULL}
+};
+
+static const bench benches[] = {
+	{"crc8",			b_crc8,			0},
+	{"read_reg",		b_read_reg,		B_BUS},
+	{"write_reg",		b_write_reg,	B_BUS},
+	{"bus_scan",		b_scan,			B_BUS},
+	{"emiss_types",		b_emiss_types,	0},
+	{"emiss_type",		b_emiss_type,	0},
+	{"emiss_wildcard",	b_emiss_wild,	0},
+	{"emiss_db_open_20k",	b_emiss_open,	0},
+	{"emiss_type_20k",	b_emiss_big_type,	0},
+	{"emiss_wildcard_20k",	b_emiss_big_wild,	0},
+	{"emiss_fuzzy",		b_emiss_fuzzy,	0},
+	{"emiss_fuzzy_20k",	b_emiss_big_fuzzy,	0},
+	{"raw_to_celsius",	b_raw_celsius,	0},
+	{"pwm_decode_1khz",	b_pwm_1k,		0},
+	{"pwm_decode_10hz",	b_pwm_10,		0},
+	{"pwm_bits_1khz",	b_pwm_bits,		0},
+	{"popcount_scalar",	b_popcount_scalar,	0},
+	{"popcount_simd",	b_popcount_simd,	0},
+	{"comp_sample",		b_comp_sample,	0},
+	{"comp_scalar_4k",	b_comp_scalar,	0},
+	{"comp_simd_4k",	b_comp_simd,	0},
+	{"stats_add",		b_stats_add,	0},
+	{"stats_get_3600",	b_stats_get,	0},
+	{"alarm_update",	b_alarm_update,	0},
+	{"fleet_find",		b_fleet_find,	0},
+	{"fleet_add_del",	b_fleet_add_del,	0},
+	{"sample_sync",		b_sample_sync,	B_BUS | B_SAMPLE},
+	{"sample_async",	b_sample_async,	B_BUS | B_SAMPLE},
+	{"sleep_wake",		b_sleep_wake,	B_BUS},
+	{NULL, NULL, 0}
+};
+
+/** setup */
+
+/* sample a generator every step into a bitstream of nbits
+ * return the bitstream (free() it) */
+static uint64_t *make_bits(mlx_pwm_gen *g, uint64_t t, double step_ns, long nbits)
+{
+	uint64_t	*w;
+	long		i;
+
+	if ((w = calloc((nbits + 63) / 64, sizeof(uint64_t))) == NULL) fail("bitstream", MLX_ERR_NOMEM);
+
+	for (i = 0; i < nbits; i++)
+		if (mlx_pwm_gen_level(g, t + (uint64_t) (i * step_ns))) w[i >> 6] |= 1ULL << (i & 63);
+
+	return(w);
+}
+
+/* create a PWM waveform of 2.5 periods, starting half way a high
+ * @param freq : PWM frequency (Hz)
+ * @param duty : duty cycle (0 - 1)
+ * @param step : time between samples (us) */
+static void make_wave(wave *w, double freq, double duty, double step)
+{
+	mlx_pwm_gen	g;
+	double		period = 1e6 / freq;
+	long		i;
+
+	mlx_pwm_gen_init(&g, freq, duty);
+
+	w->step = step;
+	w->num = (long) (2.5 * period / step);
+
+	if ((w->level = malloc(w->num)) == NULL) fail("wave", MLX_ERR_NOMEM);
+
+	for (i = 0; i < w->num; i++)
+		w->level[i] = mlx_pwm_gen_level(&g, (uint64_t) ((i * step + duty * period / 2) * 1000));
+}
+
+static int cmp_float(const void *a, const void *b)
+{
+	float x = *(const float *) a, y = *(const float *) b;
+
+	return((x > y) - (x < y));
+}
+
+static void setup()
+{
+	mlx_pwm_gen	g;
+	mlx_unit	*u;
+	lookuptab	*tab;
+	char		fleet_path[] = "/tmp/mlx_bench.XXXXXX", *names;
+	mlx_summary	st;
+	float		win[STATS_WINDOW];
+	static const char *alarm_rules[4] = { "to>40:2", "to<5:1", "to+50", "ta-1:0.5" };
+	mlx_alarm_rule rule;
+	mlx_alarm_ev alarm_ev[MLX_ALARM_MAX];
+	double		x;
+	int	i, k, ret;
+
+	if ((sim = mlx_sim_new()) == NULL) fail("simulation", MLX_ERR_NOMEM);
+
+	for (i = 0; i < BENCH_DEVS; i++)
+	{
+		if ((ret = mlx_sim_add(sim, 0x5b + i, 0x64c744 + i)) != MLX_OK) fail("add device", ret);
+		mlx_sim_set_temp(sim, 0x5b + i, 21.5, 36.8);
+	}
+
+	if ((bus = mlx_bus_open_sim(sim)) == NULL) fail("bus", MLX_ERR_BUS);
+	if ((dev = mlx_open(bus, 0x5b, 0)) == NULL) fail("device", MLX_ERR_NOMEM);
+
+	make_wave(&pwm_1k, 1000, 0.6, 1);
+	make_wave(&pwm_10, 10, 0.6, 10);
+
+	mlx_pwm_gen_init(&g, 1000, 0.6);
+	bits_1k = make_bits(&g, 300000, 1e6 / BITS_SPP, BITS_SPP * (BITS_PERIODS + 1));
+
+	for (i = 0; i < POP_WORDS; i++) pop_buf[i] = (uint64_t) i * 0x9e3779b97f4a7c15ULL;
+
+	// To 0 - 150C, Ta 15 - 40C : the kernel has to agree with one sample at a time
+	mlx_comp_init(&comp);
+	if (mlx_comp_parse(&comp, "0.3:35:0.9") != MLX_OK) fail("compensation", MLX_ERR_PARAM);
+
+	for (i = 0; i < COMP_SAMPLES; i++)
+	{
+		comp_to[i] = (uint16_t) ((273.15 + (i * 37 % 1500) / 10.0) / 0.02);
+		comp_ta[i] = (uint16_t) ((273.15 + 15 + (i * 11 % 250) / 10.0) / 0.02);
+	}
+
+	mlx_comp_raw(&comp, comp_to, comp_ta, comp_out, COMP_SAMPLES);
+
+	for (i = 0; i < COMP_SAMPLES; i++)
+	{
+		x = mlx_comp_to(&comp, mlx_raw_to_celsius(comp_to[i]), mlx_raw_to_celsius(comp_ta[i]));
+
+		if (! isnan(x) != ! isnan(comp_out[i]) || fabs(x - comp_out[i]) > 0.01) fail("compensation kernel", MLX_ERR_DATA);
+	}
+
+	// statistics : mean, min and max as over the window, quantiles within 2%
+	if ((stats = mlx_stats_new(STATS_WINDOW)) == NULL) fail("statistics", MLX_ERR_NOMEM);
+
+	for (i = 0; i < 2 * STATS_WINDOW + 123; i++) mlx_stats_add(stats, mlx_raw_to_celsius(comp_to[i & (COMP_SAMPLES - 1)]));
+
+	for (x = 0, k = 0; k < STATS_WINDOW; k++)
+	{
+		win[k] = (float) mlx_raw_to_celsius(comp_to[(i - STATS_WINDOW + k) & (COMP_SAMPLES - 1)]);
+		x += win[k];
+	}
+
+	qsort(win, STATS_WINDOW, sizeof(float), cmp_float);
+	mlx_stats_get(stats, &st);
+
+	if (st.n != STATS_WINDOW || fabs(st.mean - x / STATS_WINDOW) > 0.001 ||
+		st.min != win[0] || st.max != win[STATS_WINDOW - 1] ||
+		st.p50 < win[STATS_WINDOW * 48 / 100] || st.p50 > win[STATS_WINDOW * 52 / 100] ||
+		st.p95 < win[STATS_WINDOW * 93 / 100] || st.p95 > win[STATS_WINDOW * 97 / 100] ||
+		st.p99 < win[STATS_WINDOW * 97 / 100]) fail("statistics", MLX_ERR_DATA);
+
+	// alarms : a ramp of 10C/s from 30C (sample every 7ms from 7ms) crosses 40C at 1007ms
+	if ((alarms = mlx_alarm_new(1)) == NULL) fail("alarms", MLX_ERR_NOMEM);
+
+	for (i = 0; i < 4; i++)
+		if (mlx_alarm_parse(&rule, alarm_rules[i]) != MLX_OK || mlx_alarm_add(alarms, &rule) != i)
+			fail("alarm rule", MLX_ERR_PARAM);
+
+	for (i = 0, k = 0; i <= 150 && k == 0; i++)
+		k = mlx_alarm_update(alarms, 0, (uint64_t) (i + 1) * 7 * MS, 25, 30 + i * 0.07, alarm_ev, MLX_ALARM_MAX);
+
+	if (k != 1 || alarm_ev[0].rule != 0 || alarm_ev[0].cross_ns < 1006 * MS || alarm_ev[0].cross_ns > 1008 * MS)
+		fail("alarm crossing", MLX_ERR_DATA);
+
+	mlx_alarm_reset(alarms, 0);
+
+	// registry in a temporary file
+	if ((i = mkstemp(fleet_path)) < 0) fail("fleet file", MLX_ERR_PARAM);
+	close(i);
+
+	if ((fleet = mlx_fleet_open(fleet_path, 0)) == NULL) fail("fleet", MLX_ERR_PARAM);
+	unlink(fleet_path);
+
+	for (i = 0; i < FLEET_UNITS; i++)
+		if ((u = mlx_fleet_add(fleet, fleet_id(i))) != NULL) mlx_fleet_place(fleet, u, 0, 0x10 + i % 64);
+
+	// emissivity database of EMISS_TYPES * EMISS_MATS entries, in a file
+	if ((tab = calloc(EMISS_TYPES * EMISS_MATS, sizeof(lookuptab))) == NULL ||
+		(names = malloc(EMISS_TYPES * EMISS_MATS * 32)) == NULL) fail("emissivity table", MLX_ERR_NOMEM);
+
+	for (i = 0; i < EMISS_TYPES * EMISS_MATS; i++)
+	{
+		tab[i].type = names + i * 32;
+		tab[i].material = names + i * 32 + 10;
+		sprintf(tab[i].type, "Type %03d", i / EMISS_MATS);
+		sprintf(tab[i].material, "Material %05d", i);
+		tab[i].temp = "68 (20)";
+		tab[i].emis = "0.5";
+	}
+
+	if ((i = mkstemp(emiss_path)) < 0) fail("emissivity file", MLX_ERR_PARAM);
+	close(i);
+
+	if ((emiss_big = emiss_db_build(tab, EMISS_TYPES * EMISS_MATS)) == NULL ||
+		emiss_db_save(emiss_big, emiss_path) < 0) fail("emissivity database", MLX_ERR_NOMEM);
+
+	emiss_db_close(emiss_big);
+
+	if ((emiss_big = emiss_db_open(emiss_path)) == NULL) fail("emissivity database", MLX_ERR_DATA);
+
+	free(tab);
+	free(names);
+}
+
+/** fault profiles */
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return(x < y ? -1 : x > y);
+}
+
+/* read with retries and back-off
+ * @param retries : to add the number of retries
+ * return MLX_OK or error of the last try */
+static int read_retry(int loc, double *val, int max_retry, long *retries)
+{
+	uint64_t backoff = FAULT_BACKOFF;
+	int		ret, i;
+
+	for (i = 0; ; i++)
+	{
+		if ((ret = mlx_read_temp(dev, loc, val)) == MLX_OK || i == max_retry) break;
+
+		mlx_sim_advance(sim, backoff);
+		backoff *= 2;
+		(*retries)++;
+	}
+
+	return(ret);
+}
+
+/* read samples under each fault profile */
+static void run_faults(long samples, int max_retry)
+{
+	const profile *p;
+	mlx_sim_fault f;
+	uint64_t	*lat, start, t;
+	unsigned long injected;
+	double		ta, to;
+	long		i, failed, retries;
+	int			k;
+
+	if ((lat = malloc(samples * sizeof(uint64_t))) == NULL) fail("latency", MLX_ERR_NOMEM);
+
+	printf("{\"faults\": [");
+
+	for (p = profiles; p->name != NULL; p++)
+	{
+		mlx_sim_clear_faults(sim);
+		mlx_sim_seed(sim, 0);
+
+		f = p->f;
+		f.start_ns += mlx_sim_time_ns(sim);
+		if (f.rate > 0) mlx_sim_add_fault(sim, &f);
+
+		failed = retries = 0;
+		start = mlx_sim_time_ns(sim);
+
+		for (i = 0; i < samples; i++)
+		{
+			t = mlx_sim_time_ns(sim);
+
+			if (read_retry(MLX_RAM_TA, &ta, max_retry, &retries) != MLX_OK ||
+				read_retry(MLX_RAM_TO, &to, max_retry, &retries) != MLX_OK)
+			{
+				// off the bus until a power on reset
+				failed++;
+				mlx_por(dev, FAULT_POR_OFF);
+			}
+
+			lat[i] = mlx_sim_time_ns(sim) - t;
+		}
+
+		t = mlx_sim_time_ns(sim) - start;
+
+		for (k = 0, injected = 0; k < MLX_FAULT_NUM; k++) injected += mlx_sim_faults(sim, k);
+
+		qsort(lat, samples, sizeof(uint64_t), cmp_u64);
+
+		printf("%s\n  {\"profile\": \"%s\", \"samples\": %ld, \"failed\": %ld, \"retries\": %ld, "
+			"\"injected\": %lu, \"bus_samples_per_s\": %.1f, \"p50_us\": %.1f, \"p90_us\": %.1f, "
+			"\"p99_us\": %.1f, \"p999_us\": %.1f, \"max_us\": %.1f}",
+			p == profiles ? "" : ",", p->name, samples, failed, retries, injected,
+			(samples - failed) * 1e9 / t,
+			lat[(samples - 1) * 50 / 100] / 1e3, lat[(samples - 1) * 90 / 100] / 1e3,
+			lat[(samples - 1) * 99 / 100] / 1e3, lat[(samples - 1) * 999 / 1000] / 1e3,
+			lat[samples - 1] / 1e3);
+
+		fflush(stdout);
+	}
+
+	printf("\n]}\n");
+
+	mlx_sim_clear_faults(sim);
+	free(lat);
+}
+
+/** PWM capture accuracy */
+
+/* signal profile : PWM of the generator (mlx_pwm_gen) sampled every step */
+typedef struct pwm_profile {
+	const char	*name;
+	double		freq;		// Hz
+	double		jitter_ns;	// edge jitter (standard deviation)
+	double		noise;		// chance of a wrong level
+	double		step_ns;	// time between samples
+} pwm_profile;
+
+static const pwm_profile pwm_profiles[] = {
+	{"1khz",				1000,	0,		0,		1000},
+	{"1khz_jitter_1us",		1000,	1000,	0,		1000},
+	{"1khz_jitter_5us",		1000,	5000,	0,		1000},
+	{"1khz_noise_0.01pct",	1000,	0,		0.0001,	1000},
+	{"10hz",				10,		0,		0,		10000},
+	{"10hz_jitter_100us",	10,		100000,	0,		10000},
+	{"10hz_noise_0.01pct",	10,		0,		0.0001,	10000},
+	{NULL}
+};
+
+/* same as run_pwm() for one profile, with bitstreams of BITS_PERIODS
+ * periods and BITS_SPP samples per period (only the decoding is timed) */
+static void run_pwm_bits(const pwm_profile *p, long captures)
+{
+	mlx_pwm_gen	g;
+	mlx_pwm_bits r;
+	uint64_t	*w, start, spent = 0;
+	double		min = (PWM_T_MIN - 50 * 273.15) / 50, range = PWM_T_RANGE / 50.0;
+	double		temp, err, sum = 0, sum_abs = 0, max_abs = 0, period = 1e9 / p->freq;
+	long		i, failed = 0, nbits = BITS_SPP * (BITS_PERIODS + 1);
+	int			ret;
+
+	for (i = 0; i < captures; i++)
+	{
+		temp = min + range * (i + 0.5) / captures;
+
+		mlx_pwm_gen_init(&g, p->freq, mlx_pwm_duty(temp, PWM_T_MIN, PWM_T_RANGE));
+		g.jitter_ns = p->jitter_ns;
+		g.noise = p->noise;
+		g.seed ^= i;
+		g.rnd ^= (uint64_t) (i + 1) << 32;
+
+		w = make_bits(&g, (uint64_t) (period * 10 + (i * 7919) % 1000 * period / 1000),
+			period / BITS_SPP, nbits);
+
+		start = now_ns();
+		ret = mlx_pwm_bits_decode(w, NULL, nbits, &r);
+		spent += now_ns() - start;
+
+		free(w);
+
+		if (ret != MLX_OK)
+		{
+			failed++;
+			continue;
+		}
+
+		err = mlx_pwm_celsius(r.duty, PWM_T_MIN, PWM_T_RANGE) - temp;
+
+		sum += err;
+		sum_abs += err < 0 ? -err : err;
+		if ((err < 0 ? -err : err) > max_abs) max_abs = err < 0 ? -err : err;
+	}
+
+	if (failed == captures) failed--;		// no division by 0 below
+
+	printf(",\n  {\"profile\": \"%s\", \"method\": \"bits\", \"captures\": %ld, \"failed\": %ld, "
+		"\"ns_per_capture\": %.1f, \"samples_per_capture\": %ld, \"mean_err_c\": %.4f, "
+		"\"mean_abs_err_c\": %.4f, \"max_abs_err_c\": %.4f}",
+		p->name, captures, failed, (double) spent / captures, nbits,
+		sum / (captures - failed), sum_abs / (captures - failed), max_abs);
+
+	fflush(stdout);
+}
+
+/* decode captures over the temperature range for each profile and
+ * compare with the temperature of the signal */
+static void run_pwm(long captures)
+{
+	const pwm_profile *p;
+	mlx_pwm_gen	g;
+	mlx_pwm_dec	d;
+	uint64_t	start, spent, t, end, steps;
+	double		min = (PWM_T_MIN - 50 * 273.15) / 50, range = PWM_T_RANGE / 50.0;
+	double		temp, err, sum, sum_abs, max_abs, period;
+	long		i, failed;
+
+	printf("{\"pwm\": [");
+
+	for (p = pwm_profiles; p->name != NULL; p++)
+	{
+		period = 1e9 / p->freq;
+		sum = sum_abs = max_abs = 0;
+		failed = 0;
+		steps = 0;
+
+		start = now_ns();
+
+		for (i = 0; i < captures; i++)
+		{
+			temp = min + range * (i + 0.5) / captures;
+
+			mlx_pwm_gen_init(&g, p->freq, mlx_pwm_duty(temp, PWM_T_MIN, PWM_T_RANGE));
+			g.jitter_ns = p->jitter_ns;
+			g.noise = p->noise;
+			g.seed ^= i;
+			g.rnd ^= (uint64_t) (i + 1) << 32;
+
+			// start somewhere in a period, give up after 4 periods
+			t = (uint64_t) (period * 10 + (i * 7919) % 1000 * period / 1000);
+			end = t + (uint64_t) (4 * period);
+
+			mlx_pwm_dec_init(&d);
+
+			for ( ; t < end; t += (uint64_t) p->step_ns, steps++)
+				if (mlx_pwm_dec_step(&d, mlx_pwm_gen_level(&g, t), t / 1000.0) == MLX_PWM_DONE) break;
+
+			if (t >= end)
+			{
+				failed++;
+				continue;
+			}
+
+			err = mlx_pwm_celsius((d.stop_high - d.start_high) / d.cycle_time, PWM_T_MIN, PWM_T_RANGE) - temp;
+
+			sum += err;
+			sum_abs += err < 0 ? -err : err;
+			if ((err < 0 ? -err : err) > max_abs) max_abs = err < 0 ? -err : err;
+		}
+
+		spent = now_ns() - start;
+
+		if (failed == captures) failed--;		// no division by 0 below
+
+		printf("%s\n  {\"profile\": \"%s\", \"method\": \"edge\", \"captures\": %ld, \"failed\": %ld, "
+			"\"ns_per_capture\": %.1f, \"samples_per_capture\": %.0f, \"mean_err_c\": %.4f, "
+			"\"mean_abs_err_c\": %.4f, \"max_abs_err_c\": %.4f}",
+			p == pwm_profiles ? "" : ",", p->name, captures, failed,
+			(double) spent / captures, (double) steps / captures,
+			sum / (captures - failed), sum_abs / (captures - failed), max_abs);
+
+		fflush(stdout);
+
+		run_pwm_bits(p, captures / 10 ? captures / 10 : 1);
+	}
+
+	printf("\n]}\n");
+}
+
+/** PWM capture engine scaling */
+
+/* lines in a capture run */
+typedef struct cap_run {
+	int			num;
+	int			fd[CAP_MAX];	// write end of the pipe of each line
+	double		temp[CAP_MAX];	// temperature of each line
+	double		duty[CAP_MAX];
+	volatile int stop;
+	double		max_err;
+} cap_run;
+
+/* generator thread : writes the edges of all lines in real time,
+ * as the kernel would with GPIO lines */
+static void *cap_gen(void *arg)
+{
+	cap_run		*run = arg;
+	mlx_pwm_event e;
+	uint64_t	next[CAP_MAX], now, period = 1000000;		// 1Khz
+	int			high[CAP_MAX], i;
+
+	now = now_ns();
+
+	// spread the rising edges over the period
+	for (i = 0; i < run->num; i++)
+	{
+		next[i] = now + period + period * i / run->num;
+		high[i] = 0;
+	}
+
+	memset(&e, 0, sizeof(e));
+
+	while (! run->stop)
+	{
+		now = now_ns();
+
+		for (i = 0; i < run->num; i++)
+		{
+			while (next[i] <= now)
+			{
+				e.timestamp = next[i];
+				e.id = high[i] ? MLX_PWM_FALLING : MLX_PWM_RISING;
+
+				if (write(run->fd[i], &e, sizeof(e)) != sizeof(e)) break;
+
+				// rising to falling : high time, falling to rising : rest of the period
+				next[i] += (uint64_t) (high[i] ? (1 - run->duty[i]) * period : run->duty[i] * period);
+				high[i] = ! high[i];
+			}
+		}
+
+		usleep(100);
+	}
+
+	return(NULL);
+}
+
+static void cap_reading(const mlx_pwm_reading *r, void *user)
+{
+	cap_run	*run = user;
+	double	err = r->celsius - run->temp[r->line];
+
+	if (err < 0) err = -err;
+	if (err > run->max_err) run->max_err = err;
+}
+
+/* capture 1, 2, 4 .. CAP_MAX lines of 1Khz PWM in one epoll loop and
+ * report the readings per second and CPU use of the loop */
+static void run_capture(long ms)
+{
+	static cap_run run;
+	mlx_pwm_line cfg = {0, PWM_T_MIN, PWM_T_RANGE, MLX_RAM_TO};
+	mlx_pwm_cap	*cap;
+	mlx_pwm_stat st;
+	pthread_t	gen;
+	struct timespec ts;
+	uint64_t	start, cpu, wall;
+	int			p[2], i, ret;
+
+	printf("{\"capture\": [");
+
+	for (run.num = 1; run.num <= CAP_MAX; run.num *= 2)
+	{
+		if ((cap = mlx_pwm_cap_new(cap_reading, &run)) == NULL) fail("capture", MLX_ERR_NOMEM);
+
+		for (i = 0; i < run.num; i++)
+		{
+			if (pipe(p) < 0) fail("pipe", MLX_ERR_NOMEM);
+
+			cfg.pin = i;
+			run.fd[i] = p[1];
+			run.temp[i] = 5 + (i * 7) % 40;
+			run.duty[i] = mlx_pwm_duty(run.temp[i], PWM_T_MIN, PWM_T_RANGE);
+
+			if ((ret = mlx_pwm_cap_add_fd(cap, p[0], &cfg)) < 0) fail("add line", ret);
+		}
+
+		run.stop = 0;
+		run.max_err = 0;
+
+		if (pthread_create(&gen, NULL, cap_gen, &run) != 0) fail("generator", MLX_ERR_NOMEM);
+
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+		cpu = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+		start = now_ns();
+
+		while (now_ns() - start < ms * MS)
+			if ((ret = mlx_pwm_cap_poll(cap, 100)) < 0) fail("poll", ret);
+
+		wall = now_ns() - start;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+		cpu = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec - cpu;
+
+		run.stop = 1;
+		pthread_join(gen, NULL);
+
+		mlx_pwm_cap_stat(cap, &st);
+
+		printf("%s\n  {\"lines\": %d, \"events\": %lu, \"readings\": %lu, \"rejected\": %lu, "
+			"\"readings_per_s\": %.0f, \"cpu_pct\": %.2f, \"ns_per_event\": %.0f, \"max_err_c\": %.4f}",
+			run.num == 1 ? "" : ",", run.num, st.events, st.readings, st.rejected,
+			st.readings * 1e9 / wall, cpu * 100.0 / wall, st.events ? (double) cpu / st.events : 0,
+			run.max_err);
+
+		fflush(stdout);
+
+		for (i = 0; i < run.num; i++) close(run.fd[i]);
+		mlx_pwm_cap_free(cap);
+	}
+
+	printf("\n]}\n");
+}
+
+/** presence monitor */
+
+/* sensors of a run with the presence monitor */
+typedef struct watch_run {
+	mlx_sim		*sim;
+	int			num;
+	uint32_t	id[BENCH_DEVS + 1];
+	mlx_dev		*dev[BENCH_DEVS + 1];
+	int			present[BENCH_DEVS + 1];
+	uint64_t	t_add, t_drop, t_move;		// virtual time of the changes
+	double		added_ms, removed_ms, moved_ms;
+	int			events;
+} watch_run;
+
+/* devices of the run : 4 at start, one added, one dropped, one moved */
+#define WATCH_ID(i)		(0x64c744 + (i))
+#define WATCH_NEW		0x60
+#define WATCH_MOVED		0x7d
+
+static uint64_t watch_time(void *ctx)
+{
+	return(mlx_sim_time_ns(ctx));
+}
+
+static void watch_event(const mlx_watch_ev *ev, void *user)
+{
+	watch_run	*run = user;
+	uint64_t	now = mlx_sim_time_ns(run->sim);
+	int			i;
+
+	run->events++;
+
+	for (i = 0; i < run->num; i++)
+		if (run->id[i] == ev->unit_id) break;
+
+	if (i == run->num)
+	{
+		if (run->num == BENCH_DEVS + 1) return;
+
+		run->id[run->num++] = ev->unit_id;
+	}
+
+	run->dev[i] = ev->dev;
+	run->present[i] = ev->type != MLX_WATCH_REMOVED;
+
+	// first report of each change
+	if (run->t_add && ev->unit_id == WATCH_ID(BENCH_DEVS) && run->added_ms < 0)
+		run->added_ms = (now - run->t_add) / 1e6;
+	else if (run->t_drop && ev->unit_id == WATCH_ID(1) && run->removed_ms < 0)
+		run->removed_ms = (now - run->t_drop) / 1e6;
+	else if (run->t_move && ev->unit_id == WATCH_ID(2) && ev->addr == WATCH_MOVED && run->moved_ms < 0)
+		run->moved_ms = (now - run->t_move) / 1e6;
+}
+
+/* sample all sensors with and without the presence monitor */
+static void run_watch()
+{
+	static const long budgets[] = {0, 250, 500, 1000, 2000, -1};
+	watch_run	run;
+	mlx_sim_fault f;
+	mlx_sim		*ws;
+	mlx_bus		*wb;
+	mlx_dev		*mover;
+	mlx_watch	*w;
+	uint64_t	start, now, t, watch_ns;
+	uint16_t	val;
+	long		rounds, samples, failed;
+	double		ta, to;
+	int			b, i, ret;
+
+	printf("{\"watch\": [");
+
+	for (b = 0; budgets[b] >= 0; b++)
+	{
+		memset(&run, 0, sizeof(run));
+		run.added_ms = run.removed_ms = run.moved_ms = -1;
+
+		if ((ws = mlx_sim_new()) == NULL) fail("simulation", MLX_ERR_NOMEM);
+		if ((wb = mlx_bus_open_sim(ws)) == NULL) fail("bus", MLX_ERR_BUS);
+
+		run.sim = ws;
+		w = NULL;
+
+		if (budgets[b] > 0)
+		{
+			if ((w = mlx_watch_new(wb, watch_event, &run)) == NULL) fail("watch", MLX_ERR_NOMEM);
+			mlx_watch_set_time(w, watch_time, ws);
+		}
+
+		for (i = 0; i < BENCH_DEVS; i++)
+		{
+			if ((ret = mlx_sim_add(ws, 0x5b + i, WATCH_ID(i))) != MLX_OK) fail("add device", ret);
+			mlx_sim_set_temp(ws, 0x5b + i, 21.5, 36.8);
+
+			if ((run.dev[i] = mlx_open(wb, 0x5b + i, 0)) == NULL) fail("device", MLX_ERR_NOMEM);
+			if (w && (ret = mlx_watch_attach(w, run.dev[i], WATCH_ID(i))) != MLX_OK) fail("attach", ret);
+
+			run.id[i] = WATCH_ID(i);
+			run.present[i] = 1;
+		}
+
+		run.num = BENCH_DEVS;
+		rounds = samples = failed = 0;
+		watch_ns = 0;
+		start = mlx_sim_time_ns(ws);
+
+		while ((now = mlx_sim_time_ns(ws) - start) < WATCH_RUN * SEC)
+		{
+			if (! run.t_add && now >= WATCH_ADD * SEC)
+			{
+				mlx_sim_add(ws, WATCH_NEW, WATCH_ID(BENCH_DEVS));
+				mlx_sim_set_temp(ws, WATCH_NEW, 21.5, 36.8);
+				run.t_add = mlx_sim_time_ns(ws);
+			}
+
+			if (! run.t_drop && now >= WATCH_DROP * SEC)
+			{
+				memset(&f, 0, sizeof(f));
+				f.type = MLX_FAULT_DROP;
+				f.addr = 0x5c;
+				f.rate = 1;
+				mlx_sim_add_fault(ws, &f);
+				run.t_drop = mlx_sim_time_ns(ws);
+			}
+
+			/* readdressed by another program. Without erase the address
+			 * becomes the OR of old and new (0x5d -> 0x7d) : after an
+			 * erase it would be on 0x0, where all sensors answer */
+			if (! run.t_move && now >= WATCH_MOVE * SEC)
+			{
+				if ((mover = mlx_open(wb, 0x5d, 0)) == NULL) fail("device", MLX_ERR_NOMEM);
+
+				if ((ret = mlx_read_reg(mover, MLX_REG_PWMSA, &val)) != MLX_OK ||
+					(ret = mlx_write_raw(mover, MLX_REG_PWMSA | 0x10, val | WATCH_MOVED)) != MLX_OK)
+					fail("readdress", ret);
+
+				mlx_close(mover);
+				run.t_move = mlx_sim_time_ns(ws);
+			}
+
+			for (i = 0; i < run.num; i++)
+			{
+				// without monitor the sensors of the start are read
+				if (! run.present[i] || (w == NULL && i >= BENCH_DEVS)) continue;
+
+				if (mlx_read_temp(run.dev[i], MLX_RAM_TA, &ta) == MLX_OK &&
+					mlx_read_temp(run.dev[i], MLX_RAM_TO, &to) == MLX_OK) samples++;
+				else
+					failed++;
+			}
+
+			rounds++;
+
+			if (w)
+			{
+				t = mlx_sim_time_ns(ws);
+				mlx_watch_tick(w, budgets[b] * 1000);
+				watch_ns += mlx_sim_time_ns(ws) - t;
+			}
+		}
+
+		now = mlx_sim_time_ns(ws) - start;
+
+		printf("%s\n  {\"budget_us\": %ld, \"rounds\": %ld, \"samples\": %ld, \"failed\": %ld, "
+			"\"bus_samples_per_s\": %.1f, \"probes\": %lu, \"events\": %d, \"watch_bus_pct\": %.2f, "
+			"\"added_ms\": %.1f, \"removed_ms\": %.1f, \"moved_ms\": %.1f}",
+			b ? "," : "", budgets[b], rounds, samples, failed, samples * 1e9 / now,
+			w ? mlx_watch_probes(w) : 0, run.events, watch_ns * 100.0 / now,
+			run.added_ms, run.removed_ms, run.moved_ms);
+
+		fflush(stdout);
+
+		if (w) mlx_watch_free(w);
+		else for (i = 0; i < BENCH_DEVS; i++) mlx_close(run.dev[i]);
+
+		mlx_bus_close(wb);
+		mlx_sim_free(ws);
+	}
+
+	printf("\n]}\n");
+}
+
+static void cleanup()
+{
+	mlx_close(dev);
+	mlx_bus_close(bus);
+	mlx_sim_free(sim);
+	free(pwm_1k.level);
+	free(pwm_10.level);
+	free(bits_1k);
+	mlx_fleet_close(fleet);
+	emiss_db_close(emiss_big);
+	unlink(emiss_path);
+}
+
+/* run a benchmark with doubling iterations until min_ns
+ * @param bus_ns : to store the bus time per iteration
+ * return ns per iteration */
+static double measure(const bench *b, uint64_t min_ns, long *ops, double *bus_ns)
+{
+	uint64_t	start, spent, bus_start;
+	long		n = 1;
+
+	for (;;)
+	{
+		bus_start = mlx_sim_time_ns(sim);
+		start = now_ns();
+		b->fn(n);
+		spent = now_ns() - start;
+		*bus_ns = (double) (mlx_sim_time_ns(sim) - bus_start) / n;
+
+		if (spent >= min_ns || n >= (1L << 30)) break;
+
+		n *= 2;
+	}
+
+	*ops = n;
+	return((double) spent / n);
+}
+
+int main(int argc, char *argv[])
+{
+	const bench *b;
+	char	*only = NULL;
+	double	ns, bus_ns;
+	long	ops, min_ms = 200, samples = 0;
+	int		c, faults = 0, pwm = 0, capture = 0, watch = 0, max_retry = 3;
+
+	while ((c = getopt(argc, argv, "b:t:fpcwn:r:H")) != -1)
+	{
+		switch(c)
+		{
+			case 'b':	// only benchmarks starting with
+				only = optarg;
+				break;
+
+			case 't':	// minimum time per benchmark
+				min_ms = strtol(optarg, NULL, 10);
+				break;
+
+			case 'f':	// fault profiles
+				faults = 1;
+				break;
+
+			case 'p':	// PWM capture accuracy
+				pwm = 1;
+				break;
+
+			case 'c':	// PWM capture engine scaling
+				capture = 1;
+				break;
+
+			case 'w':	// presence monitor
+				watch = 1;
+				break;
+
+			case 'n':	// samples per fault profile / captures per PWM profile
+				samples = strtol(optarg, NULL, 10);
+				if (samples < 1) samples = 1;
+				break;
+
+			case 'r':	// retries of a failed read
+				max_retry = (int) strtol(optarg, NULL, 10);
+				break;
+
+			default:
+				printf("%s [-b name] [-t min ms] [-f [-n samples] [-r retries]] [-p [-n captures]] [-c [-t ms]] [-w]\n", argv[0]);
+				exit(c == 'H' ? 0 : 1);
+		}
+	}
+
+	if (capture)
+	{
+		// at least a few hundred periods per run
+		run_capture(min_ms < 500 ? 500 : min_ms);
+		exit(0);
+	}
+
+	if (watch)
+	{
+		run_watch();
+		exit(0);
+	}
+
+	if (pwm)
+	{
+		run_pwm(samples ? samples : 1000);
+		exit(0);
+	}
+
+	setup();
+
+	if (faults)
+	{
+		run_faults(samples ? samples : 100000, max_retry);
+		cleanup();
+		exit(0);
+	}
+
+	printf("{\"benchmarks\": [");
+
+	for (b = benches, c = 0; b->name != NULL; b++)
+	{
+		if (only && strncmp(b->name, only, strlen(only))) continue;
+
+		ns = measure(b, min_ms * 1000000, &ops, &bus_ns);
+
+		printf("%s\n  {\"name\": \"%s\", \"ops\": %ld, \"ns_per_op\": %.1f", c++ ? "," : "",
+			b->name, ops, ns);
+
+		if (b->flags & B_SAMPLE) printf(", \"samples_per_s\": %.0f", 1e9 / ns);
+
+		if (b->flags & B_BUS)
+		{
+			printf(", \"bus_ns_per_op\": %.1f", bus_ns);
+
+			if (b->flags & B_SAMPLE) printf(", \"bus_samples_per_s\": %.1f", 1e9 / bus_ns);
+		}
+
+		printf("}");
+		fflush(stdout);
+	}
+
+	printf("\n]}\n");
+
+	cleanup();
+
+	exit(0);
+}
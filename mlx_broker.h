@@ -0,0 +1,65 @@
+/* messages between the bus broker (mlxd) and its clients
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_broker is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_broker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_broker. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The broker and the clients talk over a Unix SOCK_SEQPACKET socket:
+ * one request message, one response message. A request is one bus
+ * transaction of the transport (mlx_bus_ops), so the PEC is still
+ * checked by the client.
+ *
+ * A client can hold the bus for a sequence of transactions (MLXD_HOLD):
+ * requests of other clients wait until it is released (MLXD_RELEASE),
+ * the client leaves or the hold time has passed. Only the holder can
+ * switch the power.
+ */
+
+#ifndef MLX_BROKER_H
+#define MLX_BROKER_H
+
+#include <stdint.h>
+
+/* request types */
+#define MLXD_BEGIN		1		// start I2C (broker keeps the bus started)
+#define MLXD_END		2		// stop I2C (ignored by broker)
+#define MLXD_WRITE		3		// write data[0..len-1] to addr
+#define MLXD_READ		4		// write cmd, repeated start, read len bytes
+#define MLXD_WAKE		5		// SCL low for arg ms
+#define MLXD_POWER		6		// power off (arg = 0) or on (arg = 1), holder only
+#define MLXD_HOLD		7		// hold the bus for arg ms
+#define MLXD_RELEASE	8		// release the bus
+
+/* max hold time (ms) */
+#define MLXD_HOLD_MAX	10000
+
+/* max data in a message */
+#define MLXD_MAX		8
+
+typedef struct mlxd_req {
+	uint8_t		type;			// MLXD_xxx
+	uint8_t		addr;			// slave address
+	uint8_t		cmd;			// command for MLXD_READ
+	uint8_t		len;			// bytes to write / read
+	int32_t		arg;			// MLXD_WAKE / MLXD_POWER / MLXD_HOLD
+	uint8_t		data[MLXD_MAX];	// data to write
+} mlxd_req;
+
+typedef struct mlxd_rsp {
+	int32_t		result;			// MLX_OK or MLX_ERR_xxx
+	uint8_t		len;			// bytes read
+	uint8_t		data[MLXD_MAX];	// data read
+} mlxd_rsp;
+
+#endif /* MLX_BROKER_H */
@@ -0,0 +1,155 @@
+/* libmlx90615 : transport on the BCM2835 I2C of the Raspberry-pi
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_bus_bcm2835 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_bus_bcm2835 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_bus_bcm2835. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * It is assumed that a V2 system is used (SCL = P1_05, power = P1_07)
+ */
+
+#include <bcm2835.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "libmlx90615.h"
+
+#define BCM_SCL_PIN		RPI_V2_GPIO_P1_05
+#define BCM_POWER_PIN	RPI_V2_GPIO_P1_07	// GPIO4
+
+/* translate BCM2835 reason code */
+static int bcm_result(uint8_t reason)
+{
+	switch(reason)
+	{
+		case BCM2835_I2C_REASON_ERROR_NACK : return(MLX_ERR_NACK);
+		case BCM2835_I2C_REASON_ERROR_CLKT : return(MLX_ERR_CLKT);
+		case BCM2835_I2C_REASON_ERROR_DATA : return(MLX_ERR_DATA);
+	}
+	return(MLX_OK);
+}
+
+/* will select I2C channel 0 or 1 depending on board reversion. */
+static int bcm_begin(void *ctx)
+{
+	if (! bcm2835_i2c_begin()) return(MLX_ERR_BUS);
+
+	/* set BSC speed to 100Khz*/
+	bcm2835_i2c_setClockDivider(BCM2835_I2C_CLOCK_DIVIDER_2500);
+
+	return(MLX_OK);
+}
+
+static void bcm_end(void *ctx)
+{
+	bcm2835_i2c_end();
+}
+
+static void bcm_set_addr(void *ctx, uint8_t addr)
+{
+	bcm2835_i2c_setSlaveAddress(addr);
+}
+
+static int bcm_write(void *ctx, const uint8_t *buf, int len)
+{
+	return(bcm_result(bcm2835_i2c_write((const char *) buf, len)));
+}
+
+static int bcm_read_rs(void *ctx, uint8_t cmd, uint8_t *buf, int len)
+{
+	char reg = (char) cmd;
+
+	return(bcm_result(bcm2835_i2c_read_register_rs(&reg, (char *) buf, len)));
+}
+
+/* wakeup MLX or restore from PWM to SMB communication
+ * Datasheet pag. 15 : 8.4.8.2 exit sleep mode :
+ * a low pulse of > 8ms is needed on SCL (measured : at least 17ms) */
+static int bcm_wake(void *ctx, int ms)
+{
+	// reset pins
+	bcm2835_i2c_end();
+
+	// set the SCL pin to output and low
+	bcm2835_gpio_fsel(BCM_SCL_PIN, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_write(BCM_SCL_PIN, LOW);
+
+	mlx_clock_sleep((uint64_t) ms * 1000000);
+
+	return(bcm_begin(ctx));
+}
+
+static void bcm_power(void *ctx, int on)
+{
+	// set the power pin to output
+	bcm2835_gpio_fsel(BCM_POWER_PIN, BCM2835_GPIO_FSEL_OUTP);
+
+	if (on) bcm2835_gpio_write(BCM_POWER_PIN, HIGH);
+	else 	bcm2835_gpio_write(BCM_POWER_PIN, LOW);
+}
+
+static void bcm_close(void *ctx)
+{
+	// release BCM2835 library
+	bcm2835_close();
+}
+
+static const mlx_bus_ops bcm_ops = {
+	bcm_begin,
+	bcm_end,
+	bcm_set_addr,
+	bcm_write,
+	bcm_read_rs,
+	bcm_wake,
+	bcm_power,
+	bcm_close,
+};
+
+static void bcm_gpio_fsel(void *ctx, uint8_t pin, int mode)
+{
+	bcm2835_gpio_fsel(pin, mode == MLX_GPIO_OUT ? BCM2835_GPIO_FSEL_OUTP : BCM2835_GPIO_FSEL_INPT);
+}
+
+static void bcm_gpio_write(void *ctx, uint8_t pin, int level)
+{
+	bcm2835_gpio_write(pin, level ? HIGH : LOW);
+}
+
+static int bcm_gpio_lev(void *ctx, uint8_t pin)
+{
+	return(bcm2835_gpio_lev(pin) == HIGH);
+}
+
+/* the BCM2835 library is released with the bus */
+static const mlx_gpio_ops bcm_gpio_ops = {
+	bcm_gpio_fsel,
+	bcm_gpio_write,
+	bcm_gpio_lev,
+	NULL,
+};
+
+mlx_gpio *mlx_gpio_open_bcm2835(void)
+{
+	return(mlx_gpio_new(&bcm_gpio_ops, NULL));
+}
+
+mlx_bus *mlx_bus_open_bcm2835(void)
+{
+	mlx_bus *bus;
+
+	if (! bcm2835_init()) return(NULL);
+
+	if ((bus = mlx_bus_new(&bcm_ops, NULL)) == NULL) bcm2835_close();
+
+	return(bus);
+}
@@ -0,0 +1,209 @@
+/* libmlx90615 : transport on the bus broker (mlxd)
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_bus_broker is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_bus_broker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_bus_broker. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Each transaction is sent to the broker, that does it on the real
+ * bus. The broker keeps the bus started, so begin and end do nothing
+ * on the bus.
+ *
+ * Only the client that holds the bus can switch the power : when the
+ * power is switched off without a hold, the bus is held until it is
+ * switched on again (a POR).
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "libmlx90615.h"
+#include "mlx_broker.h"
+
+typedef struct broker {
+	int		fd;
+	uint8_t	addr;		// slave address for next transaction
+	int		held;		// holds not released (nested)
+	int		por;		// held for the power off only
+} broker;
+
+/* send a request and wait for the response */
+static int broker_xfer(broker *b, mlxd_req *req, mlxd_rsp *rsp)
+{
+	req->addr = b->addr;
+
+	if (send(b->fd, req, sizeof(mlxd_req), 0) != sizeof(mlxd_req))
+		return(MLX_ERR_BUS);
+
+	if (recv(b->fd, rsp, sizeof(mlxd_rsp), 0) != sizeof(mlxd_rsp))
+		return(MLX_ERR_BUS);
+
+	return(rsp->result);
+}
+
+/* simple request without data */
+static int broker_cmd(broker *b, int type, int arg)
+{
+	mlxd_req	req = {0};
+	mlxd_rsp	rsp;
+
+	req.type = type;
+	req.arg = arg;
+
+	return(broker_xfer(b, &req, &rsp));
+}
+
+static int broker_begin(void *ctx)
+{
+	return(broker_cmd(ctx, MLXD_BEGIN, 0));
+}
+
+static void broker_end(void *ctx)
+{
+	broker_cmd(ctx, MLXD_END, 0);
+}
+
+static void broker_set_addr(void *ctx, uint8_t addr)
+{
+	((broker *) ctx)->addr = addr;
+}
+
+static int broker_write(void *ctx, const uint8_t *buf, int len)
+{
+	mlxd_req	req = {0};
+	mlxd_rsp	rsp;
+
+	if (len > MLXD_MAX) return(MLX_ERR_PARAM);
+
+	req.type = MLXD_WRITE;
+	req.len = len;
+	memcpy(req.data, buf, len);
+
+	return(broker_xfer(ctx, &req, &rsp));
+}
+
+static int broker_read_rs(void *ctx, uint8_t cmd, uint8_t *buf, int len)
+{
+	mlxd_req	req = {0};
+	mlxd_rsp	rsp;
+	int			ret;
+
+	if (len > MLXD_MAX) return(MLX_ERR_PARAM);
+
+	req.type = MLXD_READ;
+	req.cmd = cmd;
+	req.len = len;
+
+	if ((ret = broker_xfer(ctx, &req, &rsp)) != MLX_OK) return(ret);
+
+	if (rsp.len != len) return(MLX_ERR_DATA);
+
+	memcpy(buf, rsp.data, len);
+	return(MLX_OK);
+}
+
+static int broker_wake(void *ctx, int ms)
+{
+	return(broker_cmd(ctx, MLXD_WAKE, ms));
+}
+
+static int broker_hold(void *ctx, int ms)
+{
+	broker	*b = ctx;
+	int		ret;
+
+	// the bus is released with the outer hold
+	if (ms == 0)
+	{
+		if (b->held == 0 || --b->held > 0) return(MLX_OK);
+		return(broker_cmd(b, MLXD_RELEASE, 0));
+	}
+
+	if (ms > MLXD_HOLD_MAX) ms = MLXD_HOLD_MAX;
+
+	// a nested hold can only extend the time
+	if ((ret = broker_cmd(b, MLXD_HOLD, ms)) == MLX_OK) b->held++;
+
+	return(ret);
+}
+
+static void broker_power(void *ctx, int on)
+{
+	broker *b = ctx;
+
+	if (! on && ! b->held && broker_hold(b, MLXD_HOLD_MAX) == MLX_OK) b->por = 1;
+
+	broker_cmd(b, MLXD_POWER, on);
+
+	if (on && b->por)
+	{
+		b->por = 0;
+		broker_hold(b, 0);
+	}
+}
+
+static void broker_close(void *ctx)
+{
+	broker *b = ctx;
+
+	close(b->fd);
+	free(b);
+}
+
+static const mlx_bus_ops broker_ops = {
+	broker_begin,
+	broker_end,
+	broker_set_addr,
+	broker_write,
+	broker_read_rs,
+	broker_wake,
+	broker_power,
+	broker_close,
+	broker_hold,
+};
+
+mlx_bus *mlx_bus_open_broker(const char *path)
+{
+	struct sockaddr_un	sa;
+	broker	*b;
+	mlx_bus	*bus;
+
+	if (path == NULL) path = MLXD_SOCKET;
+
+	if (strlen(path) >= sizeof(sa.sun_path)) return(NULL);
+
+	if ((b = calloc(1, sizeof(broker))) == NULL) return(NULL);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, path);
+
+	if ((b->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) < 0)
+	{
+		free(b);
+		return(NULL);
+	}
+
+	if (connect(b->fd, (struct sockaddr *) &sa, sizeof(sa)) < 0 ||
+		(bus = mlx_bus_new(&broker_ops, b)) == NULL)
+	{
+		close(b->fd);
+		free(b);
+		return(NULL);
+	}
+
+	return(bus);
+}
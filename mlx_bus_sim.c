@@ -0,0 +1,759 @@
+/* libmlx90615 : simulated bus with simulated MLX90615
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_bus_sim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_bus_sim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_bus_sim. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A simulated device :
+ * - answers on its slave address (EEPROM 0x0, bit 0 - 6) and on 0x0
+ * - reads the EEPROM (opcode 0x1x) and RAM (opcode 0x2x) with PEC
+ * - ignores a write with a wrong PEC
+ * - an EEPROM write of 0x0000 erases a register, writing a register
+ *   that is not erased gives the OR of old and new value.
+ *   Only the user registers (0x0 - 0x3) can be written.
+ * - does not answer in sleep (0xc6) until a wake-up pulse
+ * - after power on reset starts in PWM mode if config bit 0 is 0 and
+ *   does not answer until an SMBus request (same as wake-up pulse)
+ *
+ * Timing : there is no waiting, each transaction advances a virtual
+ * clock with the time it takes on the real bus (mlx_sim_timing). The
+ * bit time follows from the clock divider, a byte takes 9 bits (with
+ * acknowledge). A device that is busy (EEPROM write, wake-up, power on)
+ * is waited for : the transaction starts when the device is ready.
+ * With mlx_sim_set_clock() the virtual time is kept at least at the
+ * time of a (virtual) clock, so host sleeps count as bus time.
+ *
+ * Faults (mlx_sim_add_fault) hit a transaction with a rate, within a
+ * (repeating) window of virtual time. The random numbers come from a
+ * generator with a fixed seed, so a run with faults is repeatable.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "libmlx90615.h"
+
+/* minimum SCL low pulse to wake-up / SMBus request (ms) */
+#define SIM_WAKE_MIN	8
+
+/* factory EEPROM (from a real MLX90615, see mlx90615.h) */
+static const uint16_t sim_eeprom[16] = {
+	0x005b, 0x09c3, 0x14d9, 0x4000, 0x6a67, 0x355a, 0x431c, 0x2011,
+	0x003d, 0x8011, 0x1d19, 0x0269, 0x1a7a, 0x3a3c, 0xc744, 0x0064
+};
+
+/* RAM of the same device */
+static const uint16_t sim_ram[16] = {
+	0x39c4, 0x00c1, 0x060e, 0x82f8, 0x1a44, 0x8036, 0x39c6, 0x39aa,
+	0x8004, 0x8003, 0x05ea, 0x0001, 0x05f6, 0x024b, 0x02f3, 0x03bc
+};
+
+typedef struct sim_dev {
+	int			used;
+	uint16_t	eeprom[16];
+	uint16_t	ram[16];
+	int			sleep;		// in sleep mode
+	int			pwm;		// in PWM mode
+	int			dropped;	// dropped off the bus (fault) until power on reset
+	uint64_t	ready;		// virtual time the device is ready
+} sim_dev;
+
+struct mlx_sim {
+	pthread_mutex_t lock;	// set_temp from other threads
+	sim_dev		dev[MLX_SIM_MAX];
+	uint8_t		addr;		// slave address of next transaction
+	int			power;
+	unsigned long transfers;
+	mlx_sim_timing tm;
+	double		bit_ns;		// SCL period
+	uint64_t	now;		// virtual time (ns)
+	mlx_clock	*clock;		// follow this clock (or NULL)
+	mlx_sim_fault fault[MLX_SIM_FAULTS];
+	int			num_fault;
+	unsigned long fault_cnt[MLX_FAULT_NUM];
+	uint64_t	rnd;		// random generator state
+	mlx_pwm_gen	pwm;		// PWM signal on SDA
+};
+
+/* pins of the simulated GPIO */
+#define SIM_PINS		64
+
+typedef struct sim_gpio {
+	mlx_sim		*sim;
+	uint8_t		sda;
+	uint64_t	sample_ns;	// time of a read
+	uint8_t		out[SIM_PINS];		// set for output
+	uint8_t		level[SIM_PINS];	// level written
+} sim_gpio;
+
+/* default seed of the random generator */
+#define SIM_SEED	0x9e3779b97f4a7c15ULL
+
+mlx_sim *mlx_sim_new(void)
+{
+	mlx_sim *sim;
+
+	if ((sim = calloc(1, sizeof(mlx_sim))) == NULL) return(NULL);
+
+	pthread_mutex_init(&sim->lock, NULL);
+	sim->power = 1;
+	sim->rnd = SIM_SEED;
+
+	mlx_sim_timing_default(&sim->tm);
+	mlx_sim_set_timing(sim, &sim->tm);
+
+	mlx_pwm_gen_init(&sim->pwm, 1000, 0);
+
+	return(sim);
+}
+
+void mlx_sim_free(mlx_sim *sim)
+{
+	if (sim == NULL) return;
+
+	pthread_mutex_destroy(&sim->lock);
+	free(sim);
+}
+
+/* find the device on a slave address (0x0 = any device) */
+static sim_dev *sim_find(mlx_sim *sim, uint8_t addr)
+{
+	int i;
+
+	for (i = 0; i < MLX_SIM_MAX; i++)
+	{
+		if (! sim->dev[i].used) continue;
+
+		if (addr == 0 || (sim->dev[i].eeprom[0] & 0x7f) == addr) return(&sim->dev[i]);
+	}
+
+	return(NULL);
+}
+
+/* catch up with the clock that is followed (lock held) */
+static void sim_sync(mlx_sim *sim)
+{
+	uint64_t t;
+
+	if (sim->clock == NULL) return;
+
+	if ((t = mlx_clock_read(sim->clock)) > sim->now) sim->now = t;
+}
+
+/* return a random number (xorshift64*) */
+static uint64_t sim_rand(mlx_sim *sim)
+{
+	sim->rnd ^= sim->rnd >> 12;
+	sim->rnd ^= sim->rnd << 25;
+	sim->rnd ^= sim->rnd >> 27;
+
+	return(sim->rnd * 0x2545f4914f6cdd1dULL);
+}
+
+/* check for a fault on a transaction (lock held)
+ * @param type : MLX_FAULT_xxx
+ * @param addr : device (0 = bus wide)
+ * return 1 if the fault hits */
+static int sim_fault(mlx_sim *sim, int type, uint8_t addr)
+{
+	mlx_sim_fault *f;
+	uint64_t	t;
+	int			i;
+
+	for (i = 0; i < sim->num_fault; i++)
+	{
+		f = &sim->fault[i];
+
+		if (f->type != type || (f->addr && addr && f->addr != addr)) continue;
+
+		// outside the window
+		if (f->len_ns)
+		{
+			if (sim->now < f->start_ns) continue;
+
+			t = sim->now - f->start_ns;
+			if (f->every_ns) t %= f->every_ns;
+			if (t >= f->len_ns) continue;
+		}
+
+		if (f->rate >= 1 || (sim_rand(sim) >> 11) * (1.0 / (1ULL << 53)) < f->rate)
+		{
+			sim->fault_cnt[type]++;
+			return(1);
+		}
+	}
+
+	return(0);
+}
+
+/* advance the virtual time with a number of bit times */
+static void sim_bits(mlx_sim *sim, double bits)
+{
+	sim->now += (uint64_t) (bits * sim->bit_ns + 0.5);
+}
+
+/* a transaction that is not acknowledged : START, address and STOP */
+static int sim_nack(mlx_sim *sim)
+{
+	sim_bits(sim, sim->tm.start_bits + 9 + sim->tm.stop_bits);
+	return(MLX_ERR_NACK);
+}
+
+/* start of a transaction (lock held) : find the device that answers
+ * on the bus and wait till it is ready
+ * @param pd : to store the device
+ * return MLX_OK or error (time of the failed transaction is added) */
+static int sim_start(mlx_sim *sim, sim_dev **pd)
+{
+	sim_dev *d;
+	uint8_t	addr;
+
+	sim->transfers++;
+	sim_sync(sim);
+
+	// SDA stuck low : no START condition, master times out
+	if (sim_fault(sim, MLX_FAULT_STUCK, 0))
+	{
+		sim_bits(sim, sim->tm.start_bits + sim->tm.clkt_bits);
+		return(MLX_ERR_DATA);
+	}
+
+	if (! sim->power || (d = sim_find(sim, sim->addr)) == NULL) return(sim_nack(sim));
+
+	addr = d->eeprom[0] & 0x7f;
+
+	// dropped off the bus : gone until a power on reset
+	if (d->dropped || sim_fault(sim, MLX_FAULT_DROP, addr))
+	{
+		d->dropped = 1;
+		return(sim_nack(sim));
+	}
+
+	if (d->sleep || d->pwm || sim_fault(sim, MLX_FAULT_NACK, addr)) return(sim_nack(sim));
+
+	if (d->ready > sim->now) sim->now = d->ready;
+
+	*pd = d;
+	return(MLX_OK);
+}
+
+int mlx_sim_add(mlx_sim *sim, uint8_t addr, uint32_t unit_id)
+{
+	int i;
+
+	if (addr == 0 || addr > 0x7f) return(MLX_ERR_PARAM);
+
+	pthread_mutex_lock(&sim->lock);
+
+	if (sim_find(sim, addr))
+	{
+		pthread_mutex_unlock(&sim->lock);
+		return(MLX_ERR_PARAM);
+	}
+
+	for (i = 0; i < MLX_SIM_MAX; i++)
+	{
+		if (sim->dev[i].used) continue;
+
+		memset(&sim->dev[i], 0, sizeof(sim_dev));
+		memcpy(sim->dev[i].eeprom, sim_eeprom, sizeof(sim_eeprom));
+		memcpy(sim->dev[i].ram, sim_ram, sizeof(sim_ram));
+
+		sim->dev[i].eeprom[0] = addr;
+		sim->dev[i].eeprom[MLX_REG_ID1] = unit_id & 0xffff;
+		sim->dev[i].eeprom[MLX_REG_ID2] = unit_id >> 16;
+		sim->dev[i].used = 1;
+		break;
+	}
+
+	pthread_mutex_unlock(&sim->lock);
+
+	return(i < MLX_SIM_MAX ? MLX_OK : MLX_ERR_PARAM);
+}
+
+int mlx_sim_set_temp(mlx_sim *sim, uint8_t addr, double ta, double to)
+{
+	sim_dev *d;
+
+	if (addr == 0) return(MLX_ERR_PARAM);
+
+	pthread_mutex_lock(&sim->lock);
+
+	if ((d = sim_find(sim, addr)) != NULL)
+	{
+		d->ram[MLX_RAM_TA] = (uint16_t) ((ta + 273.15) * 50 + 0.5);
+		d->ram[MLX_RAM_TO] = (uint16_t) ((to + 273.15) * 50 + 0.5);
+	}
+
+	pthread_mutex_unlock(&sim->lock);
+
+	return(d ? MLX_OK : MLX_ERR_PARAM);
+}
+
+unsigned long mlx_sim_transfers(mlx_sim *sim)
+{
+	return(sim->transfers);
+}
+
+void mlx_sim_timing_default(mlx_sim_timing *t)
+{
+	t->core_hz = 250000000;		// BCM2835 core clock
+	t->divider = 2500;			// BCM2835_I2C_CLOCK_DIVIDER_2500 : 100Khz
+	t->start_bits = 1;
+	t->restart_bits = 1;
+	t->stop_bits = 1;
+	t->stretch_ns = 0;
+	t->clkt_bits = 0x40;		// BCM2835 CLKT register after reset
+	t->eeprom_ns = 5000000;		// datasheet : erase / write 5ms
+	t->sleep_ns = 0;
+	t->wake_ns = 300000000;		// datasheet : first data after 0.3s
+	t->por_ns = 300000000;
+}
+
+void mlx_sim_set_timing(mlx_sim *sim, const mlx_sim_timing *t)
+{
+	pthread_mutex_lock(&sim->lock);
+
+	if (t != &sim->tm) sim->tm = *t;
+	sim->bit_ns = 1e9 * t->divider / t->core_hz;
+
+	pthread_mutex_unlock(&sim->lock);
+}
+
+uint64_t mlx_sim_time_ns(mlx_sim *sim)
+{
+	uint64_t now;
+
+	// 64 bit is not atomic on the Raspberry-pi
+	pthread_mutex_lock(&sim->lock);
+	sim_sync(sim);
+	now = sim->now;
+	pthread_mutex_unlock(&sim->lock);
+
+	return(now);
+}
+
+void mlx_sim_advance(mlx_sim *sim, uint64_t ns)
+{
+	pthread_mutex_lock(&sim->lock);
+	sim_sync(sim);
+	sim->now += ns;
+	pthread_mutex_unlock(&sim->lock);
+}
+
+int mlx_sim_add_fault(mlx_sim *sim, const mlx_sim_fault *f)
+{
+	int ret = MLX_OK;
+
+	if (f->type < 0 || f->type >= MLX_FAULT_NUM) return(MLX_ERR_PARAM);
+
+	pthread_mutex_lock(&sim->lock);
+
+	if (sim->num_fault < MLX_SIM_FAULTS) sim->fault[sim->num_fault++] = *f;
+	else ret = MLX_ERR_PARAM;
+
+	pthread_mutex_unlock(&sim->lock);
+
+	return(ret);
+}
+
+void mlx_sim_clear_faults(mlx_sim *sim)
+{
+	int i;
+
+	pthread_mutex_lock(&sim->lock);
+
+	sim->num_fault = 0;
+
+	for (i = 0; i < MLX_FAULT_NUM; i++) sim->fault_cnt[i] = 0;
+
+	pthread_mutex_unlock(&sim->lock);
+}
+
+void mlx_sim_seed(mlx_sim *sim, uint64_t seed)
+{
+	pthread_mutex_lock(&sim->lock);
+	sim->rnd = seed ? seed : SIM_SEED;
+	sim->pwm.seed = sim->pwm.rnd = sim->rnd;
+	pthread_mutex_unlock(&sim->lock);
+}
+
+unsigned long mlx_sim_faults(mlx_sim *sim, int type)
+{
+	if (type < 0 || type >= MLX_FAULT_NUM) return(0);
+
+	return(sim->fault_cnt[type]);
+}
+
+void mlx_sim_set_clock(mlx_sim *sim, mlx_clock *c)
+{
+	pthread_mutex_lock(&sim->lock);
+	sim->clock = c;
+	sim_sync(sim);
+	pthread_mutex_unlock(&sim->lock);
+}
+
+/** transport routines */
+
+static int sim_begin(void *ctx)
+{
+	return(MLX_OK);
+}
+
+static void sim_end(void *ctx)
+{
+}
+
+static void sim_set_addr(void *ctx, uint8_t addr)
+{
+	((mlx_sim *) ctx)->addr = addr;
+}
+
+/* execute a command written to a device (lock held) */
+static int sim_command(mlx_sim *sim, sim_dev *d, const uint8_t *buf, int len)
+{
+	uint8_t	pbuf[4];
+	int		reg;
+
+	// sleep command
+	if (len == 2 && buf[0] == 0xc6)
+	{
+		pbuf[0] = sim->addr << 1;
+		pbuf[1] = buf[0];
+
+		if (mlx_crc8(0x7, pbuf, 2) == buf[1])
+		{
+			d->sleep = 1;
+			d->ready = sim->now + sim->tm.sleep_ns;
+		}
+	}
+
+	// EEPROM write
+	else if (len == 4 && (buf[0] & 0xf0) == 0x10)
+	{
+		pbuf[0] = sim->addr << 1;
+		memcpy(pbuf + 1, buf, 3);
+		reg = buf[0] & 0xf;
+
+		if (mlx_crc8(0x7, pbuf, 4) == buf[3] && reg <= MLX_REG_EMMIS)
+		{
+			if (buf[1] == 0 && buf[2] == 0) d->eeprom[reg] = 0;
+			else d->eeprom[reg] |= buf[2] << 8 | buf[1];
+
+			d->ready = sim->now + sim->tm.eeprom_ns;
+		}
+	}
+
+	else return(MLX_ERR_DATA);
+
+	return(MLX_OK);
+}
+
+static int sim_write(void *ctx, const uint8_t *buf, int len)
+{
+	mlx_sim	*sim = ctx;
+	sim_dev	*d;
+	int		ret;
+
+	pthread_mutex_lock(&sim->lock);
+
+	if ((ret = sim_start(sim, &d)) != MLX_OK) ;
+
+	// clock stretch time-out after the first byte
+	else if (sim_fault(sim, MLX_FAULT_CLKT, sim->addr))
+	{
+		sim_bits(sim, sim->tm.start_bits + 18 + sim->tm.clkt_bits + sim->tm.stop_bits);
+		ret = MLX_ERR_CLKT;
+	}
+
+	// aborted after the first byte
+	else if (sim_fault(sim, MLX_FAULT_SHORT, sim->addr))
+	{
+		sim_bits(sim, sim->tm.start_bits + 18 + sim->tm.stop_bits);
+		ret = MLX_ERR_DATA;
+	}
+
+	else
+	{
+		// START, address, data and STOP
+		sim_bits(sim, sim->tm.start_bits + 9 * (1 + len) + sim->tm.stop_bits);
+
+		// a corrupted byte fails the PEC check of the device : ignored
+		if (! sim_fault(sim, MLX_FAULT_PEC, sim->addr)) ret = sim_command(sim, d, buf, len);
+	}
+
+	pthread_mutex_unlock(&sim->lock);
+
+	return(ret);
+}
+
+static int sim_read_rs(void *ctx, uint8_t cmd, uint8_t *buf, int len)
+{
+	mlx_sim	*sim = ctx;
+	sim_dev	*d;
+	uint8_t	pbuf[5];
+	uint16_t val;
+	int		ret = MLX_OK;
+
+	pthread_mutex_lock(&sim->lock);
+
+	if ((ret = sim_start(sim, &d)) != MLX_OK) ;
+
+	else if (len != 3 || ((cmd & 0xf0) != 0x10 && (cmd & 0xf0) != 0x20))
+	{
+		sim_bits(sim, sim->tm.start_bits + 18 + sim->tm.stop_bits);
+		ret = MLX_ERR_DATA;
+	}
+
+	// master gives up on a long clock stretch
+	else if (sim->tm.stretch_ns > sim->tm.clkt_bits * sim->bit_ns ||
+		sim_fault(sim, MLX_FAULT_CLKT, sim->addr))
+	{
+		sim_bits(sim, sim->tm.start_bits + 18 + sim->tm.restart_bits + 9 +
+			sim->tm.clkt_bits + sim->tm.stop_bits);
+		ret = MLX_ERR_CLKT;
+	}
+
+	// aborted after the first data byte
+	else if (sim_fault(sim, MLX_FAULT_SHORT, sim->addr))
+	{
+		sim_bits(sim, sim->tm.start_bits + 18 + sim->tm.restart_bits + 18 + sim->tm.stop_bits);
+		ret = MLX_ERR_DATA;
+	}
+
+	else
+	{
+		val = (cmd & 0xf0) == 0x10 ? d->eeprom[cmd & 0xf] : d->ram[cmd & 0xf];
+
+		pbuf[0] = sim->addr << 1;
+		pbuf[1] = cmd;
+		pbuf[2] = sim->addr << 1 | 1;
+		pbuf[3] = val & 0xff;
+		pbuf[4] = val >> 8;
+
+		buf[0] = pbuf[3];
+		buf[1] = pbuf[4];
+		buf[2] = mlx_crc8(0x7, pbuf, 5);
+
+		// flip a bit
+		if (sim_fault(sim, MLX_FAULT_PEC, sim->addr))
+		{
+			val = (uint16_t) (sim_rand(sim) % 24);
+			buf[val / 8] ^= 1 << (val % 8);
+		}
+
+		// START, address, command, repeated START, address, data and STOP
+		sim_bits(sim, sim->tm.start_bits + 18 + sim->tm.restart_bits + 9 + 9 * len + sim->tm.stop_bits);
+		sim->now += sim->tm.stretch_ns;
+	}
+
+	pthread_mutex_unlock(&sim->lock);
+
+	return(ret);
+}
+
+static int sim_wake(void *ctx, int ms)
+{
+	mlx_sim	*sim = ctx;
+	int		i;
+
+	pthread_mutex_lock(&sim->lock);
+
+	sim_sync(sim);
+	sim->now += (uint64_t) ms * 1000000;
+
+	// wake-up from sleep and SMBus request from PWM
+	if (ms >= SIM_WAKE_MIN)
+	{
+		for (i = 0; i < MLX_SIM_MAX; i++)
+		{
+			// not in sleep yet : wake-up after it
+			if (sim->dev[i].sleep)
+				sim->dev[i].ready = (sim->dev[i].ready > sim->now ? sim->dev[i].ready : sim->now) + sim->tm.wake_ns;
+
+			sim->dev[i].sleep = sim->dev[i].pwm = 0;
+		}
+	}
+
+	pthread_mutex_unlock(&sim->lock);
+
+	return(MLX_OK);
+}
+
+static void sim_power(void *ctx, int on)
+{
+	mlx_sim	*sim = ctx;
+	int		i;
+
+	pthread_mutex_lock(&sim->lock);
+
+	sim_sync(sim);
+
+	// power on reset : mode from config register
+	if (on && ! sim->power)
+	{
+		for (i = 0; i < MLX_SIM_MAX; i++)
+		{
+			sim->dev[i].dropped = sim->dev[i].sleep = 0;
+			sim->dev[i].pwm = ! (sim->dev[i].eeprom[MLX_REG_CONFIG] & 0x1);
+			sim->dev[i].ready = sim->now + sim->tm.por_ns;
+		}
+	}
+
+	sim->power = on;
+
+	pthread_mutex_unlock(&sim->lock);
+}
+
+static void sim_close(void *ctx)
+{
+	// the simulation is released by mlx_sim_free()
+}
+
+static const mlx_bus_ops sim_ops = {
+	sim_begin,
+	sim_end,
+	sim_set_addr,
+	sim_write,
+	sim_read_rs,
+	sim_wake,
+	sim_power,
+	sim_close,
+};
+
+mlx_bus *mlx_bus_open_sim(mlx_sim *sim)
+{
+	mlx_bus *bus;
+
+	if (sim == NULL) return(NULL);
+
+	if ((bus = mlx_bus_new(&sim_ops, sim)) != NULL) mlx_bus_set_write_delay(bus, 0);
+
+	return(bus);
+}
+
+/** GPIO routines */
+
+void mlx_sim_set_pwm_noise(mlx_sim *sim, double jitter_ns, double noise)
+{
+	pthread_mutex_lock(&sim->lock);
+	sim->pwm.jitter_ns = jitter_ns;
+	sim->pwm.noise = noise;
+	pthread_mutex_unlock(&sim->lock);
+}
+
+/* level of SDA : PWM signal of the first device in PWM mode (lock held) */
+static int sim_sda(mlx_sim *sim)
+{
+	sim_dev	*d;
+	uint16_t conf;
+	int		i;
+
+	for (i = 0, d = NULL; i < MLX_SIM_MAX; i++)
+	{
+		if (sim->dev[i].used && sim->dev[i].pwm && ! sim->dev[i].dropped)
+		{
+			d = &sim->dev[i];
+			break;
+		}
+	}
+
+	// no PWM : pull-up
+	if (d == NULL || ! sim->power) return(1);
+
+	// PWM starts after the power on reset
+	if (sim->now < d->ready) return(0);
+
+	// Bit 1 : PWM frequency, Bit 2 : Ta (1) or To (0)
+	conf = d->eeprom[MLX_REG_CONFIG];
+
+	sim->pwm.freq = conf & 0x2 ? 10 : 1000;
+	sim->pwm.duty = mlx_pwm_duty(mlx_raw_to_celsius(d->ram[conf & 0x4 ? MLX_RAM_TA : MLX_RAM_TO]),
+		d->eeprom[MLX_REG_PWMSA], d->eeprom[MLX_REG_PWMTR]);
+
+	return(mlx_pwm_gen_level(&sim->pwm, sim->now - d->ready));
+}
+
+static void sim_gpio_fsel(void *ctx, uint8_t pin, int mode)
+{
+	sim_gpio *g = ctx;
+
+	if (pin < SIM_PINS) g->out[pin] = (mode == MLX_GPIO_OUT);
+}
+
+static void sim_gpio_write(void *ctx, uint8_t pin, int level)
+{
+	sim_gpio *g = ctx;
+
+	if (pin < SIM_PINS) g->level[pin] = (level != 0);
+}
+
+static int sim_gpio_lev(void *ctx, uint8_t pin)
+{
+	sim_gpio *g = ctx;
+	mlx_sim	*sim = g->sim;
+	int		level;
+
+	if (pin >= SIM_PINS) return(0);
+
+	// an output reads back what was written
+	if (g->out[pin]) return(g->level[pin]);
+
+	if (pin != g->sda) return(1);
+
+	// the followed clock must move, else the read takes sample_ns
+	if (sim->clock && g->sample_ns) mlx_clock_sleep(g->sample_ns);
+
+	pthread_mutex_lock(&sim->lock);
+
+	if (sim->clock) sim_sync(sim);
+	else sim->now += g->sample_ns;
+
+	level = sim_sda(sim);
+
+	pthread_mutex_unlock(&sim->lock);
+
+	return(level);
+}
+
+static void sim_gpio_close(void *ctx)
+{
+	free(ctx);
+}
+
+static const mlx_gpio_ops sim_gpio_ops = {
+	sim_gpio_fsel,
+	sim_gpio_write,
+	sim_gpio_lev,
+	sim_gpio_close,
+};
+
+mlx_gpio *mlx_gpio_open_sim(mlx_sim *sim, uint8_t sda, uint64_t sample_ns)
+{
+	mlx_gpio *gpio;
+	sim_gpio *g;
+
+	if (sim == NULL) return(NULL);
+
+	if ((g = calloc(1, sizeof(sim_gpio))) == NULL) return(NULL);
+
+	g->sim = sim;
+	g->sda = sda;
+	g->sample_ns = sample_ns;
+
+	if ((gpio = mlx_gpio_new(&sim_gpio_ops, g)) == NULL) free(g);
+
+	return(gpio);
+}
@@ -0,0 +1,212 @@
+/* libmlx90615 : injectable clock, real or virtual
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_clock is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_clock is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_clock. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * All sleeps and time reads of the library and the program go through
+ * the process clock (mlx_clock_ns / mlx_clock_time / mlx_clock_sleep).
+ *
+ * The real clock is CLOCK_MONOTONIC and nanosleep().
+ *
+ * The virtual clock only moves when all actors (threads using the
+ * clock) are sleeping : it then jumps to the earliest wake-up time.
+ * A run with one actor does exactly the same every time, and a day of
+ * sleeping takes no time at all.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include "libmlx90615.h"
+
+/* virtual time at creation : not 0, as that is often used as "not set" */
+#define VCLOCK_START	1000000000ULL
+
+/* a sleeping actor */
+typedef struct vc_waiter {
+	uint64_t	wake;
+	struct vc_waiter *next;
+} vc_waiter;
+
+struct mlx_clock {
+	int			virt;			// 0 = real clock
+	pthread_mutex_t lock;
+	pthread_cond_t	cond;
+	uint64_t	now;			// virtual time (ns)
+	time_t		epoch;			// wall time at VCLOCK_START
+	int			actors;
+	int			sleeping;
+	vc_waiter	*waiters;
+};
+
+static mlx_clock real_clock = {0};
+
+static mlx_clock *cur_clock = &real_clock;
+
+/* jump to the earliest wake-up if all actors sleep (lock held) */
+static void vc_advance(mlx_clock *c)
+{
+	vc_waiter	*w;
+	uint64_t	next = UINT64_MAX;
+
+	if (c->sleeping == 0 || c->sleeping < c->actors) return;
+
+	for (w = c->waiters; w != NULL; w = w->next)
+		if (w->wake < next) next = w->wake;
+
+	if (next > c->now) c->now = next;
+
+	pthread_cond_broadcast(&c->cond);
+}
+
+mlx_clock *mlx_clock_real(void)
+{
+	return(&real_clock);
+}
+
+mlx_clock *mlx_vclock_new(time_t epoch)
+{
+	mlx_clock *c;
+
+	if ((c = calloc(1, sizeof(mlx_clock))) == NULL) return(NULL);
+
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->cond, NULL);
+
+	c->virt = 1;
+	c->now = VCLOCK_START;
+	c->epoch = epoch;
+	c->actors = 1;
+
+	return(c);
+}
+
+void mlx_vclock_free(mlx_clock *c)
+{
+	if (c == NULL || ! c->virt) return;
+
+	if (cur_clock == c) cur_clock = &real_clock;
+
+	pthread_cond_destroy(&c->cond);
+	pthread_mutex_destroy(&c->lock);
+	free(c);
+}
+
+void mlx_vclock_join(mlx_clock *c)
+{
+	if (! c->virt) return;
+
+	pthread_mutex_lock(&c->lock);
+	c->actors++;
+	pthread_mutex_unlock(&c->lock);
+}
+
+void mlx_vclock_leave(mlx_clock *c)
+{
+	if (! c->virt) return;
+
+	pthread_mutex_lock(&c->lock);
+
+	if (c->actors > 0) c->actors--;
+
+	// the others might all be sleeping now
+	vc_advance(c);
+
+	pthread_mutex_unlock(&c->lock);
+}
+
+void mlx_clock_set(mlx_clock *c)
+{
+	cur_clock = c ? c : &real_clock;
+}
+
+mlx_clock *mlx_clock_get(void)
+{
+	return(cur_clock);
+}
+
+uint64_t mlx_clock_read(mlx_clock *c)
+{
+	struct timespec ts;
+	uint64_t now;
+
+	if (! c->virt)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return((uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec);
+	}
+
+	// 64 bit is not atomic on the Raspberry-pi
+	pthread_mutex_lock(&c->lock);
+	now = c->now;
+	pthread_mutex_unlock(&c->lock);
+
+	return(now);
+}
+
+uint64_t mlx_clock_ns(void)
+{
+	return(mlx_clock_read(cur_clock));
+}
+
+time_t mlx_clock_time(void)
+{
+	mlx_clock *c = cur_clock;
+
+	if (! c->virt) return(time(NULL));
+
+	return(c->epoch + (time_t) ((mlx_clock_read(c) - VCLOCK_START) / 1000000000));
+}
+
+void mlx_clock_sleep(uint64_t ns)
+{
+	mlx_clock	*c = cur_clock;
+	struct timespec ts;
+	vc_waiter	w, **p;
+
+	if (ns == 0) return;
+
+	if (! c->virt)
+	{
+		ts.tv_sec = ns / 1000000000;
+		ts.tv_nsec = ns % 1000000000;
+
+		while (nanosleep(&ts, &ts) < 0 && errno == EINTR) ;
+		return;
+	}
+
+	pthread_mutex_lock(&c->lock);
+
+	w.wake = c->now + ns;
+	w.next = c->waiters;
+	c->waiters = &w;
+	c->sleeping++;
+
+	while (c->now < w.wake)
+	{
+		vc_advance(c);
+
+		if (c->now < w.wake) pthread_cond_wait(&c->cond, &c->lock);
+	}
+
+	// remove from the waiters
+	for (p = &c->waiters; *p != &w; p = &(*p)->next) ;
+	*p = w.next;
+	c->sleeping--;
+
+	pthread_mutex_unlock(&c->lock);
+}
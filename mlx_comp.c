@@ -0,0 +1,320 @@
+/* libmlx90615 : radiometric compensation of To
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_comp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_comp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_comp. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The sensor measures the radiation of the object against its own
+ * temperature Ta and computes To for the emissivity in its EEPROM (ec),
+ * as if the rest came from surroundings at Ta :
+ *
+ *   ec (Tc^4 - Ta^4) = t (e To^4 + (1 - e) Tr^4) + (1 - t) Tw^4 - Ta^4
+ *
+ * Tc is To of the sensor, e the emissivity of the object, Tr the
+ * temperature that is reflected by the object, t the transmissivity of
+ * a window in front of the sensor and Tw the temperature of the window
+ * (all in kelvin). Solved for To this is linear in the fourth powers :
+ *
+ *   To^4 = ko Tc^4 + ka Ta^4 + k0
+ *
+ * mlx_comp_prepare() computes ko, ka and k0 once, so a sample only
+ * needs a few multiplies and two square roots.
+ *
+ * The batch kernel (logged data, e.g. the history ring) works on the
+ * RAM values in float, 8 at a time with AVX2 on x86 (selected at run
+ * time) or 4 with NEON on ARM (Raspberry Pi with -mfpu=neon).
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include "libmlx90615.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define COMP_NEON
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COMP_AVX2
+#endif
+
+/* RAM value : kelvin per bit and the error flag */
+#define COMP_KELVIN		0.02
+#define COMP_ERROR		0x8000
+
+void mlx_comp_init(mlx_comp *c)
+{
+	memset(c, 0, sizeof(mlx_comp));
+
+	c->emissivity = 1;
+	c->chip_emiss = 1;
+	c->t_refl = MLX_COMP_TA;
+	c->tau = 1;
+	c->t_win = MLX_COMP_TA;
+
+	mlx_comp_prepare(c);
+}
+
+/* kelvin ^ 4 of a temperature in celsius */
+static double kelvin4(double celsius)
+{
+	double k = celsius + 273.15;
+
+	return(k * k * k * k);
+}
+
+int mlx_comp_prepare(mlx_comp *c)
+{
+	double	e = c->emissivity, t = c->tau;
+
+	if (! (e > 0 && e <= 1) || ! (t > 0 && t <= 1) || ! (c->chip_emiss > 0 && c->chip_emiss <= 1) ||
+		(c->t_refl != MLX_COMP_TA && c->t_refl < -273.15) ||
+		(c->t_win != MLX_COMP_TA && c->t_win < -273.15))
+		return(MLX_ERR_PARAM);
+
+	c->ko = c->chip_emiss / (t * e);
+	c->ka = (1 - c->chip_emiss) / (t * e);
+	c->k0 = 0;
+
+	// the window radiates at its own temperature
+	if (c->t_win == MLX_COMP_TA) c->ka -= (1 - t) / (t * e);
+	else c->k0 -= (1 - t) * kelvin4(c->t_win) / (t * e);
+
+	// what the object reflects
+	if (c->t_refl == MLX_COMP_TA) c->ka -= (1 - e) / e;
+	else c->k0 -= (1 - e) * kelvin4(c->t_refl) / e;
+
+	return(MLX_OK);
+}
+
+/* a temperature of the specification : "ta" or celsius
+ * return MLX_OK or MLX_ERR_PARAM */
+static int comp_temp(const char *s, char **end, double *val)
+{
+	if (! strncasecmp(s, "ta", 2))
+	{
+		*val = MLX_COMP_TA;
+		*end = (char *) s + 2;
+		return(MLX_OK);
+	}
+
+	*val = strtod(s, end);
+
+	return(*end == s ? MLX_ERR_PARAM : MLX_OK);
+}
+
+int mlx_comp_parse(mlx_comp *c, const char *spec)
+{
+	char *p;
+
+	c->t_refl = MLX_COMP_TA;
+	c->tau = 1;
+	c->t_win = MLX_COMP_TA;
+
+	c->emissivity = strtod(spec, &p);
+	if (p == spec) return(MLX_ERR_PARAM);
+
+	if (*p == ':' && comp_temp(p + 1, &p, &c->t_refl) != MLX_OK) return(MLX_ERR_PARAM);
+
+	if (*p == ':')
+	{
+		spec = p + 1;
+		c->tau = strtod(spec, &p);
+		if (p == spec) return(MLX_ERR_PARAM);
+	}
+
+	if (*p == ':' && comp_temp(p + 1, &p, &c->t_win) != MLX_OK) return(MLX_ERR_PARAM);
+
+	if (*p) return(MLX_ERR_PARAM);
+
+	return(mlx_comp_prepare(c));
+}
+
+double mlx_comp_to(const mlx_comp *c, double to, double ta)
+{
+	double	tc = to + 273.15, tk = ta + 273.15, t4;
+
+	tc *= tc;
+	tk *= tk;
+	t4 = c->ko * tc * tc + c->ka * tk * tk + c->k0;
+
+	// more radiation reflected than measured
+	if (t4 <= 0) return(NAN);
+
+	return(sqrt(sqrt(t4)) - 273.15);
+}
+
+int mlx_comp_raw_scalar(const mlx_comp *c, const uint16_t *raw_to, const uint16_t *raw_ta, float *out, long n)
+{
+	float	ko = c->ko, ka = c->ka, k0 = c->k0, tc, tk, t4;
+	long	i;
+
+	for (i = 0; i < n; i++)
+	{
+		tc = (raw_to[i] & ~COMP_ERROR) * (float) COMP_KELVIN;
+		tk = (raw_ta[i] & ~COMP_ERROR) * (float) COMP_KELVIN;
+		tc *= tc;
+		tk *= tk;
+		t4 = ko * (tc * tc) + ka * (tk * tk) + k0;
+
+		if (t4 <= 0 || ((raw_to[i] | raw_ta[i]) & COMP_ERROR)) out[i] = NAN;
+		else out[i] = sqrtf(sqrtf(t4)) - 273.15f;
+	}
+
+	return(MLX_OK);
+}
+
+#ifdef COMP_NEON
+
+/* square root : ARMv7 has only an estimate of 1 / sqrt, refined twice */
+static inline float32x4_t comp_sqrt(float32x4_t x)
+{
+#ifdef __aarch64__
+	return(vsqrtq_f32(x));
+#else
+	float32x4_t r = vrsqrteq_f32(x);
+
+	r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(x, r), r));
+	r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(x, r), r));
+
+	return(vmulq_f32(x, r));
+#endif
+}
+
+static void comp_neon(const mlx_comp *c, const uint16_t *raw_to, const uint16_t *raw_ta, float *out, long n)
+{
+	const float32x4_t ko = vdupq_n_f32(c->ko), ka = vdupq_n_f32(c->ka), k0 = vdupq_n_f32(c->k0);
+	const float32x4_t kelvin = vdupq_n_f32(COMP_KELVIN), zero = vdupq_n_f32(0);
+	const float32x4_t abs0 = vdupq_n_f32(273.15f), nan = vdupq_n_f32(NAN);
+	const uint16x4_t  flag = vdup_n_u16(COMP_ERROR);
+	float32x4_t	tc, tk, t4;
+	uint16x4_t	ro, ra;
+	uint32x4_t	bad;
+	long		i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+	{
+		ro = vld1_u16(raw_to + i);
+		ra = vld1_u16(raw_ta + i);
+
+		tc = vmulq_f32(vcvtq_f32_u32(vmovl_u16(vbic_u16(ro, flag))), kelvin);
+		tk = vmulq_f32(vcvtq_f32_u32(vmovl_u16(vbic_u16(ra, flag))), kelvin);
+		tc = vmulq_f32(tc, tc);
+		tk = vmulq_f32(tk, tk);
+		t4 = vaddq_f32(vaddq_f32(vmulq_f32(ko, vmulq_f32(tc, tc)), vmulq_f32(ka, vmulq_f32(tk, tk))), k0);
+
+		bad = vorrq_u32(vcleq_f32(t4, zero), vtstq_u32(vmovl_u16(vorr_u16(ro, ra)), vdupq_n_u32(COMP_ERROR)));
+
+		// t4 of a bad one is not used : keep the square root finite
+		t4 = vbslq_f32(bad, kelvin, t4);
+		t4 = vsubq_f32(comp_sqrt(comp_sqrt(t4)), abs0);
+
+		vst1q_f32(out + i, vbslq_f32(bad, nan, t4));
+	}
+
+	mlx_comp_raw_scalar(c, raw_to + i, raw_ta + i, out + i, n - i);
+}
+
+int mlx_comp_raw(const mlx_comp *c, const uint16_t *raw_to, const uint16_t *raw_ta, float *out, long n)
+{
+	comp_neon(c, raw_to, raw_ta, out, n);
+	return(MLX_OK);
+}
+
+#elif defined(COMP_AVX2)
+
+__attribute__((target("avx2")))
+static void comp_avx2(const mlx_comp *c, const uint16_t *raw_to, const uint16_t *raw_ta, float *out, long n)
+{
+	const __m256 ko = _mm256_set1_ps(c->ko), ka = _mm256_set1_ps(c->ka), k0 = _mm256_set1_ps(c->k0);
+	const __m256 kelvin = _mm256_set1_ps(COMP_KELVIN), zero = _mm256_setzero_ps();
+	const __m256 abs0 = _mm256_set1_ps(273.15f), nan = _mm256_set1_ps(NAN);
+	const __m256i value = _mm256_set1_epi32(~COMP_ERROR & 0xffff), flag = _mm256_set1_epi32(COMP_ERROR);
+	__m256i	ro, ra;
+	__m256	tc, tk, t4, bad;
+	long	i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		ro = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (raw_to + i)));
+		ra = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (raw_ta + i)));
+
+		tc = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(ro, value)), kelvin);
+		tk = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(ra, value)), kelvin);
+		tc = _mm256_mul_ps(tc, tc);
+		tk = _mm256_mul_ps(tk, tk);
+		t4 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ko, _mm256_mul_ps(tc, tc)),
+			_mm256_mul_ps(ka, _mm256_mul_ps(tk, tk))), k0);
+
+		bad = _mm256_or_ps(_mm256_cmp_ps(t4, zero, _CMP_LE_OQ), _mm256_castsi256_ps(
+			_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_or_si256(ro, ra), flag), flag)));
+
+		t4 = _mm256_sub_ps(_mm256_sqrt_ps(_mm256_sqrt_ps(t4)), abs0);
+
+		_mm256_storeu_ps(out + i, _mm256_blendv_ps(t4, nan, bad));
+	}
+
+	mlx_comp_raw_scalar(c, raw_to + i, raw_ta + i, out + i, n - i);
+}
+
+int mlx_comp_raw(const mlx_comp *c, const uint16_t *raw_to, const uint16_t *raw_ta, float *out, long n)
+{
+	static int avx2 = -1;
+
+	if (avx2 < 0) avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+
+	if (avx2) comp_avx2(c, raw_to, raw_ta, out, n);
+	else mlx_comp_raw_scalar(c, raw_to, raw_ta, out, n);
+
+	return(MLX_OK);
+}
+
+#else
+
+int mlx_comp_raw(const mlx_comp *c, const uint16_t *raw_to, const uint16_t *raw_ta, float *out, long n)
+{
+	return(mlx_comp_raw_scalar(c, raw_to, raw_ta, out, n));
+}
+
+#endif
+
+/* records taken apart per block, for the kernel */
+#define COMP_BLOCK	256
+
+int mlx_comp_samples(const mlx_comp *c, const mlx_sample *s, float *out, long n)
+{
+	uint16_t	ro[COMP_BLOCK], ra[COMP_BLOCK];
+	long		i, k, num;
+
+	for (i = 0; i < n; i += num)
+	{
+		num = n - i < COMP_BLOCK ? n - i : COMP_BLOCK;
+
+		for (k = 0; k < num; k++)
+		{
+			ro[k] = s[i + k].raw_to;
+			ra[k] = s[i + k].raw_ta;
+		}
+
+		mlx_comp_raw(c, ro, ra, out + i, num);
+
+		// a reading that failed has no temperature
+		for (k = 0; k < num; k++)
+			if (s[i + k].status != MLX_OK) out[i + k] = NAN;
+	}
+
+	return(MLX_OK);
+}
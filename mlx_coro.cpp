@@ -0,0 +1,140 @@
+/* mlx_coro : collectors as C++20 coroutines (libmlx90615.hpp)
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_coro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_coro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_coro. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * An example of the coroutine front-end on a simulated bus (no bus
+ * needed) : one collector per sensor reads Ta and To every period, all
+ * on one executor thread. At the end the readings are checked against
+ * the temperatures set in the simulation and the use of the frame pool
+ * is displayed.
+ *
+ * usage : mlx_coro [-s sensors] [-n readings] [-p ms]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include "libmlx90615.hpp"
+
+/* first slave address and unit ID of the simulated sensors */
+#define CORO_ADDR	0x5b
+#define CORO_ID		0x64c744
+
+struct tally {
+	int		readings;
+	int		errors;			// failed or time-out
+	int		mismatch;		// not as set in the simulation
+};
+
+static void usage(char *name)
+{
+	fprintf(stderr, "usage : %s [-s sensors] [-n readings] [-p ms]\n"
+		"  -s sensors   simulated sensors (1 - %d, default 4)\n"
+		"  -n readings  per sensor (default 10)\n"
+		"  -p ms        period (default 100)\n", name, MLX_SIM_MAX);
+	exit(1);
+}
+
+/* read Ta and To 'num' times, every period ms */
+static mlx::task<void> collect(mlx::device &dev, double ta, double to, int num, int period, tally &t)
+{
+	for (int i = 0; i < num; i++)
+	{
+		auto a = co_await dev.read_ambient().timeout(500);
+		auto o = co_await dev.read_object().timeout(500);
+
+		if (! a || ! o) t.errors++;
+		else
+		{
+			t.readings++;
+
+			// the RAM has a resolution of 0.02C
+			if (fabs(*a - ta) > 0.02 || fabs(*o - to) > 0.02) t.mismatch++;
+		}
+
+		co_await dev.exec().sleep_for(period);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	mlx_sim		*sim;
+	mlx_bus		*bus;
+	mlx_dev		*dev[MLX_SIM_MAX];
+	mlx::device	*mdev[MLX_SIM_MAX];
+	tally		t = {0, 0, 0};
+	int			c, i, sensors = 4, num = 10, period = 100;
+
+	while ((c = getopt(argc, argv, "s:n:p:")) != -1)
+	{
+		switch(c)
+		{
+			case 's':	sensors = (int) strtol(optarg, NULL, 10);	break;
+			case 'n':	num = (int) strtol(optarg, NULL, 10);		break;
+			case 'p':	period = (int) strtol(optarg, NULL, 10);	break;
+			default:	usage(argv[0]);
+		}
+	}
+
+	if (sensors < 1 || sensors > MLX_SIM_MAX || num < 1 || period < 0) usage(argv[0]);
+
+	if ((sim = mlx_sim_new()) == NULL || (bus = mlx_bus_open_sim(sim)) == NULL)
+	{
+		fprintf(stderr, "can not create the simulation\n");
+		exit(1);
+	}
+
+	mlx::executor ex;
+
+	if (! ex.ok())
+	{
+		fprintf(stderr, "can not create the executor\n");
+		exit(1);
+	}
+
+	for (i = 0; i < sensors; i++)
+	{
+		if (mlx_sim_add(sim, CORO_ADDR + i, CORO_ID + i) != MLX_OK ||
+			mlx_sim_set_temp(sim, CORO_ADDR + i, 20 + i, 30 + i) != MLX_OK ||
+			(dev[i] = mlx_open(bus, CORO_ADDR + i, 0)) == NULL)
+		{
+			fprintf(stderr, "can not add sensor 0x%x\n", CORO_ADDR + i);
+			exit(1);
+		}
+
+		mdev[i] = new mlx::device(ex, dev[i]);
+		ex.spawn(collect(*mdev[i], 20 + i, 30 + i, num, period, t));
+	}
+
+	ex.run();
+
+	mlx::frame_pool::stats st = mlx::frame_pool::get_stats();
+
+	printf("%d sensors : %d readings, %d errors, %d not as set\n", sensors, t.readings, t.errors, t.mismatch);
+	printf("frame pool : %zu blocks (%zu bytes), %zu in use, %zu oversize\n", st.blocks, st.bytes, st.in_use, st.oversize);
+
+	for (i = 0; i < sensors; i++)
+	{
+		delete mdev[i];
+		mlx_close(dev[i]);
+	}
+
+	mlx_bus_close(bus);
+	mlx_sim_free(sim);
+
+	exit(t.errors || t.mismatch ? 1 : 0);
+}
@@ -0,0 +1,211 @@
+/* duty-cycled sampling for an MLX90615 on Raspberry-pi
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_duty is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_duty is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_duty. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For battery powered nodes the MLX can sleep in between samples.
+ * Waking up takes a low pulse on SCL (wake_up()) and some time before
+ * the readings are stable again. That time is measured on each wake-up
+ * (ready_wait()) and learned, so the scheduler can decide per sample whether it is
+ * worth to go to sleep, or better to stay awake, given the requested
+ * sample period.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "mlx90615.h"
+
+/* learned wake-to-stable latency in ms (start with 50ms pulse + 300ms) */
+double duty_latency = 350;
+
+/* margin on top of the learned latency before sleep is worth it */
+#define DUTY_MARGIN	1.2
+
+/* statistics of the last run (ms) */
+static struct {
+	long	samples;
+	long	wakes;
+	double	awake;			// time MLX was awake
+	double	asleep;			// time MLX was in sleep
+	double	wait;			// time spent waiting for stable readings
+} duty_stat;
+
+/* sleep for a number of ms */
+static void duty_delay(double ms)
+{
+	if (ms > 0) mlx_clock_sleep((uint64_t) (ms * 1000000));
+}
+
+/* learn the latency with an exponential moving average
+ * @param ms : observed wake-to-stable latency */
+void duty_learn(double ms)
+{
+	if (ms < 0) return;
+
+	duty_latency = 0.75 * duty_latency + 0.25 * ms;
+
+	if (DEBUG) printf("DEBUG: wake latency observed %1.1fms, learned %1.1fms\n", ms, duty_latency);
+}
+
+/* take one sample : object and ambient temperature
+ * return 0 = OK, -1 = error */
+static int duty_sample()
+{
+	long to, ta;
+
+	if ((to = read_ram(TO)) < 0 || (ta = read_ram(TA)) < 0)
+	{
+		p_printf(1,"can not read temperature\n");
+		return(-1);
+	}
+
+	duty_stat.samples++;
+
+	p_printf(2,"%6ld  Object %2.2fC  Ambient %2.2fC\n", duty_stat.samples,
+	mlx_raw_to_celsius(to), mlx_raw_to_celsius(ta));
+
+	return(0);
+}
+
+/* run duty-cycled sampling
+ * @param period : requested sample period in ms
+ * @param count : number of samples to take
+ *
+ * After each sample the MLX is put in sleep if the time until the next
+ * sample is longer than the learned latency (plus margin). The wake-up
+ * is started early, so the readings are stable at the next sample time.
+ *
+ * return 0 = OK, -1 = error */
+int duty_run(long period, long count)
+{
+	double	run, start, next, lat;
+	long	i;
+
+	duty_stat.samples = duty_stat.wakes = 0;
+	duty_stat.awake = duty_stat.asleep = duty_stat.wait = 0;
+
+	if (pwm_mode)
+	{
+		p_printf(1,"MLX is in PWM mode\n");
+		return(-1);
+	}
+
+	run = next = get_current();
+
+	for (i = 0; i < count; i++)
+	{
+		// wake-up when sleeping and wait for stable readings
+		if (in_sleep_mode)
+		{
+			start = get_current();
+
+			if (wake_up() < 0)
+			{
+				p_printf(1,"could not wakeup\n");
+				return(-1);
+			}
+			in_sleep_mode = 0;
+			duty_stat.wakes++;
+
+			if ((lat = ready_wait(start)) < 0)
+			{
+				p_printf(1,"readings did not stabilise after wake-up\n");
+				return(-1);
+			}
+
+			duty_learn(lat);
+			duty_stat.wait += lat;
+		}
+
+		// wait for sample time (in case woken up early)
+		duty_delay((next - get_current()) / 1000);
+
+		if (duty_sample() < 0) return(-1);
+
+		next += period * 1000;
+
+		if (i == count - 1) break;
+
+		// is sleep worth it ? then start the wake-up early enough
+		// to have stable readings at the next sample time
+		if ((next - get_current()) / 1000 > duty_latency * DUTY_MARGIN)
+		{
+			if (enter_sleep() < 0)
+			{
+				p_printf(1,"could not set sleep mode\n");
+				return(-1);
+			}
+			in_sleep_mode = 1;
+
+			start = get_current();
+			duty_delay((next - start) / 1000 - duty_latency * DUTY_MARGIN);
+			duty_stat.asleep += (get_current() - start) / 1000;
+		}
+	}
+
+	duty_stat.awake = (get_current() - run) / 1000 - duty_stat.asleep;
+
+	return(0);
+}
+
+/* display the result of the last duty-cycled run */
+void duty_report()
+{
+	double total = duty_stat.awake + duty_stat.asleep;
+
+	if (total == 0)
+	{
+		p_printf(1,"No duty-cycled samples taken\n");
+		return;
+	}
+
+	p_printf(3,"\nDuty-cycled sampling\n");
+	p_printf(2,"samples:\t\t%ld (%ld wake-ups)\n", duty_stat.samples, duty_stat.wakes);
+	p_printf(2,"learned latency:\t%1.1fms\n", duty_latency);
+	p_printf(2,"estimated duty:\t\t%2.1f%% awake\n", duty_stat.awake * 100 / total);
+	p_printf(2,"latency overhead:\t%2.1f%% of awake time\n",
+	duty_stat.awake ? duty_stat.wait * 100 / duty_stat.awake : 0);
+
+	if (detailed)
+		p_printf(2,"estimated average current: %1.3fmA\n",
+		(duty_stat.awake * MLX_I_ACTIVE + duty_stat.asleep * MLX_I_SLEEP) / total);
+}
+
+/* ask period and count and run duty-cycled sampling */
+void duty_menu()
+{
+	long period, count;
+
+	p_printf(3,"\nSample period in ms (99 = return) ");
+	if ((period = get_dec_input()) == 99 || period < 1) return;
+
+	p_printf(3,"Number of samples (99 = return) ");
+	if ((count = get_dec_input()) == 99 || count < 1) return;
+
+	p_printf(2,"%s between samples (learned latency %1.1fms)\n",
+	period > duty_latency * DUTY_MARGIN ? "sleeping" : "staying awake", duty_latency);
+
+	duty_run(period, count);
+
+	// make sure to leave the MLX awake
+	if (in_sleep_mode)
+	{
+		if (wake_up() == 0) in_sleep_mode = 0;
+	}
+
+	duty_report();
+}
@@ -0,0 +1,985 @@
+/*
+ * MLX90615 - infra read sensor
+ *
+ * ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ *
+ * version 1.0 / paulvha / April 2017
+ *
+ * Binary emissivity database. The file is used as it is mapped in
+ * memory : nothing is parsed or copied when it is opened.
+ *
+ * Layout (all offsets from the start of the file, 4 byte aligned) :
+ *
+ *   emiss_hdr
+ *   emiss_rec[count]       entries, the entries of a type are together
+ *   emiss_type[types]      types in the order of the source
+ *   uint32_t[types]        types sorted on name (no case)
+ *   uint32_t[count]        entries sorted on material (no case)
+ *   emiss_gram[grams]      trigrams sorted on code, with their entries
+ *   uint32_t[posts]        entries of the trigrams, each list sorted
+ *   char[str_size]         strings, each ends with 0
+ *
+ * A prefix search on type or material is a binary search in one of the
+ * sorted indexes, so it does not depend on the size of the database.
+ *
+ * The fuzzy search (emiss_search) uses the trigrams of the words in type
+ * and material : "Steel" is " st" "ste" "tee" "eel" "el ". The trigrams
+ * at the start and end of a word weigh double, so a word of the query
+ * that is a word (or the start of one) of the entry scores higher. An
+ * entry is a candidate when it has at least half of the weight of the
+ * query, so it is enough to count the entries of the rarest trigrams : a
+ * candidate has to be in one of them. The others are only looked up
+ * (binary search) for the candidates, the strongest first, until the
+ * rest can not get in the best k (heap). The score is the part of the
+ * query that is found and a bit for the part of the entry that is
+ * matched (shorter is better).
+ * Numbers are in the byte order of the machine that compiled it.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mlx90615.h"
+
+#define EMISS_MAGIC		0x424d4545		// "EEMB"
+#define EMISS_VERSION	2
+
+typedef struct emiss_hdr {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	size;			// of the file
+	uint32_t	count;			// entries
+	uint32_t	types;
+	uint32_t	rec_off;
+	uint32_t	type_off;
+	uint32_t	by_type_off;
+	uint32_t	by_mat_off;
+	uint32_t	str_off;
+	uint32_t	str_size;
+	uint32_t	gram_off;
+	uint32_t	grams;
+	uint32_t	post_off;
+	uint32_t	posts;
+} emiss_hdr;
+
+typedef struct emiss_rec {
+	uint32_t	type;			// string offsets
+	uint32_t	material;
+	uint32_t	temp;
+	uint32_t	emis;
+	float		value;			// emissivity
+	uint32_t	type_idx;
+	uint32_t	grams;			// trigrams of type and material
+} emiss_rec;
+
+typedef struct emiss_type {
+	uint32_t	name;
+	uint32_t	first;			// first entry
+	uint32_t	count;
+} emiss_type;
+
+typedef struct emiss_gram {
+	uint32_t	code;			// 3 characters
+	uint32_t	first;			// first in the entries of the trigrams
+	uint32_t	count;
+} emiss_gram;
+
+/* counts of the candidates of a search, per entry */
+typedef struct emiss_scratch {
+	uint32_t	gen;			// search of the counts
+	uint32_t	*stamp;			// search an entry was counted in
+	uint16_t	*hits;			// trigrams found
+	uint32_t	*cand;
+	uint32_t	*order;			// candidates, most weight first
+} emiss_scratch;
+
+struct emiss_db {
+	void		*base;
+	size_t		size;
+	int			mapped;			// 0 = malloc()
+	const emiss_hdr *hdr;
+	const emiss_rec *rec;
+	const emiss_type *type;
+	const uint32_t *by_type;
+	const uint32_t *by_mat;
+	const emiss_gram *gram;
+	const uint32_t *post;
+	const char	*str;
+	emiss_scratch *scratch;
+};
+
+/* database in use */
+static emiss_db *emiss_cur = NULL;
+
+/* set the pointers of the sections
+ * return 0 = OK, -1 = not a valid database */
+static int db_sections(emiss_db *db)
+{
+	const emiss_hdr *h = db->base;
+	uint32_t	i;
+
+	if (db->size < sizeof(emiss_hdr)) return(-1);
+
+	if (h->magic != EMISS_MAGIC || h->version != EMISS_VERSION || h->size != db->size ||
+		h->str_size == 0 || h->str_off + (uint64_t) h->str_size > db->size ||
+		h->rec_off + (uint64_t) h->count * sizeof(emiss_rec) > db->size ||
+		h->type_off + (uint64_t) h->types * sizeof(emiss_type) > db->size ||
+		h->by_type_off + (uint64_t) h->types * 4 > db->size ||
+		h->by_mat_off + (uint64_t) h->count * 4 > db->size ||
+		h->gram_off + (uint64_t) h->grams * sizeof(emiss_gram) > db->size ||
+		h->post_off + (uint64_t) h->posts * 4 > db->size ||
+		((h->rec_off | h->type_off | h->by_type_off | h->by_mat_off | h->gram_off | h->post_off) & 3))
+		return(-1);
+
+	db->hdr = h;
+	db->rec = (const emiss_rec *) ((const char *) db->base + h->rec_off);
+	db->type = (const emiss_type *) ((const char *) db->base + h->type_off);
+	db->by_type = (const uint32_t *) ((const char *) db->base + h->by_type_off);
+	db->by_mat = (const uint32_t *) ((const char *) db->base + h->by_mat_off);
+	db->gram = (const emiss_gram *) ((const char *) db->base + h->gram_off);
+	db->post = (const uint32_t *) ((const char *) db->base + h->post_off);
+	db->str = (const char *) db->base + h->str_off;
+
+	// all strings end within the string area
+	if (db->str[h->str_size - 1] != 0) return(-1);
+
+	// only compares, no copy : also fast for a large database
+	for (i = 0; i < h->count; i++)
+	{
+		if (db->rec[i].type >= h->str_size || db->rec[i].material >= h->str_size ||
+			db->rec[i].temp >= h->str_size || db->rec[i].emis >= h->str_size ||
+			db->rec[i].type_idx >= h->types || db->by_mat[i] >= h->count) return(-1);
+	}
+
+	for (i = 0; i < h->types; i++)
+	{
+		if (db->type[i].name >= h->str_size || db->by_type[i] >= h->types ||
+			db->type[i].first + (uint64_t) db->type[i].count > h->count) return(-1);
+	}
+
+	// the entries in the lists are checked during a search
+	for (i = 0; i < h->grams; i++)
+		if (db->gram[i].first + (uint64_t) db->gram[i].count > h->posts) return(-1);
+
+	if ((db->scratch = calloc(1, sizeof(emiss_scratch))) == NULL ||
+		(db->scratch->stamp = calloc(h->count + 1, sizeof(uint32_t))) == NULL ||
+		(db->scratch->hits = calloc(h->count + 1, sizeof(uint16_t))) == NULL ||
+		(db->scratch->cand = calloc(h->count + 1, sizeof(uint32_t))) == NULL ||
+		(db->scratch->order = calloc(h->count + 1, sizeof(uint32_t))) == NULL) return(-1);
+
+	return(0);
+}
+
+emiss_db *emiss_db_open(const char *path)
+{
+	emiss_db	*db;
+	struct stat	st;
+	int			fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) return(NULL);
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(emiss_hdr) ||
+		(db = calloc(1, sizeof(emiss_db))) == NULL)
+	{
+		close(fd);
+		return(NULL);
+	}
+
+	db->size = st.st_size;
+	db->base = mmap(NULL, db->size, PROT_READ, MAP_SHARED, fd, 0);
+	db->mapped = 1;
+
+	// the mapping stays valid
+	close(fd);
+
+	if (db->base == MAP_FAILED)
+	{
+		free(db);
+		return(NULL);
+	}
+
+	if (db_sections(db) < 0)
+	{
+		emiss_db_close(db);
+		return(NULL);
+	}
+
+	return(db);
+}
+
+void emiss_db_close(emiss_db *db)
+{
+	if (db == NULL) return;
+
+	if (db->mapped) munmap(db->base, db->size);
+	else free(db->base);
+
+	if (db == emiss_cur) emiss_cur = NULL;
+
+	if (db->scratch)
+	{
+		free(db->scratch->stamp);
+		free(db->scratch->hits);
+		free(db->scratch->cand);
+		free(db->scratch->order);
+		free(db->scratch);
+	}
+
+	free(db);
+}
+
+/** building */
+
+/* the image is built in memory */
+typedef struct db_build {
+	char		*buf;
+	size_t		len, size;
+} db_build;
+
+/* add len bytes (NULL = zeros), 4 byte aligned
+ * return offset or -1 */
+static long build_add(db_build *b, const void *p, size_t len)
+{
+	size_t	off = b->len, need = (len + 3) & ~3;
+	char	*n;
+
+	if (off + need > b->size)
+	{
+		b->size = (off + need) * 2;
+		if ((n = realloc(b->buf, b->size)) == NULL) return(-1);
+		b->buf = n;
+	}
+
+	if (p) memcpy(b->buf + off, p, len);
+	else memset(b->buf + off, 0, len);
+
+	memset(b->buf + off + len, 0, need - len);
+	b->len += need;
+
+	return((long) off);
+}
+
+/* length of s without white space at start and end
+ * @param start : to store the first character */
+static size_t trim(const char *s, const char **start)
+{
+	size_t len;
+
+	while (isspace((unsigned char) *s)) s++;
+
+	for (len = strlen(s); len > 0 && isspace((unsigned char) s[len - 1]); len--);
+
+	*start = s;
+	return(len);
+}
+
+/* trigrams of a text that are stored / looked up */
+#define GRAMS_MAX	256
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+	return((x > y) - (x < y));
+}
+
+/* add a character to the last 3 (w) and the trigram to g */
+static void gram_add(uint32_t *w, int c, uint32_t *g, int *n, int max)
+{
+	c = isalnum(c) ? tolower(c) : ' ';
+
+	// one space between words
+	if (c == ' ' && (*w & 0xff) == ' ') return;
+
+	// the number of characters (up to 3) is in the top byte
+	*w = ((*w << 8) & 0xffffff) | c | (*w & 0xff000000);
+	if (*w < 0x3000000) *w += 0x1000000;
+
+	// a word starts with a space : 3 characters and not over 2 words
+	if (*w >= 0x3000000 && ((*w >> 8) & 0xff) != ' ' && *n < max) g[(*n)++] = *w & 0xffffff;
+}
+
+/* the trigrams of the words in s and t (NULL = none), sorted, each once
+ * A word is letters and digits (no case) with a space before and after.
+ * return number of trigrams (at most max) */
+static int text_grams(const char *s, const char *t, uint32_t *g, int max)
+{
+	uint32_t	w = 0x1000000 | ' ';
+	int			n = 0, k, num = 0;
+
+	for ( ; *s; s++) gram_add(&w, (unsigned char) *s, g, &n, max);
+	gram_add(&w, ' ', g, &n, max);
+
+	for ( ; t && *t; t++) gram_add(&w, (unsigned char) *t, g, &n, max);
+	gram_add(&w, ' ', g, &n, max);
+
+	qsort(g, n, sizeof(uint32_t), cmp_u32);
+
+	for (k = 0; k < n; k++)
+		if (k == 0 || g[k] != g[k - 1]) g[num++] = g[k];
+
+	return(num);
+}
+
+/* the strings of the image, to sort the indexes */
+static const char *sort_str;
+static const emiss_rec *sort_rec;
+static const emiss_type *sort_type;
+
+static int cmp_type(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+	int		 r = strcasecmp(sort_str + sort_type[x].name, sort_str + sort_type[y].name);
+
+	return(r ? r : (x > y) - (x < y));
+}
+
+static int cmp_mat(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+	int		 r = strcasecmp(sort_str + sort_rec[x].material, sort_str + sort_rec[y].material);
+
+	return(r ? r : (x > y) - (x < y));
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return((x > y) - (x < y));
+}
+
+/* add a string without white space at start and end
+ * return offset or -1 */
+static long build_str(db_build *b, const char *s)
+{
+	const char	*start;
+	size_t		len = trim(s, &start);
+	long		off;
+
+	if ((off = build_add(b, NULL, len + 1)) >= 0) memcpy(b->buf + off, start, len);
+
+	return(off);
+}
+
+emiss_db *emiss_db_build(const lookuptab *tab, int num)
+{
+	db_build	str = {0}, img = {0};
+	emiss_db	*db = NULL;
+	emiss_hdr	h;
+	emiss_rec	*rec = NULL;
+	emiss_type	*type = NULL;
+	emiss_gram	*gram = NULL;
+	uint32_t	*by_type = NULL, *by_mat = NULL, *order = NULL, *type_of = NULL, *post = NULL, i, j, t;
+	uint32_t	g[GRAMS_MAX];
+	uint64_t	*pair = NULL, *n_pair;
+	const char	*s;
+	size_t		len, pairs = 0, size = 0;
+	long		off[7];
+	int			k, n;
+
+	if (num < 0) for (num = 0; strcmp(tab[num].type, "0"); num++);
+
+	memset(&h, 0, sizeof(h));
+
+	if ((rec = calloc(num + 1, sizeof(emiss_rec))) == NULL ||
+		(type = calloc(num + 1, sizeof(emiss_type))) == NULL ||
+		(type_of = calloc(num + 1, sizeof(uint32_t))) == NULL ||
+		(order = calloc(num + 1, sizeof(uint32_t))) == NULL ||
+		(by_type = calloc(num + 1, sizeof(uint32_t))) == NULL ||
+		(by_mat = calloc(num + 1, sizeof(uint32_t))) == NULL) goto done;
+
+	// offset 0 is the empty string
+	if (build_add(&str, "", 1) < 0) goto done;
+
+	// the types in order of first appearance
+	for (i = 0, t = 0; i < (uint32_t) num; i++)
+	{
+		len = trim(tab[i].type, &s);
+
+		// mostly the same type as the entry before
+		if (i == 0 || strlen(str.buf + type[t].name) != len || strncmp(str.buf + type[t].name, s, len))
+		{
+			for (t = 0; t < h.types; t++)
+			{
+				if (strlen(str.buf + type[t].name) == len && ! strncmp(str.buf + type[t].name, s, len))
+					break;
+			}
+
+			if (t == h.types)
+			{
+				if ((off[0] = build_str(&str, s)) < 0) goto done;
+				type[h.types++].name = off[0];
+			}
+		}
+
+		type[t].count++;
+		type_of[i] = t;
+	}
+
+	// the entries of a type together, in the order of the table
+	for (t = 0, j = 0; t < h.types; t++)
+	{
+		type[t].first = j;
+
+		for (i = 0; i < (uint32_t) num; i++)
+			if (type_of[i] == t) order[j++] = i;
+	}
+
+	for (j = 0; j < (uint32_t) num; j++)
+	{
+		i = order[j];
+
+		if ((off[1] = build_str(&str, tab[i].material)) < 0 ||
+			(off[2] = build_str(&str, tab[i].temp)) < 0 ||
+			(off[3] = build_str(&str, tab[i].emis)) < 0) goto done;
+
+		rec[j].type = type[type_of[i]].name;
+		rec[j].material = off[1];
+		rec[j].temp = off[2];
+		rec[j].emis = off[3];
+		rec[j].value = strtof(tab[i].emis, NULL);
+		rec[j].type_idx = type_of[i];
+	}
+
+	// indexes
+	sort_str = str.buf;
+	sort_rec = rec;
+	sort_type = type;
+
+	for (t = 0; t < h.types; t++) by_type[t] = t;
+	for (i = 0; i < (uint32_t) num; i++) by_mat[i] = i;
+
+	qsort(by_type, h.types, sizeof(uint32_t), cmp_type);
+	qsort(by_mat, num, sizeof(uint32_t), cmp_mat);
+
+	// the trigrams of each entry : sorted on trigram, then entry
+	for (j = 0; j < (uint32_t) num; j++)
+	{
+		n = text_grams(str.buf + rec[j].type, str.buf + rec[j].material, g, GRAMS_MAX);
+		rec[j].grams = n;
+
+		if (pairs + n > size)
+		{
+			size = (pairs + n) * 2;
+			if ((n_pair = realloc(pair, size * sizeof(uint64_t))) == NULL) goto done;
+			pair = n_pair;
+		}
+
+		for (k = 0; k < n; k++) pair[pairs++] = (uint64_t) g[k] << 32 | j;
+	}
+
+	if (pairs) qsort(pair, pairs, sizeof(uint64_t), cmp_u64);
+
+	if ((gram = calloc(pairs + 1, sizeof(emiss_gram))) == NULL ||
+		(post = calloc(pairs + 1, sizeof(uint32_t))) == NULL) goto done;
+
+	for (i = 0; i < pairs; i++)
+	{
+		if (i == 0 || (pair[i] >> 32) != gram[h.grams - 1].code)
+		{
+			gram[h.grams].code = pair[i] >> 32;
+			gram[h.grams++].first = i;
+		}
+
+		gram[h.grams - 1].count++;
+		post[i] = (uint32_t) pair[i];
+	}
+
+	h.posts = pairs;
+
+	// the image
+	h.magic = EMISS_MAGIC;
+	h.version = EMISS_VERSION;
+	h.count = num;
+
+	if (build_add(&img, &h, sizeof(h)) < 0 ||
+		(off[0] = build_add(&img, rec, num * sizeof(emiss_rec))) < 0 ||
+		(off[1] = build_add(&img, type, h.types * sizeof(emiss_type))) < 0 ||
+		(off[2] = build_add(&img, by_type, h.types * sizeof(uint32_t))) < 0 ||
+		(off[3] = build_add(&img, by_mat, num * sizeof(uint32_t))) < 0 ||
+		(off[4] = build_add(&img, gram, h.grams * sizeof(emiss_gram))) < 0 ||
+		(off[5] = build_add(&img, post, h.posts * sizeof(uint32_t))) < 0) goto done;
+
+	h.rec_off = off[0];
+	h.type_off = off[1];
+	h.by_type_off = off[2];
+	h.by_mat_off = off[3];
+	h.gram_off = off[4];
+	h.post_off = off[5];
+	h.str_size = str.len;
+
+	if ((off[0] = build_add(&img, str.buf, str.len)) < 0) goto done;
+
+	h.str_off = off[0];
+	h.size = img.len;
+	memcpy(img.buf, &h, sizeof(h));
+
+	if ((db = calloc(1, sizeof(emiss_db))) == NULL) goto done;
+
+	db->base = img.buf;
+	db->size = img.len;
+	img.buf = NULL;
+
+	if (db_sections(db) < 0)
+	{
+		emiss_db_close(db);
+		db = NULL;
+	}
+
+done:
+	free(rec);
+	free(type);
+	free(order);
+	free(type_of);
+	free(by_type);
+	free(by_mat);
+	free(pair);
+	free(gram);
+	free(post);
+	free(str.buf);
+	free(img.buf);
+
+	return(db);
+}
+
+int emiss_db_save(const emiss_db *db, const char *path)
+{
+	char	tmp[256];
+	FILE	*fp;
+	size_t	n;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	if ((fp = fopen(tmp, "w")) == NULL) return(-1);
+
+	n = fwrite(db->base, 1, db->size, fp);
+
+	if (fclose(fp) != 0 || n != db->size)
+	{
+		unlink(tmp);
+		return(-1);
+	}
+
+	// a program that has the old file mapped keeps it
+	return(rename(tmp, path));
+}
+
+int emiss_db_count(const emiss_db *db)
+{
+	return(db->hdr->count);
+}
+
+int emiss_db_get(const emiss_db *db, int i, lookuptab *e)
+{
+	const emiss_rec *r;
+
+	if (i < 0 || (uint32_t) i >= db->hdr->count) return(-1);
+
+	r = &db->rec[i];
+
+	// read-only strings in the database
+	e->type = (char *) db->str + r->type;
+	e->material = (char *) db->str + r->material;
+	e->temp = (char *) db->str + r->temp;
+	e->emis = (char *) db->str + r->emis;
+
+	return(0);
+}
+
+float emiss_db_value(const emiss_db *db, int i)
+{
+	return(i < 0 || (uint32_t) i >= db->hdr->count ? 0 : db->rec[i].value);
+}
+
+int emiss_use(const char *path)
+{
+	emiss_db *db;
+
+	if ((db = emiss_db_open(path)) == NULL) return(-1);
+
+	emiss_db_close(emiss_cur);
+	emiss_cur = db;
+
+	return(0);
+}
+
+emiss_db *emiss_current()
+{
+	if (emiss_cur == NULL && emiss_use(EMISS_FILE) < 0)
+		emiss_cur = emiss_db_build(emis_table, -1);
+
+	return(emiss_cur);
+}
+
+/** search */
+
+/* first type (in name order) with name >= lookup (no case, len characters) */
+static uint32_t first_type(const emiss_db *db, const char *lookup, size_t len)
+{
+	uint32_t lo = 0, hi = db->hdr->types, mid;
+
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+
+		if (strncasecmp(db->str + db->type[db->by_type[mid]].name, lookup, len) < 0) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return(lo);
+}
+
+/* first entry (in material order) with material >= lookup (no case, len characters) */
+static uint32_t first_mat(const emiss_db *db, const char *lookup, size_t len)
+{
+	uint32_t lo = 0, hi = db->hdr->count, mid;
+
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+
+		if (strncasecmp(db->str + db->rec[db->by_mat[mid]].material, lookup, len) < 0) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return(lo);
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+	int x = *(const int *) a, y = *(const int *) b;
+
+	return((x > y) - (x < y));
+}
+
+/* add the entries of a type (sorted later) */
+static int add_type(const emiss_db *db, uint32_t t, int *found, int num)
+{
+	uint32_t i;
+
+	for (i = 0; i < db->type[t].count; i++) found[num++] = db->type[t].first + i;
+
+	return(num);
+}
+
+int emiss_match(int step, char *lookup, int *pnt, int max)
+{
+	return(emiss_match_db(emiss_current(), step, lookup, pnt, max));
+}
+
+int emiss_match_db(const emiss_db *db, int step, char *lookup, int *pnt, int max)
+{
+	const char	*s, *name;
+	uint32_t	i, t0, t1, m0, m1;
+	size_t		len, size = 0;
+	int			*found, num = 0, k, n;
+
+	if (db == NULL || (pnt && max < 1)) return(0);
+
+	// only count
+	if (pnt == NULL) max = INT_MAX;
+
+	// first entry of each type, in the order of the source
+	if (step == 1)
+	{
+		for (i = 0; i < db->hdr->types && num < max; i++, num++)
+			if (pnt) pnt[num] = db->type[i].first;
+
+		return(num);
+	}
+
+	if (step != 2 && step != 3) return(0);
+
+	len = trim(lookup ? lookup : "", &s);
+
+	// the types and materials that start with lookup (no case)
+	for (t0 = t1 = first_type(db, s, len); t1 < db->hdr->types; t1++)
+	{
+		if (strncasecmp(db->str + db->type[db->by_type[t1]].name, s, len)) break;
+		size += db->type[db->by_type[t1]].count;
+	}
+
+	m0 = m1 = 0;
+
+	if (step == 3)
+	{
+		for (m0 = m1 = first_mat(db, s, len); m1 < db->hdr->count; m1++)
+			if (strncasecmp(db->str + db->rec[db->by_mat[m1]].material, s, len)) break;
+
+		size += m1 - m0;
+	}
+
+	if (size == 0 || (found = malloc(size * sizeof(int))) == NULL) return(0);
+
+	for (i = t0; i < t1; i++)
+	{
+		name = db->str + db->type[db->by_type[i]].name;
+
+		// step 2 : the case as given
+		if (step == 3 || ! strncmp(name, s, len)) num = add_type(db, db->by_type[i], found, num);
+	}
+
+	for (i = m0; i < m1; i++) found[num++] = db->by_mat[i];
+
+	// in the order of the source, an entry that matches on type and material once
+	qsort(found, num, sizeof(int), cmp_int);
+
+	for (k = 0, n = 0; k < num && n < max; k++)
+	{
+		if (k > 0 && found[k] == found[k - 1]) continue;
+		if (pnt) pnt[n] = found[k];
+		n++;
+	}
+
+	free(found);
+	return(n);
+}
+
+/** fuzzy search */
+
+/* trigrams of a query that are used */
+#define QUERY_GRAMS		64
+
+/* weight of a trigram at the start or end of a word : a word of the query
+ * that is the same as a word of the entry has both */
+#define EDGE_WEIGHT		2
+
+/* score for the part of the entry that is matched (shorter is better) */
+#define FIT_BONUS		0.25
+
+/* hit a is worse than b : lower score, else later in the database */
+static int worse(const emiss_hit *a, const emiss_hit *b)
+{
+	return(a->score < b->score || (a->score == b->score && a->entry > b->entry));
+}
+
+/* the worst of the k best is on top (hit[0]) */
+static void heap_down(emiss_hit *hit, int num, int i)
+{
+	emiss_hit	t;
+	int			c;
+
+	for ( ; (c = 2 * i + 1) < num; i = c)
+	{
+		if (c + 1 < num && worse(&hit[c + 1], &hit[c])) c++;
+		if (! worse(&hit[c], &hit[i])) break;
+
+		t = hit[i]; hit[i] = hit[c]; hit[c] = t;
+	}
+}
+
+static void heap_up(emiss_hit *hit, int i)
+{
+	emiss_hit	t;
+	int			p;
+
+	for ( ; i > 0 && worse(&hit[i], &hit[p = (i - 1) / 2]); i = p)
+	{
+		t = hit[i]; hit[i] = hit[p]; hit[p] = t;
+	}
+}
+
+static int cmp_hit(const void *a, const void *b)
+{
+	return(worse(a, b) - worse(b, a));
+}
+
+/* is entry e in a list of entries (sorted) */
+static int in_list(const uint32_t *list, uint32_t num, uint32_t e)
+{
+	uint32_t lo = 0, hi = num, mid;
+
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+
+		if (list[mid] < e) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return(lo < num && list[lo] == e);
+}
+
+/* the entries of trigram code (num = 0 if not in the database) */
+static const uint32_t *gram_list(const emiss_db *db, uint32_t code, uint32_t *num)
+{
+	uint32_t lo = 0, hi = db->hdr->grams, mid;
+
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+
+		if (db->gram[mid].code < code) lo = mid + 1;
+		else hi = mid;
+	}
+
+	if (lo == db->hdr->grams || db->gram[lo].code != code)
+	{
+		*num = 0;
+		return(NULL);
+	}
+
+	*num = db->gram[lo].count;
+	return(db->post + db->gram[lo].first);
+}
+
+int emiss_search(const char *query, emiss_hit *hit, int k)
+{
+	return(emiss_search_db(emiss_current(), query, hit, k));
+}
+
+int emiss_search_db(const emiss_db *db, const char *query, emiss_hit *hit, int k)
+{
+	emiss_scratch	*sc;
+	const uint32_t	*list[QUERY_GRAMS], *l;
+	uint32_t		g[QUERY_GRAMS], len[QUERY_GRAMS], at[256], e, c, i, j, ncand = 0;
+	int				wt[QUERY_GRAMS + 1], n, w, total = 0, need, rare, rest, s;
+	int				num = 0;
+	emiss_hit		h;
+
+	if (db == NULL || query == NULL || k < 1) return(0);
+
+	if ((n = text_grams(query, NULL, g, QUERY_GRAMS)) == 0) return(0);
+
+	// the lists of the trigrams, shortest first
+	for (i = 0; i < (uint32_t) n; i++)
+	{
+		l = gram_list(db, g[i], &c);
+		w = (g[i] >> 16) == ' ' || (g[i] & 0xff) == ' ' ? EDGE_WEIGHT : 1;
+		total += w;
+
+		for (j = i; j > 0 && len[j - 1] > c; j--)
+		{
+			list[j] = list[j - 1];
+			len[j] = len[j - 1];
+			wt[j] = wt[j - 1];
+		}
+
+		list[j] = l;
+		len[j] = c;
+		wt[j] = w;
+	}
+
+	// at least half of the weight : a candidate is in one of the rarest,
+	// as the others together weigh less
+	need = (total + 1) / 2;
+
+	for (rare = 0, rest = total; rare < n && rest >= need; rare++) rest -= wt[rare];
+
+	sc = db->scratch;
+
+	if (++sc->gen == 0)
+	{
+		memset(sc->stamp, 0, db->hdr->count * sizeof(uint32_t));
+		sc->gen = 1;
+	}
+
+	// per candidate : trigrams found (high byte) and their weight
+	for (i = 0; i < (uint32_t) rare; i++)
+	{
+		for (j = 0; j < len[i]; j++)
+		{
+			if ((e = list[i][j]) >= db->hdr->count) continue;
+
+			if (sc->stamp[e] != sc->gen)
+			{
+				sc->stamp[e] = sc->gen;
+				sc->hits[e] = 0;
+				sc->cand[ncand++] = e;
+			}
+
+			sc->hits[e] += 0x100 | wt[i];
+		}
+	}
+
+	// the most weight first (counting sort), in the order of the database
+	memset(at, 0, sizeof(at));
+
+	for (j = 0; j < ncand; j++) at[sc->hits[sc->cand[j]] & 0xff]++;
+
+	for (i = 255, c = 0; i < 256; i--)
+	{
+		c += at[i];
+		at[i] = c - at[i];
+	}
+
+	for (j = 0; j < ncand; j++) sc->order[at[sc->hits[sc->cand[j]] & 0xff]++] = sc->cand[j];
+
+	for (j = 0; j < ncand; j++)
+	{
+		e = sc->order[j];
+		s = sc->hits[e] & 0xff;
+		c = sc->hits[e] >> 8;
+
+		// the best it can have does not get in the best k : nor the others
+		if (num == k)
+		{
+			if ((float) (s + rest) / total + FIT_BONUS < hit[0].score) break;
+
+			// with all other trigrams, of this entry
+			g[0] = c + n - rare < db->rec[e].grams ? c + n - rare : db->rec[e].grams;
+			if ((float) (s + rest) / total + FIT_BONUS * g[0] / (db->rec[e].grams ? db->rec[e].grams : 1) < hit[0].score)
+				continue;
+		}
+
+		// the other trigrams, as long as it can have enough
+		for (i = rare, w = rest; i < (uint32_t) n && s + w >= need; w -= wt[i++])
+		{
+			// a trigram of all entries is not looked up
+			if (len[i] == db->hdr->count || in_list(list[i], len[i], e))
+			{
+				s += wt[i];
+				c++;
+			}
+		}
+
+		if (s < need) continue;
+
+		h.entry = e;
+		h.score = (float) s / total + FIT_BONUS * c / (db->rec[e].grams ? db->rec[e].grams : 1);
+
+		if (num < k)
+		{
+			hit[num] = h;
+			heap_up(hit, num++);
+		}
+		else if (worse(&hit[0], &h))
+		{
+			hit[0] = h;
+			heap_down(hit, num, 0);
+		}
+	}
+
+	// best first
+	qsort(hit, num, sizeof(emiss_hit), cmp_hit);
+
+	return(num);
+}
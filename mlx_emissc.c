@@ -0,0 +1,250 @@
+/* mlx_emissc : compile an emissivity table (CSV) to a database file
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_emissc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_emissc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_emissc. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Each line of the CSV is : type,material,temperature,emissivity
+ * A field with a comma is between double quotes ("" is a quote in it).
+ * Empty lines, lines starting with # and a header line (first field
+ * "type") are skipped. Without a CSV the built-in table is compiled.
+ *
+ * usage : mlx_emissc [-o file] [table.csv]
+ *         mlx_emissc -d [file]      write a database as CSV
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include "mlx90615.h"
+
+/* fields per line */
+#define CSV_FIELDS	4
+
+void usage(char *name)
+{
+	fprintf(stderr, "usage : %s [-o file] [table.csv]\n"
+		"        %s -d [file]\n"
+		"  -o file    database to write (default %s)\n"
+		"  -d         write the database (default the built-in table) as CSV\n",
+		name, name, EMISS_FILE);
+	exit(1);
+}
+
+/* split a CSV line in place
+ * return number of fields */
+static int csv_split(char *line, char **field, int max)
+{
+	char	*p = line, *out;
+	int		n = 0;
+
+	while (n < max)
+	{
+		field[n++] = out = p;
+
+		if (*p == '"')
+		{
+			// quoted : up to the closing quote, "" is a quote
+			for (p++; *p; p++)
+			{
+				if (*p == '"' && *++p != '"') break;
+				*out++ = *p;
+			}
+		}
+
+		for ( ; *p && *p != ',' && *p != '\n' && *p != '\r'; p++) *out++ = *p;
+
+		if (*p != ',')
+		{
+			*out = 0;
+			break;
+		}
+
+		*out = 0;
+		p++;
+	}
+
+	return(n);
+}
+
+/* write a field, quoted if needed */
+static void csv_field(const char *s, int last)
+{
+	if (strpbrk(s, ",\"") == NULL) fputs(s, stdout);
+	else
+	{
+		putchar('"');
+
+		for ( ; *s; s++)
+		{
+			if (*s == '"') putchar('"');
+			putchar(*s);
+		}
+
+		putchar('"');
+	}
+
+	putchar(last ? '\n' : ',');
+}
+
+static int dump(char *path)
+{
+	emiss_db	*db;
+	lookuptab	e;
+	int			i;
+
+	if (path) db = emiss_db_open(path);
+	else db = emiss_db_build(emis_table, -1);
+
+	if (db == NULL)
+	{
+		fprintf(stderr, "can not open %s\n", path ? path : "the built-in table");
+		return(1);
+	}
+
+	printf("type,material,temperature F (C),emissivity\n");
+
+	for (i = 0; emiss_db_get(db, i, &e) == 0; i++)
+	{
+		csv_field(e.type, 0);
+		csv_field(e.material, 0);
+		csv_field(e.temp, 0);
+		csv_field(e.emis, 1);
+	}
+
+	emiss_db_close(db);
+	return(0);
+}
+
+/* read the table from a CSV
+ * return number of entries or -1 on error */
+static int read_csv(char *path, lookuptab **tab)
+{
+	FILE		*fp;
+	lookuptab	*t = NULL, *n;
+	char		*line = NULL, *field[CSV_FIELDS + 1], *end;
+	size_t		len = 0;
+	int			num = 0, size = 0, lineno = 0, ret = -1;
+	float		val;
+
+	if ((fp = fopen(path, "r")) == NULL)
+	{
+		perror(path);
+		return(-1);
+	}
+
+	while (getline(&line, &len, fp) > 0)
+	{
+		lineno++;
+
+		if (line[strspn(line, " \t\r\n")] == 0 || line[0] == '#') continue;
+
+		if (csv_split(line, field, CSV_FIELDS + 1) != CSV_FIELDS)
+		{
+			fprintf(stderr, "%s:%d : not %d fields\n", path, lineno, CSV_FIELDS);
+			goto done;
+		}
+
+		// header
+		if (num == 0 && ! strcasecmp(field[0], "type")) continue;
+
+		val = strtof(field[3], &end);
+
+		if (end == field[3] || val < 0 || val > 1)
+		{
+			fprintf(stderr, "%s:%d : invalid emissivity %s\n", path, lineno, field[3]);
+			goto done;
+		}
+
+		if (num == size)
+		{
+			size = size ? size * 2 : 1024;
+			if ((n = realloc(t, size * sizeof(lookuptab))) == NULL) goto done;
+			t = n;
+		}
+
+		t[num].type = strdup(field[0]);
+		t[num].material = strdup(field[1]);
+		t[num].temp = strdup(field[2]);
+		t[num].emis = strdup(field[3]);
+
+		if (! t[num].type || ! t[num].material || ! t[num].temp || ! t[num].emis)
+		{
+			fprintf(stderr, "out of memory\n");
+			goto done;
+		}
+
+		num++;
+	}
+
+	ret = num;
+
+done:
+	free(line);
+	fclose(fp);
+
+	*tab = t;
+	return(ret < 0 ? -1 : num);
+}
+
+int main(int argc, char *argv[])
+{
+	emiss_db	*db;
+	lookuptab	*tab = NULL;
+	char		*out = EMISS_FILE;
+	int			c, num = -1, do_dump = 0;
+
+	while ((c = getopt(argc, argv, "o:d")) != -1)
+	{
+		switch(c)
+		{
+			case 'o':	out = optarg;	break;
+			case 'd':	do_dump = 1;	break;
+			default:	usage(argv[0]);
+		}
+	}
+
+	if (argc - optind > 1) usage(argv[0]);
+
+	if (do_dump) exit(dump(optind < argc ? argv[optind] : NULL));
+
+	if (optind < argc)
+	{
+		if ((num = read_csv(argv[optind], &tab)) < 0) exit(1);
+
+		db = emiss_db_build(tab, num);
+	}
+	else
+		db = emiss_db_build(emis_table, -1);
+
+	if (db == NULL)
+	{
+		fprintf(stderr, "can not build the database\n");
+		exit(1);
+	}
+
+	if (emiss_db_save(db, out) < 0)
+	{
+		perror(out);
+		exit(1);
+	}
+
+	printf("%d entries written to %s\n", emiss_db_count(db), out);
+
+	emiss_db_close(db);
+	exit(0);
+}
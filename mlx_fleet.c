@@ -0,0 +1,369 @@
+/* libmlx90615 : registry of sensors keyed on the unit ID
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_fleet is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_fleet is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_fleet. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The file is a header (fleet_hdr) followed by a power of 2 slots of
+ * mlx_unit : an open addressing hash table with linear probing on the
+ * unit ID (ID 0 is a free slot). The file is mapped shared, so the table
+ * is used in place and nothing has to be loaded or saved.
+ *
+ * The table is kept at most 3/4 full. When it would become fuller, it
+ * is doubled : the file is extended, mapped again and all units are
+ * placed in their new slots. A removed unit is not marked but the units
+ * after it are moved back (backward shift), so a lookup never has to
+ * pass deleted slots.
+ *
+ * The number of slots is kept from the moment the file was mapped : a
+ * read-only open does not hold the lock and the writer can double the
+ * table meanwhile. Each lookup compares it with the header and maps the
+ * file again when the table has grown.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "libmlx90615.h"
+
+#define FLEET_MAGIC		0x544c4658		// "XFLT"
+#define FLEET_VERSION	1
+
+/* slots in a new file */
+#define FLEET_SLOTS		64
+
+_Static_assert(sizeof(mlx_unit) == 64, "unit size");
+
+typedef struct fleet_hdr {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	unit_size;
+	uint32_t	slots;			// power of 2
+	uint32_t	count;			// units in use
+	uint32_t	pad[3];
+} fleet_hdr;
+
+struct mlx_fleet {
+	int			fd;
+	int			writer;
+	size_t		size;			// of the mapping
+	uint32_t	slots;			// in the mapping
+	fleet_hdr	*hdr;
+	mlx_unit	*unit;
+};
+
+/* spread the bits of the ID (murmur3 finalizer) : IDs of sensors of
+ * one batch differ in a few low bits only */
+static uint32_t fleet_hash(uint32_t id)
+{
+	id ^= id >> 16;
+	id *= 0x85ebca6b;
+	id ^= id >> 13;
+	id *= 0xc2b2ae35;
+	id ^= id >> 16;
+
+	return(id);
+}
+
+static size_t fleet_size(uint32_t slots)
+{
+	return(sizeof(fleet_hdr) + (size_t) slots * sizeof(mlx_unit));
+}
+
+/* map size bytes of the file, in place of the current mapping */
+static int fleet_map(mlx_fleet *fleet, size_t size)
+{
+	void *p;
+
+	p = mmap(NULL, size, fleet->writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fleet->fd, 0);
+
+	if (p == MAP_FAILED) return(-1);
+
+	if (fleet->hdr) munmap(fleet->hdr, fleet->size);
+
+	fleet->size = size;
+	fleet->hdr = p;
+	fleet->unit = (mlx_unit *) (fleet->hdr + 1);
+
+	return(0);
+}
+
+/* slot of an ID, or the free slot where it would go */
+static uint32_t fleet_slot(mlx_fleet *fleet, uint32_t id)
+{
+	uint32_t mask = fleet->slots - 1, i;
+
+	for (i = fleet_hash(id) & mask; fleet->unit[i].id != 0; i = (i + 1) & mask)
+		if (fleet->unit[i].id == id) break;
+
+	return(i);
+}
+
+/* double the number of slots
+ * return 0 = OK, -1 = error */
+static int fleet_grow(mlx_fleet *fleet)
+{
+	mlx_unit	*old;
+	uint32_t	slots = fleet->slots * 2, i, n = 0;
+
+	// the units, in the order of the old table
+	if ((old = malloc(fleet->hdr->count * sizeof(mlx_unit))) == NULL) return(-1);
+
+	for (i = 0; i < fleet->slots; i++)
+		if (fleet->unit[i].id != 0) old[n++] = fleet->unit[i];
+
+	if (ftruncate(fleet->fd, fleet_size(slots)) < 0)
+	{
+		free(old);
+		return(-1);
+	}
+
+	// the old table is still valid if the new one can not be mapped
+	if (fleet_map(fleet, fleet_size(slots)) < 0)
+	{
+		(void) ftruncate(fleet->fd, fleet->size);
+		free(old);
+		return(-1);
+	}
+
+	fleet->hdr->slots = fleet->slots = slots;
+	memset(fleet->unit, 0, slots * sizeof(mlx_unit));
+
+	for (i = 0; i < n; i++)
+		fleet->unit[fleet_slot(fleet, old[i].id)] = old[i];
+
+	free(old);
+	return(0);
+}
+
+/* read-only : map the file again if the writer has grown the table.
+ * The current mapping is kept if the new size is not valid (yet). */
+static void fleet_check(mlx_fleet *fleet)
+{
+	struct stat	st;
+	uint32_t	slots = fleet->hdr->slots;
+
+	if (fleet->writer || slots == fleet->slots) return;
+
+	if (slots == 0 || (slots & (slots - 1)) || fstat(fleet->fd, &st) < 0 ||
+		(size_t) st.st_size < fleet_size(slots)) return;
+
+	if (fleet_map(fleet, fleet_size(slots)) == 0) fleet->slots = slots;
+}
+
+mlx_fleet *mlx_fleet_open(const char *path, int flags)
+{
+	mlx_fleet	*fleet;
+	struct stat	st;
+	fleet_hdr	*hdr;
+	int			oflags;
+
+	if (path == NULL) path = MLX_FLEET_FILE;
+
+	if ((fleet = calloc(1, sizeof(mlx_fleet))) == NULL) return(NULL);
+
+	fleet->writer = ! (flags & MLX_FLEET_RDONLY);
+
+	oflags = fleet->writer ? O_RDWR : O_RDONLY;
+	if (fleet->writer && (flags & MLX_FLEET_CREATE)) oflags |= O_CREAT;
+
+	if ((fleet->fd = open(path, oflags | O_CLOEXEC, 0644)) < 0)
+	{
+		free(fleet);
+		return(NULL);
+	}
+
+	// only one writer
+	if (fleet->writer && flock(fleet->fd, LOCK_EX | LOCK_NB) < 0) goto error;
+
+	if (fstat(fleet->fd, &st) < 0) goto error;
+
+	// new file
+	if (st.st_size == 0 && fleet->writer)
+	{
+		if (ftruncate(fleet->fd, fleet_size(FLEET_SLOTS)) < 0) goto error;
+		if (fleet_map(fleet, fleet_size(FLEET_SLOTS)) < 0) goto error;
+
+		hdr = fleet->hdr;
+		hdr->version = FLEET_VERSION;
+		hdr->unit_size = sizeof(mlx_unit);
+		hdr->slots = fleet->slots = FLEET_SLOTS;
+		hdr->count = 0;
+		hdr->magic = FLEET_MAGIC;
+
+		return(fleet);
+	}
+
+	if (st.st_size < (off_t) sizeof(fleet_hdr)) goto bad;
+
+	if (fleet_map(fleet, st.st_size) < 0) goto error;
+
+	hdr = fleet->hdr;
+
+	if (hdr->magic != FLEET_MAGIC || hdr->version != FLEET_VERSION ||
+		hdr->unit_size != sizeof(mlx_unit) || hdr->slots == 0 ||
+		(hdr->slots & (hdr->slots - 1)) || fleet_size(hdr->slots) != (size_t) st.st_size ||
+		hdr->count >= hdr->slots)
+	{
+		munmap(fleet->hdr, fleet->size);
+		goto bad;
+	}
+
+	fleet->slots = hdr->slots;
+
+	return(fleet);
+
+bad:
+	errno = EINVAL;
+error:
+	close(fleet->fd);
+	free(fleet);
+	return(NULL);
+}
+
+void mlx_fleet_close(mlx_fleet *fleet)
+{
+	if (fleet == NULL) return;
+
+	if (fleet->writer) msync(fleet->hdr, fleet->size, MS_SYNC);
+
+	munmap(fleet->hdr, fleet->size);
+	close(fleet->fd);
+	free(fleet);
+}
+
+int mlx_fleet_sync(mlx_fleet *fleet)
+{
+	if (! fleet->writer) return(MLX_ERR_PARAM);
+
+	return(msync(fleet->hdr, fleet->size, MS_SYNC) < 0 ? MLX_ERR_DATA : MLX_OK);
+}
+
+mlx_unit *mlx_fleet_find(mlx_fleet *fleet, uint32_t id)
+{
+	uint32_t i;
+
+	if (id == 0) return(NULL);
+
+	fleet_check(fleet);
+
+	i = fleet_slot(fleet, id);
+
+	return(fleet->unit[i].id == id ? &fleet->unit[i] : NULL);
+}
+
+mlx_unit *mlx_fleet_add(mlx_fleet *fleet, uint32_t id)
+{
+	mlx_unit	*u;
+	uint32_t	i;
+
+	if (id == 0 || ! fleet->writer) return(NULL);
+
+	if ((u = mlx_fleet_find(fleet, id)) != NULL) return(u);
+
+	// keep at most 3/4 full
+	if ((fleet->hdr->count + 1) * 4 > fleet->slots * 3 && fleet_grow(fleet) < 0) return(NULL);
+
+	i = fleet_slot(fleet, id);
+	u = &fleet->unit[i];
+
+	memset(u, 0, sizeof(mlx_unit));
+	u->emiss = MLX_UNIT_NOEMISS;
+	u->gain = 1;
+	u->id = id;
+
+	fleet->hdr->count++;
+
+	return(u);
+}
+
+int mlx_fleet_del(mlx_fleet *fleet, uint32_t id)
+{
+	uint32_t mask, i, j, k;
+
+	if (! fleet->writer || mlx_fleet_find(fleet, id) == NULL) return(MLX_ERR_PARAM);
+
+	mask = fleet->slots - 1;
+	i = fleet_slot(fleet, id);
+
+	// move back the units that would not be found past the hole
+	for (j = (i + 1) & mask; fleet->unit[j].id != 0; j = (j + 1) & mask)
+	{
+		k = fleet_hash(fleet->unit[j].id) & mask;
+
+		// home slot k is cyclically in (i, j] : it can stay
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+
+		fleet->unit[i] = fleet->unit[j];
+		i = j;
+	}
+
+	memset(&fleet->unit[i], 0, sizeof(mlx_unit));
+	fleet->hdr->count--;
+
+	return(MLX_OK);
+}
+
+void mlx_fleet_place(mlx_fleet *fleet, mlx_unit *u, uint8_t bus, uint8_t addr)
+{
+	mlx_unit *old;
+
+	if (! fleet->writer) return;
+
+	if ((old = mlx_fleet_at(fleet, bus, addr)) != NULL && old != u) old->addr = 0;
+
+	u->bus = bus;
+	u->addr = addr;
+}
+
+mlx_unit *mlx_fleet_at(mlx_fleet *fleet, uint8_t bus, uint8_t addr)
+{
+	uint32_t i;
+
+	if (addr == 0) return(NULL);
+
+	fleet_check(fleet);
+
+	for (i = 0; i < fleet->slots; i++)
+	{
+		if (fleet->unit[i].id != 0 && fleet->unit[i].bus == bus && fleet->unit[i].addr == addr)
+			return(&fleet->unit[i]);
+	}
+
+	return(NULL);
+}
+
+int mlx_fleet_count(mlx_fleet *fleet)
+{
+	return(fleet->hdr->count);
+}
+
+mlx_unit *mlx_fleet_next(mlx_fleet *fleet, int *pos)
+{
+	// a table that grew is mapped again at the start of a walk only
+	if (*pos == 0) fleet_check(fleet);
+
+	while (*pos >= 0 && (uint32_t) *pos < fleet->slots)
+	{
+		if (fleet->unit[(*pos)++].id != 0) return(&fleet->unit[*pos - 1]);
+	}
+
+	return(NULL);
+}
@@ -19,22 +19,17 @@
  * 
  * initial version of program
  *   
+ * The communication itself is done by libmlx90615. The routines here
+ * apply the program settings (slave address, PEC check) on the device
+ * and display the errors.
  */
  
-#include <bcm2835.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <unistd.h>
 #include "mlx90615.h"
 
-/* MLX commands */
-#define MLX_EEPROM 	0x10	// EEPROM access
-#define MLX_RAM		0x20	// RAM access
-#define MLX_READ    0x1		// read instruction
-#define MLX_WRITE   0x0		// write instruction
-#define MLX_SLEEP 	0xc6	// sleep command
-
 /* (default) MLX90615 slave address */
 uint8_t slave_address_base = default_SLA;
 
@@ -47,6 +42,98 @@ int no_pec_check = 0;
 /* apply Debug */
 int DEBUG = 0;
 
+/* power off time for a power on reset (ms) */
+int por_off = 1000;
+
+/* bus and MLX90615 in use */
+static mlx_bus *bus = NULL;
+static mlx_dev *dev = NULL;
+
+/* GPIO next to the bus (NULL with the bus broker) */
+static mlx_gpio *gpio = NULL;
+
+/* simulation (-S) */
+static mlx_sim *sim = NULL;
+
+/* apply the program settings on the device before access */
+static void sync_dev()
+{
+	mlx_set_addr(dev, slave_address_base);
+	mlx_set_flags(dev, no_pec_check ? MLX_F_NOPEC : 0);
+}
+
+/* display debug message for a library error */
+static void debug_err(char *what, int ret)
+{
+	if (DEBUG) p_printf(1, "DEBUG: %s: %s\n", what, mlx_strerror(ret));
+}
+
+/* simulated MLX90615 in real time : EEPROM write, power on reset and
+ * the PWM signal on SDA take the time they take on a real one
+ * return bus or NULL in case of error */
+static mlx_bus *sim_init()
+{
+	mlx_bus *b;
+
+	if ((sim = mlx_sim_new()) == NULL) return(NULL);
+
+	if (mlx_sim_add(sim, default_SLA, 0x64c744) != MLX_OK ||
+		(b = mlx_bus_open_sim(sim)) == NULL)
+	{
+		mlx_sim_free(sim);
+		sim = NULL;
+		return(NULL);
+	}
+
+	mlx_sim_set_temp(sim, default_SLA, 21.5, 36.8);
+	mlx_sim_set_clock(sim, mlx_clock_real());
+
+	gpio = mlx_gpio_open_sim(sim, sda_pin, 0);
+
+	return(b);
+}
+
+/* open the bus and MLX90615
+ * @param broker : socket of bus broker, NULL = BCM2835
+ * return 0 = OK, -1 = error */
+int mlx_lib_init(char *broker)
+{
+	if (broker) bus = mlx_bus_open_broker(broker);
+	else if (simulate) bus = sim_init();
+	else if ((bus = mlx_bus_open_bcm2835()) != NULL) gpio = mlx_gpio_open_bcm2835();
+	
+	if (bus == NULL) return(-1);
+
+	if ((dev = mlx_open(bus, slave_address_base, 0)) == NULL)
+	{
+		mlx_lib_close();
+		return(-1);
+	}
+
+	return(0);
+}
+
+/* release the MLX90615 and bus */
+void mlx_lib_close()
+{
+	if (dev) mlx_close(dev);
+	if (gpio) mlx_gpio_close(gpio);
+	if (bus) mlx_bus_close(bus);
+	if (sim) mlx_sim_free(sim);
+
+	dev = NULL;
+	gpio = NULL;
+	bus = NULL;
+	sim = NULL;
+}
+
+/* return the MLX90615 in use (for direct library calls) */
+mlx_dev *mlx_lib_dev()
+{
+	sync_dev();
+	return(dev);
+}
+
 /* CRC8 check to compare PEC (Packet Error Checking)
  * &param poly : x8+x2+x1+1
  * @param data : array to check
@@ -56,33 +143,14 @@ int DEBUG = 0;
  */
 uint8_t crc8Msb(uint8_t poly, uint8_t * data, int size)
 {
-	uint8_t crc = 0x00;
-	int bit;
-	
-	while (size--)
-	{
-		crc ^= *data++;
-		
-		for (bit = 0;  bit < 8; bit++)
-		{
-			if (crc & 0x80)  crc = crc << 1 ^ poly; 
-			else crc <<= 1;
-		}
-	}
-	return(crc);
+	return(mlx_crc8(poly, data, size));
 }
 
 /* handle power ON or OFF for MLX */
 
 void mlx_power(int act)
 {
-
-	// set the power pin to output
-	bcm2835_gpio_fsel(power_pin, BCM2835_GPIO_FSEL_OUTP); 
-	
-	if (act == ON) bcm2835_gpio_write(power_pin, HIGH);
-	else 	bcm2835_gpio_write(power_pin, LOW);
-	
+	if (bus) mlx_bus_power(bus, act == ON);
 }
 
 /* make sure NOT to overwrite any MLX reserved bits in the
@@ -97,26 +165,16 @@ void mlx_power(int act)
 
 long valid_config(long val)
 {
-	long  result;
+	uint16_t result;
+	
+	sync_dev();
 	
-	if ((result = read_reg(CONFIG)) < 0)
+	if (mlx_config_merge(dev, (uint16_t) val, &result) != MLX_OK)
 	{
 		printf(REDSTR,"can not read CONFIG register\n");
 		return (-1);
 	}
 
-	// Bit 0 : PWM or SMB
-	if (val & 0x1)	result |= 1 << 0;
-	else result &= ~ (1 << 0);
-
-	// Bit 1 : PWM frequency
-	if (val & 0x2)	result |= 1 << 1;
-	else result &= ~ (1 << 1);	
-	
-	// Bit 2 : PWM output	
-	if (val & 0x4)	result |= 1 << 2;
-	else result &= ~ (1 << 2);	
-	
 	return(result);
 }
 
@@ -132,50 +190,16 @@ long valid_config(long val)
 
 int write_mlx(char reg, long val)
 {
-	char wbuf[6]= {0};
+	int ret;
 	
-	/* needed to calculate PEC */
-	wbuf[0]=slave_address_base <<1 | MLX_WRITE;
-	wbuf[1]= reg;
- 	wbuf[2]= val & 0xff;						// LSB
-	wbuf[3]=(val >> 8) & 0xff;					// MSB   
-	wbuf[4]=crc8Msb(0x7, (uint8_t *) wbuf, 4);	// add PEC
+	sync_dev();
 	
-	if (crc8Msb(0x7, (uint8_t *) wbuf, 5))
+	if ((ret = mlx_write_raw(dev, reg, (uint16_t) val)) != MLX_OK)
 	{
-		printf(REDSTR,"error in CRC check\n");
+		debug_err("write", ret);
 		return(-1);
 	}
 	
-	/* While the slave_address is needed for the correct PEC calculation
-	 * it should NOT be sent by user level, as the BCM2835 will do 
-	 * that already automatically. (hence wbuf+1)
-	 */
-	 
-    switch(bcm2835_i2c_write(wbuf+1,4))
-    {
-        case BCM2835_I2C_REASON_ERROR_NACK :
-            if(DEBUG) printf(REDSTR,"DEBUG: write NACK error\n");
-            return(-1);
-            break;
-        case BCM2835_I2C_REASON_ERROR_CLKT :
-            if(DEBUG) printf(REDSTR,"DEBUG: write Clock stretch error\n");
-            return(-1);
-            break;
-        case BCM2835_I2C_REASON_ERROR_DATA :
-            if(DEBUG) printf(REDSTR,"DEBUG: not all data has been sent\n");
-            return(-1);
-            break;
-    }
-    
-    /* Apperently the EEPROM needs a delay after write to handle/settle.
-	 * This is undocumented, but needed !!
-	 * 
-	 * imperial research proved 50ms is needed at least for stable working, 
-	 * for safety 100ms has bee choosen !! 
-	 */
-	 
-    usleep(100000);
     return(0);
 }
 
@@ -189,6 +213,8 @@ int write_mlx(char reg, long val)
 
 int write_reg(char reg, long val)
 {	
+	int ret;
+	
 	// check on allowable registers to write
 	if (reg > 0x03)
 	{
@@ -199,51 +225,55 @@ int write_reg(char reg, long val)
 	// allow only for user definable bits in config
 	if (reg == CONFIG)	if ((val = valid_config(val)) < 0)  return(-1);
 
-	/* Before write operation to EEPROM, this needs to be erased
-	 * by writing 0x0000 (pag 14 of MLX90615 document) */
+	// obtain unit ID for the write count (before slave address changes)
+	wear_prepare();
 
-	if (DEBUG) printf("DEBUG: First erase register %d\n",reg);
+	/* every write costs an EEPROM cycle (erase + write) and 200ms.
+	 * If the register has the requested value already, skip it */
+	if (read_reg(reg) == val)
+	{
+		wear_skip(reg);
+		if (! no_pec_check) cache_set(reg, val);
 
-	// add register opcode
-	if (write_mlx((reg | MLX_EEPROM), 0x0000) < 0) return(-1);
-	
-	/* if updating the SMBUS slave address, it is now set for 0x0 
-	 * we need to take extra action to handle this change. 
-	 * In case the write of the new slave value fails, the MLX
+		// still follow the slave address change (e.g. accessed on 0x0)
+		if (reg == PWMSA) slave_address_base = val & 0x7f;
+
+		return(0);
+	}
+
+	/* The register is erased first (pag 14 of MLX90615 document)
+	 * and then written.
+	 * 
+	 * if updating the SMBUS slave address, it is set for 0x0 after
+	 * the erase. In case the write of the new slave value fails, the MLX
 	 * can still be accessed on address 0x0.
 	 *  
 	 * Although if the write of the new value to the CONFIG has failed, 
 	 * you will continue to get PEC read errors. In that case you will 
 	 * have to disable PEC on read (-n on commandline). */
 	 
-	if (reg == PWMSA)
-	{
-		// set BCM2835 to slave 0x0
-		bcm2835_i2c_setSlaveAddress(0x0);
+	if (DEBUG) printf("DEBUG: Write new value %lx to register %d\n",val,reg);
 	
-		// set for PEC calculation
-		slave_address_base = 0x0;
-		
-		if (DEBUG) printf("DEBUG: Write new slave address:  %lx\n", val);
-		
-		// now update with new address
-		if (write_mlx((reg | MLX_EEPROM), val) < 0)	return(-1);
-
-		// set BCM2835 to slave to new value
-		bcm2835_i2c_setSlaveAddress(val & 0x7f);
+	sync_dev();
+	ret = mlx_write_reg(dev, reg, (uint16_t) val);
 	
-		// set for PEC calculation
-		slave_address_base = val & 0x7f;	
-		
-		return(0);
-	}
+	// set for PEC calculation (0x0 if failed after erase)
+	if (reg == PWMSA) slave_address_base = mlx_get_addr(dev);
 	
-	if (DEBUG) printf("DEBUG: Write new value %lx to register %d\n",val,reg);
-	return(write_mlx((reg | MLX_EEPROM), val));
+	if (ret != MLX_OK)
+	{
+		debug_err("write", ret);
+		return(-1);
+	}
+
+	wear_count(reg);
+	cache_set(reg, val);
+	return(0);
 }
 
-/* read a location from MLX90615
- * @param reg : location to read
+/* read a location from MLX90615 with a library routine
+ * @param rd : mlx_read_reg or mlx_read_ram
+ * @param loc : location to read
  *
  * return value:
  * 	access error   : -1 
@@ -252,59 +282,43 @@ int write_reg(char reg, long val)
  *  
  */
 
-long read_mlx(char loc)
+static long read_mlx(int (*rd)(mlx_dev *, int, uint16_t *), char loc)
 {
-	/* needed to calculate PEC later */
-	char rbuf[6]= {0};	
-	rbuf[0]=slave_address_base<<1 | MLX_WRITE;
-	rbuf[1]=loc;
-	rbuf[2]=slave_address_base<<1 | MLX_READ;
-	char *data = &rbuf[3];
-
-    // perform read with restart
-    switch(bcm2835_i2c_read_register_rs(&loc, data, 3))
-    {
-        case BCM2835_I2C_REASON_ERROR_NACK :
-            if(DEBUG) printf(REDSTR,"DEBUG: NACK error\n");
-            return(-1);
-            break;
-
-        case BCM2835_I2C_REASON_ERROR_CLKT :
-            if(DEBUG) printf(REDSTR,"DEBUG: Clock stretch error\n");
-            return(-1);
-            break;
-
-        case BCM2835_I2C_REASON_ERROR_DATA :
-            if(DEBUG) printf(REDSTR,"DEBUG: not all data has been read\n");
-            return(-1);
-            break;
-    }
+	uint16_t val;
+	int		 ret;
+	
+	sync_dev();
+	
+	if ((ret = rd(dev, loc, &val)) == MLX_OK) return(val);
 	
-	// unless requested on the command line (-n) a PEC check is done on read
-	if (no_pec_check == 0)
+	if (ret == MLX_ERR_PEC)
 	{
-		// check PEC
-		if (crc8Msb(0x7, (uint8_t *) rbuf, 5)  != rbuf[5])
-		{
-			p_printf(1, "PEC error. expected: %x, based on data calculated: %x\n", rbuf[5], crc8Msb(0x7, (uint8_t *) rbuf, 5) );
-			if (DEBUG) p_printf(1,"DEBUG:reg: %x  data received MSB %x, LSB %x\n", slave_address_base, (int) rbuf[4], (int) rbuf[3]);
-			return(-2);
-		}
+		p_printf(1, "PEC error reading location 0x%x on slave 0x%x\n", loc, slave_address_base);
+		return(-2);
 	}
-
-	return(rbuf[4]<<8 | rbuf[3]);
+	
+	debug_err("read", ret);
+	return(-1);
 }
 
 /* read a register from the MLX90615 */
 long read_reg(char reg)
 {
+	long val;
+	
 	if ((reg > 0x0f) || (reg < 0))
     {
         printf(REDSTR,"invalid register\n");
         return(-1);
     }
 	
-	return(read_mlx(reg | MLX_EEPROM));	// add register opcode
+	val = read_mlx(mlx_read_reg, reg);
+	
+	/* keep user registers for fast mode switching, unless
+	 * the PEC was not checked (the value can be corrupted) */
+	if (! no_pec_check) cache_set(reg, val);
+	
+	return(val);
 }
 
 /* read a ram location from the MLX90615 */
@@ -315,7 +329,7 @@ long read_ram(char ram)
         printf(REDSTR,"invalid RAM location\n");
         return(-1);
     }
-	return(read_mlx(ram | MLX_RAM));	// add ram opcode
+	return(read_mlx(mlx_read_ram, ram));
 }
 
 /* sent sleep command to MLX 
@@ -323,39 +337,15 @@ long read_ram(char ram)
  * write the sleep command */
 int	enter_sleep()
 {
-	char wbuf[3]= {0};
+	int ret;
 	
-	/* needed to calculate PEC */
-	wbuf[0]= slave_address_base <<1 | MLX_WRITE;
-	wbuf[1]= MLX_SLEEP;
-	wbuf[2]= crc8Msb(0x7, (uint8_t *) wbuf, 2);	// add PEC
+	sync_dev();
 	
-	if (crc8Msb(0x7, (uint8_t *) wbuf, 3))
+	if ((ret = mlx_sleep(dev)) != MLX_OK)
 	{
-		printf ("error in CRC check\n");
+		debug_err("sleep", ret);
 		return(-1);
 	}
-	
-	/* While the slave_address is needed for the correct PEC calculation
-	 * it should NOT be sent by the user level, as the BCM2835 will do 
-	 * that already automatically. (hence wbuf+1)
-	 */
-	 
-    switch(bcm2835_i2c_write(wbuf+1,2))
-    {
-        case BCM2835_I2C_REASON_ERROR_NACK :
-            if(DEBUG) printf(REDSTR,"DEBUG: write NACK error\n");
-            return(-1);
-            break;
-        case BCM2835_I2C_REASON_ERROR_CLKT :
-            if(DEBUG) printf(REDSTR,"DEBUG: write Clock stretch error\n");
-            return(-1);
-            break;
-        case BCM2835_I2C_REASON_ERROR_DATA :
-            if(DEBUG) printf(REDSTR,"DEBUG: not all data has been sent\n");
-            return(-1);
-            break;
-    }
     return(0);
 }
 
@@ -363,21 +353,31 @@ int	enter_sleep()
  * return 0 = ok, -1 = error*/
 int set_mlx_i2c()
 {
-    // will select I2C channel 0 or 1 depending on board reversion.
-    if (!bcm2835_i2c_begin()){
+    if (mlx_bus_begin(bus) != MLX_OK){
         printf(REDSTR,"Can't setup i2c pin!\n");
         return(-1);
     }
-    
-    /* set BSC speed to 100Khz*/
-    bcm2835_i2c_setClockDivider(BCM2835_I2C_CLOCK_DIVIDER_2500);
-
-    /* set slave address for MLX90615*/
-	bcm2835_i2c_setSlaveAddress(slave_address_base);
 	
 	return(0);
 }
 
+/* stop I2c communication (to use the pins for PWM) */
+void i2c_end()
+{
+	mlx_bus_end(bus);
+}
+
+/* find the MLX90615 on I2c
+ * @param found : to store the slave addresses found
+ * @param max : size of found
+ * 
+ * return number of devices found */
+int find_mlx(uint8_t *found, int max)
+{
+	// a MLX with a broken PEC is found with -n
+	return(mlx_bus_scan(bus, found, max, no_pec_check ? MLX_F_NOPEC : 0));
+}
+
 /* wakeup MLX or restore from PWM to SMB communication 
  * Datasheet pag. 15 : 8.4.8.2 exit sleep mode :
  * a low pulse of > 8ms is needed on SCL
@@ -392,28 +392,39 @@ int set_mlx_i2c()
  
 int wake_up()
 {
-	// reset pins
-    bcm2835_i2c_end();
-		
-	// set the SCL pin to output and low
-	bcm2835_gpio_fsel(RPI_V2_GPIO_P1_05, BCM2835_GPIO_FSEL_OUTP); 
-	bcm2835_gpio_write(RPI_V2_GPIO_P1_05, LOW);
+	sync_dev();
 	
-	// wait for wake_up and recovery 
-	usleep(50000);
+	if (mlx_wake(dev) != MLX_OK)
+	{
+		printf(REDSTR,"Can't setup i2c pin!\n");
+		return(-1);
+	}
 	
-	return(set_mlx_i2c());
+	return(0);
 }
 
 /* do a power on reset */
 void por()
 {
-	// turn the power to MLX off.
-    mlx_power(OFF);
-    
-    // wait one second
-	sleep(1);
-	
-	// turn the power to MLX on.
-    mlx_power(ON); 
+	// turn the power to MLX off, wait (default one second) and on.
+	mlx_por(dev, por_off);
+
+	// an other MLX might be connected during the power off
+	cache_reset();
+}
+
+void gpio_fsel(uint8_t pin, int mode)
+{
+	if (gpio) mlx_gpio_fsel(gpio, pin, mode);
+}
+
+void gpio_write(uint8_t pin, int level)
+{
+	if (gpio) mlx_gpio_write(gpio, pin, level);
+}
+
+/* without GPIO (broker) : the pull-up */
+int gpio_lev(uint8_t pin)
+{
+	return(gpio ? mlx_gpio_lev(gpio, pin) : 1);
 }
@@ -0,0 +1,216 @@
+/* fast switching between SMBus and PWM mode of an MLX90615
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_mode is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_mode is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_mode. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Switching between SMBus and PWM takes a wake-up (SMBus request),
+ * a power on reset and a PWM detection. To speed this up:
+ *
+ * - the user registers (0x0 - 0x3) are cached when read or written,
+ *   so reading the PWM values does not need a switch to SMBus.
+ *   Values read without PEC check are not cached. A POR empties the
+ *   cache : after the POR to PWM the values are taken back only if
+ *   the PWM frequency matches the cached config.
+ * - when the cached config is set for SMBus, a POR will never
+ *   bring PWM, so the POR and detection are skipped.
+ * - the PWM detection window is based on the expected frequency.
+ * - the last known slave address is tried before a full discovery.
+ *
+ * The time of each transition is kept and can be displayed.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "mlx90615.h"
+
+/* cached user registers 0x0 - 0x3 */
+static long	reg_cache[4];
+static int	reg_cache_ok[4];
+
+/* timing per transition (ms) */
+static struct {
+	char	*name;
+	long	count;
+	double	last;
+	double	total;
+} mode_stat[TR_NUM] = {
+	{"SMBus -> PWM", 0, 0, 0},
+	{"PWM -> SMBus", 0, 0, 0},
+	{"read PWM values", 0, 0, 0},
+};
+
+/* max time after POR for the PWM signal to start (ms) */
+#define PWM_STARTUP	500
+
+/* store a register value in the cache */
+void cache_set(char reg, long val)
+{
+	if (reg < 0 || reg > 3 || val < 0) return;
+
+	reg_cache[(int) reg] = val;
+	reg_cache_ok[(int) reg] = 1;
+}
+
+/* get a register value from the cache
+ * return value or -1 if not cached */
+long cache_get(char reg)
+{
+	if (reg < 0 || reg > 3 || ! reg_cache_ok[(int) reg]) return(-1);
+
+	return(reg_cache[(int) reg]);
+}
+
+/* invalidate the cache (e.g. other device, POR) */
+void cache_reset()
+{
+	int i;
+
+	for (i = 0; i < 4; i++) reg_cache_ok[i] = 0;
+}
+
+/* copy the cached registers (-1 = not cached) */
+void cache_copy(long *regs)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) regs[i] = cache_get(i);
+}
+
+/* after a POR in PWM mode the cache is empty. Take the registers of
+ * before the POR back, but only if the PWM frequency matches their
+ * config : else an other MLX might have been connected.
+ * @param regs : from cache_copy() before the POR
+ * @param cycle_time : of the PWM detected (us) */
+void cache_pwm_check(long *regs, double cycle_time)
+{
+	int i;
+
+	if (regs[CONFIG] < 0) return;
+
+	// 10hz or 1Khz
+	if ((regs[CONFIG] & 0x2) != (cycle_time > 10000 ? 0x2 : 0)) return;
+
+	for (i = 0; i < 4; i++) cache_set(i, regs[i]);
+}
+
+/* register the time of a transition
+ * @param tr : transition TR_xxx
+ * @param start : start time of transition (get_current()) */
+void mode_time(int tr, double start)
+{
+	if (tr < 0 || tr >= TR_NUM) return;
+
+	mode_stat[tr].last = (get_current() - start) / 1000;
+	mode_stat[tr].total += mode_stat[tr].last;
+	mode_stat[tr].count++;
+
+	if (DEBUG) printf("DEBUG: %s took %1.1fms\n", mode_stat[tr].name, mode_stat[tr].last);
+}
+
+/* return the PWM detection window (ms) based on the config
+ * 3 periods of the expected frequency (1Khz or 10hz)
+ * @param conf : config register (-1 = unknown) */
+long pwm_window(long conf)
+{
+	// unknown frequency : the original window
+	if (conf < 0) return(250);
+
+	if (conf & 0x2) return(330);	// 10hz
+
+	return(5);						// 1Khz
+}
+
+/* after POR wait for the PWM signal to start
+ * return 1 = level change seen, 0 = no signal */
+int pwm_wait_start()
+{
+	double	start = get_current();
+	int		lev = gpio_lev(sda_pin);
+
+	while ((get_current() - start) / 1000 < PWM_STARTUP)
+	{
+		if (gpio_lev(sda_pin) != lev) return(1);
+	}
+
+	return(0);
+}
+
+/* can a POR bring the MLX in PWM mode ?
+ * return 0 if the cached config is set for SMBus, else 1 */
+int pwm_possible()
+{
+	long conf;
+
+	if ((conf = cache_get(CONFIG)) < 0) return(1);
+
+	return(! (conf & 0x1));
+}
+
+/* switch back to SMBus with the last known slave address
+ * only if that fails a full discovery is done (set_for_smb()).
+ * Returns once the readings are stable (ready_wait()).
+ *
+ * @param sla : last known slave address (0 = unknown) */
+void mode_to_smb(uint8_t sla)
+{
+	double	start = get_current();
+
+	// MLX did not leave SMBus (e.g. POR was skipped)
+	if (! pwm_mode && slave_address_base != 0xff)
+	{
+		if (read_reg(PWMSA) >= 0)
+		{
+			mode_time(TR_TO_SMB, start);
+			return;
+		}
+	}
+
+	if (sla && sla < 0x80)
+	{
+		slave_address_base = sla;
+
+		if (wake_up() == 0 && read_reg(PWMSA) >= 0)
+		{
+			pwm_mode = 0;
+
+			// the next reading has to be valid
+			ready_wait(start);
+			mode_time(TR_TO_SMB, start);
+			return;
+		}
+	}
+
+	set_for_smb();
+	ready_wait(start);
+	mode_time(TR_TO_SMB, start);
+}
+
+/* display the transition times */
+void mode_report()
+{
+	int i;
+
+	p_printf(3,"\n%-18s%8s%10s%10s\n", "Transition", "count", "last", "average");
+
+	for (i = 0; i < TR_NUM; i++)
+	{
+		if (mode_stat[i].count == 0)
+			p_printf(2,"%-18s%8d%10s%10s\n", mode_stat[i].name, 0, "-", "-");
+		else
+			p_printf(2,"%-18s%8ld%8.1fms%8.1fms\n", mode_stat[i].name, mode_stat[i].count,
+			mode_stat[i].last, mode_stat[i].total / mode_stat[i].count);
+	}
+}
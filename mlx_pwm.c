@@ -21,12 +21,10 @@
  */
 
 #include <stdlib.h>
-#include <bcm2835.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <string.h>
-#include <sys/time.h>
 #include "mlx90615.h"
 #include <math.h>
 
@@ -50,6 +48,8 @@ long t_range = 0x9c4;
 // indicate temperature to display
 int cur_temp = TA;
 
+static void show_pwm_temp(double duty);
+
 /* detect whether MLX is in PWM mode and capture the start_high, stop_high and cycle_time
  * return values
  * 1 = PWM signal detected, values are stored
@@ -58,53 +58,111 @@ int cur_temp = TA;
 
 int detect_pwm( double * r_start_high, double * r_stop_high, double * r_cycle_time)
 {
-	double start_high = 0, stop_high = 0, cycle_time = 0;
-    double start_loop;
-	int	 first = 1;
+	return(detect_pwm_win(r_start_high, r_stop_high, r_cycle_time, 250));
+}
+
+/* same as detect_pwm() with a detection window
+ * @param window : time-out in ms
+ */
+int detect_pwm_win( double * r_start_high, double * r_stop_high, double * r_cycle_time, long window)
+{
+	mlx_pwm_dec	dec;
+	double 		now, start_loop;
+	int			ret;
+
+	mlx_pwm_dec_init(&dec);
+
+	// no preemption during capture (if requested)
+	rt_enter();
 
 	// set start time_out
 	start_loop = (get_current() / 1000);
 
 	do
 	{
-		// detect level
-		if (bcm2835_gpio_lev(sda_pin))
+		// decode the level
+		now = get_current();
+		ret = mlx_pwm_dec_step(&dec, gpio_lev(sda_pin), now);
+
+		// end of first high : restart start time_out
+		if (ret == MLX_PWM_SYNC) start_loop = now / 1000;
+
+		//* time_out ?
+		else if (ret == MLX_PWM_BUSY && (now / 1000) - start_loop > window)
 		{
-			// if first time detect high
-			if (first)
-			{
-				// wait untill it goes low or timeout
-				while ( bcm2835_gpio_lev(sda_pin) )
-				{
-					if ((get_current()/1000) - start_loop > 250)
-						return (0);
-				}
-				// restart start time_out
-				start_loop = get_current() /1000;
+			rt_leave();
+			return (0);
+		}
 
-				first = 0;
-			}
-			// second time set start_high
-			else if (start_high == 0)
-				start_high = get_current();
+	} while (ret != MLX_PWM_DONE);
+
+	rt_leave();
+
+	*r_start_high = dec.start_high;
+	*r_stop_high = dec.stop_high;
+	*r_cycle_time = dec.cycle_time;
+
+	return(1);
+}
+
+/* sample SDA every step into a bitstream, at fixed times. Samples
+ * missed (preempted) are marked not valid and left out.
+ */
+int detect_pwm_bits(double *duty, double *cycle_time)
+{
+	mlx_pwm_bits r;
+	uint64_t	*w, *valid;
+	double		step, start, now;
+	long		nbits, i, late = 0;
+	int			ret;
+
+	// the frequency is known from the menu (or detected on entry)
+	step = (cur_freq == HIGH ? 1000.0 : 100000.0) / PWM_BITS_SPP;
+	nbits = PWM_BITS_SPP * ((cur_freq == HIGH ? PWM_BITS_HIGH : PWM_BITS_LOW) + 1);
+
+	w = calloc((nbits + 63) / 64, sizeof(uint64_t));
+	valid = calloc((nbits + 63) / 64, sizeof(uint64_t));
+
+	if (w == NULL || valid == NULL)
+	{
+		p_printf(1, "Can not allocate PWM capture\n");
+		free(w);
+		free(valid);
+		return(0);
+	}
 
-			// determine cycle time
-			else if (start_high != 0 && stop_high != 0)
-				cycle_time = get_current() - start_high;
+	rt_enter();
+
+	start = get_current();
+
+	for (i = 0; i < nbits; i++)
+	{
+		while ((now = get_current()) < start + i * step);
+
+		// preempted : skip the samples that were missed
+		if (now >= start + (i + 1) * step)
+		{
+			late += (long) ((now - start) / step) - i;
+			i = (long) ((now - start) / step);
+			if (i >= nbits) break;
 		}
-		else // get stop high if start was set first
-			if (start_high != 0 && stop_high == 0) 
-				stop_high = get_current();
-		
-		//* time_out ?		
-		if ((get_current()/1000) - start_loop > 250)
-			return (0);
-		
-	} while (stop_high == 0 || start_high == 0 || cycle_time == 0);	
-	
-	*r_start_high = start_high;
-	*r_stop_high = stop_high;
-	*r_cycle_time = cycle_time;
+
+		if (gpio_lev(sda_pin)) w[i >> 6] |= 1ULL << (i & 63);
+		valid[i >> 6] |= 1ULL << (i & 63);
+	}
+
+	rt_leave();
+
+	if (DEBUG) printf("DEBUG: bitstream of %ld samples, %ld late\n", nbits, late);
+
+	ret = mlx_pwm_bits_decode(w, valid, nbits, &r);
+	free(w);
+	free(valid);
+
+	if (ret != MLX_OK) return(0);
+
+	*duty = r.duty;
+	*cycle_time = r.period * step;
 
 	return(1);
 }
@@ -236,6 +294,7 @@ int set_pwm(int set_pwm_value)
         p_printf(2,
         "7	Exit PWM mode\n"
         "8 	Display selected temperature\n"
+        "9 	Display selected temperature (bitstream, average of all periods)\n"
         "12	Toggle to show details (where possible)");
   
         if(detailed) p_printf(1," (enabled)");
@@ -243,6 +302,11 @@ int set_pwm(int set_pwm_value)
         p_printf(2,"\n13	Toggle debug messages");
         if(DEBUG) p_printf(1," (enabled)");
         
+        p_printf(2,"\n14	Display mode transition times");
+        
+        p_printf(2,"\n15	PWM capture jitter self-test");
+        if(rt_prio) p_printf(d_col," (real-time priority %d)", rt_prio);
+        
         p_printf(3,"\n\n99	to return. ");
 
         tmp = get_dec_input();
@@ -277,12 +341,21 @@ int set_pwm(int set_pwm_value)
         case 8:
 			display_pwm_temp();
 			break;
+        case 9:
+			display_pwm_temp_bits();
+			break;
         case 12:
 			toggle_detailed();
             break;
         case 13:
             toggle_debug();
             break;
+        case 14:
+            mode_report();
+            break;
+        case 15:
+            rt_jitter_test(RT_TEST_MS);
+            break;
         case 99:
             read_values = 1;		// read values on next entry
             break;
@@ -352,42 +425,66 @@ int calc_to_t_range (float val)
  */
 int set_SCL_high(int reset)
 {
-	double trash;
+	double trash, cycle_time;
+	double start = get_current();
+	long window = 250, regs[4];
 	
 	// if requested perform a power up reset
-	if (reset) por();
+	if (reset)
+	{
+		/* if the (cached) config is set for SMBus, a POR will
+		 * not bring PWM. Skip POR and stay in SMBus */
+		if (! pwm_possible())
+		{
+			if (DEBUG) printf("DEBUG: config is SMBus, POR skipped\n");
+			pwm_mode = 0;
+			mode_time(TR_TO_PWM, start);
+			return(1);
+		}
+		
+		// the POR empties the cache
+		cache_copy(regs);
+		
+		// POR, wait for signal, then a short window on expected frequency
+		if (por_ready(1) >= 0) window = pwm_window(regs[CONFIG]);
+	}
 	else 
 	{
 		// disable i2C (already done by por)
-		bcm2835_i2c_end();
+		i2c_end();
 	}
 	
 	// set the SCL pin to output and high
-	// bcm2835_gpio_write(scl_pin, HIGH);
-	bcm2835_gpio_fsel(scl_pin, BCM2835_GPIO_FSEL_OUTP);
-	bcm2835_gpio_write(scl_pin, HIGH);
+	gpio_fsel(scl_pin, MLX_GPIO_OUT);
+	gpio_write(scl_pin, HIGH);
 	
 	// set SDA for input
-	bcm2835_gpio_fsel(sda_pin, BCM2835_GPIO_FSEL_INPT);
+	gpio_fsel(sda_pin, MLX_GPIO_IN);
 	
 	// indicate that comms is in PWM
 	slave_address_base= 0xff;
 	
 	// check whether or not in PWM signal
-    if (detect_pwm(&trash, &trash, &trash))
+    if (detect_pwm_win(&trash, &trash, &cycle_time, window))
 	{
+		// the registers of before the POR, if still the same MLX
+		if (reset) cache_pwm_check(regs, cycle_time);
+		
 		// indicate it is in PWM
 		pwm_mode = 1;
+		mode_time(TR_TO_PWM, start);
 		return(0);
 	}
 	else
 	{
 		pwm_mode = 0;
+		mode_time(TR_TO_PWM, start);
 		return(1);
 	}
 }
 
 /* set config register for PWM mode 
+ * The write is requested from the scheduler, the caller flushes it.
  * @param PWM : 1 = set to PWM else to SMB 
  * @param set_value : 1 = overwrite PWM attributes */
 int set_conf_reg (int pwm, int set_value)
@@ -419,15 +516,8 @@ int set_conf_reg (int pwm, int set_value)
 	else // set comms bit as SMB
 		result |= 1 << COMMS_BIT;
 	
-	// write config register
-	if (write_reg(CONFIG, result) < 0 )
-	{
-        if (pwm) p_printf(1,"can not update to PWM mode\n");
-		else p_printf(1,"can not update to SMB mode\n");
-		return(-1);
-	}
-		
-	return(0);
+	// request write config register
+	return(wear_request(CONFIG, result));
 }
 
 /* will write the attributes and set the MLX in PWM mode 
@@ -448,10 +538,10 @@ int enter_pwm(int set_value)
 		// set for PWM + attributes
 		if (set_conf_reg(1, 1) < 0) return(-1);	
 		
-		// set range
-		if (write_reg(PWMTR, t_range) < 0 )
+		// set range (drop the config request if not possible)
+		if (wear_request(PWMTR, t_range) < 0)
 		{
-	        p_printf(1,"can not set temperature range \n");
+			wear_cancel();
 			return(-1);
 		}
 	}
@@ -463,9 +553,16 @@ int enter_pwm(int set_value)
 	 * This will overwrite the Slave address, and thus the
 	 * MLX can only be accessed with slave address 0x0
 	 */
-	if (write_reg(PWMSA, t_min) < 0 )
+	if (wear_request(PWMSA, t_min) < 0)
+	{
+		wear_cancel();
+		return(-1);
+	}
+	
+	// write config, range and T_min (last)
+	if (wear_flush() < 0)
 	{
-        p_printf(1,"can not set minimum temperature\n");
+		p_printf(1,"can not update to PWM mode\n");
 		return(-1);
 	}
 	
@@ -518,20 +615,18 @@ int exit_pwm(int ch_to_smb)
 		if (slave_address_base_req) sla = slave_address_base_req;
 		else sla = default_SLA;
 		
-		// write new slave address
-		if (write_reg(PWMSA, (long) (sla & 0x7f)) == 0 )
+		// write config and new slave address (last)
+		if (wear_request(PWMSA, (long) (sla & 0x7f)) == 0 && wear_flush() >= 0)
 		{
 	        p_printf(2,"Slave address set to 0x%x\n", sla & 0x7f);
 	        
 		    // set for PEC calculation and re-init
 			slave_address_base = sla & 0x7f;
-			
-			/* set slave address for MLX90615*/
-			bcm2835_i2c_setSlaveAddress(sla & 0x7f);
 		}
 		else
 		{
-			p_printf(1,"can not set slave address: 0x%x\n", sla & 0x7f);
+			wear_cancel();
+			p_printf(1,"can not update to SMB mode with slave address: 0x%x\n", sla & 0x7f);
 			return(-1);
 		}
 	}
@@ -639,14 +734,10 @@ void set_range()
 	}
 }
 
-/* return current time in useconds */
+/* return current time in useconds (monotonic, from the process clock) */
 double get_current()
 {
-	struct	timeval	tv;
-
-	gettimeofday(&tv,NULL);
-	
-	return((tv.tv_sec * 1000000) + tv.tv_usec);
+	return(mlx_clock_ns() / 1000.0);
 }
 
 /* read the T_min, T-range and temperature type from an MLX in pwm_mode
@@ -656,9 +747,24 @@ double get_current()
 int get_values_from_mlx()
 {
 	long result;
+	double start = get_current();
 	
 	if (! pwm_mode ) return(1);
 	
+	/* if all values are cached (read or written before) there
+	 * is no need to switch to SMBus and back (POR) */
+	if (cache_get(PWMSA) >= 0 && cache_get(PWMTR) >= 0 && (result = cache_get(CONFIG)) >= 0)
+	{
+		t_min = cache_get(PWMSA);
+		t_range = cache_get(PWMTR);
+		
+		if (result & 0x04) cur_temp = TA;
+		else cur_temp = TO;
+		
+		mode_time(TR_READ_PWM, start);
+		return(0);
+	}
+	
 	// set for PEC calculation and re-init
 	slave_address_base= 0x0;
 	
@@ -698,7 +804,10 @@ int get_values_from_mlx()
 	else cur_temp = TO;
 	
 	// pull SCL high + Power up reset to enter PWM
-	return(set_SCL_high(1));
+	result = set_SCL_high(1);
+	
+	mode_time(TR_READ_PWM, start);
+	return(result);
 }
 
 /* display the temperature that was selected BEFORE it went in PWM mode
@@ -713,8 +822,6 @@ int get_values_from_mlx()
 int display_pwm_temp()
 {
 	double start_high = 0, stop_high = 0, cycle_time = 0;
-	float temp;
-	float duty;
 	
 	// check for PWM mode
 	if ( ! pwm_mode)
@@ -726,24 +833,56 @@ int display_pwm_temp()
 	if (detect_pwm(&start_high, &stop_high, &cycle_time))
 	{
 		// calculate duty
-		duty = (stop_high - start_high) / cycle_time;
-
-		/* the first 0.125 are always high and need to be subtracted
-		 * page 17 and 18 of the datasheet explain
-		 */
-			
-		temp = 2 * (duty - 0.125) * t_range/50 + (t_min-(50 * 273.15))/50;
-		
-		if (cur_temp == TA)
-			p_printf(3,"Ambient temperature : %1.2fC\n",temp);
-		else
-			p_printf(3,"Object temperature is : %1.2fC\n",temp);
+		show_pwm_temp((stop_high - start_high) / cycle_time);
 	}
 	else
 	{
 		p_printf(1,"MLX does not seem to be in PWM mode.\n");
 		return(-1);	
 	}
+	
+	return(0);
+}
+
+int display_pwm_temp_bits()
+{
+	double duty, cycle_time;
+	
+	if ( ! pwm_mode)
+	{
+		p_printf(1, "MLX is not in PWM mode\n");
+		return(-2);
+	}
+	
+	if (! detect_pwm_bits(&duty, &cycle_time))
+	{
+		p_printf(1,"MLX does not seem to be in PWM mode.\n");
+		return(-1);	
+	}
+
+	if (detailed) p_printf(2, "Duty %1.5f, measured %4.1fHz\n", duty, 1000000 / cycle_time);
+
+	show_pwm_temp(duty);
+
+	return(0);
+}
+
+/* display the PWM temperature of a duty cycle and warn if it is
+ * close to the minimum or maximum of T min / T range */
+static void show_pwm_temp(double duty)
+{
+	float temp;
+
+	/* the first 0.125 are always high and need to be subtracted
+	 * page 17 and 18 of the datasheet explain
+	 */
+	temp = mlx_pwm_celsius(duty, t_min, t_range);
+	
+	if (cur_temp == TA)
+		p_printf(3,"Ambient temperature : %1.2fC\n",temp);
+	else
+		p_printf(3,"Object temperature is : %1.2fC\n",temp);
+
 	// display warning messages
 	if (duty > 0.6)
 		p_printf(1,
@@ -759,6 +898,4 @@ int display_pwm_temp()
 		"It might even be that the real temperature is LOWER and you should\n"
 		"decrease the minimum temperature (option 2 of PWM menu).\n",
 		(float) round((t_min-(50 * 273.15))/50));	
-	
-	return(0);
 }
@@ -0,0 +1,237 @@
+/* libmlx90615 : PWM decoding of an oversampled bitstream
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_pwm_bits is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_pwm_bits is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_pwm_bits. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SDA is sampled at a fixed rate, one bit per sample. Instead of the
+ * time of each edge (mlx_pwm_dec) the number of high samples over all
+ * whole periods gives the duty cycle, so an edge seen late or a wrong
+ * sample only moves the result by one sample in the whole capture.
+ *
+ * The periods are found by counting the rising edges, after a majority
+ * filter of 3 samples that removes single-sample glitches. Both the
+ * filter and the edge detection work on 64 samples at a time.
+ *
+ * Samples that could not be taken in time (preempted) can be marked
+ * not valid : they are left out of the duty cycle and a rise hidden by
+ * them does not count as a longer period.
+ *
+ * The high samples are counted with a vector popcount where available :
+ * NEON on ARM (Raspberry Pi with -mfpu=neon), AVX2 on x86 (selected at
+ * run time), else the popcount of the compiler.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "libmlx90615.h"
+
+/* times between rises for the median (lost rises) */
+#define BITS_GAPS	64
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BITS_NEON
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITS_AVX2
+#endif
+
+uint64_t mlx_popcount_scalar(const uint64_t *w, long n)
+{
+	uint64_t count = 0;
+	long	i;
+
+	for (i = 0; i < n; i++) count += __builtin_popcountll(w[i]);
+
+	return(count);
+}
+
+#ifdef BITS_NEON
+
+/* count the bits per byte and add them in 16 bit lanes, which can
+ * take 4096 words before they overflow */
+static uint64_t popcount_neon(const uint64_t *w, long n)
+{
+	uint64x2_t	sum = vdupq_n_u64(0);
+	uint16x8_t	acc;
+	long		i = 0, end;
+
+	while (n - i >= 2)
+	{
+		acc = vdupq_n_u16(0);
+		end = i + 4096 < n ? i + 4096 : n;
+
+		for ( ; end - i >= 2; i += 2)
+			acc = vpadalq_u8(acc, vcntq_u8(vld1q_u8((const uint8_t *) &w[i])));
+
+		sum = vpadalq_u32(sum, vpaddlq_u16(acc));
+	}
+
+	return(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1) + mlx_popcount_scalar(w + i, n - i));
+}
+
+uint64_t mlx_popcount(const uint64_t *w, long n)
+{
+	return(popcount_neon(w, n));
+}
+
+#elif defined(BITS_AVX2)
+
+/* count the bits of each nibble with a lookup table in a register and
+ * add the bytes with sad (Mula, Kurz, Lemire) */
+__attribute__((target("avx2")))
+static uint64_t popcount_avx2(const uint64_t *w, long n)
+{
+	const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0f);
+	__m256i	sum = _mm256_setzero_si256(), v, cnt;
+	long	i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+	{
+		v = _mm256_loadu_si256((const __m256i *) &w[i]);
+		cnt = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(v, low)),
+			_mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+		sum = _mm256_add_epi64(sum, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+	}
+
+	return((uint64_t) _mm256_extract_epi64(sum, 0) + (uint64_t) _mm256_extract_epi64(sum, 1) +
+		(uint64_t) _mm256_extract_epi64(sum, 2) + (uint64_t) _mm256_extract_epi64(sum, 3) +
+		mlx_popcount_scalar(w + i, n - i));
+}
+
+uint64_t mlx_popcount(const uint64_t *w, long n)
+{
+	static int avx2 = -1;
+
+	if (avx2 < 0) avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+
+	return(avx2 ? popcount_avx2(w, n) : mlx_popcount_scalar(w, n));
+}
+
+#else
+
+uint64_t mlx_popcount(const uint64_t *w, long n)
+{
+	return(mlx_popcount_scalar(w, n));
+}
+
+#endif
+
+/* bits set from sample 'from' up to (not including) 'to' */
+static uint64_t bits_ones(const uint64_t *w, long from, long to)
+{
+	long	fw = from >> 6, tw = to >> 6;
+	uint64_t first = ~0ULL << (from & 63), last = (1ULL << (to & 63)) - 1;
+
+	if (fw == tw) return(__builtin_popcountll(w[fw] & first & last));
+
+	return(__builtin_popcountll(w[fw] & first) + mlx_popcount(w + fw + 1, tw - fw - 1) +
+		(last ? __builtin_popcountll(w[tw] & last) : 0));
+}
+
+static int cmp_long(const void *a, const void *b)
+{
+	long x = *(const long *) a, y = *(const long *) b;
+
+	return(x < y ? -1 : x > y);
+}
+
+int mlx_pwm_bits_decode(const uint64_t *w, const uint64_t *valid, long nbits, mlx_pwm_bits *r)
+{
+	long	nw = (nbits + 63) >> 6, k, first = -1, last = -1, rises = 0, gap[BITS_GAPS], ngap = 0;
+	uint64_t x, prev, next, f, fprev = 0, rise, use, vprev = ~0ULL;
+	long	samples;
+
+	memset(r, 0, sizeof(mlx_pwm_bits));
+
+	if (nbits < 3) return(MLX_ERR_NODATA);
+
+	for (k = 0; k < nw; k++)
+	{
+		// samples before and after each sample (repeat the first and last)
+		x = w[k];
+		prev = (x << 1) | (k ? w[k - 1] >> 63 : x & 1);
+		next = (x >> 1) | (k + 1 < nw ? w[k + 1] << 63 : x & (1ULL << 63));
+
+		// majority of 3 : a single-sample glitch is removed
+		f = (prev & x) | (prev & next) | (x & next);
+
+		rise = f & ~((f << 1) | (k ? fprev >> 63 : f & 1));
+		fprev = f;
+
+		// only the samples in the capture
+		use = (k == nw - 1 && (nbits & 63)) ? (1ULL << (nbits & 63)) - 1 : ~0ULL;
+
+		// the last sample can not be trusted after the filter
+		if (k == nw - 1) use &= ~(1ULL << ((nbits - 1) & 63));
+
+		// a rise needs a valid sample and a valid sample before it
+		if (valid)
+		{
+			use &= valid[k] & ((valid[k] << 1) | (k ? vprev >> 63 : 1));
+			vprev = valid[k];
+		}
+
+		if ((rise &= use) == 0) continue;
+
+		if (first < 0) first = (k << 6) + __builtin_ctzll(rise);
+
+		// the time between rises, of the first BITS_GAPS
+		for ( ; rise && ngap < BITS_GAPS; rise &= rise - 1)
+		{
+			x = (k << 6) + __builtin_ctzll(rise);
+			if (last >= 0) gap[ngap++] = x - last;
+			last = x;
+			rises++;
+		}
+
+		if (rise)
+		{
+			last = (k << 6) + 63 - __builtin_clzll(rise);
+			rises += __builtin_popcountll(rise);
+		}
+	}
+
+	// at least one whole period
+	if (rises < 2) return(MLX_ERR_NODATA);
+
+	/* without lost rises (preempted) each rise is a period, else the
+	 * number of periods follows from the median time between rises */
+	r->periods = rises - 1;
+
+	if (valid)
+	{
+		qsort(gap, ngap, sizeof(long), cmp_long);
+		r->periods = lround((double) (last - first) / gap[ngap / 2]);
+	}
+
+	if (r->periods < 1) return(MLX_ERR_NODATA);
+
+	r->first = first;
+	r->period = (double) (last - first) / r->periods;
+
+	// not valid samples are 0 in w and not counted
+	samples = valid ? (long) bits_ones(valid, first, last) : last - first;
+
+	if (samples == 0) return(MLX_ERR_NODATA);
+
+	r->duty = (double) bits_ones(w, first, last) / samples;
+
+	return(MLX_OK);
+}
@@ -0,0 +1,262 @@
+/* libmlx90615 : PWM capture of many lines in one event loop
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_pwm_cap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_pwm_cap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_pwm_cap. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Each line is a file descriptor with edge events : a GPIO line
+ * requested on the GPIO character device (kernel 4.8+), or any other
+ * (e.g. a pipe) that provides the same events. All are in one epoll
+ * set and read without blocking.
+ *
+ * A period is from a rising edge to the next rising edge, the high time
+ * from the rising to the falling edge in between. Periods that are not
+ * near 1Khz or 10hz (lost edge, glitch) are rejected.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <linux/gpio.h>
+#include "libmlx90615.h"
+
+/* default GPIO character device */
+#define CAP_CHIP		"/dev/gpiochip0"
+
+/* events read at once from a line */
+#define CAP_EVENTS		64
+
+/* lines with events handled in one epoll_wait */
+#define CAP_WAIT		64
+
+/* a period is valid within this fraction of 1ms (1Khz) or 100ms (10hz) */
+#define CAP_TOLERANCE	0.25
+
+_Static_assert(sizeof(mlx_pwm_event) == sizeof(struct gpioevent_data), "event size");
+
+typedef struct cap_line {
+	int			fd;
+	mlx_pwm_line cfg;
+	uint64_t	rise;			// last rising edge (0 = none yet)
+	uint64_t	fall;			// falling edge after it (0 = none yet)
+	int			valid;			// last holds a reading
+	mlx_pwm_reading last;
+} cap_line;
+
+struct mlx_pwm_cap {
+	int			efd;			// epoll
+	cap_line	*line;
+	int			num;
+	int			max;
+	mlx_pwm_cb	cb;
+	void		*user;
+	mlx_pwm_stat st;
+};
+
+mlx_pwm_cap *mlx_pwm_cap_new(mlx_pwm_cb cb, void *user)
+{
+	mlx_pwm_cap *cap;
+
+	if ((cap = calloc(1, sizeof(mlx_pwm_cap))) == NULL) return(NULL);
+
+	if ((cap->efd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	{
+		free(cap);
+		return(NULL);
+	}
+
+	cap->cb = cb;
+	cap->user = user;
+
+	return(cap);
+}
+
+void mlx_pwm_cap_free(mlx_pwm_cap *cap)
+{
+	int i;
+
+	if (cap == NULL) return;
+
+	for (i = 0; i < cap->num; i++) close(cap->line[i].fd);
+
+	close(cap->efd);
+	free(cap->line);
+	free(cap);
+}
+
+int mlx_pwm_cap_add_fd(mlx_pwm_cap *cap, int fd, const mlx_pwm_line *cfg)
+{
+	struct epoll_event ev;
+	cap_line	*l;
+	int			max;
+
+	if (fd < 0 || cfg == NULL || cfg->t_range <= 0) return(MLX_ERR_PARAM);
+
+	if (cap->num == cap->max)
+	{
+		max = cap->max ? cap->max * 2 : 8;
+
+		if ((l = realloc(cap->line, max * sizeof(cap_line))) == NULL) return(MLX_ERR_NOMEM);
+
+		cap->line = l;
+		cap->max = max;
+	}
+
+	// all events are read until EAGAIN
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = cap->num;
+
+	if (epoll_ctl(cap->efd, EPOLL_CTL_ADD, fd, &ev) < 0) return(MLX_ERR_PARAM);
+
+	l = &cap->line[cap->num];
+	memset(l, 0, sizeof(cap_line));
+	l->fd = fd;
+	l->cfg = *cfg;
+
+	return(cap->num++);
+}
+
+int mlx_pwm_cap_add_gpio(mlx_pwm_cap *cap, const char *chip, const mlx_pwm_line *cfg)
+{
+	struct gpioevent_request req;
+	int		cfd, ret;
+
+	if (cfg == NULL) return(MLX_ERR_PARAM);
+
+	if ((cfd = open(chip ? chip : CAP_CHIP, O_RDONLY | O_CLOEXEC)) < 0) return(MLX_ERR_BUS);
+
+	memset(&req, 0, sizeof(req));
+	req.lineoffset = cfg->pin;
+	req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	req.eventflags = GPIOEVENT_REQUEST_BOTH_EDGES;
+	strncpy(req.consumer_label, "mlx90615", sizeof(req.consumer_label) - 1);
+
+	ret = ioctl(cfd, GPIO_GET_LINEEVENT_IOCTL, &req);
+	close(cfd);
+
+	if (ret < 0) return(MLX_ERR_BUS);
+
+	if ((ret = mlx_pwm_cap_add_fd(cap, req.fd, cfg)) < 0) close(req.fd);
+
+	return(ret);
+}
+
+/* check a period : near 1ms (1Khz) or 100ms (10hz) */
+static int cap_period_ok(uint64_t period)
+{
+	double p = period / 1e6;		// ms
+
+	return((p > 1 - CAP_TOLERANCE && p < 1 + CAP_TOLERANCE) ||
+		(p > 100 * (1 - CAP_TOLERANCE) && p < 100 * (1 + CAP_TOLERANCE)));
+}
+
+/* handle an edge of a line
+ * return 1 if a period was decoded */
+static int cap_edge(mlx_pwm_cap *cap, int i, const mlx_pwm_event *e)
+{
+	cap_line	*l = &cap->line[i];
+	mlx_pwm_reading *r = &l->last;
+	uint64_t	period;
+	int			ret = 0;
+
+	cap->st.events++;
+
+	if (e->id == MLX_PWM_FALLING)
+	{
+		if (l->rise) l->fall = e->timestamp;
+		return(0);
+	}
+
+	// rising : end of a period when the falling edge was seen
+	if (l->rise && l->fall > l->rise && e->timestamp > l->fall)
+	{
+		period = e->timestamp - l->rise;
+
+		if (cap_period_ok(period))
+		{
+			r->line = i;
+			r->pin = l->cfg.pin;
+			r->temp = l->cfg.temp;
+			r->duty = (double) (l->fall - l->rise) / period;
+			r->celsius = mlx_pwm_celsius(r->duty, l->cfg.t_min, l->cfg.t_range);
+			r->freq = 1e9 / period;
+			r->time_ns = e->timestamp;
+
+			l->valid = 1;
+			cap->st.readings++;
+
+			if (cap->cb) cap->cb(r, cap->user);
+			ret = 1;
+		}
+		else cap->st.rejected++;
+	}
+
+	l->rise = e->timestamp;
+	l->fall = 0;
+
+	return(ret);
+}
+
+int mlx_pwm_cap_poll(mlx_pwm_cap *cap, int timeout_ms)
+{
+	struct epoll_event ev[CAP_WAIT];
+	mlx_pwm_event	e[CAP_EVENTS];
+	ssize_t	len;
+	int		n, i, j, line, count = 0;
+
+	if ((n = epoll_wait(cap->efd, ev, CAP_WAIT, timeout_ms)) < 0)
+		return(errno == EINTR ? 0 : MLX_ERR_BUS);
+
+	for (i = 0; i < n; i++)
+	{
+		line = ev[i].data.u32;
+
+		// all waiting events of the line
+		while ((len = read(cap->line[line].fd, e, sizeof(e))) > 0)
+		{
+			for (j = 0; j < len / (ssize_t) sizeof(mlx_pwm_event); j++)
+				count += cap_edge(cap, line, &e[j]);
+		}
+	}
+
+	return(count);
+}
+
+int mlx_pwm_cap_fd(mlx_pwm_cap *cap)
+{
+	return(cap->efd);
+}
+
+int mlx_pwm_cap_get(mlx_pwm_cap *cap, int line, mlx_pwm_reading *r)
+{
+	if (line < 0 || line >= cap->num) return(MLX_ERR_PARAM);
+
+	if (! cap->line[line].valid) return(MLX_ERR_NODATA);
+
+	*r = cap->line[line].last;
+	return(MLX_OK);
+}
+
+void mlx_pwm_cap_stat(mlx_pwm_cap *cap, mlx_pwm_stat *st)
+{
+	*st = cap->st;
+}
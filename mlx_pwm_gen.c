@@ -0,0 +1,114 @@
+/* libmlx90615 : generator of the MLX90615 PWM signal
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_pwm_gen is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_pwm_gen is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_pwm_gen. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Each period starts with a high level. The first 0.125 of the period
+ * is always high, the rest of the high time follows the temperature
+ * within T min and T range (datasheet pag 17/18, see mlx_pwm_celsius).
+ *
+ * The level is a function of the time only : the jitter of an edge is
+ * derived from the seed and the number of the period, so the signal can
+ * be read at any time and in any order.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "libmlx90615.h"
+
+/* always high at the start of a period */
+#define PWM_LEAD_IN		0.125
+
+/* default seed of the jitter and noise */
+#define PWM_SEED		0x9e3779b97f4a7c15ULL
+
+/* mix a number (splitmix64) */
+static uint64_t pwm_mix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+
+	return(x ^ (x >> 31));
+}
+
+/* jitter (ns) of an edge : about normal, from the sum of 4 uniform
+ * @param period : number of the period
+ * @param edge : 0 = rising, 1 = falling */
+static double pwm_jitter(const mlx_pwm_gen *g, uint64_t period, int edge)
+{
+	uint64_t	x;
+	double		sum = 0;
+	int			i;
+
+	if (g->jitter_ns <= 0) return(0);
+
+	x = pwm_mix(g->seed ^ (period << 1 | edge));
+
+	for (i = 0; i < 4; i++, x >>= 16) sum += (x & 0xffff) / 65536.0;
+
+	// sum has mean 2 and variance 4/12
+	return((sum - 2) * 1.7320508 * g->jitter_ns);
+}
+
+double mlx_pwm_duty(double temp, long t_min, long t_range)
+{
+	double	min = (t_min - (50 * 273.15)) / 50;
+	double	range = t_range / 50.0;
+
+	if (range <= 0) return(PWM_LEAD_IN);
+
+	if (temp < min) temp = min;
+	if (temp > min + range) temp = min + range;
+
+	return(PWM_LEAD_IN + (temp - min) * 50 / (2.0 * t_range));
+}
+
+void mlx_pwm_gen_init(mlx_pwm_gen *g, double freq, double duty)
+{
+	memset(g, 0, sizeof(mlx_pwm_gen));
+
+	g->freq = freq;
+	g->duty = duty;
+	g->seed = g->rnd = PWM_SEED;
+}
+
+int mlx_pwm_gen_level(mlx_pwm_gen *g, uint64_t t)
+{
+	double		period = 1e9 / g->freq, pos;
+	uint64_t	k;
+	int			level;
+
+	k = (uint64_t) (t / period);
+	pos = t - k * period;
+
+	// high from the (jittered) rising edge to the falling edge, or
+	// already high when the rising edge of the next period is early
+	level = (pos >= pwm_jitter(g, k, 0) && pos < g->duty * period + pwm_jitter(g, k, 1))
+		|| pos >= period + pwm_jitter(g, k + 1, 0);
+
+	// wrong level read (xorshift64*)
+	if (g->noise > 0)
+	{
+		g->rnd ^= g->rnd >> 12;
+		g->rnd ^= g->rnd << 25;
+		g->rnd ^= g->rnd >> 27;
+
+		if (((g->rnd * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / (1ULL << 53)) < g->noise) level = ! level;
+	}
+
+	return(level);
+}
@@ -0,0 +1,152 @@
+/* mlx_pwmcap : PWM capture of many MLX90615 on GPIO lines
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_pwmcap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_pwmcap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_pwmcap. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Every sensor is in PWM mode on its own GPIO line. All lines are
+ * captured in one event loop (mlx_pwm_cap.c). Every interval the last
+ * temperature of each line is displayed, with the readings per second
+ * and the CPU use of the loop.
+ *
+ * usage : mlx_pwmcap [-c chip] [-m t_min] [-r t_range] [-a] [-i sec] pin[:t_min:t_range] ...
+ *
+ * T min and T range are the raw EEPROM values (0x0 and 0x1) of the
+ * sensor, as set with option 10 and 11 of the PWM menu of mlx.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "libmlx90615.h"
+
+/* max lines */
+#define MAX_LINES	256
+
+static uint64_t clock_of(clockid_t id)
+{
+	struct timespec ts;
+
+	clock_gettime(id, &ts);
+	return((uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static void usage(char *name)
+{
+	fprintf(stderr, "usage : %s [-c chip] [-m t_min] [-r t_range] [-a] [-i sec] pin[:t_min:t_range] ...\n"
+		"  -c chip    GPIO character device (default /dev/gpiochip0)\n"
+		"  -m t_min   T min EEPROM value (default 0x355a)\n"
+		"  -r t_range T range EEPROM value (default 0x09c4)\n"
+		"  -a         PWM is ambient temperature (default object)\n"
+		"  -i sec     display interval (default 1)\n", name);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	mlx_pwm_line	cfg;
+	mlx_pwm_reading	r;
+	mlx_pwm_stat	st, prev;
+	mlx_pwm_cap		*cap;
+	char	*chip = NULL, *p;
+	int		c, i, ret, num = 0, t_min = 0x355a, t_range = 0x09c4, temp = MLX_RAM_TO, interval = 1;
+	int		pins[MAX_LINES];
+	uint64_t wall, cpu, now;
+
+	while ((c = getopt(argc, argv, "c:m:r:ai:")) != -1)
+	{
+		switch(c)
+		{
+			case 'c':	chip = optarg;	break;
+			case 'm':	t_min = (int) strtol(optarg, NULL, 0);	break;
+			case 'r':	t_range = (int) strtol(optarg, NULL, 0);	break;
+			case 'a':	temp = MLX_RAM_TA;	break;
+			case 'i':	interval = atoi(optarg);	break;
+			default:	usage(argv[0]);
+		}
+	}
+
+	if (optind >= argc || interval < 1) usage(argv[0]);
+
+	if ((cap = mlx_pwm_cap_new(NULL, NULL)) == NULL)
+	{
+		fprintf(stderr, "Can not create capture\n");
+		exit(1);
+	}
+
+	// each line : pin, or pin:t_min:t_range
+	for (i = optind; i < argc && num < MAX_LINES; i++)
+	{
+		cfg.pin = (int) strtol(argv[i], &p, 0);
+		cfg.t_min = t_min;
+		cfg.t_range = t_range;
+		cfg.temp = temp;
+
+		if (*p == ':')
+		{
+			cfg.t_min = (int) strtol(p + 1, &p, 0);
+			if (*p == ':') cfg.t_range = (int) strtol(p + 1, &p, 0);
+		}
+
+		if ((ret = mlx_pwm_cap_add_gpio(cap, chip, &cfg)) < 0)
+		{
+			fprintf(stderr, "line %d : %s\n", cfg.pin, mlx_strerror(ret));
+			exit(1);
+		}
+
+		pins[num++] = cfg.pin;
+	}
+
+	memset(&prev, 0, sizeof(prev));
+	wall = clock_of(CLOCK_MONOTONIC);
+	cpu = clock_of(CLOCK_PROCESS_CPUTIME_ID);
+
+	for (;;)
+	{
+		if ((ret = mlx_pwm_cap_poll(cap, 100)) < 0)
+		{
+			fprintf(stderr, "capture : %s\n", mlx_strerror(ret));
+			break;
+		}
+
+		now = clock_of(CLOCK_MONOTONIC);
+		if (now - wall < (uint64_t) interval * 1000000000) continue;
+
+		for (i = 0; i < num; i++)
+		{
+			if (mlx_pwm_cap_get(cap, i, &r) == MLX_OK)
+				printf("%3d : %7.2f C %7.1f Hz\n", pins[i], r.celsius, r.freq);
+			else
+				printf("%3d : no signal\n", pins[i]);
+		}
+
+		mlx_pwm_cap_stat(cap, &st);
+
+		printf("%d lines : %.0f readings/s, %lu rejected, CPU %.2f%%\n\n", num,
+			(st.readings - prev.readings) * 1e9 / (now - wall), st.rejected - prev.rejected,
+			(clock_of(CLOCK_PROCESS_CPUTIME_ID) - cpu) * 100.0 / (now - wall));
+
+		fflush(stdout);
+
+		prev = st;
+		wall = now;
+		cpu = clock_of(CLOCK_PROCESS_CPUTIME_ID);
+	}
+
+	mlx_pwm_cap_free(cap);
+	exit(1);
+}
@@ -0,0 +1,191 @@
+/* detect stable readings after wake-up or power on reset of an MLX90615
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_ready is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_ready is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_ready. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * After wake-up or POR it takes a while before the MLX provides
+ * valid and stable readings. Instead of waiting a worst-case time,
+ * To and Ta are polled at a high rate. The MLX is declared ready
+ * once the variance of the last readings is within the limit.
+ *
+ * The RAM is only refreshed every so often : polls in between return
+ * the same values, also stale values from before the sleep. A reading
+ * is only added to the window when it differs from the previous one, or
+ * a refresh period has passed, so a window of identical polls is never
+ * taken as stable.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "mlx90615.h"
+
+/* variance limit (in C^2) of the last readings to declare ready */
+double ready_variance = 0.01;
+
+/* number of successive readings to check the variance on */
+int ready_window = 4;
+
+/* poll interval (ms) */
+#define READY_POLL	5
+
+/* give up after (ms) */
+#define READY_TIMEOUT 3000
+
+/* max window size */
+#define READY_MAX	16
+
+/* the RAM values are refreshed at least this often (ms) */
+#define READY_REFRESH 100
+
+/* metrics of the last detection (ms) */
+static double ready_first = -1;		// time to first valid sample
+static double ready_stable = -1;	// time to stable readings
+
+/* check for a valid reading (-40C ... 125C)
+ * @param loc : TO or TA
+ * return temperature in C or -999 if not valid */
+static double ready_read(char loc)
+{
+	long	ram;
+	double	temp;
+
+	if ((ram = read_ram(loc)) <= 0) return(-999);
+
+	temp = mlx_raw_to_celsius(ram);
+
+	if (temp < -40 || temp > 125) return(-999);
+
+	return(temp);
+}
+
+/* calculate variance over the window */
+static double ready_var(double *val, int num)
+{
+	double	mean = 0, var = 0;
+	int		i;
+
+	for (i = 0; i < num; i++) mean += val[i];
+	mean /= num;
+
+	for (i = 0; i < num; i++) var += (val[i] - mean) * (val[i] - mean);
+
+	return(var / num);
+}
+
+/* wait until the MLX provides stable readings
+ * @param start : time the wake-up / POR was started (usec, get_current())
+ *
+ * return time to stable readings in ms or -1 in case of time-out */
+double ready_wait(double start)
+{
+	double	to[READY_MAX], ta[READY_MAX];
+	double	now, r_to, r_ta, added = 0;
+	int		num = 0, win = ready_window;
+
+	if (win < 2) win = 2;
+	if (win > READY_MAX) win = READY_MAX;
+
+	ready_first = ready_stable = -1;
+
+	do
+	{
+		now = get_current();
+
+		if ((r_to = ready_read(TO)) != -999 && (r_ta = ready_read(TA)) != -999)
+		{
+			if (ready_first < 0)
+			{
+				ready_first = (now - start) / 1000;
+				if (DEBUG) printf("DEBUG: first valid sample after %1.1fms\n", ready_first);
+			}
+
+			// same as the previous reading within the refresh period : not refreshed
+			if (num > 0 && r_to == to[num - 1] && r_ta == ta[num - 1] &&
+				(now - added) / 1000 < READY_REFRESH)
+			{
+				mlx_clock_sleep((uint64_t) READY_POLL * 1000000);
+				continue;
+			}
+
+			added = now;
+
+			// shift the window when full
+			if (num == win)
+			{
+				memmove(to, to + 1, sizeof(double) * (win - 1));
+				memmove(ta, ta + 1, sizeof(double) * (win - 1));
+				num--;
+			}
+
+			to[num] = r_to;
+			ta[num++] = r_ta;
+
+			if (num == win && ready_var(to, num) <= ready_variance
+				&& ready_var(ta, num) <= ready_variance)
+			{
+				ready_stable = (now - start) / 1000;
+				if (DEBUG) printf("DEBUG: stable readings after %1.1fms\n", ready_stable);
+				return(ready_stable);
+			}
+		}
+		else
+			num = 0;	// start over
+
+		mlx_clock_sleep((uint64_t) READY_POLL * 1000000);
+
+	} while ((get_current() - start) / 1000 < READY_TIMEOUT);
+
+	return(-1);
+}
+
+/* perform a power on reset and wait until the MLX is ready
+ * @param pwm : 1 = MLX starts in PWM : wait for the PWM signal
+ *              0 = SMB mode : wait for stable readings
+ *
+ * return time to ready in ms or -1 in case of time-out */
+double por_ready(int pwm)
+{
+	double start;
+
+	por();
+	start = get_current();
+
+	if (pwm) return(pwm_wait_start() ? (get_current() - start) / 1000 : -1);
+
+	if (set_mlx_i2c() < 0) return(-1);
+
+	return(ready_wait(start));
+}
+
+/* display the metrics of the last detection */
+void ready_report()
+{
+	if (ready_first < 0)
+	{
+		p_printf(1,"No valid sample seen\n");
+		return;
+	}
+
+	p_printf(2,"time to first valid sample:\t%1.1fms\n", ready_first);
+
+	if (ready_stable < 0)
+		p_printf(1,"readings did not become stable (variance %1.3f, window %d)\n",
+		ready_variance, ready_window);
+	else
+		p_printf(2,"time to stable readings:\t%1.1fms\n", ready_stable);
+}
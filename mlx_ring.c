@@ -0,0 +1,324 @@
+/* libmlx90615 : history of readings in a shared memory ring
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_ring is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_ring is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_ring. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The writer counts the records written (head). Record n is stored in
+ * slot n % size with sequence number n + 1, which is written after the
+ * data. While a slot is written it has a different sequence number.
+ *
+ * A consumer keeps the sequence number of the next record it wants
+ * (cursor). If head is more than size ahead, the records in between are
+ * overwritten and counted as lost. A record that is overwritten while
+ * it is copied fails the sequence check and is counted as lost as well.
+ *
+ * Like the snapshot (mlx_shm.c) all shared words are 32 bit atomics, as
+ * the sequence numbers : these wrap, so they are compared as difference.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "libmlx90615.h"
+
+#define RING_MAGIC		0x524c4d58		// "XMLR"
+#define RING_VERSION	1
+
+/* size limits (records) */
+#define RING_MIN		16
+#define RING_MAX		(1 << 20)
+
+#define REC_WORDS		(sizeof(mlx_sample) / sizeof(uint32_t))
+
+/* marks a slot that is being written */
+#define REC_BUSY		0x80000000
+
+_Static_assert(sizeof(mlx_sample) % sizeof(uint32_t) == 0, "sample size");
+
+typedef struct ring_rec {
+	_Atomic uint32_t seq;				// record number + 1
+	_Atomic uint32_t w[REC_WORDS];
+	uint32_t	pad;					// 32 bytes per record
+} ring_rec;
+
+typedef struct ring_hdr {
+	_Atomic uint32_t magic;				// set last by the writer
+	uint32_t	version;
+	uint32_t	rec_size;
+	uint32_t	size;					// records, power of 2
+	_Atomic uint32_t head;				// records written
+} __attribute__((aligned(64))) ring_hdr;
+
+struct mlx_ring {
+	ring_hdr	*hdr;
+	ring_rec	*rec;
+	uint32_t	size;
+	size_t		len;					// mapped length
+	int			writer;
+};
+
+/* length of a ring segment */
+static size_t ring_len(uint32_t size)
+{
+	return(sizeof(ring_hdr) + size * sizeof(ring_rec));
+}
+
+/* map a ring segment */
+static mlx_ring *ring_map(int fd, size_t len, int writer)
+{
+	mlx_ring *ring;
+	void	*p;
+
+	p = mmap(NULL, len, writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+
+	close(fd);
+
+	if (p == MAP_FAILED) return(NULL);
+
+	if ((ring = calloc(1, sizeof(mlx_ring))) == NULL)
+	{
+		munmap(p, len);
+		return(NULL);
+	}
+
+	ring->hdr = p;
+	ring->rec = (ring_rec *) ((char *) p + sizeof(ring_hdr));
+	ring->len = len;
+	ring->writer = writer;
+
+	return(ring);
+}
+
+mlx_ring *mlx_ring_create(const char *name, int size, int mode)
+{
+	mlx_ring *ring;
+	uint32_t n = RING_MIN;
+	int		fd;
+
+	if (name == NULL) name = MLX_RING_NAME;
+
+	if (size > RING_MAX) return(NULL);
+
+	while ((int) n < size) n <<= 1;
+
+	if ((fd = shm_open(name, O_CREAT | O_RDWR, mode)) < 0) return(NULL);
+
+	// not limited by umask
+	if (fchmod(fd, mode) < 0 || ftruncate(fd, ring_len(n)) < 0)
+	{
+		close(fd);
+		return(NULL);
+	}
+
+	if ((ring = ring_map(fd, ring_len(n), 1)) == NULL) return(NULL);
+
+	ring->size = n;
+
+	// readers check the magic : set it last
+	atomic_store_explicit(&ring->hdr->magic, 0, memory_order_relaxed);
+	atomic_store_explicit(&ring->hdr->head, 0, memory_order_relaxed);
+
+	// a ring left by a previous run
+	memset(ring->rec, 0, n * sizeof(ring_rec));
+
+	ring->hdr->version = RING_VERSION;
+	ring->hdr->rec_size = sizeof(ring_rec);
+	ring->hdr->size = n;
+
+	atomic_store_explicit(&ring->hdr->magic, RING_MAGIC, memory_order_release);
+
+	return(ring);
+}
+
+mlx_ring *mlx_ring_open(const char *name)
+{
+	struct stat st;
+	mlx_ring *ring;
+	ring_hdr *hdr;
+	int		fd;
+
+	if (name == NULL) name = MLX_RING_NAME;
+
+	if ((fd = shm_open(name, O_RDONLY, 0)) < 0) return(NULL);
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) ring_len(RING_MIN))
+	{
+		close(fd);
+		return(NULL);
+	}
+
+	if ((ring = ring_map(fd, st.st_size, 0)) == NULL) return(NULL);
+
+	hdr = ring->hdr;
+	ring->size = hdr->size;
+
+	// writer of a different version or not ready
+	if (atomic_load_explicit(&hdr->magic, memory_order_acquire) != RING_MAGIC ||
+		hdr->version != RING_VERSION || hdr->rec_size != sizeof(ring_rec) ||
+		ring->size < RING_MIN || ring->size > RING_MAX ||
+		(ring->size & (ring->size - 1)) || ring_len(ring->size) > ring->len)
+	{
+		mlx_ring_close(ring);
+		return(NULL);
+	}
+
+	return(ring);
+}
+
+void mlx_ring_close(mlx_ring *ring)
+{
+	if (ring == NULL) return;
+
+	munmap(ring->hdr, ring->len);
+	free(ring);
+}
+
+void mlx_ring_unlink(const char *name)
+{
+	shm_unlink(name ? name : MLX_RING_NAME);
+}
+
+int mlx_ring_size(mlx_ring *ring)
+{
+	return(ring->size);
+}
+
+int mlx_ring_put(mlx_ring *ring, const mlx_sample *s)
+{
+	ring_rec	*r;
+	uint32_t	w[REC_WORDS], head;
+	unsigned	i;
+
+	if (! ring->writer) return(MLX_ERR_PARAM);
+
+	memcpy(w, s, sizeof(w));
+
+	head = atomic_load_explicit(&ring->hdr->head, memory_order_relaxed);
+	r = &ring->rec[head & (ring->size - 1)];
+
+	// mark the slot as being written
+	atomic_store_explicit(&r->seq, (head + 1) ^ REC_BUSY, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	for (i = 0; i < REC_WORDS; i++)
+		atomic_store_explicit(&r->w[i], w[i], memory_order_relaxed);
+
+	atomic_store_explicit(&r->seq, head + 1, memory_order_release);
+	atomic_store_explicit(&ring->hdr->head, head + 1, memory_order_release);
+
+	return(MLX_OK);
+}
+
+void mlx_ring_cursor(mlx_ring *ring, mlx_cursor *cur, int oldest)
+{
+	uint32_t head = atomic_load_explicit(&ring->hdr->head, memory_order_acquire);
+
+	cur->lost = 0;
+
+	if (! oldest) cur->pos = head;
+
+	// ring not filled yet
+	else if (head < ring->size) cur->pos = 0;
+
+	// skip the oldest : it might be overwritten now
+	else cur->pos = head - ring->size + 1;
+}
+
+/* copy record pos
+ * return 0 = OK, -1 = overwritten (before or while copied) */
+static int ring_copy(mlx_ring *ring, uint32_t pos, mlx_sample *s)
+{
+	ring_rec	*r = &ring->rec[pos & (ring->size - 1)];
+	uint32_t	w[REC_WORDS], s1, s2;
+	unsigned	i;
+
+	s1 = atomic_load_explicit(&r->seq, memory_order_acquire);
+
+	for (i = 0; i < REC_WORDS; i++)
+		w[i] = atomic_load_explicit(&r->w[i], memory_order_relaxed);
+
+	atomic_thread_fence(memory_order_acquire);
+	s2 = atomic_load_explicit(&r->seq, memory_order_relaxed);
+
+	if (s1 != s2 || s1 != pos + 1) return(-1);
+
+	memcpy(s, w, sizeof(w));
+	return(0);
+}
+
+void mlx_ring_cursor_time(mlx_ring *ring, mlx_cursor *cur, uint64_t time_ns)
+{
+	mlx_sample	s;
+	uint32_t	lo, hi, mid;
+
+	// the records are in time order : binary search from the oldest
+	mlx_ring_cursor(ring, cur, 1);
+	lo = cur->pos;
+	mlx_ring_cursor(ring, cur, 0);
+	hi = cur->pos;
+
+	while (hi - lo > 0 && hi - lo < 0x80000000)
+	{
+		mid = lo + (hi - lo) / 2;
+
+		// overwritten : older than all that are left
+		if (ring_copy(ring, mid, &s) < 0 || s.time_ns < time_ns) lo = mid + 1;
+		else hi = mid;
+	}
+
+	cur->pos = lo;
+}
+
+int mlx_ring_get(mlx_ring *ring, mlx_cursor *cur, mlx_sample *s, int max)
+{
+	uint32_t	head, ahead;
+	int			num = 0;
+
+	head = atomic_load_explicit(&ring->hdr->head, memory_order_acquire);
+
+	while (num < max)
+	{
+		ahead = head - cur->pos;
+
+		// nothing new (or cursor ahead of writer after its restart)
+		if (ahead == 0 || ahead > 0x80000000) break;
+
+		// overwritten before read
+		if (ahead > ring->size)
+		{
+			cur->lost += ahead - ring->size;
+			cur->pos = head - ring->size;
+		}
+
+		// overwritten while copied
+		if (ring_copy(ring, cur->pos, &s[num]) < 0)
+		{
+			cur->lost++;
+			cur->pos++;
+			head = atomic_load_explicit(&ring->hdr->head, memory_order_acquire);
+			continue;
+		}
+
+		num++;
+		cur->pos++;
+	}
+
+	return(num);
+}
@@ -0,0 +1,193 @@
+/* real-time capture of the MLX90615 PWM signal on Raspberry-pi
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_rt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_rt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_rt. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * detect_pwm() timestamps the level changes of SDA in a busy loop.
+ * If the program is preempted between two samples, the level change
+ * is seen late and the duty cycle (and temperature) is wrong.
+ *
+ * With -R the capture runs with SCHED_FIFO priority, optionally (-A)
+ * on one CPU (best an isolated one : isolcpus=3 on the kernel command
+ * line), with all memory locked and the stack pre-faulted, so no page
+ * fault can happen during the capture.
+ *
+ * The jitter self-test samples SDA the same way as detect_pwm() and
+ * reports the largest time between two samples : the worst-case error
+ * of a timestamp.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "mlx90615.h"
+
+/* SCHED_FIFO priority during capture (0 = real-time mode off) */
+int rt_prio = 0;
+
+/* CPU to run the capture on (-1 = any) */
+int rt_cpu = -1;
+
+/* stack to pre-fault (bytes) */
+#define RT_STACK	(64 * 1024)
+
+/* scheduling before rt_enter() */
+static int		rt_policy;
+static struct sched_param rt_param;
+static cpu_set_t rt_cpus;
+static int		rt_active = 0;
+static int		rt_locked = 0;
+
+/* touch the stack, so it is mapped before the capture */
+static void rt_prefault_stack()
+{
+	char stack[RT_STACK];
+
+	memset(stack, 0, RT_STACK);
+
+	// do not let the compiler remove the memset
+	__asm__ __volatile__("" : : "r" (stack) : "memory");
+}
+
+/* lock all memory (once) */
+static int rt_lock_memory()
+{
+	if (rt_locked) return(0);
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+	{
+		p_printf(1, "Can not lock memory\n");
+		return(-1);
+	}
+
+	rt_prefault_stack();
+	rt_locked = 1;
+
+	return(0);
+}
+
+int rt_enter()
+{
+	struct sched_param param;
+	cpu_set_t	cpus;
+
+	if (rt_prio <= 0 || rt_active) return(0);
+
+	if (rt_lock_memory() < 0) return(-1);
+
+	// save current, to restore in rt_leave()
+	rt_policy = sched_getscheduler(0);
+	sched_getparam(0, &rt_param);
+	sched_getaffinity(0, sizeof(cpu_set_t), &rt_cpus);
+
+	if (rt_cpu >= 0)
+	{
+		CPU_ZERO(&cpus);
+		CPU_SET(rt_cpu, &cpus);
+
+		if (sched_setaffinity(0, sizeof(cpu_set_t), &cpus) < 0)
+		{
+			p_printf(1, "Can not run on CPU %d\n", rt_cpu);
+			return(-1);
+		}
+	}
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = rt_prio;
+
+	if (sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+	{
+		p_printf(1, "Can not set real-time priority %d\n", rt_prio);
+		sched_setaffinity(0, sizeof(cpu_set_t), &rt_cpus);
+		return(-1);
+	}
+
+	if (DEBUG) printf("DEBUG: real-time capture, priority %d CPU %d\n", rt_prio, rt_cpu);
+
+	rt_active = 1;
+	return(0);
+}
+
+void rt_leave()
+{
+	if (! rt_active) return;
+
+	sched_setscheduler(0, rt_policy, &rt_param);
+	sched_setaffinity(0, sizeof(cpu_set_t), &rt_cpus);
+
+	rt_active = 0;
+}
+
+/* sample SDA as detect_pwm() does
+ * @param ms : duration
+ * @param max : largest time between two samples (us)
+ * return number of samples */
+static long rt_sample(long ms, double *max)
+{
+	double	start, prev, now;
+	long	count = 0;
+
+	*max = 0;
+	start = prev = get_current();
+
+	do
+	{
+		gpio_lev(sda_pin);
+		now = get_current();
+
+		if (now - prev > *max) *max = now - prev;
+
+		prev = now;
+		count++;
+
+	} while (now - start < ms * 1000.0);
+
+	return(count);
+}
+
+void rt_jitter_test(long ms)
+{
+	double	max_normal, max_rt;
+	long	count;
+
+	// the level is read without changing the pin function (I2C or PWM)
+	count = rt_sample(ms, &max_normal);
+	p_printf(2, "normal    : %ld samples in %ld ms, worst-case timestamp latency %.1f us\n",
+		count, ms, max_normal);
+
+	if (rt_prio <= 0)
+	{
+		p_printf(3, "real-time capture is not enabled (option -R)\n");
+		return;
+	}
+
+	if (rt_enter() < 0) return;
+
+	count = rt_sample(ms, &max_rt);
+
+	rt_leave();
+
+	p_printf(2, "real-time : %ld samples in %ld ms, worst-case timestamp latency %.1f us\n",
+		count, ms, max_rt);
+
+	// at 1kHz the period is 1000us, 0.1% duty is 1us
+	if (max_rt > 10)
+		p_printf(1, "Latency above 10us : use an isolated CPU (-A) or a lower load\n");
+}
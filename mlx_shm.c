@@ -0,0 +1,236 @@
+/* libmlx90615 : latest readings in shared memory
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_shm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_shm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_shm. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Each slot has a sequence counter (seqlock). The publisher makes it
+ * odd, stores the snapshot and makes it even again. A reader copies the
+ * snapshot and checks that the counter was even and did not change,
+ * otherwise it copies again.
+ *
+ * The snapshot is stored as 32 bit atomic words : these are plain loads
+ * and stores on the Raspberry-pi (also on a read-only mapping), where
+ * 64 bit atomics might need a lock.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "libmlx90615.h"
+
+#define SHM_MAGIC		0x534c4d58		// "XMLS"
+#define SHM_VERSION		2
+
+#define SNAP_WORDS		(sizeof(mlx_snapshot) / sizeof(uint32_t))
+
+_Static_assert(sizeof(mlx_snapshot) % sizeof(uint32_t) == 0, "snapshot size");
+
+/* one slot per cache line(s), so slots do not share a line */
+typedef struct shm_slot {
+	_Atomic uint32_t seq;					// odd = publish in progress
+	_Atomic uint32_t w[SNAP_WORDS];
+} __attribute__((aligned(64))) shm_slot;
+
+typedef struct shm_seg {
+	_Atomic uint32_t magic;					// set last by the publisher
+	uint32_t	version;
+	uint32_t	snap_size;
+	uint32_t	max;
+	_Atomic int32_t	count;					// slots in use
+	shm_slot	slot[MLX_SHM_MAX];
+} shm_seg;
+
+struct mlx_shm {
+	shm_seg	*seg;
+	int		writer;
+};
+
+/* map a segment */
+static mlx_shm *shm_map(int fd, int writer)
+{
+	mlx_shm	*shm;
+	void	*p;
+
+	p = mmap(NULL, sizeof(shm_seg), writer ? PROT_READ | PROT_WRITE : PROT_READ,
+		MAP_SHARED, fd, 0);
+
+	close(fd);
+
+	if (p == MAP_FAILED) return(NULL);
+
+	if ((shm = calloc(1, sizeof(mlx_shm))) == NULL)
+	{
+		munmap(p, sizeof(shm_seg));
+		return(NULL);
+	}
+
+	shm->seg = p;
+	shm->writer = writer;
+
+	return(shm);
+}
+
+mlx_shm *mlx_shm_create(const char *name, int mode)
+{
+	mlx_shm	*shm;
+	shm_seg	*seg;
+	int		fd, i;
+
+	if (name == NULL) name = MLX_SHM_NAME;
+
+	if ((fd = shm_open(name, O_CREAT | O_RDWR, mode)) < 0) return(NULL);
+
+	// not limited by umask
+	if (fchmod(fd, mode) < 0 || ftruncate(fd, sizeof(shm_seg)) < 0)
+	{
+		close(fd);
+		return(NULL);
+	}
+
+	if ((shm = shm_map(fd, 1)) == NULL) return(NULL);
+
+	seg = shm->seg;
+
+	// readers check the magic : set it last
+	atomic_store_explicit(&seg->magic, 0, memory_order_relaxed);
+	atomic_store_explicit(&seg->count, 0, memory_order_relaxed);
+
+	for (i = 0; i < MLX_SHM_MAX; i++)
+		atomic_store_explicit(&seg->slot[i].seq, 0, memory_order_relaxed);
+
+	seg->version = SHM_VERSION;
+	seg->snap_size = sizeof(mlx_snapshot);
+	seg->max = MLX_SHM_MAX;
+
+	atomic_store_explicit(&seg->magic, SHM_MAGIC, memory_order_release);
+
+	return(shm);
+}
+
+mlx_shm *mlx_shm_open(const char *name)
+{
+	struct stat st;
+	mlx_shm	*shm;
+	shm_seg	*seg;
+	int		fd;
+
+	if (name == NULL) name = MLX_SHM_NAME;
+
+	if ((fd = shm_open(name, O_RDONLY, 0)) < 0) return(NULL);
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(shm_seg))
+	{
+		close(fd);
+		return(NULL);
+	}
+
+	if ((shm = shm_map(fd, 0)) == NULL) return(NULL);
+
+	seg = shm->seg;
+
+	// publisher of a different version
+	if (atomic_load_explicit(&seg->magic, memory_order_acquire) != SHM_MAGIC ||
+		seg->version != SHM_VERSION || seg->snap_size != sizeof(mlx_snapshot))
+	{
+		mlx_shm_close(shm);
+		return(NULL);
+	}
+
+	return(shm);
+}
+
+void mlx_shm_close(mlx_shm *shm)
+{
+	if (shm == NULL) return;
+
+	munmap(shm->seg, sizeof(shm_seg));
+	free(shm);
+}
+
+void mlx_shm_unlink(const char *name)
+{
+	shm_unlink(name ? name : MLX_SHM_NAME);
+}
+
+void mlx_shm_set_count(mlx_shm *shm, int count)
+{
+	if (! shm->writer || count < 0 || count > MLX_SHM_MAX) return;
+
+	atomic_store_explicit(&shm->seg->count, count, memory_order_release);
+}
+
+int mlx_shm_count(mlx_shm *shm)
+{
+	return(atomic_load_explicit(&shm->seg->count, memory_order_acquire));
+}
+
+int mlx_shm_publish(mlx_shm *shm, int idx, const mlx_snapshot *snap)
+{
+	shm_slot	*slot;
+	uint32_t	w[SNAP_WORDS], seq;
+	unsigned	i;
+
+	if (! shm->writer || idx < 0 || idx >= MLX_SHM_MAX) return(MLX_ERR_PARAM);
+
+	slot = &shm->seg->slot[idx];
+	memcpy(w, snap, sizeof(w));
+
+	seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+	// odd : publish in progress
+	atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	for (i = 0; i < SNAP_WORDS; i++)
+		atomic_store_explicit(&slot->w[i], w[i], memory_order_relaxed);
+
+	atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+
+	return(MLX_OK);
+}
+
+int mlx_shm_read(mlx_shm *shm, int idx, mlx_snapshot *snap)
+{
+	shm_slot	*slot;
+	uint32_t	w[SNAP_WORDS], s1, s2;
+	unsigned	i;
+
+	if (idx < 0 || idx >= MLX_SHM_MAX) return(MLX_ERR_PARAM);
+
+	slot = &shm->seg->slot[idx];
+
+	do
+	{
+		// wait for a publish in progress to finish
+		while ((s1 = atomic_load_explicit(&slot->seq, memory_order_acquire)) & 1) ;
+
+		for (i = 0; i < SNAP_WORDS; i++)
+			w[i] = atomic_load_explicit(&slot->w[i], memory_order_relaxed);
+
+		atomic_thread_fence(memory_order_acquire);
+		s2 = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+	} while (s1 != s2);
+
+	if (s1 == 0) return(MLX_ERR_NODATA);
+
+	memcpy(snap, w, sizeof(w));
+	return(MLX_OK);
+}
@@ -0,0 +1,261 @@
+/* mlx_soak : long-horizon run on a simulated bus with a virtual clock
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_soak is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_soak is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_soak. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Days of acquisition are run on the simulated bus (mlx_bus_sim.c) with
+ * the virtual clock (mlx_clock.c) as process clock. All waiting (sample
+ * period, EEPROM write delay, power off, wake-up) is on that clock, so
+ * it takes no time and every run gives the same result.
+ *
+ * Every sample period Ta and To of all devices are read and checked
+ * against the temperatures set in the simulation, which follow a day
+ * and an hour cycle. Periodically all devices are put in sleep for a
+ * while and woken up, and the first device is switched to PWM mode
+ * (config + power on reset) and back with an SMBus request.
+ *
+ * At the end the counts are displayed with a checksum over all readings
+ * (compare the checksum of two runs).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <math.h>
+#include "libmlx90615.h"
+
+/* wall time at start of the virtual clock (1 April 2017) */
+#define SOAK_EPOCH		1491004800
+
+#define NS_SEC			1000000000ULL
+
+typedef struct soak_stat {
+	long		samples;
+	long		errors;			// failed reads
+	long		mismatch;		// reading not as set in the simulation
+	long		sleeps;
+	long		switches;
+	uint64_t	sum;			// FNV-1a over the readings
+} soak_stat;
+
+static mlx_sim	*sim;
+static mlx_bus	*bus;
+static mlx_dev	*dev[MLX_SIM_MAX];
+static int		num_dev = 2;
+static soak_stat st;
+
+static void fail(const char *what, int ret)
+{
+	fprintf(stderr, "mlx_soak: %s : %s\n", what, mlx_strerror(ret));
+	exit(1);
+}
+
+/* add a value to the checksum */
+static void check_add(uint64_t val)
+{
+	int i;
+
+	if (st.sum == 0) st.sum = 0xcbf29ce484222325ULL;
+
+	for (i = 0; i < 8; i++, val >>= 8)
+	{
+		st.sum ^= val & 0xff;
+		st.sum *= 0x100000001b3ULL;
+	}
+}
+
+/* temperatures in the simulation at time t (seconds) */
+static void sim_temp(int i, double t, double *ta, double *to)
+{
+	*ta = 20 + 5 * sin(2 * M_PI * t / 86400) + i;
+	*to = *ta + 10 + 3 * sin(2 * M_PI * t / 3600);
+}
+
+/* read Ta and To of all devices and check them */
+static void sample(double t)
+{
+	double	ta, to, exp_ta, exp_to;
+	int		i, ret;
+
+	for (i = 0; i < num_dev; i++)
+	{
+		sim_temp(i, t, &exp_ta, &exp_to);
+		mlx_sim_set_temp(sim, mlx_get_addr(dev[i]), exp_ta, exp_to);
+
+		ret = mlx_read_temp(dev[i], MLX_RAM_TA, &ta);
+		if (ret == MLX_OK) ret = mlx_read_temp(dev[i], MLX_RAM_TO, &to);
+
+		check_add((uint64_t) (int64_t) ret);
+
+		if (ret != MLX_OK)
+		{
+			st.errors++;
+			continue;
+		}
+
+		// resolution is 0.02 degrees
+		if (fabs(ta - exp_ta) > 0.02 || fabs(to - exp_to) > 0.02) st.mismatch++;
+
+		check_add((uint64_t) llround(ta * 100));
+		check_add((uint64_t) llround(to * 100));
+	}
+
+	st.samples++;
+}
+
+/* all devices in sleep for a while and wake-up */
+static void sleep_cycle(int sec)
+{
+	int i, ret;
+
+	for (i = 0; i < num_dev; i++)
+		if ((ret = mlx_sleep(dev[i])) != MLX_OK) fail("sleep", ret);
+
+	mlx_clock_sleep(sec * NS_SEC);
+
+	if ((ret = mlx_wake(dev[0])) != MLX_OK) fail("wake", ret);
+
+	st.sleeps++;
+}
+
+/* first device to PWM mode (POR) and back to SMBus */
+static void mode_switch()
+{
+	uint16_t cfg, val;
+	int		ret;
+
+	if ((ret = mlx_read_reg(dev[0], MLX_REG_CONFIG, &cfg)) != MLX_OK) fail("config", ret);
+
+	// PWM mode after power on reset
+	if ((ret = mlx_write_reg(dev[0], MLX_REG_CONFIG, cfg & ~0x1)) != MLX_OK) fail("to PWM", ret);
+	if ((ret = mlx_por(dev[0], 1000)) != MLX_OK) fail("por", ret);
+
+	// in PWM it does not answer on SMBus
+	if (mlx_read_reg(dev[0], MLX_REG_CONFIG, &val) != MLX_ERR_NACK) st.mismatch++;
+
+	// SMBus request and back to SMBus after power on reset
+	if ((ret = mlx_wake(dev[0])) != MLX_OK) fail("SMBus request", ret);
+	if ((ret = mlx_write_reg(dev[0], MLX_REG_CONFIG, cfg | 0x1)) != MLX_OK) fail("to SMBus", ret);
+
+	st.switches++;
+}
+
+int main(int argc, char *argv[])
+{
+	mlx_clock	*vc;
+	uint64_t	start, end, next;
+	double		days = 1;
+	long		period = 1000, sleep_every = 600, switch_every = 3600;
+	char		*trace_file = NULL;
+	int			c, i;
+
+	while ((c = getopt(argc, argv, "d:n:p:s:m:T:H")) != -1)
+	{
+		switch(c)
+		{
+			case 'd':	// days to run
+				days = strtod(optarg, NULL);
+				break;
+
+			case 'n':	// number of devices
+				num_dev = (int) strtol(optarg, NULL, 10);
+				if (num_dev < 1 || num_dev > MLX_SIM_MAX) num_dev = 2;
+				break;
+
+			case 'p':	// sample period in ms
+				period = strtol(optarg, NULL, 10);
+				break;
+
+			case 's':	// sleep cycle every samples (0 = none)
+				sleep_every = strtol(optarg, NULL, 10);
+				break;
+
+			case 'm':	// mode switch every samples (0 = none)
+				switch_every = strtol(optarg, NULL, 10);
+				break;
+
+			case 'T':	// transaction trace (virtual time)
+				trace_file = optarg;
+				break;
+
+			default:
+				printf("%s [-d days] [-n devices] [-p period ms] [-s sleep every] [-m switch every] [-T trace file]\n", argv[0]);
+				exit(c == 'H' ? 0 : 1);
+		}
+	}
+
+	if (period < 1) period = 1;
+
+	if ((vc = mlx_vclock_new(SOAK_EPOCH)) == NULL) fail("clock", MLX_ERR_NOMEM);
+	mlx_clock_set(vc);
+
+	if (trace_file && mlx_trace_start(trace_file) != MLX_OK) fail("trace", MLX_ERR_PARAM);
+
+	if ((sim = mlx_sim_new()) == NULL) fail("simulation", MLX_ERR_NOMEM);
+	mlx_sim_set_clock(sim, vc);
+
+	for (i = 0; i < num_dev; i++)
+		if (mlx_sim_add(sim, 0x5b + i, 0x64c744 + i) != MLX_OK) fail("add device", MLX_ERR_PARAM);
+
+	if ((bus = mlx_bus_open_sim(sim)) == NULL) fail("bus", MLX_ERR_BUS);
+
+	// same EEPROM delay as on the real bus
+	mlx_bus_set_write_delay(bus, 100000);
+
+	for (i = 0; i < num_dev; i++)
+		if ((dev[i] = mlx_open(bus, 0x5b + i, 0)) == NULL) fail("device", MLX_ERR_NOMEM);
+
+	start = next = mlx_clock_ns();
+	end = start + (uint64_t) (days * 86400 * NS_SEC);
+
+	while (mlx_clock_ns() < end)
+	{
+		sample((mlx_clock_ns() - start) / 1e9);
+
+		if (sleep_every && st.samples % sleep_every == 0) sleep_cycle(10);
+
+		if (switch_every && st.samples % switch_every == 0) mode_switch();
+
+		// next sample on the period, skip the ones missed
+		next += period * 1000000ULL;
+		if (next > mlx_clock_ns()) mlx_clock_sleep(next - mlx_clock_ns());
+		else next = mlx_clock_ns();
+	}
+
+	printf("simulated\t%.2f days (%ld s)\n", (mlx_clock_ns() - start) / (86400.0 * NS_SEC),
+		(long) (mlx_clock_time() - SOAK_EPOCH));
+	printf("devices\t\t%d\n", num_dev);
+	printf("samples\t\t%ld\n", st.samples);
+	printf("errors\t\t%ld\n", st.errors);
+	printf("mismatch\t%ld\n", st.mismatch);
+	printf("sleep cycles\t%ld\n", st.sleeps);
+	printf("mode switches\t%ld\n", st.switches);
+	printf("transfers\t%lu\n", mlx_sim_transfers(sim));
+	printf("checksum\t%016llx\n", (unsigned long long) st.sum);
+
+	if (trace_file) printf("trace dropped\t%lu\n", mlx_trace_dropped());
+
+	mlx_trace_stop();
+
+	for (i = 0; i < num_dev; i++) mlx_close(dev[i]);
+
+	mlx_bus_close(bus);
+	mlx_sim_free(sim);
+	mlx_vclock_free(vc);
+
+	exit(st.errors || st.mismatch ? 1 : 0);
+}
@@ -0,0 +1,142 @@
+/* mlx_stat : display the statistics of the sensors that mlxd samples
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_stat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_stat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_stat. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The statistics are kept by mlxd -p ms -W sec and read from the shared
+ * memory : the bus is not used. With -m they are written as metrics in
+ * the Prometheus text format (e.g. for the textfile collector of the
+ * node exporter), with -i every sec seconds.
+ *
+ * usage : mlx_stat [-S name] [-m] [-i sec]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include "libmlx90615.h"
+
+static void usage(char *name)
+{
+	fprintf(stderr, "usage : %s [-S name] [-m] [-i sec]\n"
+		"  -S name    shared memory of mlxd (default %s)\n"
+		"  -m         write as metrics (Prometheus text format)\n"
+		"  -i sec     repeat every sec seconds\n", name, MLX_SHM_NAME);
+	exit(1);
+}
+
+static void table(mlx_snapshot *snap, int num)
+{
+	static const char *name[2] = { "To", "Ta" };
+	mlx_summary *r;
+	int i, k;
+
+	printf("%-8s %4s %2s %7s %8s %7s %8s %8s %8s %8s %8s\n", "unit", "addr", "",
+		"n", "mean", "sd", "min", "max", "p50", "p95", "p99");
+
+	for (i = 0; i < num; i++)
+	{
+		for (k = 0; k < 2; k++)
+		{
+			r = k ? &snap[i].ta_stat : &snap[i].to_stat;
+
+			printf("%08x 0x%02x %2s %7u ", snap[i].unit_id, snap[i].addr, name[k], r->n);
+
+			if (r->n == 0) printf("%8s\n", "-");
+			else printf("%8.2f %7.3f %8.2f %8.2f %8.2f %8.2f %8.2f\n",
+				r->mean, r->sd, r->min, r->max, r->p50, r->p95, r->p99);
+		}
+	}
+}
+
+/* one metric of all sensors */
+static void metric(mlx_snapshot *snap, int num, const char *field, const char *help, int off)
+{
+	static const char *name[2] = { "to", "ta" };
+	mlx_summary *r;
+	int i, k;
+
+	printf("# HELP mlx90615_%s %s of the window\n# TYPE mlx90615_%s gauge\n", field, help, field);
+
+	for (i = 0; i < num; i++)
+	{
+		for (k = 0; k < 2; k++)
+		{
+			r = k ? &snap[i].ta_stat : &snap[i].to_stat;
+			if (r->n == 0) continue;
+
+			printf("mlx90615_%s{unit=\"%08x\",addr=\"0x%02x\",temp=\"%s\"} ", field, snap[i].unit_id, snap[i].addr, name[k]);
+
+			if (off < 0) printf("%u\n", r->n);
+			else printf("%.3f\n", *(float *) ((char *) r + off));
+		}
+	}
+}
+
+static void metrics(mlx_snapshot *snap, int num)
+{
+	metric(snap, num, "readings", "readings", -1);
+	metric(snap, num, "mean_celsius", "mean", offsetof(mlx_summary, mean));
+	metric(snap, num, "sd_celsius", "standard deviation", offsetof(mlx_summary, sd));
+	metric(snap, num, "min_celsius", "minimum", offsetof(mlx_summary, min));
+	metric(snap, num, "max_celsius", "maximum", offsetof(mlx_summary, max));
+	metric(snap, num, "p50_celsius", "median", offsetof(mlx_summary, p50));
+	metric(snap, num, "p95_celsius", "95th percentile", offsetof(mlx_summary, p95));
+	metric(snap, num, "p99_celsius", "99th percentile", offsetof(mlx_summary, p99));
+}
+
+int main(int argc, char *argv[])
+{
+	mlx_snapshot	snap[MLX_SHM_MAX];
+	mlx_shm			*shm;
+	char			*name = MLX_SHM_NAME;
+	int				c, i, num, as_metrics = 0, interval = 0;
+
+	while ((c = getopt(argc, argv, "S:mi:")) != -1)
+	{
+		switch(c)
+		{
+			case 'S':	name = optarg;						break;
+			case 'm':	as_metrics = 1;						break;
+			case 'i':	interval = (int) strtol(optarg, NULL, 10);	break;
+			default:	usage(argv[0]);
+		}
+	}
+
+	if (optind < argc) usage(argv[0]);
+
+	if ((shm = mlx_shm_open(name)) == NULL)
+	{
+		perror(name);
+		exit(1);
+	}
+
+	do
+	{
+		// the sensors that have a reading
+		for (i = num = 0; i < mlx_shm_count(shm); i++)
+			if (mlx_shm_read(shm, i, &snap[num]) == MLX_OK) num++;
+
+		if (as_metrics) metrics(snap, num);
+		else table(snap, num);
+
+		fflush(stdout);
+	} while (interval > 0 && sleep(interval) == 0);
+
+	mlx_shm_close(shm);
+	exit(0);
+}
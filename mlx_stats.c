@@ -0,0 +1,389 @@
+/* libmlx90615 : statistics of a stream of readings over a window
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_stats is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_stats is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_stats. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * All memory is allocated when created, an update does not allocate.
+ *
+ * Mean and variance of the last 'window' readings : Welford, a new
+ * reading is added and the one that leaves the window is taken out.
+ * Once per window they are computed again from the readings, so the
+ * rounding errors of taking out do not add up (O(1) amortised).
+ *
+ * Min and max : a monotonic deque each. The max deque has the readings
+ * that can still become the max (each one higher than all after it),
+ * the oldest (the max) in front. A reading is added and removed once.
+ *
+ * Quantiles : a merging t-digest, which keeps the readings as at most
+ * DIGEST_MAX centroids (mean and weight). A centroid near the tails has
+ * less weight, so p99 stays accurate. New readings are buffered and
+ * merged sorted when the buffer is full. A t-digest can not take out a
+ * reading, so the window is split in blocks with a digest each : the
+ * oldest block is dropped when a new one starts. Part of the oldest
+ * block can be out of the window : for a query the readings of it that
+ * are still in are taken from the ring, each as a centroid of weight 1.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "libmlx90615.h"
+
+/* compression of a digest : at most about DIGEST_DELTA centroids */
+#define DIGEST_DELTA	50
+#define DIGEST_MAX		(2 * DIGEST_DELTA + 8)
+
+/* readings buffered before a merge */
+#define DIGEST_BUF		128
+
+/* digests in a window (one is filling) */
+#define STATS_BLOCKS	5
+
+typedef struct centroid {
+	float		mean;
+	float		weight;			// readings
+} centroid;
+
+typedef struct digest {
+	uint32_t	n;				// readings, merged and buffered
+	int			num;			// centroids
+	int			nbuf;
+	centroid	c[DIGEST_MAX];
+	float		buf[DIGEST_BUF];
+} digest;
+
+struct mlx_stats {
+	int			window;
+	uint64_t	count;			// readings added
+	float		*ring;			// the readings of the window
+	double		mean, m2;		// Welford of the readings in the window
+	int			*dmin, *dmax;	// deques of places in ring
+	int			min_head, min_num, max_head, max_num;
+	int			block_len;		// readings per digest
+	int			cur;			// digest that is filling
+	digest		blk[STATS_BLOCKS];
+	centroid	*merge;			// for a query (centroids + a block of readings)
+};
+
+static void digest_reset(digest *d)
+{
+	d->n = 0;
+	d->num = 0;
+	d->nbuf = 0;
+}
+
+static int cmp_float(const void *a, const void *b)
+{
+	float x = *(const float *) a, y = *(const float *) b;
+
+	return((x > y) - (x < y));
+}
+
+static int cmp_centroid(const void *a, const void *b)
+{
+	float x = ((const centroid *) a)->mean, y = ((const centroid *) b)->mean;
+
+	return((x > y) - (x < y));
+}
+
+/* the highest quantile a centroid that starts at quantile q can reach :
+ * scale k(q) = DIGEST_DELTA / (2 pi) * asin(2q - 1) goes up 1 at most.
+ * Small centroids at the tails, so at most about DIGEST_DELTA of them */
+static double digest_limit(double q)
+{
+	double a = asin(2 * q - 1) + 2 * M_PI / DIGEST_DELTA;
+
+	return(a >= M_PI / 2 ? 1.0 : (1 + sin(a)) / 2);
+}
+
+/* merge the buffer in the centroids */
+static void digest_flush(digest *d)
+{
+	centroid	out[DIGEST_MAX], cur, x;
+	double		total = d->n, sofar = 0, limit;
+	int			i = 0, k = 0, num = 0;
+
+	if (d->nbuf == 0) return;
+
+	qsort(d->buf, d->nbuf, sizeof(float), cmp_float);
+
+	// both sorted : take the lowest of each
+	cur = (d->num && d->c[0].mean <= d->buf[0]) ? d->c[i++] : (centroid) { d->buf[k++], 1 };
+	limit = digest_limit(0) * total;
+
+	while (i < d->num || k < d->nbuf)
+	{
+		if (k == d->nbuf || (i < d->num && d->c[i].mean <= d->buf[k])) x = d->c[i++];
+		else x = (centroid) { d->buf[k++], 1 };
+
+		if (sofar + cur.weight + x.weight <= limit || num == DIGEST_MAX - 1)
+		{
+			cur.weight += x.weight;
+			cur.mean += (x.mean - cur.mean) * x.weight / cur.weight;
+		}
+		else
+		{
+			sofar += cur.weight;
+			out[num++] = cur;
+			cur = x;
+			limit = digest_limit(sofar / total) * total;
+		}
+	}
+
+	out[num++] = cur;
+
+	memcpy(d->c, out, num * sizeof(centroid));
+	d->num = num;
+	d->nbuf = 0;
+}
+
+static void digest_add(digest *d, float x)
+{
+	d->buf[d->nbuf++] = x;
+	d->n++;
+
+	if (d->nbuf == DIGEST_BUF) digest_flush(d);
+}
+
+/* quantile q of sorted centroids with total weight n : between the
+ * centers of the centroids, and min / max at the ends */
+static double centroid_quantile(const centroid *c, int num, double n, double min, double max, double q)
+{
+	double	target = q * n, left = 0, center, prev;
+	int		i;
+
+	if (num == 0) return(NAN);
+
+	center = c[0].weight / 2.0;
+
+	if (target <= center) return(min + (c[0].mean - min) * (center > 0 ? target / center : 0));
+
+	for (i = 1; i < num; i++)
+	{
+		prev = center;
+		left += c[i - 1].weight;
+		center = left + c[i].weight / 2.0;
+
+		if (target <= center)
+			return(c[i - 1].mean + (c[i].mean - c[i - 1].mean) * (target - prev) / (center - prev));
+	}
+
+	// between the center of the last and max
+	return(c[num - 1].mean + (max - c[num - 1].mean) * (target - center) / (n - center));
+}
+
+mlx_stats *mlx_stats_new(int window)
+{
+	mlx_stats *s;
+
+	if (window < STATS_BLOCKS) return(NULL);
+
+	if ((s = calloc(1, sizeof(mlx_stats))) == NULL) return(NULL);
+
+	s->window = window;
+	s->block_len = (window + STATS_BLOCKS - 2) / (STATS_BLOCKS - 1);
+
+	if ((s->ring = calloc(window, sizeof(float))) == NULL ||
+		(s->dmin = calloc(window, sizeof(int))) == NULL ||
+		(s->dmax = calloc(window, sizeof(int))) == NULL ||
+		(s->merge = calloc(STATS_BLOCKS * DIGEST_MAX + s->block_len, sizeof(centroid))) == NULL)
+	{
+		mlx_stats_free(s);
+		return(NULL);
+	}
+
+	mlx_stats_reset(s);
+
+	return(s);
+}
+
+void mlx_stats_free(mlx_stats *s)
+{
+	if (s == NULL) return;
+
+	free(s->ring);
+	free(s->dmin);
+	free(s->dmax);
+	free(s->merge);
+	free(s);
+}
+
+void mlx_stats_reset(mlx_stats *s)
+{
+	int i;
+
+	s->count = 0;
+	s->mean = s->m2 = 0;
+	s->min_head = s->min_num = s->max_head = s->max_num = 0;
+	s->cur = 0;
+
+	for (i = 0; i < STATS_BLOCKS; i++) digest_reset(&s->blk[i]);
+}
+
+/* the readings in the window */
+static uint32_t stats_num(const mlx_stats *s)
+{
+	return(s->count < (uint64_t) s->window ? (uint32_t) s->count : (uint32_t) s->window);
+}
+
+/* mean and m2 again from the readings */
+static void stats_recompute(mlx_stats *s)
+{
+	double	sum = 0, d;
+	int		i, n = stats_num(s);
+
+	for (i = 0; i < n; i++) sum += s->ring[i];
+
+	s->mean = n ? sum / n : 0;
+	s->m2 = 0;
+
+	for (i = 0; i < n; i++)
+	{
+		d = s->ring[i] - s->mean;
+		s->m2 += d * d;
+	}
+}
+
+/* add the reading for place 'slot' in ring to a deque : the ones it
+ * replaces are removed from the back, the one that leaves the window
+ * (in the same place) from the front
+ * @param above : 1 = max deque, 0 = min deque */
+static void deque_add(mlx_stats *s, int *dq, int *head, int *num, int slot, float x, int above)
+{
+	float	v;
+	int		w = s->window;
+
+	if (*num && s->count >= (uint64_t) w && dq[*head] == slot)
+	{
+		*head = (*head + 1) % w;
+		(*num)--;
+	}
+
+	while (*num)
+	{
+		v = s->ring[dq[(*head + *num - 1) % w]];
+
+		if (above ? v > x : v < x) break;
+
+		(*num)--;
+	}
+
+	dq[(*head + (*num)++) % w] = slot;
+}
+
+void mlx_stats_add(mlx_stats *s, double val)
+{
+	float	x = (float) val, old;
+	int		slot = (int) (s->count % s->window);
+	double	d;
+
+	// a failed reading or compensation
+	if (isnan(x)) return;
+
+	// deques first : they still need the reading that is replaced
+	deque_add(s, s->dmin, &s->min_head, &s->min_num, slot, x, 0);
+	deque_add(s, s->dmax, &s->max_head, &s->max_num, slot, x, 1);
+
+	// the oldest leaves the window
+	if (s->count >= (uint64_t) s->window)
+	{
+		old = s->ring[slot];
+		d = old - s->mean;
+		s->mean -= d / (s->window - 1);
+		s->m2 -= d * (old - s->mean);
+	}
+
+	s->ring[slot] = x;
+	s->count++;
+
+	d = x - s->mean;
+	s->mean += d / stats_num(s);
+	s->m2 += d * (x - s->mean);
+
+	// once per window, without the rounding errors
+	if (slot == s->window - 1) stats_recompute(s);
+
+	// a new block : it takes the place of the oldest
+	if (s->blk[s->cur].n == (uint32_t) s->block_len)
+	{
+		s->cur = (s->cur + 1) % STATS_BLOCKS;
+		digest_reset(&s->blk[s->cur]);
+	}
+
+	digest_add(&s->blk[s->cur], x);
+}
+
+int mlx_stats_quantiles(mlx_stats *s, const double *q, double *val, int num)
+{
+	digest		*d;
+	uint64_t	first;
+	double		min, max;
+	int			i, j, b, k = 0, n = stats_num(s), left = n;
+
+	if (left == 0) return(MLX_ERR_NODATA);
+
+	// newest block first, as long as it is in the window as a whole
+	for (b = 0; b < STATS_BLOCKS && left > 0; b++)
+	{
+		d = &s->blk[(s->cur + STATS_BLOCKS - b) % STATS_BLOCKS];
+		if (d->n == 0 || d->n > (uint32_t) left) break;
+
+		digest_flush(d);
+		left -= d->n;
+
+		for (j = 0; j < d->num; j++) s->merge[k++] = d->c[j];
+	}
+
+	// the rest are the oldest readings of the window (part of a block)
+	first = s->count - n;
+
+	for (i = 0; i < left; i++)
+		s->merge[k++] = (centroid) { s->ring[(first + i) % s->window], 1 };
+
+	qsort(s->merge, k, sizeof(centroid), cmp_centroid);
+
+	// the ends are known exactly
+	min = s->ring[s->dmin[s->min_head]];
+	max = s->ring[s->dmax[s->max_head]];
+
+	for (i = 0; i < num; i++)
+		val[i] = fmin(max, fmax(min, centroid_quantile(s->merge, k, n, min, max, q[i])));
+
+	return(MLX_OK);
+}
+
+int mlx_stats_get(mlx_stats *s, mlx_summary *r)
+{
+	static const double q[3] = { 0.5, 0.95, 0.99 };
+	double	val[3];
+
+	memset(r, 0, sizeof(mlx_summary));
+
+	if ((r->n = stats_num(s)) == 0) return(MLX_ERR_NODATA);
+
+	r->mean = (float) s->mean;
+	r->sd = r->n > 1 && s->m2 > 0 ? (float) sqrt(s->m2 / (r->n - 1)) : 0;
+	r->min = s->ring[s->dmin[s->min_head]];
+	r->max = s->ring[s->dmax[s->max_head]];
+
+	mlx_stats_quantiles(s, q, val, 3);
+
+	r->p50 = (float) val[0];
+	r->p95 = (float) val[1];
+	r->p99 = (float) val[2];
+
+	return(MLX_OK);
+}
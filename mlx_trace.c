@@ -0,0 +1,269 @@
+/* libmlx90615 : binary transaction tracer
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_trace is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_trace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_trace. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Each thread that does a transaction gets its own buffer : a ring of
+ * events with one writer (the thread) and one reader (the flusher
+ * thread), so adding an event takes no lock and no system call. The
+ * flusher writes the events to the file every TRACE_FLUSH ms, or
+ * sooner when a buffer is half full : the thread posts a semaphore
+ * once (a flag is set until the flusher runs), which does not wait. The
+ * flusher holds no lock while it writes. If a buffer is full the event
+ * is dropped and counted : tracing never waits.
+ *
+ * The file is a header (mlx_trace_hdr) followed by events
+ * (mlx_trace_ev). Events of different threads are not in time order.
+ * mlx_trace2json converts the file to a Chrome / Perfetto trace.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include "libmlx90615.h"
+
+/* events per thread buffer (power of 2) */
+#define TRACE_EVENTS	4096
+
+/* flush interval (ms) */
+#define TRACE_FLUSH		100
+
+_Static_assert(sizeof(mlx_trace_ev) == 32, "trace event size");
+
+typedef struct trace_buf {
+	mlx_trace_ev	ev[TRACE_EVENTS];
+	_Atomic uint32_t head;			// written by the thread
+	_Atomic uint32_t tail;			// read by the flusher
+	uint32_t		tid;
+	struct trace_buf *next;
+} trace_buf;
+
+static struct {
+	pthread_mutex_t	lock;			// adding to the list of buffers
+	sem_t			wake;			// of the flusher
+	pthread_t		flusher;
+	FILE			*fp;			// flusher only while tracing
+	trace_buf * _Atomic bufs;		// new buffers are added in front
+	_Atomic int		stop;
+	_Atomic int		kick;			// flush requested, wake posted
+	_Atomic unsigned long dropped;
+} trace = {PTHREAD_MUTEX_INITIALIZER};
+
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+
+/* the semaphore is kept : a thread might still post it after a stop */
+static void trace_init()
+{
+	sem_init(&trace.wake, 0, 0);
+}
+
+/* tracing on : checked before each event */
+static _Atomic int trace_on;
+
+/* buffer of the thread. Buffers are kept after a stop : a thread
+ * might still be adding an event, it is discarded on the next start */
+static __thread trace_buf *my_buf;
+
+/* write the events of all buffers to the file (flusher, or after it)
+ * A buffer is never removed, so the list is walked without a lock */
+static void trace_drain()
+{
+	trace_buf	*b;
+	uint32_t	head, tail, n;
+
+	for (b = atomic_load_explicit(&trace.bufs, memory_order_acquire); b != NULL; b = b->next)
+	{
+		head = atomic_load_explicit(&b->head, memory_order_acquire);
+		tail = atomic_load_explicit(&b->tail, memory_order_relaxed);
+
+		while (tail != head)
+		{
+			// up to the end of the ring
+			n = head - tail;
+			if (n > TRACE_EVENTS - (tail & (TRACE_EVENTS - 1)))
+				n = TRACE_EVENTS - (tail & (TRACE_EVENTS - 1));
+
+			fwrite(&b->ev[tail & (TRACE_EVENTS - 1)], sizeof(mlx_trace_ev), n, trace.fp);
+			tail += n;
+		}
+
+		atomic_store_explicit(&b->tail, tail, memory_order_release);
+	}
+
+	fflush(trace.fp);
+}
+
+/* flusher thread : drains the buffers periodically */
+static void *trace_flusher(void *arg)
+{
+	struct timespec ts;
+
+	while (! atomic_load(&trace.stop))
+	{
+		// the flusher is not part of a simulation : real time
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += TRACE_FLUSH * 1000000L;
+		ts.tv_sec += ts.tv_nsec / 1000000000;
+		ts.tv_nsec %= 1000000000;
+
+		sem_timedwait(&trace.wake, &ts);
+
+		// a buffer that fills up again posts a new wake
+		atomic_store(&trace.kick, 0);
+		trace_drain();
+	}
+
+	return(NULL);
+}
+
+/* get the buffer of the calling thread */
+static trace_buf *trace_get_buf()
+{
+	trace_buf *b;
+
+	if (my_buf) return(my_buf);
+
+	if ((b = calloc(1, sizeof(trace_buf))) == NULL) return(NULL);
+
+	b->tid = (uint32_t) syscall(SYS_gettid);
+
+	pthread_mutex_lock(&trace.lock);
+	b->next = atomic_load(&trace.bufs);
+	atomic_store_explicit(&trace.bufs, b, memory_order_release);
+	pthread_mutex_unlock(&trace.lock);
+
+	my_buf = b;
+
+	return(b);
+}
+
+int mlx_trace_start(const char *path)
+{
+	mlx_trace_hdr hdr;
+	trace_buf	*b;
+
+	if (atomic_load(&trace_on)) return(MLX_ERR_PARAM);
+
+	pthread_once(&trace_once, trace_init);
+
+	if ((trace.fp = fopen(path, "w")) == NULL) return(MLX_ERR_PARAM);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = MLX_TRACE_MAGIC;
+	hdr.version = MLX_TRACE_VERSION;
+	hdr.ev_size = sizeof(mlx_trace_ev);
+	hdr.start_ns = mlx_clock_ns();
+
+	if (fwrite(&hdr, sizeof(hdr), 1, trace.fp) != 1)
+	{
+		fclose(trace.fp);
+		trace.fp = NULL;
+		return(MLX_ERR_PARAM);
+	}
+
+	atomic_store(&trace.stop, 0);
+	atomic_store(&trace.kick, 0);
+	atomic_store(&trace.dropped, 0);
+
+	// discard events of a previous run
+	pthread_mutex_lock(&trace.lock);
+
+	for (b = atomic_load(&trace.bufs); b != NULL; b = b->next)
+		atomic_store(&b->tail, atomic_load(&b->head));
+
+	pthread_mutex_unlock(&trace.lock);
+
+	if (pthread_create(&trace.flusher, NULL, trace_flusher, NULL) != 0)
+	{
+		fclose(trace.fp);
+		trace.fp = NULL;
+		return(MLX_ERR_NOMEM);
+	}
+
+	atomic_store(&trace_on, 1);
+
+	return(MLX_OK);
+}
+
+void mlx_trace_stop(void)
+{
+	if (! atomic_exchange(&trace_on, 0)) return;
+
+	atomic_store(&trace.stop, 1);
+	sem_post(&trace.wake);
+
+	pthread_join(trace.flusher, NULL);
+
+	// the flusher has gone : the file is ours
+	trace_drain();
+	fclose(trace.fp);
+	trace.fp = NULL;
+}
+
+int mlx_trace_active(void)
+{
+	return(atomic_load_explicit(&trace_on, memory_order_relaxed));
+}
+
+unsigned long mlx_trace_dropped(void)
+{
+	return(atomic_load(&trace.dropped));
+}
+
+void mlx_trace_event(int op, uint8_t addr, uint8_t loc, int result, uint16_t val, uint64_t start_ns)
+{
+	mlx_trace_ev *ev;
+	trace_buf	*b;
+	uint32_t	head, used;
+
+	if (! atomic_load_explicit(&trace_on, memory_order_relaxed)) return;
+
+	if ((b = trace_get_buf()) == NULL)
+	{
+		atomic_fetch_add(&trace.dropped, 1);
+		return;
+	}
+
+	head = atomic_load_explicit(&b->head, memory_order_relaxed);
+	used = head - atomic_load_explicit(&b->tail, memory_order_acquire);
+
+	if (used >= TRACE_EVENTS)
+	{
+		atomic_fetch_add(&trace.dropped, 1);
+		return;
+	}
+
+	ev = &b->ev[head & (TRACE_EVENTS - 1)];
+	ev->start_ns = start_ns;
+	ev->end_ns = mlx_clock_ns();
+	ev->tid = b->tid;
+	ev->op = (uint8_t) op;
+	ev->addr = addr;
+	ev->loc = loc;
+	ev->result = (int8_t) result;
+	ev->val = val;
+
+	atomic_store_explicit(&b->head, head + 1, memory_order_release);
+
+	// half full or more : wake the flusher, once until it has run
+	if (used + 1 >= TRACE_EVENTS / 2 && ! atomic_load_explicit(&trace.kick, memory_order_relaxed) &&
+		! atomic_exchange(&trace.kick, 1)) sem_post(&trace.wake);
+}
@@ -0,0 +1,176 @@
+/* mlx_trace2json : convert a transaction trace to Chrome / Perfetto JSON
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_trace2json is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_trace2json is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_trace2json. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Reads a file written by the tracer (mlx_trace.c, option -T of mlx and
+ * mlxd) and writes the trace event format, to be opened in
+ * chrome://tracing or ui.perfetto.dev.
+ *
+ * Every transaction is shown twice : on the thread that did it
+ * (process "threads") and on the device it was for (process "bus"), so
+ * both who waits for the bus and how busy the bus is can be seen.
+ *
+ * usage : mlx_trace2json trace.bin [out.json]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "libmlx90615.h"
+
+#define PID_THREADS		1
+#define PID_BUS			2
+
+/* opcode in the location of a read */
+#define OPCODE_RAM		0x20
+
+static const char *op_name(const mlx_trace_ev *ev)
+{
+	switch(ev->op)
+	{
+		case MLX_TR_READ:	return((ev->loc & 0xf0) == OPCODE_RAM ? "read RAM" : "read EEPROM");
+		case MLX_TR_WRITE:	return("write EEPROM");
+		case MLX_TR_SLEEP:	return("sleep");
+		case MLX_TR_WAKE:	return("wake");
+		case MLX_TR_POR:	return("power on reset");
+	}
+	return("unknown");
+}
+
+/* order on start time */
+static int ev_cmp(const void *a, const void *b)
+{
+	const mlx_trace_ev *x = a, *y = b;
+
+	if (x->start_ns != y->start_ns) return(x->start_ns < y->start_ns ? -1 : 1);
+	return(0);
+}
+
+static void meta(FILE *out, int pid, uint32_t tid, const char *what, const char *name, int *first)
+{
+	fprintf(out, "%s\n{\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"name\":\"%s\",\"args\":{\"name\":\"%s\"}}",
+		*first ? "" : ",", pid, tid, what, name);
+	*first = 0;
+}
+
+static void event(FILE *out, int pid, uint32_t tid, const mlx_trace_ev *ev, uint64_t start)
+{
+	fprintf(out, ",\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"name\":\"%s\",\"cat\":\"%s\","
+		"\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"addr\":\"0x%02x\",\"loc\":\"0x%02x\",\"val\":\"0x%04x\",\"result\":\"%s\"}}",
+		pid, tid, op_name(ev), ev->result == MLX_OK ? "ok" : "error",
+		(ev->start_ns - start) / 1000.0, (ev->end_ns - ev->start_ns) / 1000.0,
+		ev->addr, ev->loc, ev->val, mlx_strerror(ev->result));
+}
+
+int main(int argc, char *argv[])
+{
+	mlx_trace_hdr	hdr;
+	mlx_trace_ev	*ev = NULL, *tmp;
+	FILE	*in, *out = stdout;
+	size_t	num = 0, max = 0, i;
+	uint32_t tids[256];
+	char	seen[256] = {0}, name[32];
+	int		first = 1, num_tid = 0, j;
+
+	if (argc < 2 || argc > 3)
+	{
+		fprintf(stderr, "usage : %s trace.bin [out.json]\n", argv[0]);
+		exit(1);
+	}
+
+	if ((in = fopen(argv[1], "r")) == NULL)
+	{
+		perror(argv[1]);
+		exit(1);
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, in) != 1 || hdr.magic != MLX_TRACE_MAGIC
+		|| hdr.version != MLX_TRACE_VERSION || hdr.ev_size != sizeof(mlx_trace_ev))
+	{
+		fprintf(stderr, "%s : not a trace file (version %d)\n", argv[1], MLX_TRACE_VERSION);
+		exit(1);
+	}
+
+	for (;;)
+	{
+		if (num == max)
+		{
+			max = max ? max * 2 : 4096;
+
+			if ((tmp = realloc(ev, max * sizeof(mlx_trace_ev))) == NULL)
+			{
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+			ev = tmp;
+		}
+
+		if (fread(&ev[num], sizeof(mlx_trace_ev), 1, in) != 1) break;
+		num++;
+	}
+
+	fclose(in);
+
+	qsort(ev, num, sizeof(mlx_trace_ev), ev_cmp);
+
+	if (argc == 3 && (out = fopen(argv[2], "w")) == NULL)
+	{
+		perror(argv[2]);
+		exit(1);
+	}
+
+	fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	meta(out, PID_THREADS, 0, "process_name", "threads", &first);
+	meta(out, PID_BUS, 0, "process_name", "bus", &first);
+
+	// a name for each thread and device, once
+	for (i = 0; i < num; i++)
+	{
+		for (j = 0; j < num_tid; j++)
+			if (tids[j] == ev[i].tid) break;
+
+		if (j == num_tid && num_tid < 256)
+		{
+			tids[num_tid++] = ev[i].tid;
+			snprintf(name, sizeof(name), "thread %u", ev[i].tid);
+			meta(out, PID_THREADS, ev[i].tid, "thread_name", name, &first);
+		}
+
+		if (! seen[ev[i].addr])
+		{
+			seen[ev[i].addr] = 1;
+			snprintf(name, sizeof(name), "device 0x%02x", ev[i].addr);
+			meta(out, PID_BUS, ev[i].addr, "thread_name", name, &first);
+		}
+	}
+
+	for (i = 0; i < num; i++)
+	{
+		event(out, PID_THREADS, ev[i].tid, &ev[i], hdr.start_ns);
+		event(out, PID_BUS, ev[i].addr, &ev[i], hdr.start_ns);
+	}
+
+	fprintf(out, "\n]}\n");
+
+	if (out != stdout) fclose(out);
+
+	fprintf(stderr, "%zu events\n", num);
+
+	free(ev);
+	exit(0);
+}
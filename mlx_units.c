@@ -0,0 +1,139 @@
+/* mlx_units : display and change the fleet registry of MLX90615 sensors
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_units is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_units is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_units. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The registry is filled by mlxd -u. Without options all units are
+ * displayed. The calibration and emissivity profile of a unit can be
+ * set, and a unit that was replaced can be removed.
+ *
+ * usage : mlx_units [-f file] [-c id:gain:offset] [-e id:profile] [-d id]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "libmlx90615.h"
+
+static void usage(char *name)
+{
+	fprintf(stderr, "usage : %s [-f file] [-c id:gain:offset] [-e id:profile] [-d id]\n"
+		"  -f file              registry (default %s)\n"
+		"  -c id:gain:offset    set calibration of To : gain * To + offset\n"
+		"  -e id:profile        set emissivity profile\n"
+		"  -d id                remove a unit\n", name, MLX_FLEET_FILE);
+	exit(1);
+}
+
+/* unit of a hex ID at the start of arg */
+static mlx_unit *get_unit(mlx_fleet *fleet, char *arg, char **end)
+{
+	mlx_unit *u;
+
+	if ((u = mlx_fleet_find(fleet, (uint32_t) strtoul(arg, end, 16))) == NULL)
+	{
+		fprintf(stderr, "unit %s is not in the registry\n", arg);
+		mlx_fleet_close(fleet);
+		exit(1);
+	}
+
+	return(u);
+}
+
+static void list(mlx_fleet *fleet)
+{
+	mlx_unit	*u;
+	char		seen[32];
+	time_t		t;
+	int			pos = 0;
+
+	printf("%d units\n\n%-8s %3s %4s %7s %8s %8s %6s  %s\n", mlx_fleet_count(fleet),
+		"unit", "bus", "addr", "emiss", "gain", "offset", "config", "seen");
+
+	while ((u = mlx_fleet_next(fleet, &pos)) != NULL)
+	{
+		t = u->seen;
+		strftime(seen, sizeof(seen), "%Y-%m-%d %H:%M", localtime(&t));
+
+		printf("%08x %3d ", u->id, u->bus);
+
+		if (u->addr) printf("0x%02x ", u->addr);
+		else printf("%4s ", "-");
+
+		if (u->emiss != MLX_UNIT_NOEMISS) printf("%7d ", u->emiss);
+		else printf("%7s ", "-");
+
+		printf("%8.4f %8.3f ", u->gain, u->offset);
+
+		if (u->cached & (1 << MLX_REG_CONFIG)) printf("0x%04x ", u->eeprom[MLX_REG_CONFIG]);
+		else printf("%6s ", "-");
+
+		printf(" %s\n", u->seen ? seen : "never");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	mlx_fleet	*fleet;
+	mlx_unit	*u;
+	char		*file = NULL, *p;
+	int			c, change = 0;
+
+	// only check the options
+	while ((c = getopt(argc, argv, "f:c:e:d:")) != -1)
+	{
+		if (c == 'f') file = optarg;
+		else if (c == 'c' || c == 'e' || c == 'd') change = 1;
+		else usage(argv[0]);
+	}
+
+	if ((fleet = mlx_fleet_open(file, change ? 0 : MLX_FLEET_RDONLY)) == NULL)
+	{
+		perror(file ? file : MLX_FLEET_FILE);
+		exit(1);
+	}
+
+	optind = 1;
+
+	while ((c = getopt(argc, argv, "f:c:e:d:")) != -1)
+	{
+		switch(c)
+		{
+			case 'c':	// calibration
+				u = get_unit(fleet, optarg, &p);
+				if (*p == ':') u->gain = strtof(p + 1, &p);
+				if (*p == ':') u->offset = strtof(p + 1, &p);
+				break;
+
+			case 'e':	// emissivity profile
+				u = get_unit(fleet, optarg, &p);
+				if (*p == ':') u->emiss = (uint16_t) strtol(p + 1, NULL, 10);
+				break;
+
+			case 'd':	// remove
+				get_unit(fleet, optarg, &p);
+				mlx_fleet_del(fleet, (uint32_t) strtoul(optarg, NULL, 16));
+				break;
+		}
+	}
+
+	list(fleet);
+
+	mlx_fleet_close(fleet);
+	exit(0);
+}
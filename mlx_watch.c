@@ -0,0 +1,339 @@
+/* libmlx90615 : presence monitor of the sensors on a bus (hot-plug)
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_watch is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_watch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_watch. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A full scan of the bus (mlx_bus_scan) takes 126 transactions : too
+ * long to do between samples. The monitor does a few probes on each
+ * tick instead, as long as there is bus time left of what it is given.
+ * The time that is not used is kept for the next tick (at most 2 ticks).
+ * The last probe of a tick can take more than was left : that is paid
+ * back on the next ticks, so on average the budget is kept, also when
+ * a probe takes longer than the budget of one tick.
+ *
+ * The probes take turns :
+ * - a known sensor : ID1 is read on its address. After MLX_WATCH_MISSES
+ *   failed reads in a row it is removed. If another sensor answers, the
+ *   known one is removed and the other is handled as a new address.
+ * - the next free address (round robin over 0x1 - 0x7e) : read as
+ *   mlx_bus_scan does. If a sensor answers its unit ID is read : a
+ *   known unit is moved or added again on the handle it had, else a
+ *   handle is opened for it.
+ *
+ * So a removed sensor is found after 2 * MLX_WATCH_MISSES times the
+ * number of sensors probes, a new one within 2 * 126 probes.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "libmlx90615.h"
+
+/* addresses that are probed */
+#define WATCH_FIRST		0x01
+#define WATCH_LAST		0x7e
+
+typedef struct watch_unit {
+	uint32_t	id;
+	mlx_dev		*dev;
+	uint8_t		addr;		// 0 = not present
+	uint8_t		misses;		// failed reads in a row
+} watch_unit;
+
+struct mlx_watch {
+	mlx_bus		*bus;
+	mlx_dev		*probe;		// on the address that is probed
+	mlx_watch_cb cb;
+	void		*user;
+	uint64_t	(*time)(void *ctx);
+	void		*tctx;
+	watch_unit	*unit;
+	int			num, size;
+	int16_t		at[128];	// unit on an address, -1 = none
+	uint8_t		next_addr;
+	int			next_unit;
+	int			turn;		// 1 = probe a known sensor
+	int64_t		credit;		// bus time left (ns), < 0 = overdrawn
+	unsigned long probes;
+};
+
+static uint64_t watch_clock(void *ctx)
+{
+	(void) ctx;
+	return(mlx_clock_ns());
+}
+
+mlx_watch *mlx_watch_new(mlx_bus *bus, mlx_watch_cb cb, void *user)
+{
+	mlx_watch *w;
+
+	if (bus == NULL) return(NULL);
+
+	if ((w = calloc(1, sizeof(mlx_watch))) == NULL) return(NULL);
+
+	if ((w->probe = mlx_open(bus, WATCH_FIRST, 0)) == NULL)
+	{
+		free(w);
+		return(NULL);
+	}
+
+	w->bus = bus;
+	w->cb = cb;
+	w->user = user;
+	w->time = watch_clock;
+	w->next_addr = WATCH_FIRST;
+	memset(w->at, 0xff, sizeof(w->at));
+
+	return(w);
+}
+
+void mlx_watch_free(mlx_watch *w)
+{
+	int i;
+
+	if (w == NULL) return;
+
+	for (i = 0; i < w->num; i++) mlx_close(w->unit[i].dev);
+
+	mlx_close(w->probe);
+	free(w->unit);
+	free(w);
+}
+
+void mlx_watch_set_time(mlx_watch *w, uint64_t (*fn)(void *ctx), void *ctx)
+{
+	w->time = fn ? fn : watch_clock;
+	w->tctx = ctx;
+}
+
+/* index of a unit ID, or -1 */
+static int watch_find(mlx_watch *w, uint32_t id)
+{
+	int i;
+
+	for (i = 0; i < w->num; i++)
+		if (w->unit[i].id == id) return(i);
+
+	return(-1);
+}
+
+/* add a unit with its handle
+ * return index or -1 (out of memory) */
+static int watch_add(mlx_watch *w, uint32_t id, mlx_dev *dev)
+{
+	watch_unit *u;
+
+	if (w->num == w->size)
+	{
+		if ((u = realloc(w->unit, (w->size ? w->size * 2 : 8) * sizeof(watch_unit))) == NULL)
+			return(-1);
+
+		w->unit = u;
+		w->size = w->size ? w->size * 2 : 8;
+	}
+
+	u = &w->unit[w->num];
+	u->id = id;
+	u->dev = dev;
+	u->addr = 0;
+	u->misses = 0;
+
+	return(w->num++);
+}
+
+int mlx_watch_attach(mlx_watch *w, mlx_dev *dev, uint32_t id)
+{
+	uint8_t	addr = mlx_get_addr(dev);
+	int		i;
+
+	if (id == 0 || mlx_get_bus(dev) != w->bus || addr < WATCH_FIRST || addr > WATCH_LAST ||
+		w->at[addr] >= 0 || watch_find(w, id) >= 0) return(MLX_ERR_PARAM);
+
+	if ((i = watch_add(w, id, dev)) < 0) return(MLX_ERR_NOMEM);
+
+	w->unit[i].addr = addr;
+	w->at[addr] = (int16_t) i;
+
+	return(MLX_OK);
+}
+
+mlx_dev *mlx_watch_dev(mlx_watch *w, uint32_t id)
+{
+	int i;
+
+	return((i = watch_find(w, id)) < 0 ? NULL : w->unit[i].dev);
+}
+
+unsigned long mlx_watch_probes(mlx_watch *w)
+{
+	return(w->probes);
+}
+
+/* report an event on unit i
+ * return 1 (one event) */
+static int watch_event(mlx_watch *w, int type, int i, uint8_t old_addr)
+{
+	mlx_watch_ev ev;
+
+	ev.type = type;
+	ev.unit_id = w->unit[i].id;
+	ev.addr = w->unit[i].addr;
+	ev.old_addr = old_addr;
+	ev.dev = w->unit[i].dev;
+
+	if (w->cb) w->cb(&ev, w->user);
+
+	return(1);
+}
+
+/* the unit is no longer on its address
+ * return number of events */
+static int watch_lost(mlx_watch *w, int i)
+{
+	uint8_t addr = w->unit[i].addr;
+
+	w->at[addr] = -1;
+	w->unit[i].addr = 0;
+	w->unit[i].misses = 0;
+
+	return(watch_event(w, MLX_WATCH_REMOVED, i, addr));
+}
+
+/* probe a free address
+ * return number of events */
+static int probe_addr(mlx_watch *w, uint8_t addr)
+{
+	watch_unit	*u;
+	mlx_dev		*dev;
+	uint32_t	id;
+	uint16_t	val;
+	uint8_t		old;
+	int			i;
+
+	mlx_set_addr(w->probe, addr);
+
+	if (mlx_read_reg(w->probe, MLX_REG_PWMSA, &val) != MLX_OK || val == 0) return(0);
+
+	// found, but not identified yet : try again on the next pass
+	if (mlx_unit_id(w->probe, &id) != MLX_OK || id == 0) return(0);
+
+	if ((i = watch_find(w, id)) < 0)
+	{
+		if ((dev = mlx_open(w->bus, addr, 0)) == NULL) return(0);
+
+		if ((i = watch_add(w, id, dev)) < 0)
+		{
+			mlx_close(dev);
+			return(0);
+		}
+	}
+
+	u = &w->unit[i];
+	old = u->addr;
+
+	if (old) w->at[old] = -1;
+
+	u->addr = addr;
+	u->misses = 0;
+	w->at[addr] = (int16_t) i;
+	mlx_set_addr(u->dev, addr);
+
+	return(watch_event(w, old ? MLX_WATCH_MOVED : MLX_WATCH_ADDED, i, old));
+}
+
+/* probe a known sensor
+ * return number of events */
+static int probe_unit(mlx_watch *w, int i)
+{
+	watch_unit	*u = &w->unit[i];
+	uint16_t	val;
+	uint8_t		addr = u->addr;
+	int			ret;
+
+	mlx_set_addr(w->probe, addr);
+
+	if ((ret = mlx_read_reg(w->probe, MLX_REG_ID1, &val)) == MLX_OK)
+	{
+		if (val == (u->id & 0xffff))
+		{
+			u->misses = 0;
+			return(0);
+		}
+
+		// another sensor on this address
+		ret = watch_lost(w, i);
+		return(ret + probe_addr(w, addr));
+	}
+
+	if (++u->misses < MLX_WATCH_MISSES) return(0);
+
+	return(watch_lost(w, i));
+}
+
+/* one probe : a known sensor and a free address take turns
+ * return number of events */
+static int watch_step(mlx_watch *w)
+{
+	int i, n;
+
+	w->probes++;
+	w->turn ^= 1;
+
+	// next known sensor that is present
+	if (w->turn)
+	{
+		for (n = 0; n < w->num; n++)
+		{
+			i = w->next_unit;
+			w->next_unit = (w->next_unit + 1) % w->num;
+
+			if (w->unit[i].addr) return(probe_unit(w, i));
+		}
+	}
+
+	// next free address
+	for (n = WATCH_FIRST; n <= WATCH_LAST; n++)
+	{
+		i = w->next_addr;
+		w->next_addr = w->next_addr == WATCH_LAST ? WATCH_FIRST : w->next_addr + 1;
+
+		if (w->at[i] < 0) return(probe_addr(w, (uint8_t) i));
+	}
+
+	// all addresses taken
+	return(0);
+}
+
+int mlx_watch_tick(mlx_watch *w, uint64_t budget_ns)
+{
+	uint64_t	t;
+	int			n, events = 0;
+
+	// time not used is kept for at most 2 ticks
+	w->credit += (int64_t) budget_ns;
+	if (w->credit > 2 * (int64_t) budget_ns) w->credit = 2 * (int64_t) budget_ns;
+
+	// at most one pass over all addresses
+	for (n = WATCH_FIRST; n <= WATCH_LAST; n++)
+	{
+		if (w->credit <= 0) break;
+
+		t = w->time(w->tctx);
+		events += watch_step(w);
+		w->credit -= (int64_t) (w->time(w->tctx) - t);
+	}
+
+	return(events);
+}
@@ -0,0 +1,324 @@
+/* EEPROM write budget tracking for the MLX90615 on Raspberry-pi
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlx_wear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlx_wear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlx_wear. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Every write to an EEPROM register is an erase (write 0x0000) followed
+ * by the write of the new value : one erase / write cycle of the cell,
+ * and the number of cycles is limited. This module keeps a lifetime
+ * count of the cycles per register for each MLX (keyed on the unit ID)
+ * in a small text file, so the count survives a restart of the program.
+ *
+ * On top of that a small scheduler is used by the automated paths
+ * (PWM / SMB mode switch, slave address change): the writes of one
+ * operation are requested and then flushed together. A new request for
+ * the same register replaces the pending value, a value that is in the
+ * register already is not written again (write_reg) and the slave
+ * address is written last. If a write fails the rest of the batch is
+ * dropped, so a later operation never writes stale values.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "mlx90615.h"
+
+/* the writable registers 0x0 - 0x3 */
+#define WEAR_REGS	4
+
+/* max number of units kept in the wear file */
+#define WEAR_UNITS	64
+
+typedef struct {
+	uint32_t unit_id;				// ID2 << 16 | ID1
+	unsigned long cnt[WEAR_REGS];	// lifetime erase / write cycles per register
+	long	last;					// time of last write
+} wear_rec;
+
+/* file to store the counters (can be changed with -w) */
+char *wear_file = WEAR_FILE;
+
+/* expected EEPROM endurance (write cycles) */
+unsigned long wear_endurance = WEAR_ENDURANCE;
+
+/* unit ID of the connected MLX (0 = not read yet) */
+static uint32_t wear_unit_id = 0;
+
+/* pending scheduled writes */
+static struct {
+	int		pending;
+	long	val;
+} wear_sched[WEAR_REGS];
+
+/* number of writes that were skipped because the value was the same */
+static unsigned long wear_skipped = 0;
+
+/* read all records from the wear file
+ * @param rec : array to store records (minimal WEAR_UNITS)
+ *
+ * return number of records read */
+static int wear_load(wear_rec *rec)
+{
+	FILE	*fp;
+	int		num = 0;
+
+	if ((fp = fopen(wear_file, "r")) == NULL) return(0);
+
+	while (num < WEAR_UNITS)
+	{
+		if (fscanf(fp, "%x %lu %lu %lu %lu %ld\n", &rec[num].unit_id,
+			&rec[num].cnt[0], &rec[num].cnt[1], &rec[num].cnt[2],
+			&rec[num].cnt[3], &rec[num].last) != 6) break;
+		num++;
+	}
+
+	fclose(fp);
+	return(num);
+}
+
+/* write all records to the wear file
+ * To prevent a corrupted file when interrupted, a temporary file
+ * is written first and renamed.
+ *
+ * return 0 = OK, -1 = error */
+static int wear_save(wear_rec *rec, int num)
+{
+	FILE	*fp;
+	char	tmp[256];
+	int		i;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", wear_file);
+
+	if ((fp = fopen(tmp, "w")) == NULL)
+	{
+		if (DEBUG) printf("DEBUG: can not write wear file %s\n", tmp);
+		return(-1);
+	}
+
+	for (i = 0; i < num; i++)
+		fprintf(fp, "%08x %lu %lu %lu %lu %ld\n", rec[i].unit_id,
+		rec[i].cnt[0], rec[i].cnt[1], rec[i].cnt[2], rec[i].cnt[3], rec[i].last);
+
+	fclose(fp);
+
+	return(rename(tmp, wear_file));
+}
+
+/* obtain the unit ID of the connected MLX (once)
+ * return 0 = OK, -1 = error */
+static int wear_get_unit()
+{
+	long id_high, id_low;
+
+	if (wear_unit_id) return(0);
+
+	if ((id_low = read_reg(ID1)) < 0)	return(-1);
+	if ((id_high = read_reg(ID2)) < 0)	return(-1);
+
+	wear_unit_id = (uint32_t) (id_high << 16 | id_low);
+
+	return(0);
+}
+
+/* forget the unit ID (e.g. after a new device was discovered) */
+void wear_reset_unit()
+{
+	wear_unit_id = 0;
+}
+
+/* called by write_reg before the EEPROM is touched,
+ * to make sure the unit ID is known before the slave address changes */
+void wear_prepare()
+{
+	if (wear_get_unit() < 0)
+		if (DEBUG) printf("DEBUG: can not read unit ID for write count\n");
+}
+
+/* count a skipped write (value was already in the register) */
+void wear_skip(char reg)
+{
+	wear_skipped++;
+	if (DEBUG) printf("DEBUG: register %d has the requested value already, write skipped\n",reg);
+}
+
+/* count a completed write on a register
+ * @param reg : register written (0x0 - 0x3)
+ *
+ * A warning is displayed once the count passes 80% of the
+ * expected endurance */
+void wear_count(char reg)
+{
+	wear_rec	rec[WEAR_UNITS];
+	int			num, i, j;
+
+	if (reg < 0 || reg >= WEAR_REGS) return;
+
+	// unit ID could not be obtained
+	if (wear_unit_id == 0) return;
+
+	num = wear_load(rec);
+
+	for (i = 0; i < num; i++)
+		if (rec[i].unit_id == wear_unit_id) break;
+
+	// new unit
+	if (i == num)
+	{
+		// table full : reuse the entry that was written longest ago
+		if (num == WEAR_UNITS)
+		{
+			for (i = 0, j = 1; j < num; j++)
+				if (rec[j].last < rec[i].last) i = j;
+		}
+		else
+			num++;
+
+		memset(&rec[i], 0x0, sizeof(wear_rec));
+		rec[i].unit_id = wear_unit_id;
+	}
+
+	rec[i].cnt[(int) reg]++;
+	rec[i].last = (long) mlx_clock_time();
+
+	if (wear_save(rec, num) < 0)
+		p_printf(1, "can not update EEPROM write count in %s\n", wear_file);
+
+	if (rec[i].cnt[(int) reg] == (wear_endurance / 10) * 8)
+		p_printf(1,
+		"WARNING register %d of MLX %08x has been written %lu times.\n"
+		"This is 80%% of the expected endurance (%lu writes).\n",
+		reg, wear_unit_id, rec[i].cnt[(int) reg], wear_endurance);
+}
+
+/* request a write on a register through the scheduler
+ * The value is kept pending and written by wear_flush() of the caller.
+ * A new request for the same register replaces the pending value.
+ *
+ * @param reg : register to write
+ * @param val : value to write
+ *
+ * return 0 = OK, -1 = error */
+int wear_request(char reg, long val)
+{
+	if (reg < 0 || reg >= WEAR_REGS)
+	{
+		p_printf(1, "NOT allowed to write to register %d\n",reg);
+		return(-1);
+	}
+
+	if (wear_sched[(int) reg].pending)
+	{
+		if (DEBUG) printf("DEBUG: coalesce write register %d: 0x%lx replaces 0x%lx\n",
+		reg, val, wear_sched[(int) reg].val);
+	}
+	wear_sched[(int) reg].pending = 1;
+	wear_sched[(int) reg].val = val;
+
+	return(0);
+}
+
+/* drop all pending requests */
+void wear_cancel()
+{
+	int i;
+
+	for (i = 0; i < WEAR_REGS; i++) wear_sched[i].pending = 0;
+}
+
+/* write the pending requests
+ * The slave address (PWMSA) is written last : it changes the address
+ * the other registers are written on. When a write fails the requests
+ * not written yet are dropped : they belong to the failed operation.
+ *
+ * return number of registers written or -1 in case of error */
+int wear_flush()
+{
+	int		n, i, cnt = 0;
+
+	for (n = 1; n <= WEAR_REGS; n++)
+	{
+		i = n % WEAR_REGS;
+
+		if (! wear_sched[i].pending) continue;
+
+		wear_sched[i].pending = 0;
+
+		if (write_reg(i, wear_sched[i].val) < 0)
+		{
+			wear_cancel();
+			return(-1);
+		}
+
+		cnt++;
+	}
+
+	return(cnt);
+}
+
+/* return the number of pending scheduled writes */
+int wear_pending()
+{
+	int	i, cnt = 0;
+
+	for (i = 0; i < WEAR_REGS; i++)
+		if (wear_sched[i].pending) cnt++;
+
+	return(cnt);
+}
+
+/* display the lifetime erase / write cycles per register
+ * @param all : 1 = display all units in the wear file, 0 = connected MLX */
+void wear_report(int all)
+{
+	wear_rec	rec[WEAR_UNITS];
+	int			num, i, j, fnd = 0;
+	const char	*name[WEAR_REGS] = {"PWM T min / SA", "PWM T range", "Config", "Emissivity"};
+
+	if (! all) wear_get_unit();
+
+	num = wear_load(rec);
+
+	p_printf(3, "\nEEPROM erase / write cycles (expected endurance %lu), file %s\n", wear_endurance, wear_file);
+
+	for (i = 0; i < num; i++)
+	{
+		if (! all && rec[i].unit_id != wear_unit_id) continue;
+
+		fnd++;
+		p_printf(2, "\nUnit Id:\t%08x\n", rec[i].unit_id);
+
+		for (j = 0; j < WEAR_REGS; j++)
+			p_printf(rec[i].cnt[j] >= (wear_endurance / 10) * 8 ? 1 : 2,
+			"%-16s%6lu (%2.2f%%)\n", name[j], rec[i].cnt[j],
+			(double) rec[i].cnt[j] * 100 / wear_endurance);
+
+		if (detailed && rec[i].last)
+		{
+			time_t t = (time_t) rec[i].last;
+			p_printf(2, "last write:\t%s", ctime(&t));
+		}
+	}
+
+	if (fnd == 0) p_printf(1, "No writes recorded\n");
+
+	if (wear_skipped)
+		p_printf(2, "\n%lu unchanged write(s) skipped this session\n", wear_skipped);
+
+	if (wear_pending())
+		p_printf(3, "%d scheduled write(s) pending\n", wear_pending());
+}
@@ -0,0 +1,1230 @@
+/* mlxd : bus broker for MLX90615 sensors on a Raspberry-pi
+ *
+ * Copyright (c) 2017 Paul van Haastrecht <paulvha@hotmail.com>
+ *
+ * mlxd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * mlxd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mlxd. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Only one program can own the BCM2835. mlxd owns the bus and does the
+ * transactions for the clients (mlx -b, or mlx_bus_open_broker()) that
+ * connect on a Unix socket. A transaction of a client is never
+ * interleaved with one of another client. A client that needs more
+ * than one transaction without others in between (e.g. the erase and
+ * write of an EEPROM register, or a POR) holds the bus : the requests
+ * of the other clients and the sampling (-p) wait meanwhile. Only the
+ * holder can switch the power.
+ *
+ * The requests that came in while the bus was busy are handled as one
+ * batch. Identical reads in a batch (same slave address, command and
+ * length, e.g. many clients asking for To) are done once on the bus
+ * and the result is sent to all of them.
+ *
+ * With -p mlxd samples all sensors on the bus itself and publishes the
+ * latest reading of each in shared memory (mlx_shm_open()). Programs
+ * that only need the current To/Ta read it from there without using
+ * the bus at all. With -R each reading is also added to a history ring
+ * in shared memory (mlx_ring_open()) for consumers that need all of them.
+ *
+ * With -u the sensors are kept in a fleet registry (mlx_fleet_open()).
+ * At start-up a sensor at an address that is in the registry is taken
+ * from there : only new sensors are identified (unit ID and EEPROM) on
+ * the bus. The calibration of a unit in the registry is applied to To.
+ *
+ * With -w the bus is watched for sensors that are added, removed or
+ * readdressed while running (mlx_watch_new()), with a budget of bus
+ * time after each sample of all sensors. A new sensor gets the next
+ * slot in shared memory, a sensor that comes back gets its old slot.
+ *
+ * With -K the published To is compensated for the emissivity of the
+ * object, the reflected temperature and a window (mlx_comp_parse()),
+ * after the calibration. The history ring keeps the RAM values : use
+ * mlx_comp_samples() on the records that are read.
+ *
+ * With -W the statistics of To and Ta over the last seconds (mean,
+ * standard deviation, min, max, p50, p95 and p99, mlx_stats_new()) are
+ * kept for each sensor and published with the reading (see mlx_stat).
+ *
+ * With -A alarm rules are evaluated on every reading (mlx_alarm_new()) :
+ * To or Ta above / below a level or changing faster than a rate, with
+ * hysteresis. When an alarm is raised the sensors are sampled every -F
+ * ms for the post-trigger time. With -C the readings of the sensor from
+ * the pre-trigger time before the alarm to the post-trigger time after
+ * are saved from the history ring to a file. The time from the crossing
+ * of the level to the alarm is measured and displayed with the alarm and
+ * on SIGUSR1.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <poll.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "libmlx90615.h"
+#include "mlx_broker.h"
+
+/* max clients connected */
+#define MAX_CLIENTS		64
+
+/* max wake-up pulse allowed (ms) */
+#define MAX_WAKE		1000
+
+/* the statistics in shared memory are updated every STAT_MS (ms) */
+#define STAT_MS			100
+
+/* alarms in the statistics of the reaction time */
+#define ALARM_WINDOW	1000
+
+/* default pre- and post-trigger time (s) */
+#define ALARM_PRE		10
+#define ALARM_POST		10
+
+static struct client {
+	int			fd;
+	int			has_req;	// request received, not answered
+	int			done;		// request done in this batch
+	mlxd_req	req;
+	mlxd_rsp	rsp;
+} clients[MAX_CLIENTS];
+
+static int num_clients = 0;
+
+/* client that holds the bus (-1 = none) and until when */
+static int		hold_fd = -1;
+static uint64_t	hold_until = 0;
+
+/* statistics */
+static struct {
+	unsigned long requests;		// requests received
+	unsigned long transfers;	// transactions done on the bus
+	unsigned long coalesced;	// reads answered from an identical read
+	unsigned long batches;		// batches handled
+} mlxd_stat;
+
+/* acquisition loop */
+static struct sensor {
+	mlx_dev			*dev;
+	mlx_snapshot	snap;
+	float			gain;		// calibration of To (from the registry)
+	float			offset;
+	int				present;	// answers on the bus (-w)
+	int				watched;	// handle owned by the monitor
+	mlx_comp		comp;		// with the emissivity of the sensor (-K)
+	mlx_stats		*st_ta;		// of the last readings (-W)
+	mlx_stats		*st_to;
+	FILE			*cap;		// capture around an alarm (-C), NULL = none
+	mlx_cursor		cap_cur;	// next record of the ring for it
+	uint64_t		cap_cross;	// crossing of the alarm
+	uint64_t		cap_end;	// end of the post-trigger time
+} sensors[MLX_SHM_MAX];
+
+static int		num_sensors = 0;
+static mlx_shm	*shm = NULL;
+static char		*shm_name = MLX_SHM_NAME;
+static int		period = 0;				// sample period (ms), 0 = none
+static mlx_ring	*ring = NULL;
+static char		*ring_name = MLX_RING_NAME;
+static int		ring_size = 0;			// records in ring, 0 = none
+static char		*fleet_file = NULL;		// fleet registry, NULL = none
+static mlx_watch *watch = NULL;
+static long		watch_us = 0;			// bus time per sample for the monitor, 0 = none
+static mlx_comp	comp;					// compensation of To
+static int		comp_on = 0;
+static int		stat_sec = 0;			// window of the statistics (s), 0 = none
+static mlx_alarm *alarms = NULL;
+static mlx_alarm_rule rules[MLX_ALARM_MAX];	// alarm rules (-A)
+static int		num_rules = 0;
+static int		fast_period = 0;		// sample period after an alarm (ms)
+static uint64_t	fast_until = 0;			// end of the fast sampling
+static char		*cap_dir = NULL;		// captures around an alarm, NULL = none
+static int		cap_pre = ALARM_PRE;	// pre- and post-trigger time (s)
+static int		cap_post = ALARM_POST;
+static mlx_stats *reaction = NULL;		// reaction time of the alarms (ms)
+static unsigned long alarms_raised = 0;
+
+static int DEBUG = 0;
+
+static volatile sig_atomic_t stop_req = 0, report_req = 0;
+
+static void signal_handler(int sig_num)
+{
+	if (sig_num == SIGUSR1) report_req = 1;
+	else stop_req = 1;
+}
+
+/* display statistics */
+static void report()
+{
+	mlx_summary	*r, sum;
+	int			i;
+
+	printf("mlxd: %d clients, %lu requests, %lu bus transfers, %lu coalesced reads, %lu batches\n",
+		num_clients, mlxd_stat.requests, mlxd_stat.transfers, mlxd_stat.coalesced, mlxd_stat.batches);
+
+	for (i = 0; i < num_sensors && stat_sec; i++)
+	{
+		r = &sensors[i].snap.to_stat;
+
+		printf("mlxd: sensor 0x%x To over %ds : %u readings, mean %.2f sd %.2f min %.2f max %.2f p50 %.2f p95 %.2f p99 %.2f\n",
+			sensors[i].snap.addr, stat_sec, r->n, r->mean, r->sd, r->min, r->max, r->p50, r->p95, r->p99);
+	}
+
+	if (alarms)
+	{
+		mlx_stats_get(reaction, &sum);
+
+		printf("mlxd: %lu alarms raised, reaction time of the last %u : mean %.2fms p50 %.2fms p99 %.2fms max %.2fms\n",
+			alarms_raised, sum.n, sum.mean, sum.p50, sum.p99, sum.max);
+	}
+
+	fflush(stdout);
+}
+
+/* can request b be answered with the result of read a ? */
+static int same_read(mlxd_req *a, mlxd_req *b)
+{
+	return(a->type == MLXD_READ && b->type == MLXD_READ &&
+		a->addr == b->addr && a->cmd == b->cmd && a->len == b->len);
+}
+
+/* current monotonic time in ns */
+static uint64_t now_ns()
+{
+	return(mlx_clock_ns());
+}
+
+/* perform a request of client fd on the bus */
+static void do_request(mlx_bus *bus, int fd, mlxd_req *req, mlxd_rsp *rsp)
+{
+	uint64_t until;
+
+	memset(rsp, 0, sizeof(mlxd_rsp));
+
+	switch(req->type)
+	{
+		// the bus is kept started for all clients
+		case MLXD_BEGIN:
+		case MLXD_END:
+			rsp->result = MLX_OK;
+			return;
+
+		case MLXD_WRITE:
+			if (req->len < 1 || req->len > MLXD_MAX) break;
+			rsp->result = mlx_bus_write(bus, req->addr, req->data, req->len);
+			mlxd_stat.transfers++;
+			return;
+
+		case MLXD_READ:
+			if (req->len < 1 || req->len > MLXD_MAX) break;
+			rsp->result = mlx_bus_read_rs(bus, req->addr, req->cmd, rsp->data, req->len);
+			if (rsp->result == MLX_OK) rsp->len = req->len;
+			mlxd_stat.transfers++;
+			return;
+
+		case MLXD_WAKE:
+			if (req->arg < 1 || req->arg > MAX_WAKE) break;
+			rsp->result = mlx_bus_wake(bus, req->arg);
+			mlxd_stat.transfers++;
+			return;
+
+		case MLXD_POWER:
+			if (fd != hold_fd)
+			{
+				rsp->result = MLX_ERR_NOHOLD;
+				return;
+			}
+			mlx_bus_power(bus, req->arg != 0);
+			rsp->result = MLX_OK;
+			return;
+
+		// the bus is not held by another client (see serve_batch())
+		case MLXD_HOLD:
+			if (req->arg < 1 || req->arg > MLXD_HOLD_MAX) break;
+			until = now_ns() + (uint64_t) req->arg * 1000000;
+			if (fd != hold_fd || until > hold_until) hold_until = until;
+			hold_fd = fd;
+			rsp->result = MLX_OK;
+			return;
+
+		case MLXD_RELEASE:
+			if (fd == hold_fd) hold_fd = -1;
+			rsp->result = MLX_OK;
+			return;
+	}
+
+	rsp->result = MLX_ERR_PARAM;
+}
+
+/* handle all requests received. Identical reads are done once.
+ * While the bus is held only the requests of the holder are done, the
+ * others wait for a next batch */
+static void serve_batch(mlx_bus *bus)
+{
+	int	i, j, held, num = 0;
+
+	do
+	{
+		held = hold_fd;
+
+		for (i = 0; i < num_clients; i++)
+		{
+			if (! clients[i].has_req || clients[i].done) continue;
+
+			if (hold_fd >= 0 && clients[i].fd != hold_fd) continue;
+
+			num++;
+			clients[i].done = 1;
+
+			for (j = 0; j < num_clients; j++)
+			{
+				if (j != i && clients[j].done && clients[j].has_req &&
+					same_read(&clients[j].req, &clients[i].req)) break;
+			}
+
+			if (j < num_clients)
+			{
+				clients[i].rsp = clients[j].rsp;
+				mlxd_stat.coalesced++;
+			}
+			else
+				do_request(bus, clients[i].fd, &clients[i].req, &clients[i].rsp);
+		}
+
+	// the bus was held or released in between : others may go now
+	} while (hold_fd != held);
+
+	if (num == 0) return;
+
+	mlxd_stat.batches++;
+
+	if (DEBUG) printf("DEBUG: batch of %d requests\n", num);
+
+	for (i = 0; i < num_clients; i++)
+	{
+		if (! clients[i].done) continue;
+
+		clients[i].has_req = clients[i].done = 0;
+
+		// a client that went away is removed on the next read
+		send(clients[i].fd, &clients[i].rsp, sizeof(mlxd_rsp), MSG_NOSIGNAL);
+	}
+}
+
+/* release the bus when the holder has not done so in time */
+static void hold_check(mlx_bus *bus)
+{
+	if (hold_fd < 0 || now_ns() < hold_until) return;
+
+	if (DEBUG) printf("DEBUG: hold of the bus has expired\n");
+
+	hold_fd = -1;
+	serve_batch(bus);
+}
+
+/* add a unit to the fleet registry with a copy of its EEPROM
+ * return unit or NULL if it can not be added */
+static mlx_unit *acq_new_unit(mlx_fleet *fleet, struct sensor *s, uint32_t id)
+{
+	mlx_unit	*u;
+	uint16_t	val;
+	int			i;
+
+	if ((u = mlx_fleet_add(fleet, id)) == NULL) return(NULL);
+
+	for (i = 0; i < 16; i++)
+	{
+		if (mlx_read_reg(s->dev, i, &val) != MLX_OK) continue;
+
+		u->eeprom[i] = val;
+		u->cached |= 1 << i;
+	}
+
+	if (DEBUG) printf("DEBUG: sensor 0x%x : new unit %08x\n", s->snap.addr, u->id);
+
+	return(u);
+}
+
+/* take the calibration of a unit and mark it seen at the sensor address */
+static void acq_use_unit(mlx_fleet *fleet, struct sensor *s, mlx_unit *u)
+{
+	mlx_fleet_place(fleet, u, 0, s->snap.addr);
+	u->seen = (uint32_t) mlx_clock_time();
+
+	s->snap.unit_id = u->id;
+	s->gain = u->gain;
+	s->offset = u->offset;
+}
+
+/* identify a sensor with the fleet registry : the unit ID is read and
+ * compared with the unit the registry has at the address. A known unit
+ * is taken from the registry, a new one is read and added.
+ * @param s : sensor to set unit_id and calibration */
+static void acq_identify(mlx_fleet *fleet, struct sensor *s)
+{
+	mlx_unit	*u;
+	uint32_t	id;
+
+	s->gain = 1;
+	s->offset = 0;
+
+	if (mlx_unit_id(s->dev, &id) != MLX_OK)
+	{
+		s->snap.unit_id = 0;
+		return;
+	}
+
+	if ((u = mlx_fleet_at(fleet, 0, s->snap.addr)) != NULL && u->id == id)
+	{
+		if (DEBUG) printf("DEBUG: sensor 0x%x : unit %08x from the registry\n", s->snap.addr, u->id);
+	}
+	else if ((u = mlx_fleet_find(fleet, id)) != NULL)
+	{
+		if (DEBUG) printf("DEBUG: sensor 0x%x : unit %08x from the registry, moved\n", s->snap.addr, u->id);
+	}
+	else if ((u = acq_new_unit(fleet, s, id)) == NULL)
+	{
+		// not in the registry
+		s->snap.unit_id = id;
+		return;
+	}
+
+	acq_use_unit(fleet, s, u);
+}
+
+/* update the fleet registry after an event of the monitor : the unit
+ * ID is known, so the registry is searched on ID, not on address */
+static void acq_register(struct sensor *s)
+{
+	mlx_fleet	*fleet;
+	mlx_unit	*u;
+
+	if (fleet_file == NULL) return;
+
+	// the registry is not kept open : other programs may change it
+	if ((fleet = mlx_fleet_open(fleet_file, MLX_FLEET_CREATE)) == NULL)
+	{
+		if (DEBUG) printf("DEBUG: fleet registry %s : %s\n", fleet_file, strerror(errno));
+		return;
+	}
+
+	if ((u = mlx_fleet_find(fleet, s->snap.unit_id)) == NULL)
+		u = acq_new_unit(fleet, s, s->snap.unit_id);
+
+	if (u) acq_use_unit(fleet, s, u);
+
+	mlx_fleet_close(fleet);
+}
+
+/* set the compensation of a sensor with the emissivity in its EEPROM */
+static void acq_comp(struct sensor *s)
+{
+	uint16_t val;
+
+	s->comp = comp;
+
+	if (! comp_on) return;
+
+	if (mlx_read_reg(s->dev, MLX_REG_EMMIS, &val) == MLX_OK && val > 0)
+		s->comp.chip_emiss = val / 16384.0;
+
+	mlx_comp_prepare(&s->comp);
+
+	if (DEBUG) printf("DEBUG: sensor 0x%x : emissivity %.3f in the sensor\n", s->snap.addr, s->comp.chip_emiss);
+}
+
+/* create the statistics of a sensor (-W)
+ * return 0 = OK, -1 = out of memory */
+static int acq_stats(struct sensor *s)
+{
+	int window;
+
+	if (stat_sec == 0) return(0);
+
+	window = (int) ((long) stat_sec * 1000 / period);
+	if (window < 5) window = 5;
+
+	s->st_ta = mlx_stats_new(window);
+	s->st_to = mlx_stats_new(window);
+
+	if (s->st_ta && s->st_to) return(0);
+
+	mlx_stats_free(s->st_ta);
+	mlx_stats_free(s->st_to);
+	s->st_ta = s->st_to = NULL;
+
+	printf("mlxd: no memory for the statistics of 0x%x\n", s->snap.addr);
+	return(-1);
+}
+
+/* To of a reading as published : calibration and compensation */
+static double acq_to(struct sensor *s, uint16_t raw_to, double ta)
+{
+	double to = s->gain * mlx_raw_to_celsius(raw_to) + s->offset;
+
+	return(comp_on ? mlx_comp_to(&s->comp, to, ta) : to);
+}
+
+/* write the records of the ring for a capture, close it at the end of
+ * the post-trigger time */
+static void acq_drain(struct sensor *s)
+{
+	mlx_sample	rec[64];
+	double		ta;
+	int			k, n;
+
+	while ((n = mlx_ring_get(ring, &s->cap_cur, rec, 64)) > 0)
+	{
+		for (k = 0; k < n; k++)
+		{
+			if (rec[k].addr != s->snap.addr || rec[k].unit_id != s->snap.unit_id ||
+				rec[k].time_ns > s->cap_end) continue;
+
+			fprintf(s->cap, "%.4f,%d,0x%04x,0x%04x", ((int64_t) (rec[k].time_ns - s->cap_cross)) / 1e9,
+				rec[k].status, rec[k].raw_ta, rec[k].raw_to);
+
+			if (rec[k].status == MLX_OK)
+			{
+				ta = mlx_raw_to_celsius(rec[k].raw_ta);
+				fprintf(s->cap, ",%.2f,%.2f\n", ta, acq_to(s, rec[k].raw_to, ta));
+			}
+			else
+				fprintf(s->cap, ",,\n");
+		}
+	}
+
+	if (now_ns() < s->cap_end) return;
+
+	if (s->cap_cur.lost)
+	{
+		fprintf(s->cap, "# %llu records lost : the history ring (-R) is too small\n", (unsigned long long) s->cap_cur.lost);
+		printf("mlxd: %llu records of the capture lost, increase -R\n", (unsigned long long) s->cap_cur.lost);
+	}
+
+	fclose(s->cap);
+	s->cap = NULL;
+}
+
+/* start a capture of the readings around an alarm of sensor s */
+static void acq_capture(struct sensor *s, const mlx_alarm_rule *r, const mlx_alarm_ev *ev, double ms)
+{
+	char		path[PATH_MAX], stamp[32];
+	uint64_t	pre = (uint64_t) cap_pre * 1000000000;
+	time_t		t = mlx_clock_time();
+
+	// still capturing : the post-trigger time starts again
+	if (s->cap)
+	{
+		s->cap_end = ev->cross_ns + (uint64_t) cap_post * 1000000000;
+		return;
+	}
+
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&t));
+	snprintf(path, sizeof(path), "%s/mlx-%08x-%02x-%s.csv", cap_dir, s->snap.unit_id, s->snap.addr, stamp);
+
+	if ((s->cap = fopen(path, "w")) == NULL)
+	{
+		perror(path);
+		return;
+	}
+
+	fprintf(s->cap, "# unit %08x at 0x%02x : %s raised (%.2f), %.2fms after the crossing\n"
+		"# from %ds before to %ds after the crossing\n"
+		"time_s,status,raw_ta,raw_to,ta,to\n",
+		s->snap.unit_id, s->snap.addr, r->name, ev->value, ms, cap_pre, cap_post);
+
+	s->cap_cross = ev->cross_ns;
+	s->cap_end = ev->cross_ns + (uint64_t) cap_post * 1000000000;
+	mlx_ring_cursor_time(ring, &s->cap_cur, ev->cross_ns > pre ? ev->cross_ns - pre : 0);
+
+	printf("mlxd: capture in %s\n", path);
+
+	// the pre-trigger readings now, before they are overwritten
+	acq_drain(s);
+}
+
+/* an alarm of sensor i is raised or cleared */
+static void acq_alarm(int i, const mlx_alarm_ev *ev)
+{
+	const mlx_alarm_rule *r = mlx_alarm_get(alarms, ev->rule);
+	struct sensor *s = &sensors[i];
+	uint64_t end;
+	double	ms;
+
+	if (! ev->raised)
+	{
+		printf("mlxd: unit %08x at 0x%x : %s cleared (%.2f)\n", s->snap.unit_id, s->snap.addr, r->name, ev->value);
+		return;
+	}
+
+	// reaction time : from the crossing of the level to here
+	ms = (now_ns() - ev->cross_ns) / 1e6;
+	mlx_stats_add(reaction, ms);
+	alarms_raised++;
+
+	printf("mlxd: unit %08x at 0x%x : %s raised (%.2f), %.2fms after the crossing\n",
+		s->snap.unit_id, s->snap.addr, r->name, ev->value, ms);
+
+	// sample faster for the post-trigger time
+	end = ev->cross_ns + (uint64_t) cap_post * 1000000000;
+	if (end > fast_until) fast_until = end;
+
+	if (cap_dir) acq_capture(s, r, ev, ms);
+
+	fflush(stdout);
+}
+
+/* publish the state of a sensor that is no longer present */
+static void acq_gone(int i)
+{
+	// the statistics start again when it is back
+	if (sensors[i].st_ta)
+	{
+		mlx_stats_reset(sensors[i].st_ta);
+		mlx_stats_reset(sensors[i].st_to);
+		memset(&sensors[i].snap.ta_stat, 0, sizeof(mlx_summary));
+		memset(&sensors[i].snap.to_stat, 0, sizeof(mlx_summary));
+	}
+
+	// a crossing can not be taken over the time it was away
+	if (alarms) mlx_alarm_reset(alarms, i);
+
+	sensors[i].snap.status = MLX_ERR_NACK;
+	sensors[i].snap.time_ns = now_ns();
+	mlx_shm_publish(shm, i, &sensors[i].snap);
+}
+
+/* event of the presence monitor */
+static void acq_watch_event(const mlx_watch_ev *ev, void *user)
+{
+	struct sensor *s;
+	int i;
+
+	(void) user;
+
+	for (i = 0; i < num_sensors; i++)
+		if (sensors[i].watched && sensors[i].snap.unit_id == ev->unit_id) break;
+
+	// a sensor without unit ID at start-up : the monitor has identified it
+	if (i == num_sensors && ev->type == MLX_WATCH_ADDED)
+	{
+		for (i = 0; i < num_sensors; i++)
+			if (! sensors[i].watched && sensors[i].snap.addr == ev->addr) break;
+
+		if (i < num_sensors)
+		{
+			mlx_close(sensors[i].dev);
+			sensors[i].dev = ev->dev;
+			sensors[i].watched = 1;
+			sensors[i].snap.unit_id = ev->unit_id;
+		}
+	}
+
+	s = &sensors[i];
+
+	if (ev->type == MLX_WATCH_REMOVED)
+	{
+		printf("mlxd: unit %08x removed from 0x%x\n", ev->unit_id, ev->old_addr);
+
+		if (i == num_sensors) return;
+
+		s->present = 0;
+		acq_gone(i);
+	}
+	else
+	{
+		if (ev->type == MLX_WATCH_MOVED)
+			printf("mlxd: unit %08x moved from 0x%x to 0x%x\n", ev->unit_id, ev->old_addr, ev->addr);
+		else
+			printf("mlxd: unit %08x added on 0x%x\n", ev->unit_id, ev->addr);
+
+		// a new sensor takes the next slot
+		if (i == num_sensors)
+		{
+			if (num_sensors == MLX_SHM_MAX)
+			{
+				printf("mlxd: only %d sensors are sampled\n", MLX_SHM_MAX);
+				return;
+			}
+
+			memset(s, 0, sizeof(struct sensor));
+			s->dev = ev->dev;
+			s->watched = 1;
+			s->snap.unit_id = ev->unit_id;
+			s->gain = 1;
+			acq_comp(s);
+			acq_stats(s);
+
+			mlx_shm_set_count(shm, ++num_sensors);
+		}
+
+		s->present = 1;
+		s->snap.addr = ev->addr;
+		acq_register(s);
+	}
+
+	fflush(stdout);
+}
+
+/* find the sensors and create the shared memory
+ * return 0 = OK, -1 = error */
+static int acq_init(mlx_bus *bus, int mode)
+{
+	uint8_t	found[MLX_SHM_MAX];
+	mlx_fleet *fleet = NULL;
+	int		i, num;
+
+	if (num_rules > 0)
+	{
+		if ((alarms = mlx_alarm_new(MLX_SHM_MAX)) == NULL || (reaction = mlx_stats_new(ALARM_WINDOW)) == NULL)
+		{
+			fprintf(stderr, "mlxd: no memory for the alarms\n");
+			return(-1);
+		}
+
+		for (i = 0; i < num_rules; i++) mlx_alarm_add(alarms, &rules[i]);
+
+		if (fast_period <= 0) fast_period = period / 10;
+		if (fast_period < 1) fast_period = 1;
+		if (fast_period > period) fast_period = period;
+	}
+
+	if (cap_dir && (ring_size <= 0 || ! alarms))
+	{
+		fprintf(stderr, "mlxd: a capture (-C) needs alarms (-A) and the history ring (-R)\n");
+		return(-1);
+	}
+
+	if ((num = mlx_bus_scan(bus, found, MLX_SHM_MAX, 0)) > MLX_SHM_MAX)
+	{
+		printf("mlxd: %d sensors found, only %d are sampled\n", num, MLX_SHM_MAX);
+		num = MLX_SHM_MAX;
+	}
+
+	if ((shm = mlx_shm_create(shm_name, mode)) == NULL)
+	{
+		perror("mlxd: shared memory");
+		return(-1);
+	}
+
+	if (fleet_file && (fleet = mlx_fleet_open(fleet_file, MLX_FLEET_CREATE)) == NULL)
+	{
+		perror("mlxd: fleet registry");
+		return(-1);
+	}
+
+	if (watch_us > 0 && (watch = mlx_watch_new(bus, acq_watch_event, NULL)) == NULL)
+	{
+		fprintf(stderr, "mlxd: can not create the presence monitor\n");
+		return(-1);
+	}
+
+	for (i = 0; i < num; i++)
+	{
+		if ((sensors[i].dev = mlx_open(bus, found[i], 0)) == NULL) break;
+
+		memset(&sensors[i].snap, 0, sizeof(mlx_snapshot));
+		sensors[i].snap.addr = found[i];
+		sensors[i].present = 1;
+		sensors[i].watched = 0;
+		acq_comp(&sensors[i]);
+
+		if (acq_stats(&sensors[i]) < 0) return(-1);
+
+		if (fleet) acq_identify(fleet, &sensors[i]);
+		else
+		{
+			mlx_unit_id(sensors[i].dev, &sensors[i].snap.unit_id);
+			sensors[i].gain = 1;
+			sensors[i].offset = 0;
+		}
+
+		// the monitor takes over the handle (not without a unit ID)
+		if (watch && mlx_watch_attach(watch, sensors[i].dev, sensors[i].snap.unit_id) == MLX_OK)
+			sensors[i].watched = 1;
+	}
+
+	num_sensors = i;
+
+	if (fleet)
+	{
+		printf("mlxd: %d units in fleet registry %s\n", mlx_fleet_count(fleet), fleet_file);
+		mlx_fleet_close(fleet);
+	}
+	mlx_shm_set_count(shm, num_sensors);
+
+	if (ring_size > 0 && (ring = mlx_ring_create(ring_name, ring_size, mode)) == NULL)
+	{
+		perror("mlxd: history ring");
+		return(-1);
+	}
+
+	// the pre-trigger readings have to be in the ring
+	if (cap_dir && (long) num_sensors * cap_pre * 1000 / period > mlx_ring_size(ring))
+		printf("mlxd: the history ring is too small for %ds before an alarm\n", cap_pre);
+
+	printf("mlxd: sampling %d sensors every %dms in %s\n", num_sensors, period, shm_name);
+
+	if (alarms) printf("mlxd: %d alarm rules, sampling every %dms for %ds after an alarm\n", num_rules, fast_period, cap_post);
+
+	return(0);
+}
+
+/* return the sample period now (ms) : faster after an alarm */
+static int acq_period()
+{
+	return(fast_until > now_ns() ? fast_period : period);
+}
+
+/* read and publish all sensors */
+static void acq_sample()
+{
+	mlx_snapshot *snap;
+	mlx_sample	sample;
+	mlx_alarm_ev ev[MLX_ALARM_MAX];
+	int	i, k, n, ms = acq_period(), every;
+
+	// the same readings in the statistics when sampling faster
+	if ((every = STAT_MS / ms) < 1) every = 1;
+
+	for (i = 0; i < num_sensors; i++)
+	{
+		if (! sensors[i].present) continue;
+
+		snap = &sensors[i].snap;
+
+		if ((snap->status = mlx_read_ram(sensors[i].dev, MLX_RAM_TA, &snap->raw_ta)) == MLX_OK)
+			snap->status = mlx_read_ram(sensors[i].dev, MLX_RAM_TO, &snap->raw_to);
+
+		if (snap->status == MLX_OK)
+		{
+			snap->ta = mlx_raw_to_celsius(snap->raw_ta);
+			snap->to = acq_to(&sensors[i], snap->raw_to, snap->ta);
+
+			if (sensors[i].st_ta && snap->count % (period / ms) == 0)
+			{
+				mlx_stats_add(sensors[i].st_ta, snap->ta);
+				mlx_stats_add(sensors[i].st_to, snap->to);
+			}
+		}
+		else if (DEBUG)
+			printf("DEBUG: sensor 0x%x : %s\n", snap->addr, mlx_strerror(snap->status));
+
+		snap->time_ns = now_ns();
+		snap->count++;
+		mlxd_stat.transfers += 2;
+
+		// the quantiles take a sort : not on every sample
+		if (sensors[i].st_ta && snap->count % every == 0)
+		{
+			mlx_stats_get(sensors[i].st_ta, &snap->ta_stat);
+			mlx_stats_get(sensors[i].st_to, &snap->to_stat);
+		}
+
+		mlx_shm_publish(shm, i, snap);
+
+		if (ring)
+		{
+			memset(&sample, 0, sizeof(sample));
+			sample.time_ns = snap->time_ns;
+			sample.unit_id = snap->unit_id;
+			sample.status = snap->status;
+			sample.raw_ta = snap->raw_ta;
+			sample.raw_to = snap->raw_to;
+			sample.addr = snap->addr;
+
+			mlx_ring_put(ring, &sample);
+		}
+
+		if (alarms && snap->status == MLX_OK)
+		{
+			n = mlx_alarm_update(alarms, i, snap->time_ns, snap->ta, snap->to, ev, MLX_ALARM_MAX);
+
+			for (k = 0; k < n; k++) acq_alarm(i, &ev[k]);
+		}
+	}
+
+	for (i = 0; i < num_sensors; i++)
+		if (sensors[i].cap) acq_drain(&sensors[i]);
+
+	if (watch) mlx_watch_tick(watch, (uint64_t) watch_us * 1000);
+}
+
+/* stop acquisition */
+static void acq_close()
+{
+	int i;
+
+	for (i = 0; i < num_sensors; i++)
+	{
+		if (! sensors[i].watched) mlx_close(sensors[i].dev);
+
+		mlx_stats_free(sensors[i].st_ta);
+		mlx_stats_free(sensors[i].st_to);
+
+		// a capture ends with the readings so far
+		if (sensors[i].cap)
+		{
+			sensors[i].cap_end = now_ns();
+			acq_drain(&sensors[i]);
+		}
+	}
+
+	mlx_alarm_free(alarms);
+	mlx_stats_free(reaction);
+
+	mlx_watch_free(watch);
+
+	mlx_shm_close(shm);
+	mlx_shm_unlink(shm_name);
+
+	if (ring)
+	{
+		mlx_ring_close(ring);
+		mlx_ring_unlink(ring_name);
+	}
+}
+
+/* remove client i */
+static void drop_client(int i)
+{
+	if (clients[i].fd == hold_fd) hold_fd = -1;
+
+	close(clients[i].fd);
+
+	clients[i] = clients[--num_clients];
+
+	if (DEBUG) printf("DEBUG: client left, %d connected\n", num_clients);
+}
+
+/* create the listen socket
+ * return socket or -1 on error */
+static int open_socket(char *path, int mode)
+{
+	struct sockaddr_un sa;
+	int	fd;
+
+	if (strlen(path) >= sizeof(sa.sun_path))
+	{
+		fprintf(stderr, "socket path too long\n");
+		return(-1);
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, path);
+
+	// remove a left-over of a previous run
+	unlink(path);
+
+	if ((fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) < 0 ||
+		bind(fd, (struct sockaddr *) &sa, sizeof(sa)) < 0 ||
+		chmod(path, mode) < 0 ||
+		listen(fd, MAX_CLIENTS) < 0)
+	{
+		perror("mlxd: socket");
+		if (fd >= 0) close(fd);
+		return(-1);
+	}
+
+	return(fd);
+}
+
+static void usage(char *name)
+{
+	printf("%s [-s path] [-m mode] [-p ms] [-S name] [-R records] [-u file] [-w us] [-K spec] [-W sec] [-A rule] [-F ms] [-C dir[:pre[:post]]] [-t] [-T file] [-H]\n\n"
+		"-s,	Unix socket to use (default %s)\n"
+		"-m,	access mode of the socket in octal (default 660)\n"
+		"-p,	sample all sensors every ms and publish in shared memory\n"
+		"-S,	name of the shared memory (default %s)\n"
+		"-R,	keep the history of the readings in a shared memory ring (with -p)\n"
+		"-u,	fleet registry of the sensors (with -p, e.g. %s)\n"
+		"-w,	watch for sensors added / removed, us of bus time per sample (with -p)\n"
+		"-K,	compensate To : emissivity[:reflected[:transmissivity[:window]]] (with -p)\n"
+		"	reflected / window temperature in celsius or ta (default)\n"
+		"-W,	statistics of To and Ta over the last sec seconds (with -p, see mlx_stat)\n"
+		"-A,	alarm rule (with -p, repeat for more) : [to|ta]<op>level[:hysteresis]\n"
+		"	op > above, < below, + rises or - falls faster than level C/s\n"
+		"	e.g. to>40:2 is raised above 40 and cleared below 38\n"
+		"-F,	sample period after an alarm (default ms of -p / 10)\n"
+		"-C,	save the readings from pre seconds before to post seconds after\n"
+		"	an alarm in dir (default %d:%d, with -R). Post is also the time of -F\n"
+		"-t,	enable debug tracking\n"
+		"-T,	record the bus transactions in this file (see mlx_trace2json)\n"
+		"-H,	display this help text\n\n"
+		"SIGUSR1 displays the statistics\n", name, MLXD_SOCKET, MLX_SHM_NAME, MLX_FLEET_FILE, ALARM_PRE, ALARM_POST);
+}
+
+int main(int argc, char *argv[])
+{
+	struct pollfd	pfd[MAX_CLIENTS + 1];
+	char	*path = MLXD_SOCKET, *trace_file = NULL, *p;
+	int		mode = 0660, lfd, fd, c, i, n, wait;
+	uint64_t next = 0, now;
+	mlx_bus	*bus;
+
+	while ((c = getopt(argc, argv, "s:m:p:S:R:u:w:K:W:A:F:C:tT:H")) != -1)
+	{
+		switch(c)
+		{
+			case 's':	// socket path
+				path = optarg;
+				break;
+
+			case 'm':	// socket mode
+				mode = strtol(optarg, NULL, 8);
+				break;
+
+			case 'p':	// sample period
+				period = (int) strtol(optarg, NULL, 10);
+				break;
+
+			case 'S':	// shared memory name
+				shm_name = optarg;
+				break;
+
+			case 'R':	// history ring size
+				ring_size = (int) strtol(optarg, NULL, 10);
+				break;
+
+			case 'u':	// fleet registry
+				fleet_file = optarg;
+				break;
+
+			case 'w':	// presence monitor
+				watch_us = strtol(optarg, NULL, 10);
+				break;
+
+			case 'K':	// compensation of To
+				mlx_comp_init(&comp);
+
+				if (mlx_comp_parse(&comp, optarg) != MLX_OK)
+				{
+					fprintf(stderr, "Invalid compensation %s\n", optarg);
+					exit(-1);
+				}
+
+				comp_on = 1;
+				break;
+
+			case 'W':	// window of the statistics
+				stat_sec = (int) strtol(optarg, NULL, 10);
+				break;
+
+			case 'A':	// alarm rule
+				if (num_rules == MLX_ALARM_MAX || mlx_alarm_parse(&rules[num_rules], optarg) != MLX_OK)
+				{
+					fprintf(stderr, "Invalid alarm rule %s\n", optarg);
+					exit(-1);
+				}
+
+				num_rules++;
+				break;
+
+			case 'F':	// sample period after an alarm
+				fast_period = (int) strtol(optarg, NULL, 10);
+				break;
+
+			case 'C':	// capture around an alarm
+				cap_dir = strtok(optarg, ":");
+				if ((p = strtok(NULL, ":")) != NULL) cap_pre = (int) strtol(p, NULL, 10);
+				if ((p = strtok(NULL, ":")) != NULL) cap_post = (int) strtol(p, NULL, 10);
+				break;
+
+			case 't':	// debug tracking
+				DEBUG = 1;
+				break;
+
+			case 'T':	// transaction trace
+				trace_file = optarg;
+				break;
+
+			case 'H':
+				usage(argv[0]);
+				exit(0);
+
+			default:
+				usage(argv[0]);
+				exit(-1);
+		}
+	}
+
+	if (geteuid() != 0)
+	{
+		fprintf(stderr, "Must be run as root.\n");
+		exit(-1);
+	}
+
+	if (trace_file && mlx_trace_start(trace_file) != MLX_OK)
+	{
+		fprintf(stderr, "Can't create trace file %s\n", trace_file);
+		exit(-1);
+	}
+
+	if ((bus = mlx_bus_open_bcm2835()) == NULL)
+	{
+		fprintf(stderr, "Can't init bcm2835!\n");
+		exit(1);
+	}
+
+	// turn the power to MLX on.
+	mlx_bus_power(bus, 1);
+
+	if ((lfd = open_socket(path, mode)) < 0)
+	{
+		mlx_bus_close(bus);
+		exit(1);
+	}
+
+	// readers of the shared memory do not need write access
+	if (period > 0 && acq_init(bus, mode | 0444) < 0)
+	{
+		acq_close();
+		close(lfd);
+		unlink(path);
+		mlx_bus_close(bus);
+		exit(1);
+	}
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+	signal(SIGUSR1, signal_handler);
+
+	printf("mlxd: serving on %s\n", path);
+	fflush(stdout);
+
+	while (! stop_req)
+	{
+		if (report_req)
+		{
+			report();
+			report_req = 0;
+		}
+
+		hold_check(bus);
+
+		pfd[0].fd = lfd;
+		pfd[0].events = POLLIN;
+
+		for (i = 0; i < num_clients; i++)
+		{
+			pfd[i + 1].fd = clients[i].fd;
+			pfd[i + 1].events = clients[i].has_req ? 0 : POLLIN;	// waiting for the bus
+			pfd[i + 1].revents = 0;
+		}
+
+		// wait at most until the next sample
+		wait = -1;
+
+		if (period > 0)
+		{
+			now = now_ns();
+
+			if (next <= now)
+			{
+				// not while a client holds the bus
+				if (hold_fd < 0) acq_sample();
+
+				// do not catch up when late (faster after an alarm)
+				next += (uint64_t) acq_period() * 1000000;
+				if (next <= now) next = now + (uint64_t) acq_period() * 1000000;
+			}
+
+			wait = (int) ((next - now) / 1000000);
+		}
+
+		// and at most until the hold expires
+		if (hold_fd >= 0)
+		{
+			now = now_ns();
+			n = hold_until > now ? (int) ((hold_until - now) / 1000000) + 1 : 0;
+			if (wait < 0 || n < wait) wait = n;
+		}
+
+		if ((n = poll(pfd, num_clients + 1, wait)) <= 0) continue;		// signal / time-out
+
+		// take one request of each client (a client waits for the response)
+		for (i = num_clients - 1; i >= 0; i--)
+		{
+			if (! pfd[i + 1].revents) continue;
+
+			// waiting for the bus : only a client that went away
+			if (clients[i].has_req)
+			{
+				if (pfd[i + 1].revents & (POLLHUP | POLLERR)) drop_client(i);
+				continue;
+			}
+
+			n = recv(clients[i].fd, &clients[i].req, sizeof(mlxd_req), MSG_DONTWAIT);
+
+			if (n == sizeof(mlxd_req))
+			{
+				clients[i].has_req = 1;
+				mlxd_stat.requests++;
+			}
+			else if (n > 0)
+			{
+				// wrong message : answer with an error
+				memset(&clients[i].req, 0, sizeof(mlxd_req));
+				clients[i].has_req = 1;
+			}
+			else if (n < 0 && errno == EAGAIN)
+				continue;
+			else
+				drop_client(i);
+		}
+
+		serve_batch(bus);
+
+		// new client
+		if (pfd[0].revents & POLLIN)
+		{
+			if ((fd = accept(lfd, NULL, NULL)) < 0) continue;
+
+			if (num_clients == MAX_CLIENTS)
+			{
+				close(fd);
+				continue;
+			}
+
+			clients[num_clients].fd = fd;
+			clients[num_clients].has_req = 0;
+			clients[num_clients].done = 0;
+			num_clients++;
+
+			if (DEBUG) printf("DEBUG: new client, %d connected\n", num_clients);
+		}
+	}
+
+	report();
+
+	for (i = 0; i < num_clients; i++) close(clients[i].fd);
+
+	close(lfd);
+	unlink(path);
+
+	if (period > 0) acq_close();
+
+	mlx_bus_close(bus);
+
+	mlx_trace_stop();
+
+	exit(0);
+}
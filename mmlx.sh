@@ -2,4 +2,38 @@
 # make mlx90615 executable
 # version 1.0 / paulvha / April 2017
 
-cc -Wall -o mlx mlx.c mlx_lib.c mlx_emiss.c mlx_pwm.c -lbcm2835 -lm
+# libmlx90615
+cc -Wall -O2 -c libmlx90615.c mlx_bus_bcm2835.c mlx_bus_broker.c mlx_shm.c mlx_ring.c mlx_bus_sim.c mlx_clock.c mlx_trace.c mlx_pwm_gen.c mlx_pwm_cap.c mlx_pwm_bits.c mlx_fleet.c mlx_watch.c mlx_comp.c mlx_stats.c mlx_alarm.c
+ar rcs libmlx90615.a libmlx90615.o mlx_bus_bcm2835.o mlx_bus_broker.o mlx_shm.o mlx_ring.o mlx_bus_sim.o mlx_clock.o mlx_trace.o mlx_pwm_gen.o mlx_pwm_cap.o mlx_pwm_bits.o mlx_fleet.o mlx_watch.o mlx_comp.o mlx_stats.o mlx_alarm.o
+
+cc -Wall -o mlx mlx.c mlx_lib.c mlx_emiss.c mlx_emiss_tab.c mlx_emiss_db.c mlx_pwm.c mlx_wear.c mlx_duty.c mlx_ready.c mlx_mode.c mlx_rt.c libmlx90615.a -lbcm2835 -lm -lpthread -lrt
+
+# bus broker
+cc -Wall -o mlxd mlxd.c libmlx90615.a -lbcm2835 -lm -lpthread -lrt
+
+# benchmark of the shared memory history ring (no bus needed)
+cc -Wall -O2 -o bench_ring bench_ring.c libmlx90615.a -lpthread -lrt
+
+# benchmark of the code paths on a simulated bus (no bus needed)
+cc -Wall -O2 -o mlx_bench mlx_bench.c mlx_emiss_tab.c mlx_emiss_db.c libmlx90615.a -lm -lpthread
+
+# long-horizon run on a simulated bus with a virtual clock (no bus needed)
+cc -Wall -O2 -o mlx_soak mlx_soak.c libmlx90615.a -lm -lpthread
+
+# collectors as C++20 coroutines (libmlx90615.hpp) on a simulated bus (no bus needed)
+c++ -Wall -O2 -std=c++20 -o mlx_coro mlx_coro.cpp libmlx90615.a -lm -lpthread
+
+# convert a transaction trace (-T) to Chrome / Perfetto JSON
+cc -Wall -o mlx_trace2json mlx_trace2json.c libmlx90615.a -lpthread
+
+# PWM capture of many sensors on GPIO lines (GPIO character device)
+cc -Wall -o mlx_pwmcap mlx_pwmcap.c libmlx90615.a -lpthread
+
+# display / change the fleet registry (mlxd -u)
+cc -Wall -o mlx_units mlx_units.c libmlx90615.a -lpthread
+
+# statistics of the sensors that mlxd -W keeps (no bus needed)
+cc -Wall -o mlx_stat mlx_stat.c libmlx90615.a -lm -lpthread -lrt
+
+# compile an emissivity table (CSV) to a database (mlx -E)
+cc -Wall -O2 -o mlx_emissc mlx_emissc.c mlx_emiss_db.c mlx_emiss_tab.c